@@ -0,0 +1,147 @@
+#pragma once
+
+#include <queue>
+#include <mutex>
+#include <string>
+#include <condition_variable>
+
+#include <DecentApi/Common/RuntimeException.h>
+
+namespace Decent
+{
+	namespace Dht
+	{
+		/**
+		 * \brief	A blocking FIFO queue with limited capacity, used to connect two stages of a pipeline
+		 * 			running on different threads.
+		 *
+		 * \tparam	T	Type of the item.
+		 */
+		template<typename T>
+		class BoundedQueue
+		{
+		public:
+			BoundedQueue() = delete;
+
+			/**
+			 * \brief	Constructor
+			 *
+			 * \param	capacity	The maximum number of items the queue can hold.
+			 */
+			BoundedQueue(size_t capacity) :
+				m_capacity(capacity > 0 ? capacity : 1),
+				m_mutex(),
+				m_notFull(),
+				m_notEmpty(),
+				m_queue(),
+				m_isClosed(false),
+				m_isAborted(false),
+				m_errMsg()
+			{}
+
+			/** \brief	Destructor */
+			virtual ~BoundedQueue()
+			{}
+
+			/**
+			 * \brief	Pushes an item into the queue. Blocks while the queue is full.
+			 *
+			 * \param [in]	item	The item, whose ownership will be moved in.
+			 *
+			 * \return	False if the queue has been closed, thus, the item is not pushed; otherwise, true.
+			 */
+			bool Push(T&& item)
+			{
+				std::unique_lock<std::mutex> queueLock(m_mutex);
+				m_notFull.wait(queueLock, [this]() {
+					return m_isClosed || m_queue.size() < m_capacity;
+				});
+
+				if (m_isClosed)
+				{
+					return false;
+				}
+
+				m_queue.push(std::forward<T>(item));
+				queueLock.unlock();
+				m_notEmpty.notify_one();
+
+				return true;
+			}
+
+			/**
+			 * \brief	Pops an item from the queue. Blocks while the queue is empty and is not closed.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the queue has been aborted by the producer
+			 * 												(see Abort()), and all items have been popped.
+			 *
+			 * \param [out]	item	The item popped.
+			 *
+			 * \return	False if the queue has been closed and all items have been popped; otherwise, true.
+			 */
+			bool Pop(T& item)
+			{
+				std::unique_lock<std::mutex> queueLock(m_mutex);
+				m_notEmpty.wait(queueLock, [this]() {
+					return m_isClosed || m_queue.size() > 0;
+				});
+
+				if (m_queue.size() == 0)
+				{
+					if (m_isAborted)
+					{
+						throw Decent::RuntimeException(m_errMsg);
+					}
+					return false;
+				}
+
+				item = std::move(m_queue.front());
+				m_queue.pop();
+				queueLock.unlock();
+				m_notFull.notify_one();
+
+				return true;
+			}
+
+			/** \brief	Closes the queue. No more item can be pushed, but items left can still be popped. */
+			void Close()
+			{
+				{
+					std::unique_lock<std::mutex> queueLock(m_mutex);
+					m_isClosed = true;
+				}
+				m_notFull.notify_all();
+				m_notEmpty.notify_all();
+			}
+
+			/**
+			 * \brief	Closes the queue because the producer has failed. Items left can still be popped,
+			 * 			but Pop() throws the error afterwards, rather than returning false as if all items
+			 * 			were produced.
+			 *
+			 * \param	errMsg	Message describing the error.
+			 */
+			void Abort(const std::string& errMsg)
+			{
+				{
+					std::unique_lock<std::mutex> queueLock(m_mutex);
+					m_isClosed = true;
+					m_isAborted = true;
+					m_errMsg = errMsg;
+				}
+				m_notFull.notify_all();
+				m_notEmpty.notify_all();
+			}
+
+		private:
+			const size_t m_capacity;
+			std::mutex m_mutex;
+			std::condition_variable m_notFull;
+			std::condition_variable m_notEmpty;
+			std::queue<T> m_queue;
+			bool m_isClosed;
+			bool m_isAborted;
+			std::string m_errMsg;
+		};
+	}
+}
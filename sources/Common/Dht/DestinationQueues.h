@@ -0,0 +1,336 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <condition_variable>
+
+#include "MpmcRing.h"
+
+namespace Decent
+{
+	namespace Dht
+	{
+		/**
+		 * \brief	A set of FIFO sub-queues, one per destination, served by a pool of worker threads.
+		 * 			Sub-queues are partitioned into shards by destination; each worker prefers its own
+		 * 			shard, and steals from other shards once its own shard has nothing ready.
+		 *
+		 * 			A destination is served by at most one worker at a time. Thus, a worker blocked by a
+		 * 			slow destination only holds up items to that destination, while the rest of the
+		 * 			workers keep serving other destinations. Items pushed to a destination while it's
+		 * 			being served are taken by the next worker, once the current one is done.
+		 *
+		 * 			Producers don't take any lock in the common case: items are pushed into a lock-free
+		 * 			ingress ring, and workers move them into the sub-queues in bulk. A worker is only
+		 * 			signaled when the ring turns non-empty, and the draining worker wakes as many other
+		 * 			workers as the destinations it made ready. If the ring is full, the producer falls
+		 * 			back to the locked sub-queues, so items to the same destination may be reordered in
+		 * 			that case.
+		 *
+		 * \tparam	DestType	Type of the destination; must be ordered and hashable.
+		 * \tparam	T			Type of the item; must be default constructible.
+		 */
+		template<typename DestType, typename T>
+		class DestinationQueues
+		{
+		public:
+			DestinationQueues() = delete;
+
+			/**
+			 * \brief	Constructor
+			 *
+			 * \param	shardNum	   	Number of shards; usually no less than the number of workers.
+			 * \param	ingressCapacity	Capacity of the ingress ring.
+			 */
+			DestinationQueues(size_t shardNum, size_t ingressCapacity) :
+				m_shards(),
+				m_ingress(ingressCapacity),
+				m_ingressCount(0),
+				m_signalMutex(),
+				m_signal(),
+				m_readyCount(0),
+				m_isClosed(false)
+			{
+				for (size_t i = 0; i < (shardNum > 0 ? shardNum : 1); ++i)
+				{
+					m_shards.push_back(std::unique_ptr<Shard>(new Shard()));
+				}
+			}
+
+			/** \brief	Destructor */
+			virtual ~DestinationQueues()
+			{}
+
+			/**
+			 * \brief	Pushes an item into the sub-queue of the destination.
+			 *
+			 * \param 	  	dest	The destination.
+			 * \param [in]	item	The item, whose ownership will be moved in.
+			 */
+			void Push(const DestType& dest, T&& item)
+			{
+				//The count is raised before the push, so it's never lower than the number of items in
+				//the ring.
+				const size_t prevCount = m_ingressCount.fetch_add(1);
+
+				IngressItem ingressItem(dest, std::forward<T>(item));
+				if (!m_ingress.TryPush(std::move(ingressItem)))
+				{
+					m_ingressCount.fetch_sub(1);
+
+					if (PushToShard(ingressItem.first, std::move(ingressItem.second)))
+					{
+						SignalReady(1);
+					}
+					return;
+				}
+
+				if (prevCount == 0)
+				{
+					//The ring was empty; workers may be sleeping. Lock the mutex, so that the signal
+					//can't be missed by a worker that is about to wait.
+					{
+						std::unique_lock<std::mutex> signalLock(m_signalMutex);
+					}
+					m_signal.notify_one();
+				}
+			}
+
+			/**
+			 * \brief	Takes items of one ready destination, and marks the destination as busy. Blocks
+			 * 			while there is no ready destination and the queues are not closed. Done() must be
+			 * 			called with the destination once the worker finishes serving it.
+			 *
+			 * \param 	   	workerIdx	Index of the worker, which decides its own shard.
+			 * \param 	   	maxItems 	The maximum number of items to take.
+			 * \param [out]	dest	 	The destination.
+			 * \param [out]	items	 	The items taken; appended at the end.
+			 *
+			 * \return	False if the queues have been closed; otherwise, true.
+			 */
+			bool Pop(size_t workerIdx, size_t maxItems, DestType& dest, std::vector<T>& items)
+			{
+				while (true)
+				{
+					DrainIngress();
+
+					std::unique_lock<std::mutex> signalLock(m_signalMutex);
+					m_signal.wait(signalLock, [this]() {
+						return m_isClosed || m_readyCount > 0 || m_ingressCount > 0;
+					});
+
+					if (m_isClosed)
+					{
+						return false;
+					}
+
+					if (m_readyCount > 0)
+					{
+						//Claim one ready destination; it's guaranteed to be found in one of the shards.
+						--m_readyCount;
+						break;
+					}
+				}
+
+				const size_t homeIdx = workerIdx % m_shards.size();
+				while (true)
+				{
+					for (size_t i = 0; i < m_shards.size(); ++i)
+					{
+						if (TryTake(*m_shards[(homeIdx + i) % m_shards.size()], maxItems, dest, items))
+						{
+							return true;
+						}
+					}
+				}
+			}
+
+			/**
+			 * \brief	Takes more items of a destination that is currently served by the caller.
+			 *
+			 * \param 	   	dest	 	The destination.
+			 * \param 	   	maxItems 	The maximum number of items to take.
+			 * \param [out]	items	 	The items taken; appended at the end.
+			 */
+			void PopMore(const DestType& dest, size_t maxItems, std::vector<T>& items)
+			{
+				Shard& shard = GetShard(dest);
+				std::unique_lock<std::mutex> shardLock(shard.m_mutex);
+
+				auto it = shard.m_queues.find(dest);
+				if (it != shard.m_queues.end())
+				{
+					MoveItems(shard, it, maxItems, items);
+				}
+			}
+
+			/**
+			 * \brief	Marks the destination as no longer served. If more items have been pushed to it in
+			 * 			the meantime, it becomes ready again.
+			 *
+			 * \param	dest	The destination.
+			 */
+			void Done(const DestType& dest)
+			{
+				Shard& shard = GetShard(dest);
+				{
+					std::unique_lock<std::mutex> shardLock(shard.m_mutex);
+
+					shard.m_busy.erase(dest);
+					if (shard.m_queues.find(dest) == shard.m_queues.end())
+					{
+						return;
+					}
+
+					shard.m_ready.push_back(dest);
+				}
+
+				SignalReady(1);
+			}
+
+			/** \brief	Closes the queues, and wakes up all workers. Items left are discarded. */
+			void Close()
+			{
+				{
+					std::unique_lock<std::mutex> signalLock(m_signalMutex);
+					m_isClosed = true;
+				}
+				m_signal.notify_all();
+			}
+
+		private:
+			struct Shard
+			{
+				std::mutex m_mutex;
+				std::map<DestType, std::deque<T> > m_queues;
+				std::deque<DestType> m_ready;
+				std::set<DestType> m_busy;
+			};
+
+			Shard& GetShard(const DestType& dest)
+			{
+				return *m_shards[std::hash<DestType>()(dest) % m_shards.size()];
+			}
+
+			typedef std::pair<DestType, T> IngressItem;
+
+			/**
+			 * \brief	Pushes an item into the sub-queue of the destination.
+			 *
+			 * \return	True if the destination becomes ready, thus, SignalReady() should be called.
+			 */
+			bool PushToShard(const DestType& dest, T&& item)
+			{
+				Shard& shard = GetShard(dest);
+				std::unique_lock<std::mutex> shardLock(shard.m_mutex);
+
+				std::deque<T>& queue = shard.m_queues[dest];
+				const bool becomesReady = queue.size() == 0 && shard.m_busy.find(dest) == shard.m_busy.end();
+				queue.push_back(std::forward<T>(item));
+
+				if (!becomesReady)
+				{
+					return false; //Either it's ready already, or it will be re-readied by Done().
+				}
+
+				shard.m_ready.push_back(dest);
+				return true;
+			}
+
+			/** \brief	Moves all items in the ingress ring into the sub-queues. */
+			void DrainIngress()
+			{
+				size_t drained = 0;
+				size_t readied = 0;
+
+				IngressItem ingressItem;
+				while (m_ingress.TryPop(ingressItem))
+				{
+					++drained;
+					if (PushToShard(ingressItem.first, std::move(ingressItem.second)))
+					{
+						++readied;
+					}
+				}
+
+				if (drained == 0)
+				{
+					return;
+				}
+
+				m_ingressCount.fetch_sub(drained);
+				if (readied > 0)
+				{
+					SignalReady(readied);
+				}
+			}
+
+			void SignalReady(size_t readied)
+			{
+				{
+					std::unique_lock<std::mutex> signalLock(m_signalMutex);
+					m_readyCount += readied;
+				}
+
+				if (readied == 1)
+				{
+					m_signal.notify_one();
+				}
+				else
+				{
+					m_signal.notify_all();
+				}
+			}
+
+			bool TryTake(Shard& shard, size_t maxItems, DestType& dest, std::vector<T>& items)
+			{
+				std::unique_lock<std::mutex> shardLock(shard.m_mutex);
+				if (shard.m_ready.size() == 0)
+				{
+					return false;
+				}
+
+				dest = shard.m_ready.front();
+				shard.m_ready.pop_front();
+				shard.m_busy.insert(dest);
+
+				MoveItems(shard, shard.m_queues.find(dest), maxItems, items);
+
+				return true;
+			}
+
+			/** \brief	Moves items out of a sub-queue; assume the shard has been locked. */
+			static void MoveItems(Shard& shard, typename std::map<DestType, std::deque<T> >::iterator it, size_t maxItems, std::vector<T>& items)
+			{
+				std::deque<T>& queue = it->second;
+				for (size_t i = 0; i < maxItems && queue.size() > 0; ++i)
+				{
+					items.push_back(std::move(queue.front()));
+					queue.pop_front();
+				}
+
+				if (queue.size() == 0)
+				{
+					shard.m_queues.erase(it);
+				}
+			}
+
+			std::vector<std::unique_ptr<Shard> > m_shards;
+
+			MpmcRing<IngressItem> m_ingress;
+			std::atomic<size_t> m_ingressCount;
+
+			std::mutex m_signalMutex;
+			std::condition_variable m_signal;
+			size_t m_readyCount;
+			bool m_isClosed;
+		};
+	}
+}
@@ -7,6 +7,7 @@
 #include <DecentApi/Common/Common.h>
 
 #include "NodeBase.h"
+#include "TaskPool.h"
 #include "CircularRange.h"
 
 namespace Decent
@@ -57,6 +58,9 @@ namespace Decent
 			static constexpr size_t sk_keySizeBit = KeySizeByte * BITS_PER_BYTE;
 			typedef std::array<IdType, sk_keySizeBit + 1> Pow2iArrayType;
 
+			/** \brief	Number of finger lookups issued at once while joining. */
+			static constexpr size_t sk_joinLookupWaveSize = 8;
+
 		public:
 
 			/**
@@ -171,6 +175,75 @@ namespace Decent
 				}
 			}
 
+			/**
+			 * \brief	Called when this node is joining the existing network. The finger table will be re-
+			 * 			initialized according to the existing node, with the same result as JoinTo(exNode).
+			 * 			Fingers that can't be told from the previous finger are looked up in waves of
+			 * 			sk_joinLookupWaveSize rows, which are run concurrently on the task pool. A few
+			 * 			lookups in a wave may turn out to be unnecessary, but the number of round trips
+			 * 			made one after another is cut down by the size of the wave.
+			 *
+			 * \param [in,out]	exNode  	Pointer to an existing node.
+			 * \param [in,out]	taskPool	The task pool.
+			 */
+			void JoinTo(NodeBaseType& exNode, TaskPool& taskPool)
+			{
+				m_tableRecords[0].m_node = exNode.FindSuccessor(m_tableRecords[0].m_startId);
+				std::shared_ptr<TaskFuture<NodeBasePtr> > predFuture = RunAsync<NodeBasePtr>(taskPool, [this]()
+				{
+					return m_tableRecords[0].m_node->GetImmediatePredecessor();
+				});
+
+				size_t i = 0;
+				try
+				{
+					while (i < (m_tableRecords.size() - 1))
+					{
+						if (m_cirRange.IsWithinCN(m_tableRecords[i + 1].m_startId, m_nodeId, m_tableRecords[i].m_node->GetNodeId()))
+						{
+							m_tableRecords[i + 1].m_node = m_tableRecords[i].m_node;
+							++i;
+							continue;
+						}
+
+						const size_t waveEnd = (m_tableRecords.size() - (i + 1)) > sk_joinLookupWaveSize ?
+							(i + 1 + sk_joinLookupWaveSize) : m_tableRecords.size();
+
+						std::vector<std::shared_ptr<TaskFuture<NodeBasePtr> > > lookups;
+						for (size_t j = i + 1; j < waveEnd; ++j)
+						{
+							lookups.push_back(exNode.FindSuccessorAsync(m_tableRecords[j].m_startId, taskPool));
+						}
+						WaitAll(lookups);
+
+						for (size_t j = i + 1; j < waveEnd; ++j)
+						{
+							if (m_cirRange.IsWithinCN(m_tableRecords[j].m_startId, m_nodeId, m_tableRecords[j - 1].m_node->GetNodeId()))
+							{
+								m_tableRecords[j].m_node = m_tableRecords[j - 1].m_node;
+							}
+							else
+							{
+								m_tableRecords[j].m_node = lookups[j - (i + 1)]->Get();
+							}
+						}
+						i = waveEnd - 1;
+					}
+				}
+				catch (const std::exception&)
+				{
+					try
+					{
+						predFuture->Wait(); //The task refers to this table, so wait for it before leaving.
+					}
+					catch (const std::exception&)
+					{}
+					throw;
+				}
+
+				m_predecessor = predFuture->Get();
+			}
+
 			/**
 			 * \brief	Called when a new node is joining the existing network, and this node possibly need
 			 * 			to update its finger table according to that new node.
@@ -22,6 +22,13 @@ namespace Decent
 				constexpr NumType k_dUpdFingerTable = 7;
 				constexpr NumType k_queryNonBlock   = 8;
 				constexpr NumType k_queryReply      = 9;
+				constexpr NumType k_openChannel     = 10;
+				constexpr NumType k_ping            = 11;
+				constexpr NumType k_queryNonBlockBatch = 12;
+				constexpr NumType k_queryReplyBatch    = 13;
+				constexpr NumType k_routedData         = 14;
+				constexpr NumType k_routedDataReply    = 15;
+				constexpr NumType k_getMembers         = 16;
 			}
 
 			namespace Store
@@ -31,6 +38,13 @@ namespace Decent
 				constexpr NumType k_setMigrateData = 1;
 			}
 
+			/**
+			 * \brief	Functions requested by apps. A session carries requests until the app sends k_close,
+			 * 			or it's idle for too long. Responses are sent in the order of requests, so the app
+			 * 			may pipeline requests, as long as no two requests share a TLS record: the node waits
+			 * 			for the next request by watching the connection outside the enclave, and data left
+			 * 			in the TLS buffer of the enclave would not wake it up.
+			 */
 			namespace App
 			{
 				typedef uint8_t NumType;
@@ -38,6 +52,12 @@ namespace Decent
 				constexpr NumType k_getData       = 1;
 				constexpr NumType k_setData       = 2;
 				constexpr NumType k_delData       = 3;
+				constexpr NumType k_close         = 4;
+				constexpr NumType k_findNextHop   = 5;
+				constexpr NumType k_getDataOwned  = 6;
+				constexpr NumType k_setDataOwned  = 7;
+				constexpr NumType k_delDataOwned  = 8;
+				constexpr NumType k_routedData    = 9;
 			}
 		}
 	}
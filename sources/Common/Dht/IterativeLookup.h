@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+
+#include <array>
+#include <stdexcept>
+
+namespace Decent
+{
+	namespace Dht
+	{
+		/**
+		 * \brief	Reply of one step of an iterative lookup (see EncFunc::App::k_findNextHop). It's sent
+		 * 			as raw bytes, so the padding is explicit and must be zeroed.
+		 */
+		template<size_t KeySizeByte>
+		struct NextHopReply
+		{
+			/**
+			 * \brief	1 if the node is the successor of the queried key, i.e., the lookup is done; 0 if
+			 * 			it's the next hop to ask.
+			 */
+			uint8_t m_isFinal;
+			uint8_t m_pad[7];
+			std::array<uint8_t, KeySizeByte> m_nodeId;
+			uint64_t m_addr;
+		};
+
+		/**
+		 * \brief	Finds the successor of a key by walking the ring on the client side, i.e., asking a
+		 * 			node for the next hop, and then asking that hop, until a node answers with the
+		 * 			successor. No node keeps any state for the lookup, so the client is free to issue
+		 * 			the steps of many lookups in parallel, or to hedge a slow step by asking another
+		 * 			node within the ask function.
+		 *
+		 * \exception	std::runtime_error	Thrown when a node doesn't make any progress, or the number
+		 * 									of hops exceeds the limit.
+		 *
+		 * \tparam	KeySizeByte	Size of the key, in bytes.
+		 * \tparam	AskFuncT   	Type of the ask function, which sends k_findNextHop with the key to
+		 * 						the node at the given address and receives the reply. Must have the
+		 * 						form of "NextHopReply<KeySizeByte> FuncName(uint64_t addr)".
+		 * \param	startAddr	The address of the node to start with.
+		 * \param	askFunc  	The ask function.
+		 * \param	maxHops  	The maximum number of nodes to ask.
+		 *
+		 * \return	The reply of the successor.
+		 */
+		template<size_t KeySizeByte, typename AskFuncT>
+		NextHopReply<KeySizeByte> IterativeLookup(uint64_t startAddr, AskFuncT askFunc, size_t maxHops)
+		{
+			uint64_t addr = startAddr;
+			for (size_t i = 0; i < maxHops; ++i)
+			{
+				NextHopReply<KeySizeByte> reply = askFunc(addr);
+				if (reply.m_isFinal)
+				{
+					return reply;
+				}
+
+				if (reply.m_addr == addr)
+				{
+					throw std::runtime_error("The iterative lookup doesn't make any progress.");
+				}
+				addr = reply.m_addr;
+			}
+
+			throw std::runtime_error("The iterative lookup exceeds the maximum number of hops.");
+		}
+	}
+}
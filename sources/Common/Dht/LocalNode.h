@@ -6,10 +6,16 @@
 //*/
 #pragma once
 
+#include <cstdint>
+
 #include <memory>
+#include <exception>
+#include <vector>
 
 #include "NodeBase.h"
+#include "TaskPool.h"
 #include "FingerTable.h"
+#include "MembershipTable.h"
 
 namespace Decent
 {
@@ -24,6 +30,12 @@ namespace Decent
 			static constexpr size_t sk_keySizeBit = KeySizeByte * BITS_PER_BYTE;
 			typedef std::array<IdType, sk_keySizeBit + 1> Pow2iArrayType;
 
+			/**
+			 * \brief	The row number carried by UpdateFingerTable() and DeUpdateFingerTable() calls that only
+			 * 			notify a node in one-hop routing mode about the joining or leaving node, without
+			 * 			touching its finger table.
+			 */
+			static constexpr uint64_t sk_membershipRow = UINT64_MAX;
 
 		public:
 
@@ -36,15 +48,18 @@ namespace Decent
 			 * \param	ringSmallestId	Smallest possible identifier on the ring.
 			 * \param	ringLargestId 	Largest possible identifier on the ring.
 			 * \param	pow2iArray	  	Array of 2^i, where 0 <= i <= ([key size in bits] + 1).
+			 * \param	isOneHop	  	True to enable one-hop routing, where the node keeps the full list of
+			 * 							nodes in the network, and routes to the owner of a key directly.
 			 */
-			LocalNode(const IdType& id, const AddrType& addr, const IdType& ringSmallestId, const IdType& ringLargestId, std::shared_ptr<const Pow2iArrayType> pow2iArray) :
+			LocalNode(const IdType& id, const AddrType& addr, const IdType& ringSmallestId, const IdType& ringLargestId, std::shared_ptr<const Pow2iArrayType> pow2iArray, bool isOneHop = false) :
 				m_id(id),
 				m_addr(addr),
 				m_ringSmallestId(ringSmallestId),
 				m_ringLargestId(ringLargestId),
 				m_cirRange(m_ringSmallestId, m_ringLargestId),
 				m_pow2iArray(pow2iArray),
-				m_fingerTable(m_id, m_cirRange, pow2iArray)
+				m_fingerTable(m_id, m_cirRange, pow2iArray),
+				m_members(isOneHop ? new MembershipTable<IdType, AddrType>(m_id) : nullptr)
 			{}
 
 			/** \brief	Destructor */
@@ -52,34 +67,53 @@ namespace Decent
 			{}
 
 			/**
-			 * \brief	Join the existing network.
+			 * \brief	Join the existing network. Independent calls to other nodes are issued concurrently
+			 * 			on the task pool.
 			 *
-			 * \param [in,out]	node	the first node to contact with to initialize join process.
+			 * \param [in,out]	node		the first node to contact with to initialize join process.
+			 * \param [in,out]	taskPool	The task pool.
 			 */
-			virtual void Join(NodeBaseType& node)
+			virtual void Join(NodeBaseType& node, TaskPool& taskPool)
 			{
-				m_fingerTable.JoinTo(node);
+				m_fingerTable.JoinTo(node, taskPool);
 				GetImmediateSuccessor()->SetImmediatePredecessor(GetSelfPtr());
 
-				UpdateOthers();
+				if (m_members)
+				{
+					CollectMembers();
+				}
+
+				UpdateOthers(taskPool);
 
 				PrintTable();
 			}
 
 			/**
 			 * \brief	Called when this node is joining the existing network and after its finger table is
-			 * 			re-initialized.
+			 * 			re-initialized. The predecessors of all rows are found at once, and then all of them
+			 * 			are updated at once, since rows don't depend on each other. In one-hop routing mode,
+			 * 			all other nodes are notified about this node as well.
+			 *
+			 * \param [in,out]	taskPool	The task pool.
 			 */
-			void UpdateOthers()
+			void UpdateOthers(TaskPool& taskPool)
 			{
+				std::vector<NodeBasePtr> preds = FindPredecessorsOfRows(taskPool);
+
+				NodeBasePtr selfPtr = GetSelfPtr();
+				std::vector<std::shared_ptr<TaskFuture<void> > > updates;
 				for (size_t i = 0; i < sk_keySizeBit; ++i)
 				{
-					const IdType& pow2i = (*m_pow2iArray)[i];
-					IdType pow2im1 = pow2i - 1;
-					NodeBasePtr p = this->FindPredecessor(m_cirRange.Minus(m_id, pow2im1));
-					NodeBasePtr selfPtr = GetSelfPtr();
-					p->UpdateFingerTable(selfPtr, static_cast<uint64_t>(i));
+					updates.push_back(preds[i]->UpdateFingerTableAsync(selfPtr, static_cast<uint64_t>(i), taskPool));
+				}
+				if (m_members)
+				{
+					for (NodeBasePtr& member : m_members->GetOthers())
+					{
+						updates.push_back(member->UpdateFingerTableAsync(selfPtr, sk_membershipRow, taskPool));
+					}
 				}
+				WaitAll(updates);
 			}
 
 			/**
@@ -88,39 +122,66 @@ namespace Decent
 			 * 			call to FingerTable class, and notify its predecessor.
 			 *
 			 * \param [in,out]	succ	Pointer to the new node.
-			 * \param 		  	i   	row of the finger table that needs to be checked.
+			 * \param 		  	i   	row of the finger table that needs to be checked, or
+			 * 							sk_membershipRow.
 			 */
 			virtual void UpdateFingerTable(NodeBasePtr& succ, uint64_t i) override
 			{
+				if (m_members)
+				{
+					m_members->Add(succ);
+				}
+				if (i == sk_membershipRow)
+				{
+					return;
+				}
+
 				if (m_fingerTable.UpdateFingerTable(succ, static_cast<size_t>(i)))
 				{
 					GetImmediatePredecessor()->UpdateFingerTable(succ, i);
 				}
 			}
 
-			/** \brief	Leaving the network. */
-			virtual void Leave()
+			/**
+			 * \brief	Leaving the network. Independent calls to other nodes are issued concurrently on the
+			 * 			task pool.
+			 *
+			 * \param [in,out]	taskPool	The task pool.
+			 */
+			virtual void Leave(TaskPool& taskPool)
 			{
 				GetImmediateSuccessor()->SetImmediatePredecessor(GetImmediatePredecessor());
 
-				DeUpdateOthers();
+				DeUpdateOthers(taskPool);
 			}
 
-			/** \brief	Called when this node is leaving the network. */
-			void DeUpdateOthers()
+			/**
+			 * \brief	Called when this node is leaving the network. Just like UpdateOthers(), all rows are
+			 * 			handled at once, and all other nodes are notified in one-hop routing mode.
+			 *
+			 * \param [in,out]	taskPool	The task pool.
+			 */
+			void DeUpdateOthers(TaskPool& taskPool)
 			{
-				NodeBasePtr succ = GetImmediateSuccessor();
+				std::vector<NodeBasePtr> preds = FindPredecessorsOfRows(taskPool);
 
+				NodeBasePtr succ = GetImmediateSuccessor();
+				std::vector<std::shared_ptr<TaskFuture<void> > > updates;
 				for (size_t i = 0; i < sk_keySizeBit; ++i)
 				{
-					const IdType& pow2i = (*m_pow2iArray)[i];
-					IdType pow2im1 = pow2i - 1;
-					NodeBasePtr p = this->FindPredecessor(m_cirRange.Minus(m_id, pow2im1));
-					if (p->GetNodeId() != this->GetNodeId()) //Do not update the node self.
+					if (preds[i]->GetNodeId() != this->GetNodeId()) //Do not update the node self.
+					{
+						updates.push_back(preds[i]->DeUpdateFingerTableAsync(this->GetNodeId(), succ, static_cast<uint64_t>(i), taskPool));
+					}
+				}
+				if (m_members)
+				{
+					for (NodeBasePtr& member : m_members->GetOthers())
 					{
-						p->DeUpdateFingerTable(this->GetNodeId(), succ, static_cast<uint64_t>(i));
+						updates.push_back(member->DeUpdateFingerTableAsync(this->GetNodeId(), succ, sk_membershipRow, taskPool));
 					}
 				}
+				WaitAll(updates);
 			}
 
 			/**
@@ -130,10 +191,20 @@ namespace Decent
 			 *
 			 * \param 		  	oldId	ID of the leaving node.
 			 * \param [in,out]	succ 	Pointer to the successor of the leaving node.
-			 * \param 		  	i	 	Row of the finger table that needs to be checked.
+			 * \param 		  	i	 	Row of the finger table that needs to be checked, or
+			 * 							sk_membershipRow.
 			 */
 			virtual void DeUpdateFingerTable(const IdType& oldId, NodeBasePtr& succ, uint64_t i) override
 			{
+				if (m_members)
+				{
+					m_members->Remove(oldId);
+				}
+				if (i == sk_membershipRow)
+				{
+					return;
+				}
+
 				if (m_fingerTable.DeUpdateFingerTable(oldId, succ, static_cast<size_t>(i)) && oldId != GetImmediatePredecessor()->GetNodeId())
 				{
 					GetImmediatePredecessor()->DeUpdateFingerTable(oldId, succ, i);
@@ -169,7 +240,7 @@ namespace Decent
 				{
 					return GetSelfPtr();
 				}
-				NodeBasePtr nextHop = GetNextHop(key);
+				NodeBasePtr nextHop = GetClosestPrecedingNode(key);
 				return nextHop->FindPredecessor(key);
 			}
 
@@ -195,6 +266,22 @@ namespace Decent
 				return res ? res : GetSelfPtr();
 			}
 
+			/**
+			 * \brief	Gets the membership list of this node, including itself.
+			 *
+			 * \return	The nodes; empty if one-hop routing is disabled.
+			 */
+			virtual std::vector<NodeBasePtr> GetMembers() override
+			{
+				std::vector<NodeBasePtr> res;
+				if (m_members)
+				{
+					res = m_members->GetOthers();
+					res.push_back(GetSelfPtr());
+				}
+				return res;
+			}
+
 			/**
 			 * \brief	Set the immediate predecessor of this node.
 			 *
@@ -209,6 +296,10 @@ namespace Decent
 				else
 				{
 					m_fingerTable.SetImmediatePredecessor(pred);
+					if (m_members)
+					{
+						m_members->Add(pred);
+					}
 				}
 			}
 
@@ -237,8 +328,25 @@ namespace Decent
 				return m_cirRange.IsWithinNC(key, GetImmediatePredecessor()->GetNodeId(), m_id);
 			}
 
+			/**
+			 * \brief	Gets the next node to forward a lookup of the key to. In one-hop routing mode, it's the
+			 * 			owner of the key found in the membership list; otherwise, or if the list says it's
+			 * 			this node (i.e. the list is stale), it's the closest preceding finger.
+			 *
+			 * \param	key	Key to lookup.
+			 *
+			 * \return	The next hop.
+			 */
 			NodeBasePtr GetNextHop(const IdType& key)
 			{
+				if (m_members)
+				{
+					NodeBasePtr owner = m_members->GetSuccessorOf(key);
+					if (owner)
+					{
+						return owner;
+					}
+				}
 				return m_fingerTable.GetClosetPrecFinger(key);
 			}
 
@@ -255,6 +363,91 @@ namespace Decent
 
 		protected:
 
+			/**
+			 * \brief	Find the predecessors of (n - 2^i + 1) for all rows i of the finger table, at once.
+			 *
+			 * \param [in,out]	taskPool	The task pool.
+			 *
+			 * \return	The predecessors, indexed by row.
+			 */
+			std::vector<NodeBasePtr> FindPredecessorsOfRows(TaskPool& taskPool)
+			{
+				std::vector<std::shared_ptr<TaskFuture<NodeBasePtr> > > lookups;
+				for (size_t i = 0; i < sk_keySizeBit; ++i)
+				{
+					const IdType& pow2i = (*m_pow2iArray)[i];
+					IdType pow2im1 = pow2i - 1;
+					lookups.push_back(this->FindPredecessorAsync(m_cirRange.Minus(m_id, pow2im1), taskPool));
+				}
+				WaitAll(lookups);
+
+				std::vector<NodeBasePtr> preds;
+				preds.reserve(lookups.size());
+				for (std::shared_ptr<TaskFuture<NodeBasePtr> >& lookup : lookups)
+				{
+					preds.push_back(lookup->Get());
+				}
+				return preds;
+			}
+
+			/**
+			 * \brief	Gets the closest node preceding the key that is known to this node. In one-hop routing
+			 * 			mode, it's the immediate predecessor of the key found in the membership list, unless
+			 * 			the list says it's this node.
+			 *
+			 * \param	key	The key.
+			 *
+			 * \return	The closest preceding node.
+			 */
+			NodeBasePtr GetClosestPrecedingNode(const IdType& key)
+			{
+				if (m_members)
+				{
+					NodeBasePtr pred = m_members->GetPredecessorOf(key);
+					if (pred)
+					{
+						return pred;
+					}
+				}
+				return m_fingerTable.GetClosetPrecFinger(key);
+			}
+
+			/**
+			 * \brief	Fills the membership list with the one of the immediate successor, fetched in one
+			 * 			call. If that fails, or the successor has no list, the list is filled by walking the
+			 * 			ring through immediate successors instead, starting from the immediate successor of
+			 * 			this node, until the walk gets back to this node or to a node seen already. Called
+			 * 			when this node is joining the network in one-hop routing mode.
+			 */
+			void CollectMembers()
+			{
+				NodeBasePtr node = GetImmediateSuccessor();
+
+				std::vector<NodeBasePtr> succMembers;
+				try
+				{
+					succMembers = node->GetMembers();
+				}
+				catch (const std::exception&)
+				{
+					succMembers.clear();
+				}
+
+				if (succMembers.size() > 0)
+				{
+					for (NodeBasePtr& member : succMembers)
+					{
+						m_members->Add(member);
+					}
+					return;
+				}
+
+				while (node->GetNodeId() != m_id && m_members->Add(node))
+				{
+					node = node->GetImmediateSuccessor();
+				}
+			}
+
 			/**
 			 * \brief	Gets shared pointer to self
 			 *
@@ -273,6 +466,7 @@ namespace Decent
 			CircularRange<IdType, checkCircleRange> m_cirRange;
 			std::shared_ptr<const Pow2iArrayType> m_pow2iArray;
 			FingerTable<IdType, KeySizeByte, AddrType, checkCircleRange> m_fingerTable;
+			std::unique_ptr<MembershipTable<IdType, AddrType> > m_members;
 		};
 	}
 }
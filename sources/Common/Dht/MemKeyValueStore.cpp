@@ -4,9 +4,169 @@
 
 //#include <DecentApi/Common/Common.h>
 #include <DecentApi/Common/make_unique.h>
+#include <DecentApi/Common/RuntimeException.h>
 
 using namespace Decent::Dht;
 
+namespace
+{
+	static void PackSizedBuf(uint8_t*& pos, const void* buf, uint64_t size)
+	{
+		std::memcpy(pos, &size, sizeof(size));
+		pos += sizeof(size);
+		if (size > 0)
+		{
+			std::memcpy(pos, buf, static_cast<size_t>(size));
+			pos += size;
+		}
+	}
+
+	static const uint8_t* UnpackSizedBuf(const uint8_t*& pos, const uint8_t* end, uint64_t& size)
+	{
+		if (static_cast<size_t>(end - pos) < sizeof(size))
+		{
+			throw Decent::RuntimeException("Packed key-value pairs are malformed.");
+		}
+		std::memcpy(&size, pos, sizeof(size));
+		pos += sizeof(size);
+
+		if (static_cast<uint64_t>(end - pos) < size)
+		{
+			throw Decent::RuntimeException("Packed key-value pairs are malformed.");
+		}
+		const uint8_t* res = pos;
+		pos += size;
+
+		return res;
+	}
+
+	static void AppendSizedBuf(std::vector<uint8_t>& dest, const void* buf, uint64_t size)
+	{
+		const uint8_t* sizePtr = reinterpret_cast<const uint8_t*>(&size);
+		dest.insert(dest.end(), sizePtr, sizePtr + sizeof(size));
+		if (size > 0)
+		{
+			const uint8_t* bufPtr = static_cast<const uint8_t*>(buf);
+			dest.insert(dest.end(), bufPtr, bufPtr + size);
+		}
+	}
+
+	static uint8_t UnpackByte(const uint8_t*& pos, const uint8_t* end)
+	{
+		if (pos == end)
+		{
+			throw Decent::RuntimeException("Packed key-value pairs are malformed.");
+		}
+		return *(pos++);
+	}
+}
+
+MemKeyValueStore::ValueType MemKeyValueStore::PackPairs(const std::vector<KeyValPair>& pairs)
+{
+	ValueType res;
+	res.first = GetPackedPairsSize(pairs);
+	res.second = Tools::make_unique<uint8_t[]>(res.first);
+
+	PackPairs(pairs, res.second.get());
+
+	return res;
+}
+
+size_t MemKeyValueStore::GetPackedPairsSize(const std::vector<KeyValPair>& pairs)
+{
+	size_t totalSize = 0;
+	for (const KeyValPair& pair : pairs)
+	{
+		totalSize += sizeof(uint64_t) + pair.first.size() + sizeof(uint64_t) + pair.second.first;
+	}
+
+	return totalSize;
+}
+
+void MemKeyValueStore::PackPairs(const std::vector<KeyValPair>& pairs, uint8_t * dest)
+{
+	uint8_t* pos = dest;
+	for (const KeyValPair& pair : pairs)
+	{
+		PackSizedBuf(pos, pair.first.data(), pair.first.size());
+		PackSizedBuf(pos, pair.second.second.get(), pair.second.first);
+	}
+}
+
+std::vector<std::pair<MemKeyValueStore::KeyType, std::vector<uint8_t> > > MemKeyValueStore::UnpackPairs(const uint8_t * buf, size_t size)
+{
+	std::vector<std::pair<KeyType, std::vector<uint8_t> > > res;
+
+	VisitPairs(buf, size, [&res](const KeyType& key, const uint8_t* val, size_t valSize)
+	{
+		res.push_back(std::make_pair(key, std::vector<uint8_t>(val, val + valSize)));
+	});
+
+	return res;
+}
+
+void MemKeyValueStore::VisitPairs(const uint8_t * buf, size_t size, const std::function<void(const KeyType&, const uint8_t*, size_t)>& visitFunc)
+{
+	const uint8_t* pos = buf;
+	const uint8_t* end = buf + size;
+	while (pos != end)
+	{
+		uint64_t keySize = 0;
+		const uint8_t* keyPtr = UnpackSizedBuf(pos, end, keySize);
+		uint64_t valSize = 0;
+		const uint8_t* valPtr = UnpackSizedBuf(pos, end, valSize);
+
+		visitFunc(KeyType(reinterpret_cast<const char*>(keyPtr), static_cast<size_t>(keySize)), valPtr, static_cast<size_t>(valSize));
+	}
+}
+
+void MemKeyValueStore::AppendBatchOp(std::vector<uint8_t>& batch, BatchOp op, const KeyType & key, const uint8_t * val, size_t valSize)
+{
+	batch.push_back(static_cast<uint8_t>(op));
+	AppendSizedBuf(batch, key.data(), key.size());
+	if (op == BatchOp::Store)
+	{
+		AppendSizedBuf(batch, val, valSize);
+	}
+}
+
+uint8_t * MemKeyValueStore::AppendBatchStoreOp(std::vector<uint8_t>& batch, const KeyType & key, size_t valSize)
+{
+	batch.push_back(static_cast<uint8_t>(BatchOp::Store));
+	AppendSizedBuf(batch, key.data(), key.size());
+
+	const uint64_t valSize64 = static_cast<uint64_t>(valSize);
+	const uint8_t* sizePtr = reinterpret_cast<const uint8_t*>(&valSize64);
+	batch.insert(batch.end(), sizePtr, sizePtr + sizeof(valSize64));
+
+	batch.resize(batch.size() + valSize);
+	return batch.data() + (batch.size() - valSize);
+}
+
+std::vector<MemKeyValueStore::BatchResult> MemKeyValueStore::UnpackBatchResults(const uint8_t * buf, size_t size, size_t opCount)
+{
+	std::vector<BatchResult> res;
+	res.reserve(opCount);
+
+	const uint8_t* pos = buf;
+	const uint8_t* end = buf + size;
+	while (pos != end)
+	{
+		bool isSucceeded = UnpackByte(pos, end) != 0;
+		uint64_t valSize = 0;
+		const uint8_t* valPtr = UnpackSizedBuf(pos, end, valSize);
+
+		res.push_back(std::make_pair(isSucceeded, std::vector<uint8_t>(valPtr, valPtr + valSize)));
+	}
+
+	if (res.size() != opCount)
+	{
+		throw Decent::RuntimeException("The number of batch results doesn't match the number of operations.");
+	}
+
+	return res;
+}
+
 MemKeyValueStore::MemKeyValueStore()
 {
 }
@@ -55,6 +215,21 @@ MemKeyValueStore::ValueType MemKeyValueStore::Read(const KeyType & key)
 	}
 }
 
+bool MemKeyValueStore::Read(const KeyType & key, const std::function<void(const uint8_t*, size_t)>& readFunc)
+{
+	std::unique_lock<std::mutex> mapLock(m_mapMutex);
+	auto it = m_map.find(key);
+	if (it == m_map.end())
+	{
+		//Val not found:
+		return false;
+	}
+
+	readFunc(it->second.second.get(), it->second.first);
+
+	return true;
+}
+
 MemKeyValueStore::ValueType MemKeyValueStore::Delete(const KeyType & key)
 {
 	std::unique_lock<std::mutex> mapLock(m_mapMutex);
@@ -89,6 +264,25 @@ std::vector<MemKeyValueStore::KeyValPair> MemKeyValueStore::Migrate(const KeyTyp
 	return res;
 }
 
+std::vector<MemKeyValueStore::KeyValPair> MemKeyValueStore::Migrate(const KeyType & lowerVal, const KeyType & higherVal, size_t maxCount)
+{
+	std::vector<MemKeyValueStore::KeyValPair> res;
+
+	{
+		std::unique_lock<std::mutex> mapLock(m_mapMutex);
+
+		auto itBegin = m_map.lower_bound(lowerVal);
+		auto itEnd = m_map.upper_bound(higherVal);
+
+		for (auto it = itBegin; it != itEnd && res.size() < maxCount; it = m_map.erase(it))
+		{
+			res.push_back(std::make_pair(std::move(it->first), std::move(it->second)));
+		}
+	}
+
+	return res;
+}
+
 std::vector<MemKeyValueStore::KeyValPair> MemKeyValueStore::MigrateAll()
 {
 	std::vector<MemKeyValueStore::KeyValPair> res;
@@ -104,6 +298,91 @@ std::vector<MemKeyValueStore::KeyValPair> MemKeyValueStore::MigrateAll()
 	return res;
 }
 
+MemKeyValueStore::ValueType MemKeyValueStore::ProcessBatch(const uint8_t * batch, size_t size)
+{
+	std::vector<uint8_t> res;
+	ProcessBatch(batch, size, res);
+
+	ValueType packed;
+	packed.first = res.size();
+	packed.second = Tools::make_unique<uint8_t[]>(packed.first);
+	if (packed.first > 0)
+	{
+		std::memcpy(packed.second.get(), res.data(), packed.first);
+	}
+
+	return packed;
+}
+
+void MemKeyValueStore::ProcessBatch(const uint8_t * batch, size_t size, std::vector<uint8_t>& res)
+{
+	res.clear();
+
+	const uint8_t* pos = batch;
+	const uint8_t* end = batch + size;
+	while (pos != end)
+	{
+		const BatchOp op = static_cast<BatchOp>(UnpackByte(pos, end));
+		uint64_t keySize = 0;
+		const uint8_t* keyPtr = UnpackSizedBuf(pos, end, keySize);
+		const KeyType key(reinterpret_cast<const char*>(keyPtr), static_cast<size_t>(keySize));
+
+		ValueType val;
+		bool isSucceeded = false;
+		switch (op)
+		{
+		case BatchOp::Store:
+		{
+			uint64_t valSize = 0;
+			const uint8_t* valPtr = UnpackSizedBuf(pos, end, valSize);
+
+			ValueType storeVal;
+			storeVal.first = static_cast<size_t>(valSize);
+			storeVal.second = Tools::make_unique<uint8_t[]>(storeVal.first);
+			if (storeVal.first > 0)
+			{
+				std::memcpy(storeVal.second.get(), valPtr, storeVal.first);
+			}
+
+			Store(key, std::move(storeVal));
+			isSucceeded = true;
+		}
+			break;
+		case BatchOp::Read:
+		{
+			//The value is copied straight into the results, instead of into a copy of its own first.
+			const size_t resultPos = res.size();
+			res.push_back(0);
+			isSucceeded = Read(key, [&res](const uint8_t* readVal, size_t readSize)
+			{
+				AppendSizedBuf(res, readVal, readSize);
+			});
+			if (isSucceeded)
+			{
+				res[resultPos] = 1;
+			}
+			else
+			{
+				AppendSizedBuf(res, nullptr, 0);
+			}
+		}
+			continue;
+		case BatchOp::Delete:
+			isSucceeded = Delete(key).second.get() != nullptr;
+			break;
+		case BatchOp::Migrate:
+			val = Delete(key);
+			isSucceeded = val.second.get() != nullptr;
+			break;
+		default:
+			throw Decent::RuntimeException("Unknown operation in memory store batch.");
+		}
+
+		res.push_back(isSucceeded ? 1 : 0);
+		AppendSizedBuf(res, val.second.get(), val.second ? val.first : 0);
+	}
+}
+
 MemKeyValueStore::ValueType MemKeyValueStore::Delete(MapType::iterator it)
 {
 	//Protected function; assume 'it' is not pointing to the end; assume map has been locked.
@@ -5,6 +5,7 @@
 #include <memory>
 #include <map>
 #include <mutex>
+#include <functional>
 
 namespace Decent
 {
@@ -18,6 +19,104 @@ namespace Decent
 			typedef std::map<KeyType, ValueType> MapType;
 			typedef std::pair<KeyType, ValueType> KeyValPair;
 
+			/** \brief	Operations that can be carried in a batch. */
+			enum class BatchOp : uint8_t
+			{
+				Store   = 0,
+				Read    = 1,
+				Delete  = 2,
+				Migrate = 3, //Read and delete.
+			};
+
+			/** \brief	Result of one operation in a batch. The first is true if the operation succeeded. */
+			typedef std::pair<bool, std::vector<uint8_t> > BatchResult;
+
+			/**
+			 * \brief	Packs a list of key-value pairs into one buffer, so that they can be passed across
+			 * 			the enclave boundary at once. Each pair is packed as [key size (uint64_t)][key][value
+			 * 			size (uint64_t)][value].
+			 *
+			 * \param	pairs	The key-value pairs.
+			 *
+			 * \return	The packed buffer.
+			 */
+			static ValueType PackPairs(const std::vector<KeyValPair>& pairs);
+
+			/** \brief	Gets the size of the buffer generated by PackPairs for the given pairs. */
+			static size_t GetPackedPairsSize(const std::vector<KeyValPair>& pairs);
+
+			/**
+			 * \brief	Packs a list of key-value pairs into a buffer given by the caller, so that they can
+			 * 			be packed straight into a buffer that is reused (e.g. UntrustedBufferPool).
+			 *
+			 * \param 	   	pairs	The key-value pairs.
+			 * \param [out]	dest 	The destination, which must be GetPackedPairsSize(pairs) bytes.
+			 */
+			static void PackPairs(const std::vector<KeyValPair>& pairs, uint8_t* dest);
+
+			/**
+			 * \brief	Unpacks a buffer generated by PackPairs.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the buffer is malformed.
+			 *
+			 * \param	buf 	The packed buffer.
+			 * \param	size	The size of the packed buffer.
+			 *
+			 * \return	A list of key-value pairs, in the order they were packed.
+			 */
+			static std::vector<std::pair<KeyType, std::vector<uint8_t> > > UnpackPairs(const uint8_t* buf, size_t size);
+
+			/**
+			 * \brief	Visits each pair in a buffer generated by PackPairs, without copying the values out.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the buffer is malformed.
+			 *
+			 * \param	buf		 	The packed buffer.
+			 * \param	size	 	The size of the packed buffer.
+			 * \param	visitFunc	The function called for each pair, in the order they were packed. Must
+			 * 						have the form of "void FuncName(const KeyType&amp; key, const uint8_t* val, size_t size)".
+			 */
+			static void VisitPairs(const uint8_t* buf, size_t size, const std::function<void(const KeyType&, const uint8_t*, size_t)>& visitFunc);
+
+			/**
+			 * \brief	Appends an operation to a batch, which is later processed by ProcessBatch. Each
+			 * 			operation is packed as [op (uint8_t)][key size (uint64_t)][key], followed by
+			 * 			[value size (uint64_t)][value] for BatchOp::Store only.
+			 *
+			 * \param [in,out]	batch  	The batch.
+			 * \param 		  	op	   	The operation.
+			 * \param 		  	key	   	The key.
+			 * \param 		  	val	   	The value to store; ignored if the operation is not BatchOp::Store.
+			 * \param 		  	valSize	Size of the value.
+			 */
+			static void AppendBatchOp(std::vector<uint8_t>& batch, BatchOp op, const KeyType& key, const uint8_t* val = nullptr, size_t valSize = 0);
+
+			/**
+			 * \brief	Appends a BatchOp::Store operation, whose value is written by the caller afterwards,
+			 * 			so that the value can be generated (e.g. sealed) straight into the batch.
+			 *
+			 * \param [in,out]	batch  	The batch.
+			 * \param 		  	key	   	The key.
+			 * \param 		  	valSize	Size of the value.
+			 *
+			 * \return	Pointer to the space for the value, which is valid until the batch is modified.
+			 */
+			static uint8_t* AppendBatchStoreOp(std::vector<uint8_t>& batch, const KeyType& key, size_t valSize);
+
+			/**
+			 * \brief	Unpacks the results generated by ProcessBatch.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the buffer is malformed, or the number
+			 * 												of results is not the expected one.
+			 *
+			 * \param	buf	   	The packed results.
+			 * \param	size   	The size of the packed results.
+			 * \param	opCount	The number of operations in the batch.
+			 *
+			 * \return	A list of results, in the same order as operations in the batch.
+			 */
+			static std::vector<BatchResult> UnpackBatchResults(const uint8_t* buf, size_t size, size_t opCount);
+
 		public:
 			/** \brief	Default constructor */
 			MemKeyValueStore();
@@ -42,6 +141,18 @@ namespace Decent
 			 */
 			virtual ValueType Read(const KeyType& key);
 
+			/**
+			 * \brief	Reads the value associated with given key, without making a copy of it. The value
+			 * 			is passed to the given function while the store is locked.
+			 *
+			 * \param	key	   	The key to read.
+			 * \param	readFunc	The function that reads the value. Must have the form of
+			 * 						"void FuncName(const uint8_t* val, size_t size)".
+			 *
+			 * \return	True if the key is found; false otherwise.
+			 */
+			virtual bool Read(const KeyType& key, const std::function<void(const uint8_t*, size_t)>& readFunc);
+
 			/**
 			 * \brief	Deletes the value associated with given key
 			 *
@@ -61,6 +172,19 @@ namespace Decent
 			 */
 			virtual std::vector<KeyValPair> Migrate(const KeyType& lowerVal, const KeyType& higherVal);
 
+			/**
+			 * \brief	Migrates a range of key value pairs, but no more than a given number of pairs at a
+			 * 			time. Pairs with the smallest keys in the range are moved out first, so repeating
+			 * 			the call will eventually move out the whole range.
+			 *
+			 * \param	lowerVal 	The lower key value.
+			 * \param	higherVal	The higher key value.
+			 * \param	maxCount 	The maximum number of pairs to move out.
+			 *
+			 * \return	A std::vector&lt;KeyValPair&gt; which is a list of key-value pairs that has been moved out.
+			 */
+			virtual std::vector<KeyValPair> Migrate(const KeyType& lowerVal, const KeyType& higherVal, size_t maxCount);
+
 			/**
 			 * \brief	Migrate all values in this key-value store.
 			 *
@@ -68,6 +192,33 @@ namespace Decent
 			 */
 			virtual std::vector<KeyValPair> MigrateAll();
 
+			/**
+			 * \brief	Process a batch of operations generated by AppendBatchOp, in order. Failure of one
+			 * 			operation (e.g. key not found) does not stop the rest. The result of each operation
+			 * 			is packed as [succeeded (uint8_t)][value size (uint64_t)][value], where the value
+			 * 			is only given for BatchOp::Read and BatchOp::Migrate.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the batch is malformed.
+			 *
+			 * \param	batch	The batch.
+			 * \param	size 	The size of the batch.
+			 *
+			 * \return	The packed results.
+			 */
+			virtual ValueType ProcessBatch(const uint8_t* batch, size_t size);
+
+			/**
+			 * \brief	Same as the other ProcessBatch, but the packed results are written into a vector given
+			 * 			by the caller, so that the vector can be reused, and the results are not copied again.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the batch is malformed.
+			 *
+			 * \param 	   	batch	The batch.
+			 * \param 	   	size 	The size of the batch.
+			 * \param [out]	res  	The packed results; any previous content is discarded.
+			 */
+			virtual void ProcessBatch(const uint8_t* batch, size_t size, std::vector<uint8_t>& res);
+
 		protected:
 
 			/**
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <atomic>
+
+namespace Decent
+{
+	namespace Dht
+	{
+		/**
+		 * \brief	A request/response ring shared between the enclave and untrusted worker threads. The
+		 * 			enclave posts memory store requests (i.e. batches generated by
+		 * 			MemKeyValueStore::AppendBatchOp) into free slots, and polls for the responses, so
+		 * 			that no enclave transition is needed. It lives in untrusted memory, thus, the
+		 * 			enclave must not trust any value read from it.
+		 */
+		struct MemStoreRing
+		{
+			/** \brief	Number of slots in the ring. */
+			static constexpr size_t sk_slotNum = 64;
+
+			/** \brief	Size of the inline data buffer of each slot. */
+			static constexpr size_t sk_slotDataSize = 4096;
+
+			static constexpr uint32_t sk_slotFree    = 0; //The slot is available to enclave threads.
+			static constexpr uint32_t sk_slotFilling = 1; //An enclave thread is writing the request.
+			static constexpr uint32_t sk_slotPosted  = 2; //The request is ready for a worker.
+			static constexpr uint32_t sk_slotServing = 3; //A worker is processing the request.
+			static constexpr uint32_t sk_slotDone    = 4; //The response is ready for the enclave thread.
+
+			struct Slot
+			{
+				std::atomic<uint32_t> m_state;
+
+				/** \brief	Size of the request in m_data. */
+				uint64_t m_reqSize;
+
+				/** \brief	Non-zero if the request is processed successfully. */
+				uint32_t m_resRet;
+
+				/** \brief	Size of the response, which is in m_data, or in m_resOverflow if it is not null. */
+				uint64_t m_resSize;
+
+				/**
+				 * \brief	Buffer for response that doesn't fit in m_data. It's owned by the worker, and is
+				 * 			freed when the slot is served next time.
+				 */
+				uint8_t* m_resOverflow;
+
+				uint8_t m_data[sk_slotDataSize];
+			};
+
+			/** \brief	Slot where enclave threads start looking for a free slot. */
+			std::atomic<uint32_t> m_nextSlot;
+
+			Slot m_slots[sk_slotNum];
+		};
+	}
+}
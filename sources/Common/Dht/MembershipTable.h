@@ -0,0 +1,167 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <vector>
+
+#include "NodeBase.h"
+
+namespace Decent
+{
+	namespace Dht
+	{
+		/**
+		 * \brief	A full, sorted list of the nodes in the network, used for one-hop routing. The owner
+		 * 			or the predecessor of any key is found with a binary search over the list.
+		 *
+		 * 			The local node is always in the list, but its entry holds a null pointer, so that the
+		 * 			node doesn't reference itself; thus, a null result means the local node.
+		 *
+		 * \tparam	IdType  	Type of the node ID; must be ordered.
+		 * \tparam	AddrType	Type of the node address.
+		 */
+		template<typename IdType, typename AddrType>
+		class MembershipTable
+		{
+		public:
+			typedef NodeBase<IdType, AddrType> NodeBaseType;
+			typedef typename NodeBaseType::NodeBasePtr NodeBasePtr;
+
+		public:
+			MembershipTable() = delete;
+
+			/**
+			 * \brief	Constructor
+			 *
+			 * \param	selfId	The ID of the local node.
+			 */
+			MembershipTable(const IdType& selfId) :
+				m_selfId(selfId),
+				m_mutex(),
+				m_members()
+			{
+				m_members[m_selfId] = nullptr;
+			}
+
+			/** \brief	Destructor */
+			virtual ~MembershipTable()
+			{}
+
+			/**
+			 * \brief	Adds a node, or replaces the one with the same ID. The local node is ignored.
+			 *
+			 * \param	node	The node.
+			 *
+			 * \return	True if there was no node with the same ID; otherwise, false.
+			 */
+			bool Add(NodeBasePtr node)
+			{
+				const IdType& id = node->GetNodeId();
+				if (id == m_selfId)
+				{
+					return false;
+				}
+
+				std::unique_lock<std::mutex> membersLock(m_mutex);
+				NodeBasePtr& entry = m_members[id];
+				const bool isNew = !entry;
+				entry = node;
+				return isNew;
+			}
+
+			/**
+			 * \brief	Removes a node. The local node is ignored.
+			 *
+			 * \param	id	The ID of the node.
+			 */
+			void Remove(const IdType& id)
+			{
+				if (id == m_selfId)
+				{
+					return;
+				}
+
+				std::unique_lock<std::mutex> membersLock(m_mutex);
+				m_members.erase(id);
+			}
+
+			/**
+			 * \brief	Gets the successor of the key, i.e. the node responsible for it.
+			 *
+			 * \param	key	The key.
+			 *
+			 * \return	The first node whose ID is equal to or greater than the key, wrapping around the
+			 * 			ring. Null if it's the local node.
+			 */
+			NodeBasePtr GetSuccessorOf(const IdType& key) const
+			{
+				std::unique_lock<std::mutex> membersLock(m_mutex);
+
+				auto it = m_members.lower_bound(key);
+				if (it == m_members.end())
+				{
+					it = m_members.begin();
+				}
+				return it->second;
+			}
+
+			/**
+			 * \brief	Gets the immediate predecessor of the key.
+			 *
+			 * \param	key	The key.
+			 *
+			 * \return	The last node whose ID is less than the key, wrapping around the ring. Null if it's
+			 * 			the local node.
+			 */
+			NodeBasePtr GetPredecessorOf(const IdType& key) const
+			{
+				std::unique_lock<std::mutex> membersLock(m_mutex);
+
+				auto it = m_members.lower_bound(key);
+				if (it == m_members.begin())
+				{
+					it = m_members.end();
+				}
+				return (--it)->second;
+			}
+
+			/**
+			 * \brief	Gets all nodes other than the local node.
+			 *
+			 * \return	The nodes, in the order of their IDs.
+			 */
+			std::vector<NodeBasePtr> GetOthers() const
+			{
+				std::unique_lock<std::mutex> membersLock(m_mutex);
+
+				std::vector<NodeBasePtr> res;
+				res.reserve(m_members.size() - 1);
+				for (const auto& member : m_members)
+				{
+					if (member.second)
+					{
+						res.push_back(member.second);
+					}
+				}
+				return res;
+			}
+
+			/**
+			 * \brief	Gets the number of nodes, including the local node.
+			 *
+			 * \return	The number of nodes.
+			 */
+			size_t Size() const
+			{
+				std::unique_lock<std::mutex> membersLock(m_mutex);
+				return m_members.size();
+			}
+
+		private:
+			const IdType m_selfId;
+			mutable std::mutex m_mutex;
+			std::map<IdType, NodeBasePtr> m_members;
+		};
+	}
+}
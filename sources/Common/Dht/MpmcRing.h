@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstdint>
+
+#include <atomic>
+#include <memory>
+
+namespace Decent
+{
+	namespace Dht
+	{
+		/**
+		 * \brief	A bounded, lock-free, multi-producer multi-consumer FIFO ring. Items are held inline
+		 * 			in the ring's cells. Each cell has a sequence number, which tells whether the cell is
+		 * 			free for the producer at a given position, or filled for the consumer at that position;
+		 * 			producers and consumers only contend on a compare-and-swap of their own position.
+		 *
+		 * 			The ring never blocks; callers decide what to do when it's full or empty.
+		 *
+		 * \tparam	T	Type of the item; must be default constructible and move assignable.
+		 */
+		template<typename T>
+		class MpmcRing
+		{
+		public:
+			MpmcRing() = delete;
+
+			/**
+			 * \brief	Constructor
+			 *
+			 * \param	capacity	The minimum number of items the ring can hold; rounded up to a power of
+			 * 						two.
+			 */
+			MpmcRing(size_t capacity) :
+				m_mask(RoundUpPow2(capacity) - 1),
+				m_cells(new Cell[m_mask + 1]),
+				m_enqueuePos(0),
+				m_dequeuePos(0)
+			{
+				for (size_t i = 0; i <= m_mask; ++i)
+				{
+					m_cells[i].m_seq.store(i, std::memory_order_relaxed);
+				}
+			}
+
+			/** \brief	Destructor */
+			virtual ~MpmcRing()
+			{}
+
+			/**
+			 * \brief	Try to push an item into the ring.
+			 *
+			 * \param [in]	item	The item, whose ownership will be moved in if it's pushed.
+			 *
+			 * \return	False if the ring is full; otherwise, true.
+			 */
+			bool TryPush(T&& item)
+			{
+				Cell* cell = nullptr;
+				size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+				while (true)
+				{
+					cell = &m_cells[pos & m_mask];
+					const size_t seq = cell->m_seq.load(std::memory_order_acquire);
+					const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+					if (diff == 0)
+					{
+						if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+						{
+							break;
+						}
+					}
+					else if (diff < 0)
+					{
+						return false; //The cell hasn't been consumed since the last lap.
+					}
+					else
+					{
+						pos = m_enqueuePos.load(std::memory_order_relaxed);
+					}
+				}
+
+				cell->m_item = std::forward<T>(item);
+				cell->m_seq.store(pos + 1, std::memory_order_release);
+
+				return true;
+			}
+
+			/**
+			 * \brief	Try to pop an item from the ring.
+			 *
+			 * \param [out]	item	The item popped.
+			 *
+			 * \return	False if the ring is empty; otherwise, true.
+			 */
+			bool TryPop(T& item)
+			{
+				Cell* cell = nullptr;
+				size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+				while (true)
+				{
+					cell = &m_cells[pos & m_mask];
+					const size_t seq = cell->m_seq.load(std::memory_order_acquire);
+					const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+					if (diff == 0)
+					{
+						if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+						{
+							break;
+						}
+					}
+					else if (diff < 0)
+					{
+						return false; //The cell hasn't been produced in this lap.
+					}
+					else
+					{
+						pos = m_dequeuePos.load(std::memory_order_relaxed);
+					}
+				}
+
+				item = std::move(cell->m_item);
+				cell->m_seq.store(pos + m_mask + 1, std::memory_order_release);
+
+				return true;
+			}
+
+			size_t GetCapacity() const
+			{
+				return m_mask + 1;
+			}
+
+		private:
+			/** \brief	Size of a cache line, used to keep the two positions from sharing one. */
+			static constexpr size_t sk_cacheLineSize = 64;
+
+			struct Cell
+			{
+				std::atomic<size_t> m_seq;
+				T m_item;
+			};
+
+			static size_t RoundUpPow2(size_t val)
+			{
+				size_t res = 1;
+				while (res < val)
+				{
+					res <<= 1;
+				}
+				return res;
+			}
+
+			const size_t m_mask;
+			std::unique_ptr<Cell[]> m_cells;
+
+			char m_pad0[sk_cacheLineSize];
+			std::atomic<size_t> m_enqueuePos;
+			char m_pad1[sk_cacheLineSize - sizeof(std::atomic<size_t>)];
+			std::atomic<size_t> m_dequeuePos;
+			char m_pad2[sk_cacheLineSize - sizeof(std::atomic<size_t>)];
+		};
+	}
+}
@@ -1,8 +1,11 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 #include <cstdint>
 
+#include "TaskPool.h"
+
 namespace Decent
 {
 	namespace Dht
@@ -61,6 +64,14 @@ namespace Decent
 			 */
 			virtual void SetImmediatePredecessor(NodeBasePtr pred) = 0;
 
+			/**
+			 * \brief	Gets the membership list of this node, i.e. all nodes in the network known to it,
+			 * 			including itself. Only kept in one-hop routing mode.
+			 *
+			 * \return	The nodes; empty if this node doesn't keep the membership list.
+			 */
+			virtual std::vector<NodeBasePtr> GetMembers() = 0;
+
 			/**
 			 * \brief	Called when a new node is joining the existing network, and this node possibly need
 			 * 			to update its finger table according to that new node. This function will forward the
@@ -96,6 +107,77 @@ namespace Decent
 			 */
 			virtual const AddrType& GetAddress() const = 0;
 
+			/**
+			 * \brief	Asynchronous version of FindSuccessor(), which is run on the given task pool. This
+			 * 			node must outlive the task.
+			 *
+			 * \param	key			Key to lookup.
+			 * \param	taskPool	The task pool.
+			 *
+			 * \return	The future of the found successor.
+			 */
+			virtual std::shared_ptr<TaskFuture<NodeBasePtr> > FindSuccessorAsync(const IdType& key, TaskPool& taskPool)
+			{
+				return RunAsync<NodeBasePtr>(taskPool, [this, key]()
+				{
+					return this->FindSuccessor(key);
+				});
+			}
+
+			/**
+			 * \brief	Asynchronous version of FindPredecessor(), which is run on the given task pool. This
+			 * 			node must outlive the task.
+			 *
+			 * \param	key			Key to lookup.
+			 * \param	taskPool	The task pool.
+			 *
+			 * \return	The future of the found predecessor.
+			 */
+			virtual std::shared_ptr<TaskFuture<NodeBasePtr> > FindPredecessorAsync(const IdType& key, TaskPool& taskPool)
+			{
+				return RunAsync<NodeBasePtr>(taskPool, [this, key]()
+				{
+					return this->FindPredecessor(key);
+				});
+			}
+
+			/**
+			 * \brief	Asynchronous version of UpdateFingerTable(), which is run on the given task pool.
+			 * 			This node must outlive the task.
+			 *
+			 * \param	s			Pointer to the new node.
+			 * \param	i			Row of the finger table that needs to be checked.
+			 * \param	taskPool	The task pool.
+			 *
+			 * \return	The future of the call.
+			 */
+			virtual std::shared_ptr<TaskFuture<void> > UpdateFingerTableAsync(NodeBasePtr s, uint64_t i, TaskPool& taskPool)
+			{
+				return RunAsync<void>(taskPool, [this, s, i]() mutable
+				{
+					this->UpdateFingerTable(s, i);
+				});
+			}
+
+			/**
+			 * \brief	Asynchronous version of DeUpdateFingerTable(), which is run on the given task pool.
+			 * 			This node must outlive the task.
+			 *
+			 * \param	oldId   	ID of the leaving node.
+			 * \param	succ		Pointer to the successor of the leaving node.
+			 * \param	i			Row of the finger table that needs to be checked.
+			 * \param	taskPool	The task pool.
+			 *
+			 * \return	The future of the call.
+			 */
+			virtual std::shared_ptr<TaskFuture<void> > DeUpdateFingerTableAsync(const IdType& oldId, NodeBasePtr succ, uint64_t i, TaskPool& taskPool)
+			{
+				return RunAsync<void>(taskPool, [this, oldId, succ, i]() mutable
+				{
+					this->DeUpdateFingerTable(oldId, succ, i);
+				});
+			}
+
 		};
 	}
 }
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <cstdint>
+
+#include <map>
+#include <array>
+#include <mutex>
+#include <stdexcept>
+
+namespace Decent
+{
+	namespace Dht
+	{
+		/**
+		 * \brief	Header of replies to owner-checked data operations (see EncFunc::App::k_getDataOwned,
+		 * 			k_setDataOwned, and k_delDataOwned). It always carries the ownership interval of the
+		 * 			serving node, i.e. (predecessor ID, node ID], as seen by that node.
+		 */
+		template<size_t KeySizeByte>
+		struct OwnershipReply
+		{
+			/**
+			 * \brief	1 if the node owns the key and the operation is done (for a GET, the value follows
+			 * 			the header); 0 if the node doesn't own the key, in which case the operation is not
+			 * 			done, and the app is redirected.
+			 */
+			uint8_t m_isServed;
+			uint8_t m_pad[7];
+			std::array<uint8_t, KeySizeByte> m_predId;
+			std::array<uint8_t, KeySizeByte> m_nodeId;
+			uint64_t m_nodeAddr;
+
+			/** \brief	Only used if not served; the node, closer to the owner, the app should try next. */
+			uint64_t m_redirectAddr;
+		};
+
+		/**
+		 * \brief	A client-side cache of ownership intervals of DHT nodes, learned from replies to owner-
+		 * 			checked data operations, so that data operations can be sent to the owner of the key
+		 * 			directly, rather than after a lookup. Cached intervals never overlap; an interval
+		 * 			learned later replaces the ones it overlaps, since the membership must have changed.
+		 *
+		 * \tparam	IdType	Type of the ID; must be ordered.
+		 */
+		template<typename IdType>
+		class OwnershipCache
+		{
+		public:
+			OwnershipCache() :
+				m_mutex(),
+				m_intervals()
+			{}
+
+			/** \brief	Destructor */
+			virtual ~OwnershipCache()
+			{}
+
+			/**
+			 * \brief	Looks up the owner of the key.
+			 *
+			 * \param 	   	key 	The key.
+			 * \param [out]	addr	The address of the owner.
+			 *
+			 * \return	True if the key falls in a cached interval; otherwise, false.
+			 */
+			bool Find(const IdType& key, uint64_t& addr) const
+			{
+				std::unique_lock<std::mutex> intervalsLock(m_mutex);
+				if (m_intervals.size() == 0)
+				{
+					return false;
+				}
+
+				//Intervals are keyed by their ends, so the only candidate is the first one ending at or
+				//after the key; the interval wrapping around the ring has the smallest end.
+				auto it = m_intervals.lower_bound(key);
+				if (it == m_intervals.end())
+				{
+					it = m_intervals.begin();
+				}
+
+				if (!IsWithin(key, it->second.m_predId, it->first))
+				{
+					return false;
+				}
+				addr = it->second.m_addr;
+				return true;
+			}
+
+			/**
+			 * \brief	Caches the ownership interval of a node.
+			 *
+			 * \param	predId	The ID of the node's predecessor, exclusive.
+			 * \param	nodeId	The ID of the node, inclusive.
+			 * \param	addr  	The address of the node.
+			 */
+			void Update(const IdType& predId, const IdType& nodeId, uint64_t addr)
+			{
+				std::unique_lock<std::mutex> intervalsLock(m_mutex);
+
+				for (auto it = m_intervals.begin(); it != m_intervals.end(); )
+				{
+					if (IsWithin(it->first, predId, nodeId) || IsWithin(nodeId, it->second.m_predId, it->first))
+					{
+						it = m_intervals.erase(it);
+					}
+					else
+					{
+						++it;
+					}
+				}
+
+				Interval& interval = m_intervals[nodeId];
+				interval.m_predId = predId;
+				interval.m_addr = addr;
+			}
+
+			/**
+			 * \brief	Removes the interval the key falls in, if there is any.
+			 *
+			 * \param	key	The key.
+			 */
+			void Invalidate(const IdType& key)
+			{
+				std::unique_lock<std::mutex> intervalsLock(m_mutex);
+				if (m_intervals.size() == 0)
+				{
+					return;
+				}
+
+				auto it = m_intervals.lower_bound(key);
+				if (it == m_intervals.end())
+				{
+					it = m_intervals.begin();
+				}
+
+				if (IsWithin(key, it->second.m_predId, it->first))
+				{
+					m_intervals.erase(it);
+				}
+			}
+
+			/** \brief	Removes all intervals. */
+			void Clear()
+			{
+				std::unique_lock<std::mutex> intervalsLock(m_mutex);
+				m_intervals.clear();
+			}
+
+		private:
+			struct Interval
+			{
+				IdType m_predId;
+				uint64_t m_addr;
+			};
+
+			/**
+			 * \brief	Query if v is within the circular interval (start, end]. If start equals end, the
+			 * 			interval covers the entire ring, i.e. there is only one node.
+			 */
+			static bool IsWithin(const IdType& v, const IdType& start, const IdType& end)
+			{
+				return (start < end) ? (start < v && !(end < v)) : (start < v || !(end < v));
+			}
+
+			mutable std::mutex m_mutex;
+			std::map<IdType, Interval> m_intervals;
+		};
+
+		/**
+		 * \brief	Sends an owner-checked data operation to the owner of the key, as known by the cache,
+		 * 			and follows redirects until a node serves it. The cache is updated with every interval
+		 * 			carried by replies; if the cached owner redirects the operation, the cached interval
+		 * 			is replaced by the (newer) one of that node.
+		 *
+		 * \exception	std::runtime_error	Thrown when a node redirects the operation to itself, or the
+		 * 									number of redirects exceeds the limit.
+		 *
+		 * \tparam	KeySizeByte	Size of the key, in bytes.
+		 * \tparam	IdType	   	Type of the ID; must be constructible from std::array<uint8_t, KeySizeByte>.
+		 * \tparam	OpFuncT	   	Type of the operation function, which sends the operation on the key to
+		 * 						the node at the given address, and receives the reply header (and, if
+		 * 						served, the rest of the reply). Must have the form of
+		 * 						"OwnershipReply<KeySizeByte> FuncName(uint64_t addr)".
+		 * \param [in,out]	cache	   	The ownership cache.
+		 * \param 		  	key		   	The key.
+		 * \param 		  	defaultAddr	The address of the node to try on cache misses, e.g. the one
+		 * 								found by a lookup, or any known node.
+		 * \param 		  	opFunc	   	The operation function.
+		 * \param 		  	maxRedirects	The maximum number of redirects to follow.
+		 *
+		 * \return	The reply of the node that has served the operation.
+		 */
+		template<size_t KeySizeByte, typename IdType, typename OpFuncT>
+		OwnershipReply<KeySizeByte> OwnerCheckedOp(OwnershipCache<IdType>& cache, const IdType& key, uint64_t defaultAddr, OpFuncT opFunc, size_t maxRedirects)
+		{
+			uint64_t addr = defaultAddr;
+			cache.Find(key, addr);
+
+			for (size_t i = 0; i <= maxRedirects; ++i)
+			{
+				OwnershipReply<KeySizeByte> reply = opFunc(addr);
+				cache.Update(IdType(reply.m_predId), IdType(reply.m_nodeId), reply.m_nodeAddr);
+				if (reply.m_isServed)
+				{
+					return reply;
+				}
+
+				if (reply.m_redirectAddr == addr)
+				{
+					throw std::runtime_error("The node redirects the data operation to itself.");
+				}
+				addr = reply.m_redirectAddr;
+			}
+
+			throw std::runtime_error("The data operation exceeds the maximum number of redirects.");
+		}
+	}
+}
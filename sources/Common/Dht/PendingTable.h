@@ -0,0 +1,198 @@
+#pragma once
+
+#include <cstdint>
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <utility>
+
+namespace Decent
+{
+	namespace Dht
+	{
+		/**
+		 * \brief	A bounded table of pending requests, which are waiting for replies. Entries are kept in
+		 * 			a fixed number of slots, partitioned into shards, each with its own lock.
+		 *
+		 * 			The ID of an entry is the index of its slot (lower 32 bits) tagged with the generation
+		 * 			of the slot (higher 32 bits). The generation is bumped every time the slot is freed,
+		 * 			so a late reply carrying the ID of an expired entry never matches a newer entry that
+		 * 			reuses the slot. IDs are never zero.
+		 *
+		 * \tparam	T	Type of the item.
+		 */
+		template<typename T>
+		class PendingTable
+		{
+		public:
+			typedef std::pair<uint64_t, std::unique_ptr<T> > EntryType;
+
+		public:
+			PendingTable() = delete;
+
+			/**
+			 * \brief	Constructor
+			 *
+			 * \param	shardNum	 	Number of shards.
+			 * \param	slotsPerShard	Number of slots in each shard.
+			 */
+			PendingTable(size_t shardNum, size_t slotsPerShard) :
+				m_slotsPerShard(slotsPerShard > 0 ? slotsPerShard : 1),
+				m_shards(),
+				m_nextShard(0)
+			{
+				for (size_t i = 0; i < (shardNum > 0 ? shardNum : 1); ++i)
+				{
+					m_shards.push_back(std::unique_ptr<Shard>(new Shard(m_slotsPerShard)));
+				}
+			}
+
+			/** \brief	Destructor */
+			virtual ~PendingTable()
+			{}
+
+			/**
+			 * \brief	Inserts an item.
+			 *
+			 * \param [in] 	item	 	The item, whose ownership will be moved in if it's inserted.
+			 * \param 	   	deadline	The time after which the entry is expired.
+			 * \param [out]	id		 	The ID of the entry.
+			 *
+			 * \return	False if all slots are in use, in which case the item is left untouched;
+			 * 			otherwise, true.
+			 */
+			bool Insert(std::unique_ptr<T>&& item, uint64_t deadline, uint64_t& id)
+			{
+				const size_t firstShard = m_nextShard++;
+				for (size_t i = 0; i < m_shards.size(); ++i)
+				{
+					const size_t shardIdx = (firstShard + i) % m_shards.size();
+					Shard& shard = *m_shards[shardIdx];
+
+					std::unique_lock<std::mutex> shardLock(shard.m_mutex);
+					if (shard.m_freeSlots.size() == 0)
+					{
+						continue;
+					}
+
+					const uint32_t slotIdx = shard.m_freeSlots.back();
+					shard.m_freeSlots.pop_back();
+
+					Slot& slot = shard.m_slots[slotIdx];
+					slot.m_deadline = deadline;
+					slot.m_item = std::move(item);
+
+					id = (static_cast<uint64_t>(slot.m_gen) << 32) | static_cast<uint64_t>((shardIdx * m_slotsPerShard) + slotIdx);
+					return true;
+				}
+
+				return false;
+			}
+
+			/**
+			 * \brief	Removes an entry and returns its item.
+			 *
+			 * \param	id	The ID of the entry.
+			 *
+			 * \return	Null if the entry is not found, e.g. it has expired; otherwise, the item.
+			 */
+			std::unique_ptr<T> Take(uint64_t id)
+			{
+				const uint32_t gen = static_cast<uint32_t>(id >> 32);
+				const size_t globalIdx = static_cast<size_t>(id & 0xFFFFFFFFULL);
+				if (globalIdx >= m_shards.size() * m_slotsPerShard)
+				{
+					return nullptr;
+				}
+
+				Shard& shard = *m_shards[globalIdx / m_slotsPerShard];
+				const uint32_t slotIdx = static_cast<uint32_t>(globalIdx % m_slotsPerShard);
+
+				std::unique_lock<std::mutex> shardLock(shard.m_mutex);
+				Slot& slot = shard.m_slots[slotIdx];
+				if (slot.m_gen != gen || !slot.m_item)
+				{
+					return nullptr;
+				}
+
+				return FreeSlot(shard, slotIdx);
+			}
+
+			/**
+			 * \brief	Removes all entries expired by the given time.
+			 *
+			 * \param 	   	now	   	The current time.
+			 * \param [out]	expired	The expired entries; appended at the end.
+			 */
+			void TakeExpired(uint64_t now, std::vector<EntryType>& expired)
+			{
+				for (size_t shardIdx = 0; shardIdx < m_shards.size(); ++shardIdx)
+				{
+					Shard& shard = *m_shards[shardIdx];
+
+					std::unique_lock<std::mutex> shardLock(shard.m_mutex);
+					for (uint32_t slotIdx = 0; slotIdx < shard.m_slots.size(); ++slotIdx)
+					{
+						Slot& slot = shard.m_slots[slotIdx];
+						if (slot.m_item && slot.m_deadline <= now)
+						{
+							const uint64_t id = (static_cast<uint64_t>(slot.m_gen) << 32) | static_cast<uint64_t>((shardIdx * m_slotsPerShard) + slotIdx);
+							expired.push_back(std::make_pair(id, FreeSlot(shard, slotIdx)));
+						}
+					}
+				}
+			}
+
+		private:
+			struct Slot
+			{
+				uint32_t m_gen;
+				uint64_t m_deadline;
+				std::unique_ptr<T> m_item;
+
+				Slot() :
+					m_gen(1),
+					m_deadline(0),
+					m_item()
+				{}
+			};
+
+			struct Shard
+			{
+				std::mutex m_mutex;
+				std::vector<Slot> m_slots;
+				std::vector<uint32_t> m_freeSlots;
+
+				Shard(size_t slotNum) :
+					m_mutex(),
+					m_slots(slotNum),
+					m_freeSlots()
+				{
+					m_freeSlots.reserve(slotNum);
+					for (size_t i = slotNum; i > 0; --i)
+					{
+						m_freeSlots.push_back(static_cast<uint32_t>(i - 1));
+					}
+				}
+			};
+
+			/** \brief	Frees a slot in use; assume the shard has been locked. */
+			static std::unique_ptr<T> FreeSlot(Shard& shard, uint32_t slotIdx)
+			{
+				Slot& slot = shard.m_slots[slotIdx];
+
+				std::unique_ptr<T> res = std::move(slot.m_item);
+				slot.m_gen = (slot.m_gen == UINT32_MAX) ? 1 : (slot.m_gen + 1);
+				shard.m_freeSlots.push_back(slotIdx);
+
+				return res;
+			}
+
+			const size_t m_slotsPerShard;
+			std::vector<std::unique_ptr<Shard> > m_shards;
+			std::atomic<size_t> m_nextShard;
+		};
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+namespace Decent
+{
+	namespace Dht
+	{
+		/**
+		 * \brief	Results of processing a request on a connection, returned by the enclave to the host,
+		 * 			which tell the host what to do with the connection next.
+		 */
+		namespace ProcResult
+		{
+			typedef int NumType;
+
+			/** \brief	The request is done; the next request on the connection is served as usual. */
+			constexpr NumType k_done = 0;
+
+			/**
+			 * \brief	The connection is held by the enclave until the result is ready, at which time it's
+			 * 			released through ocall_decent_dht_release_held_cnt, with one of the other results.
+			 */
+			constexpr NumType k_held = 1;
+
+			/** \brief	The connection should be closed. */
+			constexpr NumType k_close = 2;
+
+			/**
+			 * \brief	The enclave keeps the TLS session of the connection for the next message. The host
+			 * 			waits, outside the enclave, until data arrive on the connection, and then passes it
+			 * 			to ecall_decent_dht_proc_session_msg, which returns one of these results again. If
+			 * 			the connection is closed, or idle for too long, the host must call
+			 * 			ecall_decent_dht_close_session before the connection is destroyed.
+			 */
+			constexpr NumType k_session = 3;
+		}
+	}
+}
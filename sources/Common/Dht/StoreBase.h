@@ -2,21 +2,51 @@
 
 #include <cstdint>
 
+#include <array>
+#include <string>
 #include <vector>
 #include <map>
 #include <mutex>
+#include <memory>
+#include <functional>
 
 #include <DecentApi/Common/RuntimeException.h>
 
+#include "TaskPool.h"
+#include "BoundedQueue.h"
+#include "ValueCache.h"
+
 namespace Decent
 {
 	namespace Dht
 	{
-		template<typename IdType, typename AddrType>
+		/**
+		 * \brief	Base of the DHT store, which keeps the index of keys stored.
+		 *
+		 * \tparam	IdType 	Type of the key.
+		 * \tparam	AddrType	Type of the node address.
+		 * \tparam	TagSize 	Size of the tag generated by the storage for each value. Tags are kept
+		 * 					inline in the index, so that no separate allocation is needed per key.
+		 */
+		template<typename IdType, typename AddrType, size_t TagSize>
 		class StoreBase
 		{
 		public: //static member:
-			typedef std::map<IdType, std::vector<uint8_t> > IndexingType;
+			typedef std::array<uint8_t, TagSize> TagType;
+
+			typedef std::map<IdType, TagType> IndexingType;
+
+			/**
+			 * \brief	Type of the callback function used to receive each migrated key-value pair. Must
+			 * 			have the form of "void FuncName(const IdType&amp; key, const std::vector&lt;uint8_t&gt;&amp; data)".
+			 */
+			typedef std::function<void(const IdType&, const std::vector<uint8_t>&)> MigrateCallbackType;
+
+			/** \brief	The maximum number of key-value pairs buffered between two stages of the migration pipeline. */
+			static constexpr size_t sk_migratePipelineDepth = 64;
+
+			/** \brief	The maximum number of received key-value pairs saved to storage at once during migration. */
+			static constexpr size_t sk_migrateSaveBatchSize = 64;
 
 		public:
 			StoreBase() = delete;
@@ -25,7 +55,8 @@ namespace Decent
 				m_ringStart(ringStart),
 				m_ringEnd(ringEnd),
 				m_indexingMutex(),
-				m_indexing()
+				m_indexing(),
+				m_valueCache(0)
 			{}
 
 			virtual ~StoreBase()
@@ -45,29 +76,12 @@ namespace Decent
 			template<typename SendFuncT, typename SendNumFuncT>
 			void SendMigratingData(SendFuncT sendFunc, SendNumFuncT sendNumFunc, const IndexingType& sendIndexing)
 			{
-				static constexpr uint8_t hasData2Send = 1;
-				static constexpr uint8_t noData2Send = 0;
-
-				for (auto it = sendIndexing.begin(); it != sendIndexing.end(); ++it)
+				for (const auto& item : MigrateDataFiles(sendIndexing))
 				{
-					std::vector<uint8_t> data;
-					try
-					{
-						data = MigrateOneDataFile(it->first, it->second);
-					}
-					catch (const std::exception&)
-					{
-						continue;
-					}
-					uint64_t sizeOfData = static_cast<uint64_t>(data.size());
-
-					sendFunc(&hasData2Send, sizeof(hasData2Send)); //1. Yes, we have data to send.
-					sendNumFunc(it->first);                        //2. Send Key of the data.
-					sendFunc(&sizeOfData, sizeof(sizeOfData));     //3. Send size of data.
-					sendFunc(data.data(), data.size());            //4. Send data. - Done!
+					SendOneMigratingData(sendFunc, sendNumFunc, item.first, item.second);
 				}
 
-				sendFunc(&noData2Send, sizeof(noData2Send));       //5. Stop.
+				SendMigratingStop(sendFunc);
 			}
 
 			/**
@@ -85,7 +99,46 @@ namespace Decent
 			template<typename SendFuncT, typename SendNumFuncT>
 			void SendMigratingData(SendFuncT sendFunc, SendNumFuncT sendNumFunc, const IdType& start, const IdType& end)
 			{
-				SendMigratingData(sendFunc, sendNumFunc, DeleteIndexing(start, end));
+				MigrateRange(start, end,
+					[&sendFunc, &sendNumFunc, this](const IdType& key, const std::vector<uint8_t>& data)
+				{
+					SendOneMigratingData(sendFunc, sendNumFunc, key, data);
+				});
+
+				SendMigratingStop(sendFunc);
+			}
+
+			/**
+			 * \brief	Migrate a range of data to send to the remote DHT store, where reading and unsealing
+			 * 			the data runs on a worker from the task pool, overlapped with sending the data on the
+			 * 			calling thread. If there is no idle worker in the pool, it falls back to the
+			 * 			sequential version. If either sending or reading fails, the migration is aborted
+			 * 			without the stop mark, so the receiver doesn't take it as complete, and data that
+			 * 			have not been passed to the send function are kept in this store.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the migration is aborted.
+			 *
+			 * \tparam	SendFuncT   	Type of the send function t. Must have the form of
+			 * 							"void FuncName(const void* buf, size_t size)".
+			 * \tparam	SendNumFuncT	Type of the send function t for sending key numbers.
+			 * 							Must have the form of "void FuncName(const IdType&amp; key)".
+			 * \param	sendFunc   	The send function for sending data.
+			 * \param	sendNumFunc	The send function for sending key number value.
+			 * \param	start	   	The start position on the ring (INclusive).
+			 * \param	end		   	The end position on the ring (EXclusive).
+			 * \param	taskPool   	The task pool.
+			 */
+			template<typename SendFuncT, typename SendNumFuncT>
+			void SendMigratingData(SendFuncT sendFunc, SendNumFuncT sendNumFunc, const IdType& start, const IdType& end, TaskPool& taskPool)
+			{
+				const IdType startCopy(start);
+				const IdType endCopy(end);
+
+				SendMigratingPipelined(sendFunc, sendNumFunc, taskPool,
+					[this, startCopy, endCopy](const MigrateCallbackType& callback)
+				{
+					MigrateRange(startCopy, endCopy, callback);
+				});
 			}
 
 			/**
@@ -101,12 +154,34 @@ namespace Decent
 			template<typename SendFuncT, typename SendNumFuncT>
 			void SendMigratingDataAll(SendFuncT sendFunc, SendNumFuncT sendNumFunc)
 			{
-				IndexingType indexing;
+				MigrateAll([&sendFunc, &sendNumFunc, this](const IdType& key, const std::vector<uint8_t>& data)
 				{
-					std::unique_lock<std::mutex> indexingLock(m_indexingMutex);
-					indexing.swap(m_indexing);
-				}
-				SendMigratingData(sendFunc, sendNumFunc, indexing);
+					SendOneMigratingData(sendFunc, sendNumFunc, key, data);
+				});
+
+				SendMigratingStop(sendFunc);
+			}
+
+			/**
+			 * \brief	Migrates all data to send to the remote DHT store, in a pipelined way. See
+			 * 			SendMigratingData for details.
+			 *
+			 * \tparam	SendFuncT   	Type of the send function t. Must have the form of "void
+			 * 							FuncName(const void* buf, size_t size)".
+			 * \tparam	SendNumFuncT	Type of the send function t for sending key numbers. Must have the
+			 * 							form of "void FuncName(const IdType&amp; key)".
+			 * \param	sendFunc   	The send function for sending data.
+			 * \param	sendNumFunc	The send function for sending key number value.
+			 * \param	taskPool   	The task pool.
+			 */
+			template<typename SendFuncT, typename SendNumFuncT>
+			void SendMigratingDataAll(SendFuncT sendFunc, SendNumFuncT sendNumFunc, TaskPool& taskPool)
+			{
+				SendMigratingPipelined(sendFunc, sendNumFunc, taskPool,
+					[this](const MigrateCallbackType& callback)
+				{
+					MigrateAll(callback);
+				});
 			}
 
 			/**
@@ -116,35 +191,95 @@ namespace Decent
 			 * 							"void FuncName(void* buf, size_t size)".
 			 * \tparam	RecvNumFuncT	Type of the receive function t for receiving key number value.
 			 * 							Must have the form of "IdType FuncName()"
+			 * \exception	Decent::RuntimeException	Thrown when any of the data received fails to be
+			 * 												saved, after the rest of them are saved.
+			 *
 			 * \param	recvFunc   	The receive function for receiving data.
 			 * \param	recvNumFunc	The receive function for receiving key number value.
 			 */
 			template<typename RecvFuncT, typename RecvNumFuncT>
 			void RecvMigratingData(RecvFuncT recvFunc, RecvNumFuncT recvNumFunc)
 			{
-				static constexpr uint8_t hasData2Recv = 1;
-				//static constexpr uint8_t noData2Recv = 0;
-
-				uint8_t hasData = 0;
-				recvFunc(&hasData, sizeof(hasData)); //1. Do we have data to receive?
+				std::vector<MigrateItemType> saveBatch;
+				size_t failedNum = 0;
 
-				uint64_t sizeOfData = 0;
-				while (hasData == hasData2Recv)
+				RecvMigratingItems(recvFunc, recvNumFunc,
+					[this, &saveBatch, &failedNum](IdType& key, std::vector<uint8_t>& data)
 				{
-					IdType key = recvNumFunc();                //2. Receive key of the data.
-					recvFunc(&sizeOfData, sizeof(sizeOfData)); //3. Receive size of data.
-					std::vector<uint8_t> data(sizeOfData);
-					recvFunc(data.data(), data.size());        //4. Receive data. - Done!
+					saveBatch.push_back(std::make_pair(std::move(key), std::move(data)));
+					if (saveBatch.size() >= sk_migrateSaveBatchSize)
+					{
+						failedNum += SaveMigratedData(saveBatch);
+					}
+				});
 
-					try
+				failedNum += SaveMigratedData(saveBatch);
+				CheckMigratedDataSaved(failedNum);
+			}
+
+			/**
+			 * \brief	Receive migrating data from remote DHT store, where sealing and storing the data
+			 * 			runs on a worker from the task pool, overlapped with receiving the data on the
+			 * 			calling thread. If there is no idle worker in the pool, it falls back to the
+			 * 			sequential version. It returns after all data received is stored.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when any of the data received fails to be
+			 * 												saved, after the rest of them are saved.
+			 *
+			 * \tparam	RecvFuncT   	Type of the receive function t. Must have the form of
+			 * 							"void FuncName(void* buf, size_t size)".
+			 * \tparam	RecvNumFuncT	Type of the receive function t for receiving key number value.
+			 * 							Must have the form of "IdType FuncName()"
+			 * \param	recvFunc   	The receive function for receiving data.
+			 * \param	recvNumFunc	The receive function for receiving key number value.
+			 * \param	taskPool   	The task pool.
+			 */
+			template<typename RecvFuncT, typename RecvNumFuncT>
+			void RecvMigratingData(RecvFuncT recvFunc, RecvNumFuncT recvNumFunc, TaskPool& taskPool)
+			{
+				std::shared_ptr<MigrateQueueType> queue = std::make_shared<MigrateQueueType>(sk_migratePipelineDepth);
+				std::shared_ptr<TaskLatch> storeLatch = std::make_shared<TaskLatch>();
+				std::shared_ptr<size_t> failedNum = std::make_shared<size_t>(0); //Read once storeLatch is released.
+
+				bool isAsync = taskPool.TryRunAsync([this, queue, storeLatch, failedNum]()
+				{
+					std::vector<MigrateItemType> saveBatch;
+					MigrateItemType item;
+					while (queue->Pop(item))
 					{
-						SetValue(key, data);
+						saveBatch.push_back(std::move(item));
+						if (saveBatch.size() >= sk_migrateSaveBatchSize)
+						{
+							*failedNum += SaveMigratedData(saveBatch);
+						}
 					}
-					catch (const std::exception&)
-					{}
+					*failedNum += SaveMigratedData(saveBatch);
+					storeLatch->Release();
+				});
 
-					recvFunc(&hasData, sizeof(hasData));       //1. Do we have more data to receive?
+				if (!isAsync)
+				{
+					return RecvMigratingData(recvFunc, recvNumFunc);
+				}
+
+				try
+				{
+					RecvMigratingItems(recvFunc, recvNumFunc,
+						[&queue](IdType& key, std::vector<uint8_t>& data)
+					{
+						queue->Push(std::make_pair(std::move(key), std::move(data)));
+					});
+				}
+				catch (const std::exception&)
+				{
+					queue->Close();
+					storeLatch->Wait();
+					throw;
 				}
+
+				queue->Close();
+				storeLatch->Wait();
+				CheckMigratedDataSaved(*failedNum);
 			}
 
 			virtual bool IsResponsibleFor(const IdType& key) const = 0;
@@ -156,11 +291,39 @@ namespace Decent
 					throw Decent::RuntimeException("This server is not resposible for queried key.");
 				}
 
-				std::vector<uint8_t> tag = SaveDataFile(key, data);
+				TagType tag = SaveDataFile(key, data);
 
 				{
 					std::unique_lock<std::mutex> indexingLock(m_indexingMutex);
-					m_indexing.insert(std::make_pair(IdType(key), std::move(tag)));
+					PutIndex(key, tag);
+				}
+				m_valueCache.Invalidate(key);
+			}
+
+			/**
+			 * \brief	Sets values for multiple keys, where the data are saved to storage in one batch.
+			 * 			Each value is saved on its own, so the values saved are set even if others fail.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when this server is not responsible for any of
+			 * 												the keys, in which case nothing is set; or when
+			 * 												any of the values fails to be saved.
+			 *
+			 * \param	items	The list of key-value pairs.
+			 */
+			virtual void SetValues(const std::vector<std::pair<IdType, std::vector<uint8_t> > >& items)
+			{
+				for (const auto& item : items)
+				{
+					if (!IsResponsibleFor(item.first))
+					{
+						throw Decent::RuntimeException("This server is not resposible for queried key.");
+					}
+				}
+
+				const size_t failedNum = IndexSavedDataFiles(items, SaveDataFiles(items));
+				if (failedNum > 0)
+				{
+					throw Decent::RuntimeException("Failed to save " + std::to_string(failedNum) + " of " + std::to_string(items.size()) + " values.");
 				}
 			}
 
@@ -173,8 +336,9 @@ namespace Decent
 
 				{
 					std::unique_lock<std::mutex> indexingLock(m_indexingMutex);
-					m_indexing.erase(key);
+					EraseIndex(key);
 				}
+				m_valueCache.Invalidate(key);
 
 				DeleteDataFile(key);
 			}
@@ -186,32 +350,53 @@ namespace Decent
 					throw Decent::RuntimeException("This server is not resposible for queried key.");
 				}
 
-				std::vector<uint8_t> tag;
+				std::vector<uint8_t> res;
+				if (m_valueCache.Get(key, res))
 				{
-					std::unique_lock<std::mutex> indexingLock(m_indexingMutex);
-					auto it = m_indexing.find(key);
-					if (it == m_indexing.end())
+					return res;
+				}
+				const uint64_t cacheVersion = m_valueCache.GetVersion(key);
+
+				try
+				{
+					TagType tag;
 					{
-						throw Decent::RuntimeException("Queried key-value pair is not found.");
+						std::unique_lock<std::mutex> indexingLock(m_indexingMutex);
+						if (!FindIndex(key, tag))
+						{
+							throw Decent::RuntimeException("Queried key-value pair is not found.");
+						}
 					}
-					tag = it->second;
+
+					res = ReadDataFile(key, tag);
 				}
+				catch (const std::exception&)
+				{
+					m_valueCache.Release(key, cacheVersion);
+					throw;
+				}
+				m_valueCache.Put(key, res, cacheVersion);
 
-				return ReadDataFile(key, tag);
+				return res;
 			}
 
 		protected:
 
+			/** \brief	Gets the cache of values for hot keys, which is disabled until a budget is set. */
+			ValueCache<IdType>& GetValueCache()
+			{
+				return m_valueCache;
+			}
+
 			/**
 			 * \brief	Saves the data to storage. NOTE: this function should only interact with file system.
 			 *
 			 * \param	key 	The key.
 			 * \param	data	The data.
 			 *
-			 * \return	The tag for the data stored in std::vector&lt;uint8_t&gt;. The tag is generated for
-			 * 			verification later.
+			 * \return	The tag for the data. The tag is generated for verification later.
 			 */
-			virtual std::vector<uint8_t> SaveDataFile(const IdType& key, const std::vector<uint8_t>& data) = 0;
+			virtual TagType SaveDataFile(const IdType& key, const std::vector<uint8_t>& data) = 0;
 
 			/**
 			 * \brief	Delete the data file from the file system. NOTE: this function should only interact
@@ -232,7 +417,7 @@ namespace Decent
 			 *
 			 * \return	The data.
 			 */
-			virtual std::vector<uint8_t> ReadDataFile(const IdType& key, const std::vector<uint8_t>& tag) = 0;
+			virtual std::vector<uint8_t> ReadDataFile(const IdType& key, const TagType& tag) = 0;
 
 			/**
 			 * \brief	Migrate (i.e. read and delete) one key-value pair from the file system. NOTE: this
@@ -245,7 +430,110 @@ namespace Decent
 			 *
 			 * \return	The data in std::vector&lt;uint8_t&gt;
 			 */
-			virtual std::vector<uint8_t> MigrateOneDataFile(const IdType& key, const std::vector<uint8_t>& tag) = 0;
+			virtual std::vector<uint8_t> MigrateOneDataFile(const IdType& key, const TagType& tag) = 0;
+
+			/**
+			 * \brief	Saves multiple data to storage. By default, it calls SaveDataFile for each of them;
+			 * 			implementations should override it to save them in as few round trips to the
+			 * 			underlying storage as possible. Each of them is saved on its own, so that the data
+			 * 			saved can still be indexed when others fail. NOTE: this function should only
+			 * 			interact with file system.
+			 *
+			 * \param	items	The list of key-value pairs.
+			 *
+			 * \return	For each of the data, in the same order as the given list, whether it's saved, and
+			 * 			its tag if so.
+			 */
+			virtual std::vector<std::pair<bool, TagType> > SaveDataFiles(const std::vector<std::pair<IdType, std::vector<uint8_t> > >& items)
+			{
+				std::vector<std::pair<bool, TagType> > res(items.size(), std::make_pair(false, TagType()));
+				for (size_t i = 0; i < items.size(); ++i)
+				{
+					try
+					{
+						res[i].second = SaveDataFile(items[i].first, items[i].second);
+						res[i].first = true;
+					}
+					catch (const std::exception&)
+					{}
+				}
+				return res;
+			}
+
+			/**
+			 * \brief	Delete multiple data files from the file system. By default, it calls
+			 * 			DeleteDataFile for each of them. NOTE: this function should only interact with file
+			 * 			system.
+			 *
+			 * \param	keys	The keys.
+			 */
+			virtual void DeleteDataFiles(const std::vector<IdType>& keys)
+			{
+				for (const IdType& key : keys)
+				{
+					DeleteDataFile(key);
+				}
+			}
+
+			/**
+			 * \brief	Reads multiple data from file system. By default, it calls ReadDataFile for each of
+			 * 			them. NOTE: this function should only interact with file system.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when any of the data read is invalid.
+			 *
+			 * \param	keyTags	The list of keys and the tags used to verify the validity of the data.
+			 *
+			 * \return	The data, in the same order as the given list.
+			 */
+			virtual std::vector<std::vector<uint8_t> > ReadDataFiles(const std::vector<std::pair<IdType, TagType> >& keyTags)
+			{
+				std::vector<std::vector<uint8_t> > res;
+				res.reserve(keyTags.size());
+				for (const auto& keyTag : keyTags)
+				{
+					res.push_back(ReadDataFile(keyTag.first, keyTag.second));
+				}
+				return res;
+			}
+
+			/**
+			 * \brief	Migrate (i.e. read and delete) multiple key-value pairs from the file system. By
+			 * 			default, it calls MigrateOneDataFile for each of them. Data that fails the
+			 * 			verification is dropped. NOTE: this function should only interact with file system.
+			 *
+			 * \param	indexing	The indexing of the data to migrate.
+			 *
+			 * \return	The list of key-value pairs migrated.
+			 */
+			virtual std::vector<std::pair<IdType, std::vector<uint8_t> > > MigrateDataFiles(const IndexingType& indexing)
+			{
+				std::vector<std::pair<IdType, std::vector<uint8_t> > > res;
+				for (const auto& item : indexing)
+				{
+					try
+					{
+						res.push_back(std::make_pair(item.first, MigrateOneDataFile(item.first, item.second)));
+					}
+					catch (const std::exception&)
+					{}
+				}
+				return res;
+			}
+
+			/**
+			 * \brief	Migrate (i.e. read and delete) all key-value pairs within a range from the file
+			 * 			system, in as few round trips to the underlying storage as possible. Data that
+			 * 			is not listed in the given indexing, or fails the verification, is dropped. NOTE:
+			 * 			this function should only interact with file system.
+			 *
+			 * \param	start   	The start of the ID range (smallest value, INclusive).
+			 * \param	end			The end of the ID range (largest value, INclusive).
+			 * \param	indexing	The indexing of the data within the range, which has already been
+			 * 						removed from the store's indexing.
+			 * \param	callback	The callback function called once for each migrated key-value pair, in
+			 * 						ascending order of key.
+			 */
+			virtual void MigrateRangeDataFile(const IdType& start, const IdType& end, const IndexingType& indexing, const MigrateCallbackType& callback) = 0;
 
 
 			/**
@@ -261,20 +549,39 @@ namespace Decent
 				std::unique_lock<std::mutex> indexingLock(m_indexingMutex);
 
 				IndexingType res;
+				for (const auto& range : GetNormalOrderRanges(start, end))
+				{
+					DeleteIndexingNormalOrder(res, range.first, range.second);
+				}
+
+				return std::move(res);
+			}
+
+			/**
+			 * \brief	Converts a range on the ring into ranges in normal order (i.e. smallest value to largest value).
+			 *
+			 * \param	start	The start position on the ring (INclusive).
+			 * \param	end  	The end position on the ring (EXclusive).
+			 *
+			 * \return	A list of ranges in normal order, where both ends are INclusive.
+			 */
+			std::vector<std::pair<IdType, IdType> > GetNormalOrderRanges(const IdType& start, const IdType& end) const
+			{
+				std::vector<std::pair<IdType, IdType> > res;
 				if (start > end)
 				{//normal case.
-					DeleteIndexingNormalOrder(res, end + 1, start);
+					res.push_back(std::make_pair(end + 1, start));
 				}
 				else if (end > start)
 				{
 					if (end != m_ringEnd)
 					{
-						DeleteIndexingNormalOrder(res, end + 1, m_ringEnd);
+						res.push_back(std::make_pair(end + 1, m_ringEnd));
 					}
-					DeleteIndexingNormalOrder(res, m_ringStart, start);
+					res.push_back(std::make_pair(m_ringStart, start));
 				}
 
-				return std::move(res);
+				return res;
 			}
 
 			/**
@@ -291,14 +598,413 @@ namespace Decent
 				{
 					res.insert(*it);
 				}
+
+				m_valueCache.InvalidateRange(start, end);
+			}
+
+			/**
+			 * \brief	Finds the tag of a key in the indexing. Assume m_indexingMutex has been locked.
+			 * 			Implementations may override the set of indexing functions to keep the indexing
+			 * 			elsewhere.
+			 *
+			 * \param 	   	key	The key.
+			 * \param [out]	tag	The tag.
+			 *
+			 * \return	True if it's found, otherwise, false.
+			 */
+			virtual bool FindIndex(const IdType& key, TagType& tag)
+			{
+				auto it = m_indexing.find(key);
+				if (it == m_indexing.end())
+				{
+					return false;
+				}
+				tag = it->second;
+				return true;
+			}
+
+			/** \brief	Adds a key to the indexing, or replace its tag. Assume m_indexingMutex has been locked. */
+			virtual void PutIndex(const IdType& key, const TagType& tag)
+			{
+				m_indexing[key] = tag;
+			}
+
+			/** \brief	Erases a key from the indexing. Assume m_indexingMutex has been locked. */
+			virtual void EraseIndex(const IdType& key)
+			{
+				m_indexing.erase(key);
+			}
+
+			/**
+			 * \brief	Removes all keys from the indexing, and returns them. Assume m_indexingMutex has been
+			 * 			locked.
+			 *
+			 * \param [out]	res	All elements removed.
+			 */
+			virtual void ExtractAllIndex(IndexingType& res)
+			{
+				res.swap(m_indexing);
 			}
 
 		private:
+			template<typename SendFuncT, typename SendNumFuncT>
+			void SendOneMigratingData(SendFuncT& sendFunc, SendNumFuncT& sendNumFunc, const IdType& key, const std::vector<uint8_t>& data)
+			{
+				static constexpr uint8_t hasData2Send = 1;
+
+				uint64_t sizeOfData = static_cast<uint64_t>(data.size());
+
+				sendFunc(&hasData2Send, sizeof(hasData2Send)); //1. Yes, we have data to send.
+				sendNumFunc(key);                              //2. Send Key of the data.
+				sendFunc(&sizeOfData, sizeof(sizeOfData));     //3. Send size of data.
+				sendFunc(data.data(), data.size());            //4. Send data. - Done!
+			}
+
+			template<typename SendFuncT>
+			void SendMigratingStop(SendFuncT& sendFunc)
+			{
+				static constexpr uint8_t noData2Send = 0;
+
+				sendFunc(&noData2Send, sizeof(noData2Send));   //5. Stop.
+			}
+
+			typedef std::pair<IdType, std::vector<uint8_t> > MigrateItemType;
+			typedef BoundedQueue<MigrateItemType> MigrateQueueType;
+
+			template<typename RecvFuncT, typename RecvNumFuncT, typename StoreFuncT>
+			void RecvMigratingItems(RecvFuncT& recvFunc, RecvNumFuncT& recvNumFunc, StoreFuncT storeFunc)
+			{
+				static constexpr uint8_t hasData2Recv = 1;
+				//static constexpr uint8_t noData2Recv = 0;
+
+				uint8_t hasData = 0;
+				recvFunc(&hasData, sizeof(hasData)); //1. Do we have data to receive?
+
+				uint64_t sizeOfData = 0;
+				while (hasData == hasData2Recv)
+				{
+					IdType key = recvNumFunc();                //2. Receive key of the data.
+					recvFunc(&sizeOfData, sizeof(sizeOfData)); //3. Receive size of data.
+					std::vector<uint8_t> data(sizeOfData);
+					recvFunc(data.data(), data.size());        //4. Receive data. - Done!
+
+					storeFunc(key, data);
+
+					recvFunc(&hasData, sizeof(hasData));       //1. Do we have more data to receive?
+				}
+			}
+
+			/**
+			 * \brief	Sends the migrating data produced by the fetch function. The fetch function runs on
+			 * 			a worker from the task pool, and passes the data to the sending thread through a
+			 * 			bounded queue. Once sending fails, data not sent are put back into this store; the
+			 * 			item being sent is put back, too, since the receiver may not have it.
+			 *
+			 * \param	fetchFunc	The function that migrates data from storage, and calls the given
+			 * 						callback for each key-value pair.
+			 */
+			template<typename SendFuncT, typename SendNumFuncT>
+			void SendMigratingPipelined(SendFuncT& sendFunc, SendNumFuncT& sendNumFunc, TaskPool& taskPool, std::function<void(const MigrateCallbackType&)> fetchFunc)
+			{
+				std::shared_ptr<MigrateQueueType> queue = std::make_shared<MigrateQueueType>(sk_migratePipelineDepth);
+				std::shared_ptr<std::vector<MigrateItemType> > unsent = std::make_shared<std::vector<MigrateItemType> >();
+				std::shared_ptr<TaskLatch> fetchLatch = std::make_shared<TaskLatch>();
+
+				bool isAsync = taskPool.TryRunAsync([queue, unsent, fetchLatch, fetchFunc]()
+				{
+					try
+					{
+						fetchFunc([&queue, &unsent](const IdType& key, const std::vector<uint8_t>& data)
+						{
+							if (!queue->Push(std::make_pair(key, data)))
+							{
+								//The sender has aborted. The data can't be put back until fetching is done,
+								//otherwise, they are put into the range being migrated.
+								unsent->push_back(std::make_pair(key, data));
+							}
+						});
+						queue->Close();
+					}
+					catch (const std::exception& e)
+					{
+						queue->Abort(e.what());
+					}
+					fetchLatch->Release();
+				});
+
+				if (!isAsync)
+				{
+					return SendMigratingSequential(sendFunc, sendNumFunc, fetchFunc);
+				}
+
+				MigrateItemType item;
+				bool isSending = false;
+				try
+				{
+					while (queue->Pop(item)) //Throws if the fetching stage has failed.
+					{
+						isSending = true;
+						SendOneMigratingData(sendFunc, sendNumFunc, item.first, item.second);
+						isSending = false;
+					}
+				}
+				catch (const std::exception&)
+				{
+					queue->Close(); //Stops the fetching stage from passing more data.
+					fetchLatch->Wait();
+
+					if (isSending)
+					{
+						unsent->push_back(std::move(item));
+					}
+					try
+					{
+						while (queue->Pop(item))
+						{
+							unsent->push_back(std::move(item));
+						}
+					}
+					catch (const std::exception&)
+					{} //The fetching stage has failed, too; the first error is reported.
+
+					RestoreMigratingData(*unsent);
+					throw;
+				}
+
+				SendMigratingStop(sendFunc);
+			}
+
+			/**
+			 * \brief	The sequential version of SendMigratingPipelined(), used when there is no idle worker
+			 * 			in the task pool.
+			 */
+			template<typename SendFuncT, typename SendNumFuncT>
+			void SendMigratingSequential(SendFuncT& sendFunc, SendNumFuncT& sendNumFunc, const std::function<void(const MigrateCallbackType&)>& fetchFunc)
+			{
+				std::vector<MigrateItemType> unsent;
+				bool isSendFailed = false;
+				std::string sendErrMsg;
+
+				try
+				{
+					fetchFunc([this, &sendFunc, &sendNumFunc, &unsent, &isSendFailed, &sendErrMsg](const IdType& key, const std::vector<uint8_t>& data)
+					{
+						if (!isSendFailed)
+						{
+							try
+							{
+								return SendOneMigratingData(sendFunc, sendNumFunc, key, data);
+							}
+							catch (const std::exception& e)
+							{
+								isSendFailed = true;
+								sendErrMsg = e.what();
+							}
+						}
+						unsent.push_back(std::make_pair(key, data));
+					});
+				}
+				catch (const std::exception&)
+				{
+					RestoreMigratingData(unsent);
+					throw;
+				}
+
+				if (isSendFailed)
+				{
+					RestoreMigratingData(unsent);
+					throw Decent::RuntimeException(sendErrMsg);
+				}
+
+				SendMigratingStop(sendFunc);
+			}
+
+			/**
+			 * \brief	Puts migrating data back into this store, after the migration is aborted. They are
+			 * 			kept regardless of the responsibility, since the range may have been handed over
+			 * 			already. Data failed to be saved are dropped, since the migration has failed anyway.
+			 *
+			 * \param	items	The list of key-value pairs.
+			 */
+			void RestoreMigratingData(const std::vector<MigrateItemType>& items) noexcept
+			{
+				if (items.size() == 0)
+				{
+					return;
+				}
+
+				try
+				{
+					IndexSavedDataFiles(items, SaveDataFiles(items));
+				}
+				catch (const std::exception&)
+				{}
+			}
+
+			/**
+			 * \brief	Adds the data saved to the indexing.
+			 *
+			 * \param	items  	The list of key-value pairs passed to SaveDataFiles().
+			 * \param	results	The results returned by SaveDataFiles().
+			 *
+			 * \return	The number of data failed to be saved.
+			 */
+			size_t IndexSavedDataFiles(const std::vector<MigrateItemType>& items, const std::vector<std::pair<bool, TagType> >& results)
+			{
+				size_t failedNum = 0;
+				{
+					std::unique_lock<std::mutex> indexingLock(m_indexingMutex);
+					for (size_t i = 0; i < items.size(); ++i)
+					{
+						if (results[i].first)
+						{
+							PutIndex(items[i].first, results[i].second);
+						}
+						else
+						{
+							++failedNum;
+						}
+					}
+				}
+				for (const auto& item : items)
+				{
+					m_valueCache.Invalidate(item.first);
+				}
+
+				return failedNum;
+			}
+
+			/**
+			 * \brief	Saves a batch of received migrating data, and clears the batch. Data that this
+			 * 			server is not responsible for is dropped.
+			 *
+			 * \return	The number of data failed to be saved; the rest of the batch is saved regardless.
+			 */
+			size_t SaveMigratedData(std::vector<MigrateItemType>& batch)
+			{
+				std::vector<MigrateItemType> responsibleItems;
+				responsibleItems.reserve(batch.size());
+				for (MigrateItemType& item : batch)
+				{
+					if (IsResponsibleFor(item.first))
+					{
+						responsibleItems.push_back(std::move(item));
+					}
+				}
+				batch.clear();
+
+				if (responsibleItems.size() == 0)
+				{
+					return 0;
+				}
+
+				std::vector<std::pair<bool, TagType> > results;
+				try
+				{
+					results = SaveDataFiles(responsibleItems);
+				}
+				catch (const std::exception&)
+				{
+					return responsibleItems.size(); //None of them is saved.
+				}
+
+				return IndexSavedDataFiles(responsibleItems, results);
+			}
+
+			/** \brief	Reports the data failed to be saved at the end of receiving migrating data. */
+			static void CheckMigratedDataSaved(size_t failedNum)
+			{
+				if (failedNum > 0)
+				{
+					throw Decent::RuntimeException("Failed to save " + std::to_string(failedNum) + " migrated key-value pairs.");
+				}
+			}
+
+			void MigrateRange(const IdType& start, const IdType& end, const MigrateCallbackType& callback)
+			{
+				std::vector<std::pair<IdType, IdType> > ranges = GetNormalOrderRanges(start, end);
+
+				for (const auto& range : ranges)
+				{
+					IndexingType indexing;
+					{
+						std::unique_lock<std::mutex> indexingLock(m_indexingMutex);
+						DeleteIndexingNormalOrder(indexing, range.first, range.second);
+					}
+
+					if (indexing.size() > 0)
+					{
+						MigrateIndexedDataFiles(range.first, range.second, indexing, callback);
+					}
+				}
+			}
+
+			void MigrateAll(const MigrateCallbackType& callback)
+			{
+				IndexingType indexing;
+				{
+					std::unique_lock<std::mutex> indexingLock(m_indexingMutex);
+					ExtractAllIndex(indexing);
+				}
+				m_valueCache.Clear();
+
+				if (indexing.size() > 0)
+				{
+					MigrateIndexedDataFiles(m_ringStart, m_ringEnd, indexing, callback);
+				}
+			}
+
+			/**
+			 * \brief	Calls MigrateRangeDataFile(). If the storage, rather than the callback, fails midway,
+			 * 			keys that haven't been passed to the callback yet are put back into the indexing,
+			 * 			since their data are still in storage.
+			 */
+			void MigrateIndexedDataFiles(const IdType& start, const IdType& end, const IndexingType& indexing, const MigrateCallbackType& callback)
+			{
+				bool hasMigrated = false;
+				bool isCallbackFailed = false;
+				IdType lastKey(start);
+				try
+				{
+					MigrateRangeDataFile(start, end, indexing,
+						[&callback, &hasMigrated, &isCallbackFailed, &lastKey](const IdType& key, const std::vector<uint8_t>& data)
+					{
+						isCallbackFailed = true;
+						callback(key, data);
+						isCallbackFailed = false;
+						hasMigrated = true;
+						lastKey = key;
+					});
+				}
+				catch (const std::exception&)
+				{
+					if (isCallbackFailed)
+					{
+						throw;
+					}
+
+					std::unique_lock<std::mutex> indexingLock(m_indexingMutex);
+					for (auto it = (hasMigrated ? indexing.upper_bound(lastKey) : indexing.begin()); it != indexing.end(); ++it)
+					{
+						PutIndex(it->first, it->second);
+					}
+					throw;
+				}
+			}
+
 			IdType m_ringStart;
 			IdType m_ringEnd;
 
 			mutable std::mutex m_indexingMutex;
 			IndexingType m_indexing;
+
+			ValueCache<IdType> m_valueCache;
 		};
+
+		template<typename IdType, typename AddrType, size_t TagSize>
+		constexpr size_t StoreBase<IdType, AddrType, TagSize>::sk_migratePipelineDepth;
+
+		template<typename IdType, typename AddrType, size_t TagSize>
+		constexpr size_t StoreBase<IdType, AddrType, TagSize>::sk_migrateSaveBatchSize;
 	}
 }
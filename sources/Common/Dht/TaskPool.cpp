@@ -0,0 +1,116 @@
+#include "TaskPool.h"
+
+#include <exception>
+
+using namespace Decent::Dht;
+
+TaskPool::TaskPool() :
+	m_mutex(),
+	m_signal(),
+	m_tasks(),
+	m_workerCount(0),
+	m_idleCount(0),
+	m_isTerminated(false)
+{
+}
+
+TaskPool::~TaskPool()
+{
+}
+
+void TaskPool::Work()
+{
+	std::unique_lock<std::mutex> poolLock(m_mutex);
+	++m_workerCount;
+	while (true)
+	{
+		++m_idleCount;
+		m_signal.wait(poolLock, [this]() {
+			return m_isTerminated || m_tasks.size() > 0;
+		});
+		--m_idleCount;
+
+		if (m_tasks.size() == 0)
+		{
+			--m_workerCount;
+			return; //Terminated and no task left.
+		}
+
+		std::function<void()> task = std::move(m_tasks.front());
+		m_tasks.pop();
+
+		poolLock.unlock();
+		try
+		{
+			task();
+		}
+		catch (const std::exception&)
+		{}
+		poolLock.lock();
+	}
+}
+
+void TaskPool::Terminate()
+{
+	{
+		std::unique_lock<std::mutex> poolLock(m_mutex);
+		m_isTerminated = true;
+	}
+	m_signal.notify_all();
+}
+
+bool TaskPool::TryRunAsync(std::function<void()> task)
+{
+	{
+		std::unique_lock<std::mutex> poolLock(m_mutex);
+		if (m_isTerminated || m_idleCount <= m_tasks.size())
+		{
+			return false;
+		}
+		m_tasks.push(std::move(task));
+	}
+	m_signal.notify_one();
+
+	return true;
+}
+
+bool TaskPool::TryQueue(std::function<void()> task, size_t maxQueuedNum)
+{
+	{
+		std::unique_lock<std::mutex> poolLock(m_mutex);
+		if (m_isTerminated || m_workerCount == 0 || m_tasks.size() >= maxQueuedNum)
+		{
+			return false;
+		}
+		m_tasks.push(std::move(task));
+	}
+	m_signal.notify_one();
+
+	return true;
+}
+
+TaskLatch::TaskLatch() :
+	m_mutex(),
+	m_signal(),
+	m_isReleased(false)
+{
+}
+
+TaskLatch::~TaskLatch()
+{
+}
+
+void TaskLatch::Release()
+{
+	std::unique_lock<std::mutex> latchLock(m_mutex);
+	m_isReleased = true;
+	m_signal.notify_all();
+}
+
+void TaskLatch::Wait()
+{
+	std::unique_lock<std::mutex> latchLock(m_mutex);
+	m_signal.wait(latchLock, [this]() {
+		return m_isReleased;
+	});
+}
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <queue>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+#include <DecentApi/Common/RuntimeException.h>
+
+namespace Decent
+{
+	namespace Dht
+	{
+		/**
+		 * \brief	A pool of worker threads that run tasks asynchronously. Threads are not created by the
+		 * 			pool; instead, each worker thread joins the pool by calling Work(), so that the pool
+		 * 			can also be used inside the enclave, where the threads come from the untrusted side,
+		 * 			and each of them takes a TCS of the enclave for as long as it works. Thus, the number
+		 * 			of workers is set by the untrusted side (see DecentDhtApp::InitTaskWorkers). A task
+		 * 			given to TryRunAsync() is never queued behind others; if no worker is idle, it runs
+		 * 			on the calling thread, so a pool without workers runs everything inline. A task
+		 * 			given to TryQueue() may wait in a bounded queue for the next worker instead.
+		 */
+		class TaskPool
+		{
+		public:
+			TaskPool();
+
+			virtual ~TaskPool();
+
+			/**
+			 * \brief	Runs the tasks assigned to this pool, until the pool is terminated. It is called by
+			 * 			each worker thread.
+			 */
+			virtual void Work();
+
+			/**
+			 * \brief	Terminates the pool. Tasks that are already assigned will still be finished before
+			 * 			workers return from Work().
+			 */
+			virtual void Terminate();
+
+			/**
+			 * \brief	Try to run a task on an idle worker.
+			 *
+			 * \param	task	The task.
+			 *
+			 * \return	True if the task is assigned to an idle worker; false if there is no idle worker, in
+			 * 			which case the caller should run the task by itself.
+			 */
+			virtual bool TryRunAsync(std::function<void()> task);
+
+			/**
+			 * \brief	Try to queue a task for the next worker, even if no worker is idle now.
+			 *
+			 * \param	task		 	The task.
+			 * \param	maxQueuedNum	Maximum number of tasks waiting for workers, including this one.
+			 *
+			 * \return	True if the task is queued; false if the pool has no worker, or the queue is full,
+			 * 			in which case the task is not run.
+			 */
+			virtual bool TryQueue(std::function<void()> task, size_t maxQueuedNum);
+
+		private:
+			std::mutex m_mutex;
+			std::condition_variable m_signal;
+			std::queue<std::function<void()> > m_tasks;
+			size_t m_workerCount;
+			size_t m_idleCount;
+			bool m_isTerminated;
+		};
+
+		/** \brief	A one-shot signal used to wait for a task, running on another thread, to finish. */
+		class TaskLatch
+		{
+		public:
+			TaskLatch();
+
+			virtual ~TaskLatch();
+
+			/** \brief	Mark the task as finished, and wake up the waiting thread. */
+			void Release();
+
+			/** \brief	Wait until the task is finished. */
+			void Wait();
+
+		private:
+			std::mutex m_mutex;
+			std::condition_variable m_signal;
+			bool m_isReleased;
+		};
+
+		/**
+		 * \brief	The shared state of a task that may run on another thread, which is used to wait for the
+		 * 			task and to pass its error back to the waiting thread.
+		 */
+		class TaskFutureBase
+		{
+		public:
+			TaskFutureBase() :
+				m_latch(),
+				m_isFailed(false),
+				m_errMsg()
+			{}
+
+			virtual ~TaskFutureBase()
+			{}
+
+			/**
+			 * \brief	Wait until the task is finished.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the task has thrown an exception.
+			 */
+			void Wait()
+			{
+				m_latch.Wait();
+				if (m_isFailed)
+				{
+					throw RuntimeException(m_errMsg);
+				}
+			}
+
+		protected:
+			/** \brief	Mark the task as failed, and wake up the waiting thread. */
+			void Fail(const char* errMsg)
+			{
+				m_isFailed = true;
+				m_errMsg = errMsg;
+				m_latch.Release();
+			}
+
+			TaskLatch m_latch;
+
+		private:
+			bool m_isFailed;
+			std::string m_errMsg;
+		};
+
+		/**
+		 * \brief	The result of a task that may run on another thread.
+		 *
+		 * \tparam	T	Type of the result; must be default constructible.
+		 */
+		template<typename T>
+		class TaskFuture : public TaskFutureBase
+		{
+		public:
+			TaskFuture() :
+				TaskFutureBase(),
+				m_result()
+			{}
+
+			virtual ~TaskFuture()
+			{}
+
+			/** \brief	Run the task, and keep its result. */
+			template<typename FuncT>
+			void Run(FuncT& func)
+			{
+				try
+				{
+					m_result = func();
+				}
+				catch (const std::exception& e)
+				{
+					return Fail(e.what());
+				}
+				m_latch.Release();
+			}
+
+			/**
+			 * \brief	Wait until the task is finished, and get its result.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the task has thrown an exception.
+			 *
+			 * \return	The result.
+			 */
+			T& Get()
+			{
+				Wait();
+				return m_result;
+			}
+
+		private:
+			T m_result;
+		};
+
+		/** \brief	The result of a task, which returns nothing, that may run on another thread. */
+		template<>
+		class TaskFuture<void> : public TaskFutureBase
+		{
+		public:
+			TaskFuture() :
+				TaskFutureBase()
+			{}
+
+			virtual ~TaskFuture()
+			{}
+
+			/** \brief	Run the task. */
+			template<typename FuncT>
+			void Run(FuncT& func)
+			{
+				try
+				{
+					func();
+				}
+				catch (const std::exception& e)
+				{
+					return Fail(e.what());
+				}
+				m_latch.Release();
+			}
+
+			/**
+			 * \brief	Wait until the task is finished.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the task has thrown an exception.
+			 */
+			void Get()
+			{
+				Wait();
+			}
+		};
+
+		/**
+		 * \brief	Run a task on an idle worker of the pool, or on the calling thread if there is no idle
+		 * 			worker. Anything captured by reference must outlive the task, i.e., the caller must
+		 * 			wait for the returned future before leaving the scope.
+		 *
+		 * \tparam	T	 	Type of the result.
+		 * \tparam	FuncT	Type of the task; must be copyable, and have the form of "T FuncName()".
+		 * \param	taskPool	The task pool.
+		 * \param	func		The task.
+		 *
+		 * \return	The future of the result.
+		 */
+		template<typename T, typename FuncT>
+		std::shared_ptr<TaskFuture<T> > RunAsync(TaskPool& taskPool, FuncT func)
+		{
+			std::shared_ptr<TaskFuture<T> > future = std::make_shared<TaskFuture<T> >();
+
+			if (!taskPool.TryRunAsync([future, func]() mutable
+			{
+				future->Run(func);
+			}))
+			{
+				future->Run(func);
+			}
+
+			return future;
+		}
+
+		/**
+		 * \brief	Wait until all tasks are finished, even if some of them have failed.
+		 *
+		 * \exception	Decent::RuntimeException	Thrown when any of the tasks has thrown an exception.
+		 *
+		 * \param	futures	The futures of the tasks.
+		 */
+		template<typename T>
+		void WaitAll(const std::vector<std::shared_ptr<TaskFuture<T> > >& futures)
+		{
+			bool isFailed = false;
+			std::string errMsg;
+			for (const std::shared_ptr<TaskFuture<T> >& future : futures)
+			{
+				try
+				{
+					future->Wait();
+				}
+				catch (const std::exception& e)
+				{
+					if (!isFailed)
+					{
+						isFailed = true;
+						errMsg = e.what();
+					}
+				}
+			}
+
+			if (isFailed)
+			{
+				throw RuntimeException(errMsg);
+			}
+		}
+	}
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <atomic>
+
+namespace Decent
+{
+	namespace Dht
+	{
+		/**
+		 * \brief	A pool of reusable buffers in untrusted memory, used to pass values out of the memory
+		 * 			store without allocating a new buffer for each of them. The untrusted side acquires
+		 * 			and fills a buffer, and the enclave releases it after copying the content out,
+		 * 			without another enclave transition. Since it lives in untrusted memory, the enclave
+		 * 			must not trust any value read from it.
+		 */
+		struct UntrustedBufferPool
+		{
+			/** \brief	Number of buffers in the pool. */
+			static constexpr size_t sk_bufNum = 64;
+
+			/** \brief	Size of each buffer. */
+			static constexpr size_t sk_bufSize = 8192;
+
+			struct Buffer
+			{
+				std::atomic<uint32_t> m_inUse;
+				uint8_t m_data[sk_bufSize];
+			};
+
+			/** \brief	Buffer where the untrusted side starts looking for a free buffer. */
+			std::atomic<uint32_t> m_nextBuf;
+
+			Buffer m_bufs[sk_bufNum];
+
+			/**
+			 * \brief	Acquires a free buffer. Called by the untrusted side.
+			 *
+			 * \param	size	The size needed.
+			 *
+			 * \return	Null if the size is too large, or no buffer is free; else, the pointer to the
+			 * 			buffer's data.
+			 */
+			uint8_t* Acquire(size_t size)
+			{
+				if (size > sk_bufSize)
+				{
+					return nullptr;
+				}
+
+				const uint32_t startIdx = m_nextBuf.fetch_add(1, std::memory_order_relaxed);
+				for (size_t i = 0; i < sk_bufNum; ++i)
+				{
+					Buffer& buf = m_bufs[(startIdx + i) % sk_bufNum];
+					uint32_t expected = 0;
+					if (buf.m_inUse.compare_exchange_strong(expected, 1, std::memory_order_acq_rel))
+					{
+						return buf.m_data;
+					}
+				}
+
+				return nullptr;
+			}
+
+			/**
+			 * \brief	Finds the buffer whose data starts at the given pointer.
+			 *
+			 * \param	ptr	The pointer.
+			 *
+			 * \return	Null if the pointer is not the data of any buffer in this pool (e.g. it's allocated
+			 * 			separately because the pool ran out); else, the buffer.
+			 */
+			Buffer* Find(const uint8_t* ptr)
+			{
+				const uintptr_t base = reinterpret_cast<uintptr_t>(&m_bufs[0]);
+				const uintptr_t ptrVal = reinterpret_cast<uintptr_t>(ptr);
+				if (ptrVal < base)
+				{
+					return nullptr;
+				}
+
+				const size_t idx = static_cast<size_t>((ptrVal - base) / sizeof(Buffer));
+				if (idx >= sk_bufNum || ptr != m_bufs[idx].m_data)
+				{
+					return nullptr;
+				}
+
+				return &m_bufs[idx];
+			}
+
+			/** \brief	Releases a buffer, so that it can be acquired again. */
+			static void Release(Buffer& buf)
+			{
+				buf.m_inUse.store(0, std::memory_order_release);
+			}
+		};
+	}
+}
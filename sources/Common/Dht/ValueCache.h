@@ -0,0 +1,324 @@
+#pragma once
+
+#include <cstdint>
+
+#include <vector>
+#include <list>
+#include <map>
+#include <mutex>
+
+namespace Decent
+{
+	namespace Dht
+	{
+		/**
+		 * \brief	A cache of values for hot keys, limited by a memory budget in bytes. Eviction follows
+		 * 			2Q, so that a scan over cold keys doesn't flush hot keys out of the cache: once the
+		 * 			LRU queue is full, new keys enter a FIFO queue, and only keys seen again shortly after
+		 * 			being evicted from the FIFO queue (tracked by a ghost list of keys without values) are
+		 * 			promoted to the LRU queue.
+		 *
+		 * \tparam	KeyType	Type of the key. Must be copyable and ordered.
+		 */
+		template<typename KeyType>
+		class ValueCache
+		{
+		public:
+			/** \brief	Estimated memory used by an entry in addition to its value. */
+			static constexpr size_t sk_entryOverhead = 128;
+
+			/**
+			 * \brief	Maximum number of keys whose versions are tracked for reads in flight. Once it's
+			 * 			reached, all of them are dropped, so those reads are not put into the cache.
+			 */
+			static constexpr size_t sk_maxVersionNum = 4096;
+
+		public:
+			ValueCache() = delete;
+
+			/**
+			 * \brief	Constructor
+			 *
+			 * \param	budget	The memory budget in bytes. Zero to disable the cache.
+			 */
+			ValueCache(size_t budget) :
+				m_mutex(),
+				m_budget(budget),
+				m_size(0),
+				m_inSize(0),
+				m_lastVersion(0),
+				m_versions(),
+				m_entries(),
+				m_inList(),
+				m_mainList(),
+				m_ghosts(),
+				m_ghostList()
+			{}
+
+			/** \brief	Destructor */
+			virtual ~ValueCache()
+			{}
+
+			/** \brief	Sets the memory budget in bytes. Zero to disable the cache. */
+			void SetBudget(size_t budget)
+			{
+				std::unique_lock<std::mutex> cacheLock(m_mutex);
+				m_budget = budget;
+				Evict();
+			}
+
+			/**
+			 * \brief	Gets the version of a key, which is changed by every invalidation of the key. It must
+			 * 			be taken before the value is read from storage, and passed to Put, so that a value
+			 * 			read before an invalidation is not put into the cache. Versions are only tracked
+			 * 			for keys being read, so each of them must be given back by either Put or Release.
+			 */
+			uint64_t GetVersion(const KeyType& key)
+			{
+				std::unique_lock<std::mutex> cacheLock(m_mutex);
+				if (m_budget == 0)
+				{
+					return 0; //Nothing will be put while the cache is disabled.
+				}
+
+				if (m_versions.size() >= sk_maxVersionNum)
+				{
+					m_versions.clear();
+				}
+
+				const uint64_t version = ++m_lastVersion;
+				m_versions[key] = version;
+				return version;
+			}
+
+			/** \brief	Gives back the version of a key, whose value fails to be read from storage. */
+			void Release(const KeyType& key, uint64_t version)
+			{
+				std::unique_lock<std::mutex> cacheLock(m_mutex);
+				ReleaseVersion(key, version);
+			}
+
+			/**
+			 * \brief	Gets a value from the cache.
+			 *
+			 * \param 	   	key	The key.
+			 * \param [out]	val	The value.
+			 *
+			 * \return	True if it's a hit, otherwise, false.
+			 */
+			bool Get(const KeyType& key, std::vector<uint8_t>& val)
+			{
+				std::unique_lock<std::mutex> cacheLock(m_mutex);
+				auto it = m_entries.find(key);
+				if (it == m_entries.end())
+				{
+					return false;
+				}
+
+				if (it->second.m_isMain)
+				{
+					m_mainList.splice(m_mainList.begin(), m_mainList, it->second.m_pos);
+				}
+
+				val = it->second.m_val;
+				return true;
+			}
+
+			/**
+			 * \brief	Puts a value, which was missed in the cache and has been read from storage.
+			 *
+			 * \param	key	   	The key.
+			 * \param	val	   	The value.
+			 * \param	version	The version taken by GetVersion before the value was read.
+			 */
+			void Put(const KeyType& key, const std::vector<uint8_t>& val, uint64_t version)
+			{
+				const size_t entrySize = val.size() + sk_entryOverhead;
+
+				std::unique_lock<std::mutex> cacheLock(m_mutex);
+				if (!ReleaseVersion(key, version) || entrySize > m_budget)
+				{
+					return;
+				}
+
+				auto it = m_entries.find(key);
+				if (it != m_entries.end())
+				{
+					//Put by another reader in the meantime.
+					return;
+				}
+
+				//Keys go straight into the LRU queue while it has room, e.g. when the cache is warming up.
+				auto ghostIt = m_ghosts.find(key);
+				const bool isGhost = ghostIt != m_ghosts.end();
+				const bool isMain = isGhost || (m_size - m_inSize) + entrySize <= m_budget - GetInBudget();
+				if (isGhost)
+				{
+					m_ghostList.erase(ghostIt->second);
+					m_ghosts.erase(ghostIt);
+				}
+
+				std::list<KeyType>& list = isMain ? m_mainList : m_inList;
+				list.push_front(key);
+
+				Entry& entry = m_entries[key];
+				entry.m_val = val;
+				entry.m_isMain = isMain;
+				entry.m_pos = list.begin();
+
+				m_size += entrySize;
+				if (!isMain)
+				{
+					m_inSize += entrySize;
+				}
+
+				Evict();
+			}
+
+			/** \brief	Invalidates the value of a key. */
+			void Invalidate(const KeyType& key)
+			{
+				std::unique_lock<std::mutex> cacheLock(m_mutex);
+				m_versions.erase(key);
+
+				auto it = m_entries.find(key);
+				if (it != m_entries.end())
+				{
+					Erase(it);
+				}
+			}
+
+			/**
+			 * \brief	Invalidates values within a range.
+			 *
+			 * \param	start	The start of the range (smallest value, INclusive).
+			 * \param	end  	The end of the range (largest value, INclusive).
+			 */
+			void InvalidateRange(const KeyType& start, const KeyType& end)
+			{
+				std::unique_lock<std::mutex> cacheLock(m_mutex);
+				m_versions.erase(m_versions.lower_bound(start), m_versions.upper_bound(end));
+
+				auto endIt = m_entries.upper_bound(end);
+				for (auto it = m_entries.lower_bound(start); it != endIt; )
+				{
+					it = Erase(it);
+				}
+			}
+
+			/** \brief	Invalidates all values. */
+			void Clear()
+			{
+				std::unique_lock<std::mutex> cacheLock(m_mutex);
+				m_versions.clear();
+
+				m_entries.clear();
+				m_inList.clear();
+				m_mainList.clear();
+				m_ghosts.clear();
+				m_ghostList.clear();
+				m_size = 0;
+				m_inSize = 0;
+			}
+
+		private:
+			struct Entry
+			{
+				std::vector<uint8_t> m_val;
+				bool m_isMain;
+				typename std::list<KeyType>::iterator m_pos;
+			};
+
+			typedef std::map<KeyType, Entry> EntryMapType;
+
+			/** \brief	Budget for the FIFO queue, which is a quarter of the total budget. */
+			size_t GetInBudget() const
+			{
+				return m_budget / 4;
+			}
+
+			/**
+			 * \brief	Stops tracking the version of a key; assume the cache has been locked.
+			 *
+			 * \return	False if the version has been changed, e.g. by an invalidation.
+			 */
+			bool ReleaseVersion(const KeyType& key, uint64_t version)
+			{
+				auto it = m_versions.find(key);
+				if (it == m_versions.end() || it->second != version)
+				{
+					return false;
+				}
+
+				m_versions.erase(it);
+				return true;
+			}
+
+			/** \brief	Erases an entry; assume the cache has been locked. */
+			typename EntryMapType::iterator Erase(typename EntryMapType::iterator it)
+			{
+				const size_t entrySize = it->second.m_val.size() + sk_entryOverhead;
+				m_size -= entrySize;
+				if (it->second.m_isMain)
+				{
+					m_mainList.erase(it->second.m_pos);
+				}
+				else
+				{
+					m_inSize -= entrySize;
+					m_inList.erase(it->second.m_pos);
+				}
+
+				return m_entries.erase(it);
+			}
+
+			/** \brief	Evicts entries until the cache is within budget; assume the cache has been locked. */
+			void Evict()
+			{
+				while (m_size > m_budget)
+				{
+					if (m_inList.size() > 0 && (m_inSize > GetInBudget() || m_mainList.size() == 0))
+					{
+						//Keys evicted from the FIFO queue are remembered in the ghost list.
+						KeyType key = m_inList.back();
+						Erase(m_entries.find(key));
+
+						m_ghostList.push_front(key);
+						m_ghosts[key] = m_ghostList.begin();
+					}
+					else
+					{
+						Erase(m_entries.find(m_mainList.back()));
+					}
+				}
+
+				//The ghost list remembers as many keys as half of the cached entries.
+				const size_t ghostMaxNum = (m_entries.size() / 2) + 1;
+				while (m_ghostList.size() > ghostMaxNum)
+				{
+					m_ghosts.erase(m_ghostList.back());
+					m_ghostList.pop_back();
+				}
+			}
+
+			mutable std::mutex m_mutex;
+			size_t m_budget;
+			size_t m_size;
+			size_t m_inSize;
+			uint64_t m_lastVersion;
+			std::map<KeyType, uint64_t> m_versions;
+
+			EntryMapType m_entries;
+			std::list<KeyType> m_inList;
+			std::list<KeyType> m_mainList;
+			std::map<KeyType, typename std::list<KeyType>::iterator> m_ghosts;
+			std::list<KeyType> m_ghostList;
+		};
+
+		template<typename KeyType>
+		constexpr size_t ValueCache<KeyType>::sk_entryOverhead;
+
+		template<typename KeyType>
+		constexpr size_t ValueCache<KeyType>::sk_maxVersionNum;
+	}
+}
@@ -0,0 +1,114 @@
+#include "HeldCntRegistry.h"
+
+#include "../../Common/Dht/ProcResult.h"
+
+using namespace Decent::Dht;
+using namespace Decent::Net;
+
+HeldCntRegistry::HeldCntRegistry() :
+	m_mutex(),
+	m_releaseSignal(),
+	m_entries(),
+	m_isTerminated(false)
+{}
+
+HeldCntRegistry::~HeldCntRegistry()
+{
+	Terminate();
+}
+
+void HeldCntRegistry::Hold(ConnectionBase* cnt, CallbackType callback)
+{
+	std::unique_lock<std::mutex> entriesLock(m_mutex);
+
+	if (m_isTerminated)
+	{
+		callback(ProcResult::k_close);
+		return;
+	}
+
+	auto it = m_entries.find(cnt);
+	if (it != m_entries.end() && it->second.m_isReleased)
+	{
+		//Released before the ECall holding it returned.
+		const int result = it->second.m_result;
+		m_entries.erase(it);
+		callback(result);
+		return;
+	}
+
+	Entry& entry = m_entries[cnt];
+	entry.m_isReleased = false;
+	entry.m_result = ProcResult::k_close;
+	entry.m_callback = std::move(callback);
+}
+
+int HeldCntRegistry::WaitRelease(ConnectionBase* cnt)
+{
+	//The callback is called under the lock, so the flag is guarded by it, too.
+	bool isReleased = false;
+	int result = ProcResult::k_close;
+	Hold(cnt, [&isReleased, &result](int res)
+	{
+		result = res;
+		isReleased = true;
+	});
+
+	std::unique_lock<std::mutex> entriesLock(m_mutex);
+	m_releaseSignal.wait(entriesLock, [&isReleased]()
+	{
+		return isReleased;
+	});
+
+	return result;
+}
+
+void HeldCntRegistry::Release(ConnectionBase* cnt, int result)
+{
+	std::unique_lock<std::mutex> entriesLock(m_mutex);
+
+	auto it = m_entries.find(cnt);
+	if (it == m_entries.end() || it->second.m_isReleased)
+	{
+		//The ECall holding it has not returned yet.
+		Entry& entry = m_entries[cnt];
+		entry.m_isReleased = true;
+		entry.m_result = result;
+		return;
+	}
+
+	CallbackType callback = std::move(it->second.m_callback);
+	m_entries.erase(it);
+	callback(result);
+
+	m_releaseSignal.notify_all();
+}
+
+void HeldCntRegistry::Cancel(ConnectionBase* cnt)
+{
+	std::unique_lock<std::mutex> entriesLock(m_mutex);
+	m_entries.erase(cnt);
+}
+
+void HeldCntRegistry::Terminate()
+{
+	std::unique_lock<std::mutex> entriesLock(m_mutex);
+
+	m_isTerminated = true;
+	for (auto& item : m_entries)
+	{
+		if (!item.second.m_isReleased)
+		{
+			item.second.m_callback(ProcResult::k_close);
+		}
+	}
+	m_entries.clear();
+
+	m_releaseSignal.notify_all();
+}
+
+HeldCntRegistry& Decent::Dht::GetHeldCntRegistry()
+{
+	static HeldCntRegistry inst;
+	return inst;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+namespace Decent
+{
+	namespace Net
+	{
+		class ConnectionBase;
+	}
+
+	namespace Dht
+	{
+		/**
+		 * \brief	Keeps track of connections held by the enclave (see ProcResult::k_held), and notifies
+		 * 			whoever serves a connection once the enclave releases it, through the OCall
+		 * 			ocall_decent_dht_release_held_cnt. Every connection is released on its own, right
+		 * 			when its result is sent, so connections completed together (e.g. by one reply batch)
+		 * 			don't have to wait for later ECalls to be handed back.
+		 */
+		class HeldCntRegistry
+		{
+		public:
+			/** \brief	Called with the result the connection is released with (see ProcResult). */
+			typedef std::function<void(int)> CallbackType;
+
+		public:
+			HeldCntRegistry();
+
+			/** \brief	Destructor */
+			virtual ~HeldCntRegistry();
+
+			/**
+			 * \brief	Registers a connection the enclave has held. The callback is called once the
+			 * 			enclave releases the connection, or right away if it has been released already,
+			 * 			which happens if the result is ready before the ECall holding it returns.
+			 * 			Callbacks are called under the lock of the registry, so they must be short.
+			 *
+			 * \param [in,out]	cnt			The held connection.
+			 * \param 		  	callback	The callback.
+			 */
+			void Hold(Net::ConnectionBase* cnt, CallbackType callback);
+
+			/**
+			 * \brief	Registers a connection the enclave has held, and blocks until it's released.
+			 *
+			 * \param [in,out]	cnt	The held connection.
+			 *
+			 * \return	The result the connection is released with.
+			 */
+			int WaitRelease(Net::ConnectionBase* cnt);
+
+			/**
+			 * \brief	Releases a held connection. Called by the enclave.
+			 *
+			 * \param [in,out]	cnt   	The held connection.
+			 * \param 		  	result	The result (see ProcResult).
+			 */
+			void Release(Net::ConnectionBase* cnt, int result);
+
+			/**
+			 * \brief	Forgets a connection, e.g. before it's destroyed, without calling its callback.
+			 * 			Once it returns, the callback of the connection will not be called.
+			 *
+			 * \param [in,out]	cnt	The connection.
+			 */
+			void Cancel(Net::ConnectionBase* cnt);
+
+			/**
+			 * \brief	Releases all connections, and those held afterwards, with ProcResult::k_close, since
+			 * 			the enclave will not release them anymore.
+			 */
+			void Terminate();
+
+		private:
+			struct Entry
+			{
+				bool m_isReleased;
+				int m_result;
+				CallbackType m_callback;
+			};
+
+			std::mutex m_mutex;
+			std::condition_variable m_releaseSignal;
+			std::map<Net::ConnectionBase*, Entry> m_entries;
+			bool m_isTerminated;
+		};
+
+		HeldCntRegistry& GetHeldCntRegistry();
+	}
+}
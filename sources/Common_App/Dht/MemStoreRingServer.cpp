@@ -0,0 +1,199 @@
+#include "MemStoreRingServer.h"
+
+#include <cstring>
+
+#include <chrono>
+
+#include <DecentApi/Common/make_unique.h>
+
+#include "../../Common/Dht/MemStoreRing.h"
+#include "../../Common/Dht/MemKeyValueStore.h"
+
+using namespace Decent::Dht;
+
+namespace
+{
+	static std::atomic<size_t> gs_workerNum(0);
+
+	/** \brief	Number of consecutive empty scans before a worker starts to sleep between scans. */
+	static constexpr size_t gsk_idleScanLimit = 1024;
+}
+
+void MemStoreRingServer::SetWorkerNum(size_t workerNum)
+{
+	gs_workerNum = workerNum;
+}
+
+size_t MemStoreRingServer::GetWorkerNum()
+{
+	return gs_workerNum;
+}
+
+MemStoreRingServer::MemStoreRingServer(MemKeyValueStore & store, size_t workerNum) :
+	m_store(store),
+	m_ring(Tools::make_unique<MemStoreRing>()),
+	m_isTerminated(false),
+	m_workers()
+{
+	m_ring->m_nextSlot = 0;
+	for (size_t i = 0; i < MemStoreRing::sk_slotNum; ++i)
+	{
+		MemStoreRing::Slot& slot = m_ring->m_slots[i];
+		slot.m_reqSize = 0;
+		slot.m_resRet = 0;
+		slot.m_resSize = 0;
+		slot.m_resOverflow = nullptr;
+		slot.m_state = MemStoreRing::sk_slotFree;
+	}
+
+	for (size_t i = 0; i < workerNum; ++i)
+	{
+		m_workers.push_back(std::thread([this]()
+		{
+			this->Worker();
+		}));
+	}
+}
+
+MemStoreRingServer::~MemStoreRingServer()
+{
+	m_isTerminated = true;
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+
+	for (size_t i = 0; i < MemStoreRing::sk_slotNum; ++i)
+	{
+		delete[] m_ring->m_slots[i].m_resOverflow;
+	}
+}
+
+void MemStoreRingServer::Worker()
+{
+	size_t idleScanCount = 0;
+	while (!m_isTerminated)
+	{
+		bool hasServed = false;
+		for (size_t i = 0; i < MemStoreRing::sk_slotNum; ++i)
+		{
+			hasServed = TryServe(i) || hasServed;
+		}
+
+		if (hasServed)
+		{
+			idleScanCount = 0;
+		}
+		else if (idleScanCount < gsk_idleScanLimit)
+		{
+			++idleScanCount;
+			std::this_thread::yield();
+		}
+		else
+		{
+			//Enclave threads will fall back to OCalls if requests are not picked up in time.
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	}
+}
+
+bool MemStoreRingServer::TryServe(size_t slotIdx)
+{
+	MemStoreRing::Slot& slot = m_ring->m_slots[slotIdx];
+
+	uint32_t expected = MemStoreRing::sk_slotPosted;
+	if (!slot.m_state.compare_exchange_strong(expected, MemStoreRing::sk_slotServing, std::memory_order_acq_rel))
+	{
+		return false;
+	}
+
+	//The response from last time has been consumed by the enclave.
+	delete[] slot.m_resOverflow;
+	slot.m_resOverflow = nullptr;
+	slot.m_resSize = 0;
+	slot.m_resRet = 0;
+
+	if (slot.m_reqSize <= MemStoreRing::sk_slotDataSize)
+	{
+		try
+		{
+			MemKeyValueStore::ValueType res = m_store.ProcessBatch(slot.m_data, static_cast<size_t>(slot.m_reqSize));
+
+			slot.m_resSize = res.first;
+			if (res.first <= MemStoreRing::sk_slotDataSize)
+			{
+				if (res.first > 0)
+				{
+					std::memcpy(slot.m_data, res.second.get(), res.first);
+				}
+			}
+			else
+			{
+				slot.m_resOverflow = res.second.release();
+			}
+			slot.m_resRet = 1;
+		}
+		catch (const std::exception&)
+		{}
+	}
+
+	slot.m_state.store(MemStoreRing::sk_slotDone, std::memory_order_release);
+
+	return true;
+}
+
+extern "C" void* ocall_decent_dht_mem_store_ring_init(void* obj, void** ring_ptr)
+{
+	if (!obj || !ring_ptr)
+	{
+		return nullptr;
+	}
+
+	*ring_ptr = nullptr;
+
+	const size_t workerNum = MemStoreRingServer::GetWorkerNum();
+	if (workerNum == 0)
+	{
+		return nullptr;
+	}
+
+	try
+	{
+		MemStoreRingServer* server = new MemStoreRingServer(*static_cast<MemKeyValueStore*>(obj), workerNum);
+		*ring_ptr = &server->GetRing();
+
+		return server;
+	}
+	catch (const std::exception&)
+	{
+		return nullptr;
+	}
+}
+
+extern "C" void ocall_decent_dht_mem_store_ring_deinit(void* ring_server)
+{
+	delete static_cast<MemStoreRingServer*>(ring_server);
+}
+
+extern "C" void ocall_decent_dht_mem_store_ring_wait(void* slot_ptr)
+{
+	if (!slot_ptr)
+	{
+		return;
+	}
+
+	const MemStoreRing::Slot& slot = *static_cast<const MemStoreRing::Slot*>(slot_ptr);
+	size_t idleCount = 0;
+	while (slot.m_state.load(std::memory_order_acquire) == MemStoreRing::sk_slotServing)
+	{
+		if (idleCount < gsk_idleScanLimit)
+		{
+			++idleCount;
+			std::this_thread::yield();
+		}
+		else
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	}
+}
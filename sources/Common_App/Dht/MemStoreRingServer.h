@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace Decent
+{
+	namespace Dht
+	{
+		struct MemStoreRing;
+		class MemKeyValueStore;
+
+		/**
+		 * \brief	The untrusted side of the MemStoreRing. It owns the ring, and runs dedicated worker
+		 * 			threads that poll the ring and process requests posted by the enclave.
+		 */
+		class MemStoreRingServer
+		{
+		public: //static member:
+
+			/**
+			 * \brief	Sets the number of worker threads for rings created afterwards. It must be set
+			 * 			before the enclave is created. 0 disables the ring, so that the enclave will use
+			 * 			OCalls instead.
+			 *
+			 * \param	workerNum	Number of workers.
+			 */
+			static void SetWorkerNum(size_t workerNum);
+
+			static size_t GetWorkerNum();
+
+		public:
+			MemStoreRingServer() = delete;
+
+			/**
+			 * \brief	Constructor
+			 *
+			 * \param [in,out]	store	 	The memory store that requests are processed on.
+			 * \param 		  	workerNum	Number of worker threads.
+			 */
+			MemStoreRingServer(MemKeyValueStore& store, size_t workerNum);
+
+			/** \brief	Destructor. Stops and joins all workers. */
+			virtual ~MemStoreRingServer();
+
+			MemStoreRing& GetRing()
+			{
+				return *m_ring;
+			}
+
+		private:
+			void Worker();
+
+			bool TryServe(size_t slotIdx);
+
+			MemKeyValueStore& m_store;
+			std::unique_ptr<MemStoreRing> m_ring;
+			std::atomic<bool> m_isTerminated;
+			std::vector<std::thread> m_workers;
+		};
+	}
+}
@@ -7,30 +7,52 @@
 #include <DecentApi/CommonApp/Threading/TaskSet.h>
 
 #include "../../../Common/Dht/RequestCategory.h"
+#include "../../../Common/Dht/ProcResult.h"
+
+#include "../HeldCntRegistry.h"
 
 using namespace Decent::Net;
 using namespace Decent::Dht;
 
+extern "C" void ecall_decent_dht_set_one_hop_routing(int is_enabled);
+extern "C" int ecall_decent_dht_set_store_config(size_t paged_value_max_size, size_t value_cache_budget, int is_index_untrusted);
+extern "C" void ecall_decent_dht_set_session_budget(size_t max_session_num);
 extern "C" int ecall_decent_dht_init(uint64_t self_addr, int is_first_node, uint64_t ex_addr, size_t totalNode, size_t idx);
 extern "C" void ecall_decent_dht_deinit();
 
-extern "C" int ecall_decent_dht_proc_msg_from_dht(void* connection, void** prev_held_cnt);
+extern "C" int ecall_decent_dht_proc_msg_from_dht(void* connection);
 extern "C" int ecall_decent_dht_proc_msg_from_store(void* connection);
 extern "C" int ecall_decent_dht_proc_msg_from_app(void* connection);
+extern "C" int ecall_decent_dht_proc_session_msg(void* connection);
+extern "C" void ecall_decent_dht_close_session(void* connection);
+extern "C" void ecall_decent_dht_set_forward_batching(size_t flush_size, uint64_t window_ms);
 extern "C" int ecall_decent_dht_forward_queue_worker();
 extern "C" int ecall_decent_dht_reply_queue_worker();
+extern "C" int ecall_decent_dht_pending_query_timer();
+extern "C" int ecall_decent_dht_task_worker();
 extern "C" void ecall_decent_dht_terminate_workers();
 
+namespace
+{
+	/** \brief	Time, in milliseconds, an app session may wait for its next request before it's closed. */
+	static constexpr uint64_t gsk_appSessionIdleTimeoutMs = 30 * 1000;
+
+	/**
+	 * \brief	Time, in milliseconds, a channel opened by a peer may wait for its next RPC before it's
+	 * 			closed. Peers close channels idle for DhtSecureConnectionMgr::sk_channelMaxIdleMs first.
+	 */
+	static constexpr uint64_t gsk_channelIdleTimeoutMs = 2 * 60 * 1000;
+}
+
 Decent::Dht::DecentDhtApp::~DecentDhtApp()
 {
 	TerminateWorkers();
 	ecall_decent_dht_deinit();
 }
 
-bool DecentDhtApp::ProcessMsgFromDht(ConnectionBase & connection, ConnectionBase*& freeHeldCnt)
+int DecentDhtApp::ProcessMsgFromDht(ConnectionBase & connection)
 {
-	void*& prevHeldCntRef = reinterpret_cast<void*&>(freeHeldCnt);
-	int retValue = ecall_decent_dht_proc_msg_from_dht(&connection, &prevHeldCntRef);
+	int retValue = ecall_decent_dht_proc_msg_from_dht(&connection);
 
 	return retValue;
 }
@@ -42,13 +64,35 @@ bool DecentDhtApp::ProcessMsgFromStore(ConnectionBase & connection)
 	return retValue;
 }
 
-bool DecentDhtApp::ProcessMsgFromApp(ConnectionBase & connection)
+int DecentDhtApp::ProcessMsgFromApp(ConnectionBase & connection)
 {
 	int retValue = ecall_decent_dht_proc_msg_from_app(&connection);
 
 	return retValue;
 }
 
+int DecentDhtApp::ProcessSessionMsg(ConnectionBase & connection)
+{
+	int retValue = ecall_decent_dht_proc_session_msg(&connection);
+
+	return retValue;
+}
+
+void DecentDhtApp::CloseSession(ConnectionBase & connection)
+{
+	ecall_decent_dht_close_session(&connection);
+}
+
+uint64_t DecentDhtApp::GetSessionIdleTimeoutMs(const std::string & category) const
+{
+	return category == RequestCategory::sk_fromApp ? gsk_appSessionIdleTimeoutMs : gsk_channelIdleTimeoutMs;
+}
+
+void DecentDhtApp::SetForwardBatching(size_t flushSize, uint64_t windowMs)
+{
+	ecall_decent_dht_set_forward_batching(flushSize, windowMs);
+}
+
 void DecentDhtApp::QueryForwardWorker()
 {
 	int retVal = ecall_decent_dht_forward_queue_worker();
@@ -67,20 +111,42 @@ void DecentDhtApp::QueryReplyWorker()
 	}
 }
 
+void DecentDhtApp::PendingQueryTimer()
+{
+	int retVal = ecall_decent_dht_pending_query_timer();
+	if (!retVal)
+	{
+		throw RuntimeException("DecentDhtApp::PendingQueryTimer failed.");
+	}
+}
+
+void DecentDhtApp::TaskWorker()
+{
+	int retVal = ecall_decent_dht_task_worker();
+	if (!retVal)
+	{
+		throw RuntimeException("DecentDhtApp::TaskWorker failed.");
+	}
+}
+
 void DecentDhtApp::TerminateWorkers()
 {
 	ecall_decent_dht_terminate_workers();
+
+	//Held connections will not be released once the pending query timer is stopped.
+	GetHeldCntRegistry().Terminate();
 }
 
-bool DecentDhtApp::ProcessSmartMessage(const std::string & category, ConnectionBase & connection, ConnectionBase*& freeHeldCnt)
+int DecentDhtApp::ProcessRequest(const std::string & category, ConnectionBase & connection)
 {
 	if (category == RequestCategory::sk_fromDht)
 	{
-		return ProcessMsgFromDht(connection, freeHeldCnt);
+		return ProcessMsgFromDht(connection);
 	}
 	else if (category == RequestCategory::sk_fromStore)
 	{
-		return ProcessMsgFromStore(connection);
+		ProcessMsgFromStore(connection);
+		return ProcResult::k_done; //Store requests are never held.
 	}
 	else if (category == RequestCategory::sk_fromApp)
 	{
@@ -88,10 +154,35 @@ bool DecentDhtApp::ProcessSmartMessage(const std::string & category, ConnectionB
 	}
 	else
 	{
-		return false;
+		return ProcResult::k_close;
 	}
 }
 
+bool DecentDhtApp::ProcessSmartMessage(const std::string & category, ConnectionBase & connection, ConnectionBase*& freeHeldCnt)
+{
+	if (ServeBlocking(category, connection) == ProcResult::k_close)
+	{
+		connection.Terminate();
+	}
+	return false;
+}
+
+void DecentDhtApp::SetOneHopRouting(bool isEnabled)
+{
+	ecall_decent_dht_set_one_hop_routing(isEnabled);
+}
+
+void DecentDhtApp::SetStoreConfig(size_t pagedValueMaxSize, size_t valueCacheBudget, bool isIndexUntrusted)
+{
+	int retValue = ecall_decent_dht_set_store_config(pagedValueMaxSize, valueCacheBudget, isIndexUntrusted);
+	DECENT_ASSERT_ENCLAVE_APP_RESULT(retValue, "Configure DHT store.");
+}
+
+void DecentDhtApp::SetSessionBudget(size_t maxSessionNum)
+{
+	ecall_decent_dht_set_session_budget(maxSessionNum);
+}
+
 void DecentDhtApp::InitDhtNode(uint64_t selfAddr, uint64_t exNodeAddr, size_t totalNode, size_t idx)
 {
 	int retValue = ecall_decent_dht_init(selfAddr, exNodeAddr == 0, exNodeAddr, totalNode, idx);
@@ -135,6 +226,42 @@ void DecentDhtApp::InitQueryWorkers(const size_t forwardWorkerNum, const size_t
 
 		m_queryWorkerPool->AddTaskSet(task);
 	}
+
+	std::unique_ptr<TaskSet> timerTask = std::make_unique<TaskSet>(
+		[this]() //Main task
+	{
+		this->PendingQueryTimer();
+	},
+		[this]() //Main task killer
+	{
+		this->TerminateWorkers();
+	}
+	);
+
+	m_queryWorkerPool->AddTaskSet(timerTask);
+}
+
+void DecentDhtApp::InitTaskWorkers(const size_t taskWorkerNum)
+{
+	using namespace Decent::Threading;
+
+	m_taskWorkerPool = std::make_unique<SingleTaskThreadPool>(nullptr);
+
+	for (size_t i = 0; i < taskWorkerNum; ++i)
+	{
+		std::unique_ptr<TaskSet> task = std::make_unique<TaskSet>(
+			[this]() //Main task
+		{
+			this->TaskWorker();
+		},
+			[this]() //Main task killer
+		{
+			this->TerminateWorkers();
+		}
+		);
+
+		m_taskWorkerPool->AddTaskSet(task);
+	}
 }
 
 #endif // ENCLAVE_PLATFORM_SGX
@@ -0,0 +1,705 @@
+#ifdef ENCLAVE_PLATFORM_NON_ENCLAVE
+
+#include "EpollServer.h"
+
+#include <DecentApi/Common/RuntimeException.h>
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <cstring>
+
+#include <chrono>
+#include <initializer_list>
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+#include <DecentApi/Common/Common.h>
+#include <DecentApi/Common/Net/ConnectionBase.h>
+
+#include "../../../Common/Dht/ProcResult.h"
+
+#include "../RequestHandler.h"
+#include "../HeldCntRegistry.h"
+
+using namespace Decent;
+using namespace Decent::Dht;
+using namespace Decent::Net;
+
+namespace
+{
+	/** \brief	Maximum number of events taken by one epoll_wait call. */
+	static constexpr int gsk_maxEventNum = 256;
+
+	/** \brief	Capacity of the queue of connections waiting for workers. */
+	static constexpr size_t gsk_readyQueueSize = 4096;
+
+	/** \brief	Interval, in milliseconds, between two sweeps of idle sessions. */
+	static constexpr int gsk_sessionSweepIntervalMs = 1000;
+
+	/**
+	 * \brief	Time, in milliseconds, a request may take from the moment a worker picks it up, including
+	 * 			all reads and writes of it, so that a peer trickling its data can't occupy a worker for
+	 * 			much longer than that.
+	 */
+	static constexpr int64_t gsk_requestTimeoutMs = 30 * 1000;
+
+	/** \brief	Number of files kept open besides accepted connections, e.g. peer connections and logs. */
+	static constexpr rlim_t gsk_reservedFileNum = 1024;
+
+	/**
+	 * \brief	Raises the soft limit of open files, if needed, to fit the given number of connections,
+	 * 			but never beyond the hard limit.
+	 *
+	 * \param	maxCntNum	Maximum number of connections accepted.
+	 */
+	static void RaiseFileLimit(size_t maxCntNum)
+	{
+		rlimit limit;
+		if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+		{
+			return;
+		}
+
+		const rlim_t neededNum = static_cast<rlim_t>(maxCntNum) + gsk_reservedFileNum;
+		if (limit.rlim_cur >= neededNum)
+		{
+			return;
+		}
+
+		if (limit.rlim_max != RLIM_INFINITY && limit.rlim_max < neededNum)
+		{
+			LOGW("The hard limit of open files is lower than the maximum number of connections.");
+			limit.rlim_cur = limit.rlim_max;
+		}
+		else
+		{
+			limit.rlim_cur = neededNum;
+		}
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	static std::string GetErrnoStr(const char* what)
+	{
+		return std::string(what) + " failed with errno " + std::to_string(errno) + ".";
+	}
+}
+
+/**
+ * \brief	A connection over a socket, owned by EpollServer. Reads and writes block until the deadline
+ * 			of the request being served (see StartRequest()).
+ */
+class EpollServer::SocketConnection : public ConnectionBase
+{
+public:
+	typedef std::chrono::steady_clock ClockType;
+
+public:
+	SocketConnection(int fd) :
+		m_fd(fd),
+		m_isInSession(false),
+		m_idleTimeoutMs(0),
+		m_idleDeadline(),
+		m_isArmed(false),
+		m_requestDeadline()
+	{}
+
+	virtual ~SocketConnection()
+	{
+		close(m_fd);
+	}
+
+	virtual size_t SendRaw(const void* const dataPtr, const size_t size) override
+	{
+		while (true)
+		{
+			WaitUntilReady(POLLOUT);
+
+			const ssize_t res = send(m_fd, dataPtr, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+			if (res >= 0)
+			{
+				return static_cast<size_t>(res);
+			}
+			if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)
+			{
+				throw RuntimeException(GetErrnoStr("Sending on the socket"));
+			}
+		}
+	}
+
+	virtual size_t ReceiveRaw(void* const bufPtr, const size_t size) override
+	{
+		while (true)
+		{
+			WaitUntilReady(POLLIN);
+
+			const ssize_t res = recv(m_fd, bufPtr, size, MSG_DONTWAIT);
+			if (res > 0)
+			{
+				return static_cast<size_t>(res);
+			}
+			if (res == 0)
+			{
+				throw RuntimeException("The connection has been closed by the peer.");
+			}
+			if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)
+			{
+				throw RuntimeException(GetErrnoStr("Receiving on the socket"));
+			}
+		}
+	}
+
+	virtual void Terminate() noexcept override
+	{
+		shutdown(m_fd, SHUT_RDWR);
+	}
+
+	int GetFd() const
+	{
+		return m_fd;
+	}
+
+	/**
+	 * \brief	Whether the enclave keeps a session for the connection (see ProcResult::k_session). It's
+	 * 			only accessed by whoever serves the connection, or once the connection is disarmed.
+	 */
+	bool IsInSession() const
+	{
+		return m_isInSession;
+	}
+
+	void SetInSession(bool isInSession)
+	{
+		m_isInSession = isInSession;
+	}
+
+	/**
+	 * \brief	Starts the deadline of a request, by which all its reads and writes must be done. It's
+	 * 			called by the worker that picks the request up, before any of them.
+	 */
+	void StartRequest()
+	{
+		m_requestDeadline = ClockType::now() + std::chrono::milliseconds(gsk_requestTimeoutMs);
+	}
+
+	/** \brief	Sets how long the session may wait for its next message. */
+	void SetIdleTimeout(uint64_t timeoutMs)
+	{
+		m_idleTimeoutMs = timeoutMs;
+	}
+
+	/** \brief	Marks the connection as watched by epoll. It's called under the lock of connections. */
+	void Arm()
+	{
+		m_idleDeadline = ClockType::now() + std::chrono::milliseconds(m_idleTimeoutMs);
+		m_isArmed = true;
+	}
+
+	/** \brief	Marks the connection as taken by the poll thread, since its event has fired. */
+	void Disarm()
+	{
+		m_isArmed = false;
+	}
+
+	/**
+	 * \brief	Checks if the session of the connection has waited for too long. It's called under the
+	 * 			lock of connections.
+	 */
+	bool IsSessionExpired(const ClockType::time_point& now) const
+	{
+		return m_isArmed && m_isInSession && m_idleDeadline <= now;
+	}
+
+private:
+	/**
+	 * \brief	Waits until the socket is ready for the given events, or the connection is closed.
+	 *
+	 * \exception	Decent::RuntimeException	Thrown when the deadline of the request has passed.
+	 */
+	void WaitUntilReady(short events)
+	{
+		while (true)
+		{
+			const int64_t remainMs = std::chrono::duration_cast<std::chrono::milliseconds>(m_requestDeadline - ClockType::now()).count();
+			if (remainMs <= 0)
+			{
+				throw RuntimeException("The request has timed out.");
+			}
+
+			pollfd pollFd;
+			pollFd.fd = m_fd;
+			pollFd.events = events;
+			pollFd.revents = 0;
+			const int res = poll(&pollFd, 1, static_cast<int>(remainMs));
+			if (res > 0)
+			{
+				return; //Ready, or errors to be reported by the next call.
+			}
+			if (res < 0 && errno != EINTR)
+			{
+				throw RuntimeException(GetErrnoStr("Polling the socket"));
+			}
+		}
+	}
+
+	int m_fd;
+
+	bool m_isInSession;
+	uint64_t m_idleTimeoutMs;
+	ClockType::time_point m_idleDeadline;
+	std::atomic<bool> m_isArmed;
+	ClockType::time_point m_requestDeadline;
+};
+
+EpollServer::EpollServer(std::shared_ptr<RequestHandler> handler, uint32_t ipAddr, uint16_t port, size_t workerNum, size_t maxCntNum) :
+	m_handler(handler),
+	m_maxCntNum(maxCntNum),
+	m_listenFd(-1),
+	m_epollFd(-1),
+	m_wakeFd(-1),
+	m_cntsMutex(),
+	m_cnts(),
+	m_readyCnts(gsk_readyQueueSize),
+	m_isTerminated(false),
+	m_pollThread(),
+	m_workers()
+{
+	RaiseFileLimit(maxCntNum);
+
+	try
+	{
+		m_listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (m_listenFd < 0)
+		{
+			throw RuntimeException(GetErrnoStr("Creating the listening socket"));
+		}
+
+		const int reuseAddr = 1;
+		setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &reuseAddr, sizeof(reuseAddr));
+
+		sockaddr_in addr;
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(ipAddr);
+		addr.sin_port = htons(port);
+		if (bind(m_listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+			listen(m_listenFd, SOMAXCONN) != 0)
+		{
+			throw RuntimeException(GetErrnoStr("Listening on the port"));
+		}
+
+		m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+		m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (m_epollFd < 0 || m_wakeFd < 0)
+		{
+			throw RuntimeException(GetErrnoStr("Creating the epoll instance"));
+		}
+
+		//The listening socket is tagged with null, and the wake-up event with this server.
+		epoll_event listenEvent;
+		listenEvent.events = EPOLLIN;
+		listenEvent.data.ptr = nullptr;
+		epoll_event wakeEvent;
+		wakeEvent.events = EPOLLIN;
+		wakeEvent.data.ptr = this;
+		if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_listenFd, &listenEvent) != 0 ||
+			epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &wakeEvent) != 0)
+		{
+			throw RuntimeException(GetErrnoStr("Registering to the epoll instance"));
+		}
+	}
+	catch (const std::exception&)
+	{
+		for (int fd : { m_listenFd, m_epollFd, m_wakeFd })
+		{
+			if (fd >= 0)
+			{
+				close(fd);
+			}
+		}
+		throw;
+	}
+
+	m_pollThread = std::thread([this]()
+	{
+		this->PollLoop();
+	});
+
+	for (size_t i = 0; i < (workerNum > 0 ? workerNum : 1); ++i)
+	{
+		m_workers.push_back(std::thread([this]()
+		{
+			this->Worker();
+		}));
+	}
+}
+
+EpollServer::~EpollServer()
+{
+	Terminate();
+
+	//Callbacks of held connections must not be called once the server is gone. Connections closed
+	//by a callback meanwhile are only used as keys here.
+	std::vector<SocketConnection*> cntPtrs;
+	{
+		std::unique_lock<std::mutex> cntsLock(m_cntsMutex);
+		for (auto& item : m_cnts)
+		{
+			cntPtrs.push_back(item.first);
+		}
+	}
+	for (SocketConnection* cntPtr : cntPtrs)
+	{
+		GetHeldCntRegistry().Cancel(cntPtr);
+	}
+
+	std::map<SocketConnection*, std::unique_ptr<SocketConnection> > cnts;
+	{
+		std::unique_lock<std::mutex> cntsLock(m_cntsMutex);
+		cnts.swap(m_cnts);
+	}
+	for (auto& item : cnts)
+	{
+		CloseSession(*item.second);
+	}
+
+	//The handler may still refer to held connections, so it's released before connections are closed.
+	m_handler.reset();
+	cnts.clear();
+
+	close(m_listenFd);
+	close(m_wakeFd);
+	close(m_epollFd);
+}
+
+void EpollServer::Terminate()
+{
+	if (m_isTerminated.exchange(true))
+	{
+		return;
+	}
+
+	const uint64_t wake = 1;
+	ssize_t res = write(m_wakeFd, &wake, sizeof(wake));
+	(void)res;
+
+	m_readyCnts.Close();
+
+	{
+		//Unblock workers that are serving requests.
+		std::unique_lock<std::mutex> cntsLock(m_cntsMutex);
+		for (auto& item : m_cnts)
+		{
+			item.second->Terminate();
+		}
+	}
+
+	if (m_pollThread.joinable())
+	{
+		m_pollThread.join();
+	}
+	for (std::thread& worker : m_workers)
+	{
+		if (worker.joinable())
+		{
+			worker.join();
+		}
+	}
+	m_workers.clear();
+}
+
+void EpollServer::PollLoop()
+{
+	epoll_event events[gsk_maxEventNum];
+
+	SocketConnection::ClockType::time_point nextSweep = SocketConnection::ClockType::now();
+	while (!m_isTerminated)
+	{
+		const SocketConnection::ClockType::time_point now = SocketConnection::ClockType::now();
+		if (nextSweep <= now)
+		{
+			CloseIdleSessions(now);
+			nextSweep = now + std::chrono::milliseconds(gsk_sessionSweepIntervalMs);
+		}
+
+		const int eventNum = epoll_wait(m_epollFd, events, gsk_maxEventNum, gsk_sessionSweepIntervalMs);
+		if (eventNum < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			PRINT_W("Epoll server stopped polling. Error msg: %s", GetErrnoStr("epoll_wait").c_str());
+			return;
+		}
+
+		for (int i = 0; i < eventNum; ++i)
+		{
+			void* tag = events[i].data.ptr;
+			if (tag == nullptr)
+			{
+				Accept();
+			}
+			else if (tag == this)
+			{
+				return; //Woken up by Terminate().
+			}
+			else
+			{
+				SocketConnection* cnt = static_cast<SocketConnection*>(tag);
+				cnt->Disarm();
+				if ((events[i].events & EPOLLIN) == 0)
+				{
+					Close(cnt); //Error or hang-up without pending data.
+				}
+				else if (!m_readyCnts.Push(std::move(cnt)))
+				{
+					return; //Terminated.
+				}
+			}
+		}
+	}
+}
+
+void EpollServer::Worker()
+{
+	SocketConnection* cnt = nullptr;
+	while (m_readyCnts.Pop(cnt))
+	{
+		Serve(cnt);
+	}
+}
+
+void EpollServer::Accept()
+{
+	while (true)
+	{
+		const int fd = accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+		if (fd < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+			{
+				PRINT_W("Failed to accept connection. Error msg: %s", GetErrnoStr("accept4").c_str());
+			}
+			return;
+		}
+
+		const int noDelay = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+		std::unique_ptr<SocketConnection> cnt(new SocketConnection(fd));
+		SocketConnection* cntPtr = cnt.get();
+		{
+			std::unique_lock<std::mutex> cntsLock(m_cntsMutex);
+			if (m_cnts.size() >= m_maxCntNum)
+			{
+				LOGW("Too many connections; the new connection is refused.");
+				continue;
+			}
+			cntPtr->Arm();
+			m_cnts[cntPtr] = std::move(cnt);
+		}
+
+		epoll_event event;
+		event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+		event.data.ptr = cntPtr;
+		if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) != 0)
+		{
+			std::unique_lock<std::mutex> cntsLock(m_cntsMutex);
+			m_cnts.erase(cntPtr);
+		}
+	}
+}
+
+void EpollServer::Serve(SocketConnection* cnt)
+{
+	int result = ProcResult::k_close;
+
+	//The deadline also covers the time the connection is held, since the reply is sent when it's released.
+	cnt->StartRequest();
+
+	try
+	{
+		if (cnt->IsInSession())
+		{
+			//Data of the next message have arrived.
+			result = m_handler->ProcessSessionMsg(*cnt);
+		}
+		else
+		{
+			std::string category;
+			cnt->ReceivePack(category);
+
+			cnt->SetIdleTimeout(m_handler->GetSessionIdleTimeoutMs(category));
+			result = m_handler->ProcessRequest(category, *cnt);
+		}
+	}
+	catch (const std::exception&)
+	{
+		//Most likely, the peer has closed the connection.
+		Close(cnt);
+		return;
+	}
+
+	if (result == ProcResult::k_held)
+	{
+		//The connection is parked, without a worker, until the enclave releases it.
+		cnt->SetInSession(false);
+		GetHeldCntRegistry().Hold(cnt, [this, cnt](int releaseResult)
+		{
+			this->Finish(cnt, releaseResult);
+		});
+		return;
+	}
+
+	Finish(cnt, result);
+}
+
+void EpollServer::Finish(SocketConnection* cnt, int result)
+{
+	cnt->SetInSession(result == ProcResult::k_session);
+
+	if (result == ProcResult::k_done || result == ProcResult::k_session)
+	{
+		Rearm(cnt);
+	}
+	else
+	{
+		Close(cnt);
+	}
+}
+
+void EpollServer::Rearm(SocketConnection* cnt)
+{
+	std::unique_lock<std::mutex> cntsLock(m_cntsMutex);
+	if (m_cnts.find(cnt) == m_cnts.end())
+	{
+		return;
+	}
+
+	cnt->Arm();
+
+	epoll_event event;
+	event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+	event.data.ptr = cnt;
+	if (epoll_ctl(m_epollFd, EPOLL_CTL_MOD, cnt->GetFd(), &event) != 0)
+	{
+		cnt->Disarm();
+		cntsLock.unlock();
+		Close(cnt);
+	}
+}
+
+void EpollServer::Close(SocketConnection* cnt)
+{
+	std::unique_ptr<SocketConnection> closedCnt;
+	{
+		std::unique_lock<std::mutex> cntsLock(m_cntsMutex);
+		auto it = m_cnts.find(cnt);
+		if (it == m_cnts.end())
+		{
+			return;
+		}
+		epoll_ctl(m_epollFd, EPOLL_CTL_DEL, cnt->GetFd(), nullptr);
+		closedCnt = std::move(it->second);
+		m_cnts.erase(it);
+	}
+
+	CloseSession(*closedCnt);
+}
+
+void EpollServer::CloseSession(SocketConnection& cnt)
+{
+	if (!cnt.IsInSession())
+	{
+		return;
+	}
+
+	try
+	{
+		m_handler->CloseSession(cnt);
+	}
+	catch (const std::exception& e)
+	{
+		PRINT_W("Failed to close the session of the connection. Error msg: %s", e.what());
+	}
+	cnt.SetInSession(false);
+}
+
+void EpollServer::CloseIdleSessions(const std::chrono::steady_clock::time_point& now)
+{
+	std::vector<std::unique_ptr<SocketConnection> > idleCnts;
+	{
+		std::unique_lock<std::mutex> cntsLock(m_cntsMutex);
+		for (auto it = m_cnts.begin(); it != m_cnts.end();)
+		{
+			if (it->second->IsSessionExpired(now))
+			{
+				//Once it's removed from epoll, its event can't fire anymore.
+				epoll_ctl(m_epollFd, EPOLL_CTL_DEL, it->second->GetFd(), nullptr);
+				idleCnts.push_back(std::move(it->second));
+				it = m_cnts.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
+	for (std::unique_ptr<SocketConnection>& cnt : idleCnts)
+	{
+		CloseSession(*cnt);
+	}
+}
+
+#else //__linux__
+
+using namespace Decent;
+using namespace Decent::Dht;
+using namespace Decent::Net;
+
+class EpollServer::SocketConnection
+{
+};
+
+EpollServer::EpollServer(std::shared_ptr<RequestHandler> handler, uint32_t ipAddr, uint16_t port, size_t workerNum, size_t maxCntNum) :
+	m_handler(handler),
+	m_maxCntNum(maxCntNum),
+	m_listenFd(-1),
+	m_epollFd(-1),
+	m_wakeFd(-1),
+	m_cntsMutex(),
+	m_cnts(),
+	m_readyCnts(1),
+	m_isTerminated(true),
+	m_pollThread(),
+	m_workers()
+{
+	throw RuntimeException("The epoll front end is only available on Linux.");
+}
+
+EpollServer::~EpollServer()
+{
+}
+
+void EpollServer::Terminate()
+{
+}
+
+#endif //__linux__
+
+#endif //ENCLAVE_PLATFORM_NON_ENCLAVE
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../../../Common/Dht/BoundedQueue.h"
+
+namespace Decent
+{
+	namespace Dht
+	{
+		class RequestHandler;
+
+		/**
+		 * \brief	An event-driven TCP front end, as an alternative to SmartServer, for hosts with lots of
+		 * 			idle or held connections. It's only available on Linux.
+		 *
+		 * 			All connections are registered to one epoll instance, watched by a single poll thread;
+		 * 			no thread is spent on a connection while it's idle, or while it's held by the enclave
+		 * 			(e.g. an app waiting for its lookup result). Once a request arrives on a connection,
+		 * 			the connection is handed to one of a fixed number of workers, which reads the request
+		 * 			category and passes the connection to the handler, just like SmartServer does:
+		 * 			- If the handler holds the connection, it's parked until it's released through
+		 * 			  HeldCntRegistry, at which time it's watched again for the next request.
+		 * 			- If the enclave keeps the session of the connection, it's watched again, and the
+		 * 			  next message is passed to the handler as a message of the session, without a
+		 * 			  category; thus, a session takes neither a worker nor an ECall while it's idle.
+		 * 			  Sessions that wait for too long are closed.
+		 * 			- Otherwise, it's watched again right away.
+		 * 			A connection is closed once the peer closes it, the handler throws, or the handler
+		 * 			(or the release) asks for it to be closed.
+		 */
+		class EpollServer
+		{
+		public:
+			EpollServer() = delete;
+
+			/**
+			 * \brief	Constructor. Starts listening, and starts all threads.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the server fails to be set up.
+			 *
+			 * \param	handler  	The connection handler, usually the enclave.
+			 * \param	ipAddr   	The IP address to listen on (in host byte order).
+			 * \param	port	 	The port number to listen on.
+			 * \param	workerNum	Number of workers that serve requests.
+			 * \param	maxCntNum	Maximum number of connections; new connections beyond it are refused.
+			 */
+			EpollServer(std::shared_ptr<RequestHandler> handler, uint32_t ipAddr, uint16_t port, size_t workerNum, size_t maxCntNum);
+
+			/** \brief	Destructor. Terminates the server, and closes all connections. */
+			virtual ~EpollServer();
+
+			/** \brief	Stops accepting and serving connections, and joins all threads. */
+			void Terminate();
+
+		private:
+			class SocketConnection;
+
+			void PollLoop();
+
+			void Worker();
+
+			void Accept();
+
+			/** \brief	Serves one request on the connection, which has become readable. */
+			void Serve(SocketConnection* cnt);
+
+			/** \brief	Watches the connection again, or closes it, according to the result (see ProcResult). */
+			void Finish(SocketConnection* cnt, int result);
+
+			/** \brief	Watches the connection again for the next request, or the next message of its session. */
+			void Rearm(SocketConnection* cnt);
+
+			/** \brief	Unregisters and closes the connection, and the session kept for it. */
+			void Close(SocketConnection* cnt);
+
+			/** \brief	Closes the session kept by the enclave for the connection, if there is any. */
+			void CloseSession(SocketConnection& cnt);
+
+			/** \brief	Closes connections whose sessions have waited for their next messages for too long. */
+			void CloseIdleSessions(const std::chrono::steady_clock::time_point& now);
+
+			std::shared_ptr<RequestHandler> m_handler;
+			const size_t m_maxCntNum;
+
+			int m_listenFd;
+			int m_epollFd;
+			int m_wakeFd;
+
+			std::mutex m_cntsMutex;
+			std::map<SocketConnection*, std::unique_ptr<SocketConnection> > m_cnts;
+
+			BoundedQueue<SocketConnection*> m_readyCnts;
+
+			std::atomic<bool> m_isTerminated;
+			std::thread m_pollThread;
+			std::vector<std::thread> m_workers;
+		};
+	}
+}
@@ -0,0 +1,231 @@
+#include "RequestHandler.h"
+
+#include <cstdint>
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <condition_variable>
+
+#include <DecentApi/Common/Net/ConnectionBase.h>
+
+#include "../../Common/Dht/ProcResult.h"
+
+#include "HeldCntRegistry.h"
+
+using namespace Decent::Dht;
+using namespace Decent::Net;
+
+namespace
+{
+	/**
+	 * \brief	Terminates connections that have waited for data for too long, so that the threads
+	 * 			blocked on them return.
+	 */
+	class IdleWatchdog
+	{
+	public:
+		typedef std::chrono::steady_clock ClockType;
+
+	public:
+		IdleWatchdog() :
+			m_mutex(),
+			m_signal(),
+			m_deadlines(),
+			m_isTerminated(false),
+			m_thread([this]()
+			{
+				this->Run();
+			})
+		{}
+
+		~IdleWatchdog()
+		{
+			{
+				std::unique_lock<std::mutex> deadlinesLock(m_mutex);
+				m_isTerminated = true;
+			}
+			m_signal.notify_all();
+			m_thread.join();
+		}
+
+		/** \brief	Terminates the connection once the deadline is passed, unless it's disarmed before. */
+		void Arm(ConnectionBase* cnt, ClockType::time_point deadline)
+		{
+			{
+				std::unique_lock<std::mutex> deadlinesLock(m_mutex);
+				m_deadlines[cnt] = deadline;
+			}
+			m_signal.notify_all();
+		}
+
+		/** \brief	Disarms the connection. Returns false if it has been terminated by the watchdog. */
+		bool Disarm(ConnectionBase* cnt)
+		{
+			std::unique_lock<std::mutex> deadlinesLock(m_mutex);
+			return m_deadlines.erase(cnt) > 0;
+		}
+
+	private:
+		void Run()
+		{
+			std::unique_lock<std::mutex> deadlinesLock(m_mutex);
+			while (!m_isTerminated)
+			{
+				const ClockType::time_point now = ClockType::now();
+				ClockType::time_point nextDeadline = ClockType::time_point::max();
+				for (auto it = m_deadlines.begin(); it != m_deadlines.end();)
+				{
+					if (it->second <= now)
+					{
+						it->first->Terminate();
+						it = m_deadlines.erase(it);
+					}
+					else
+					{
+						nextDeadline = std::min(nextDeadline, it->second);
+						++it;
+					}
+				}
+
+				if (m_deadlines.size() == 0)
+				{
+					m_signal.wait(deadlinesLock);
+				}
+				else
+				{
+					m_signal.wait_until(deadlinesLock, nextDeadline);
+				}
+			}
+		}
+
+		std::mutex m_mutex;
+		std::condition_variable m_signal;
+		std::map<ConnectionBase*, ClockType::time_point> m_deadlines;
+		bool m_isTerminated;
+		std::thread m_thread;
+	};
+
+	static IdleWatchdog& GetIdleWatchdog()
+	{
+		static IdleWatchdog inst;
+		return inst;
+	}
+
+	/**
+	 * \brief	A connection that can wait for data without taking them, so that the data are still
+	 * 			there for the enclave. The byte read while waiting is put back in front of the stream.
+	 */
+	class WaitableConnection : public ConnectionBase
+	{
+	public:
+		WaitableConnection(ConnectionBase& base) :
+			m_base(base),
+			m_hasPeeked(false),
+			m_peeked(0)
+		{}
+
+		virtual ~WaitableConnection()
+		{}
+
+		virtual size_t SendRaw(const void* const dataPtr, const size_t size) override
+		{
+			return m_base.SendRaw(dataPtr, size);
+		}
+
+		virtual size_t ReceiveRaw(void* const bufPtr, const size_t size) override
+		{
+			if (m_hasPeeked && size > 0)
+			{
+				*static_cast<uint8_t*>(bufPtr) = m_peeked;
+				m_hasPeeked = false;
+				return 1;
+			}
+			return m_base.ReceiveRaw(bufPtr, size);
+		}
+
+		virtual void Terminate() noexcept override
+		{
+			m_base.Terminate();
+		}
+
+		/**
+		 * \brief	Waits until data arrive.
+		 *
+		 * \param	timeoutMs	The timeout, in milliseconds; the connection is terminated once it expires.
+		 *
+		 * \return	False if the connection is closed, or the timeout has expired.
+		 */
+		bool WaitData(uint64_t timeoutMs)
+		{
+			if (m_hasPeeked)
+			{
+				return true;
+			}
+
+			GetIdleWatchdog().Arm(&m_base, IdleWatchdog::ClockType::now() + std::chrono::milliseconds(timeoutMs));
+			try
+			{
+				m_base.ReceiveRaw(&m_peeked, 1);
+			}
+			catch (const std::exception&)
+			{
+				GetIdleWatchdog().Disarm(&m_base);
+				return false;
+			}
+
+			m_hasPeeked = GetIdleWatchdog().Disarm(&m_base);
+			return m_hasPeeked;
+		}
+
+	private:
+		ConnectionBase& m_base;
+		bool m_hasPeeked;
+		uint8_t m_peeked;
+	};
+}
+
+int RequestHandler::ServeBlocking(const std::string & category, ConnectionBase & connection)
+{
+	//The enclave keeps the session for the connection passed to it, so the same wrapper is used for
+	//the whole session.
+	WaitableConnection cnt(connection);
+	const uint64_t idleTimeoutMs = GetSessionIdleTimeoutMs(category);
+
+	int result = ProcessRequest(category, cnt);
+	while (true)
+	{
+		if (result == ProcResult::k_held)
+		{
+			result = GetHeldCntRegistry().WaitRelease(&cnt);
+		}
+
+		if (result != ProcResult::k_session)
+		{
+			return result == ProcResult::k_done ? result : ProcResult::k_close;
+		}
+
+		try
+		{
+			if (!cnt.WaitData(idleTimeoutMs))
+			{
+				CloseSession(cnt);
+				return ProcResult::k_close;
+			}
+
+			result = ProcessSessionMsg(cnt);
+		}
+		catch (const std::exception&)
+		{
+			try
+			{
+				CloseSession(cnt);
+			}
+			catch (const std::exception&)
+			{}
+			throw;
+		}
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+
+#include <string>
+
+namespace Decent
+{
+	namespace Net
+	{
+		class ConnectionBase;
+	}
+
+	namespace Dht
+	{
+		/**
+		 * \brief	A handler of requests that tells how the connection should be served afterwards,
+		 * 			rather than only whether it's held; used by front ends that don't block on held
+		 * 			connections, e.g. EpollServer.
+		 */
+		class RequestHandler
+		{
+		public:
+			/** \brief	Destructor */
+			virtual ~RequestHandler()
+			{}
+
+			/**
+			 * \brief	Processes a request, whose category has already been received.
+			 *
+			 * \param 		  	category  	The category of the request.
+			 * \param [in,out]	connection	The connection.
+			 *
+			 * \return	What to do with the connection next (see ProcResult). If it's ProcResult::k_held,
+			 * 			the connection is released through HeldCntRegistry later.
+			 */
+			virtual int ProcessRequest(const std::string& category, Net::ConnectionBase& connection) = 0;
+
+			/**
+			 * \brief	Processes the next message of a session kept by the enclave (see ProcResult::k_session).
+			 * 			It's called once data have arrived on the connection.
+			 *
+			 * \param [in,out]	connection	The connection, which is the same one the session is opened on.
+			 *
+			 * \return	What to do with the connection next (see ProcResult).
+			 */
+			virtual int ProcessSessionMsg(Net::ConnectionBase& connection) = 0;
+
+			/**
+			 * \brief	Closes the session kept by the enclave for the connection, if there is any. It must be
+			 * 			called before a connection with a kept session is destroyed.
+			 *
+			 * \param [in,out]	connection	The connection.
+			 */
+			virtual void CloseSession(Net::ConnectionBase& connection) = 0;
+
+			/**
+			 * \brief	Gets how long a session opened by a request of the given category may wait for its
+			 * 			next message before it's closed.
+			 *
+			 * \param	category	The category of the request that opened the session.
+			 *
+			 * \return	The timeout, in milliseconds.
+			 */
+			virtual uint64_t GetSessionIdleTimeoutMs(const std::string& category) const = 0;
+
+			/**
+			 * \brief	Serves a request, and the session it opens, on the calling thread, for front ends that
+			 * 			spend a thread on each connection (e.g. SmartServer). The thread, but not the enclave,
+			 * 			waits for each message of the session, and for held connections to be released.
+			 *
+			 * \param 		  	category  	The category of the request.
+			 * \param [in,out]	connection	The connection.
+			 *
+			 * \return	ProcResult::k_done if the next request on the connection can be served as usual;
+			 * 			otherwise, ProcResult::k_close.
+			 */
+			int ServeBlocking(const std::string& category, Net::ConnectionBase& connection);
+		};
+	}
+}
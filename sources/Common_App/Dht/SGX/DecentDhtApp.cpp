@@ -8,34 +8,55 @@
 #include <DecentApi/CommonApp/Threading/TaskSet.h>
 
 #include "../../../Common/Dht/RequestCategory.h"
+#include "../../../Common/Dht/ProcResult.h"
 
+#include "../HeldCntRegistry.h"
+
+extern "C" sgx_status_t ecall_decent_dht_set_one_hop_routing(sgx_enclave_id_t eid, int is_enabled);
+extern "C" sgx_status_t ecall_decent_dht_set_store_config(sgx_enclave_id_t eid, int* retval, size_t paged_value_max_size, size_t value_cache_budget, int is_index_untrusted);
+extern "C" sgx_status_t ecall_decent_dht_set_session_budget(sgx_enclave_id_t eid, size_t max_session_num);
 extern "C" sgx_status_t ecall_decent_dht_init(sgx_enclave_id_t eid, int* retval, uint64_t self_addr, int is_first_node, uint64_t ex_addr, size_t totalNode, size_t idx);
 extern "C" sgx_status_t ecall_decent_dht_deinit(sgx_enclave_id_t eid);
 
-extern "C" sgx_status_t ecall_decent_dht_proc_msg_from_dht(sgx_enclave_id_t eid, int* retval, void* connection, void** prev_held_cnt);
+extern "C" sgx_status_t ecall_decent_dht_proc_msg_from_dht(sgx_enclave_id_t eid, int* retval, void* connection);
 extern "C" sgx_status_t ecall_decent_dht_proc_msg_from_store(sgx_enclave_id_t eid, int* retval, void* connection);
 extern "C" sgx_status_t ecall_decent_dht_proc_msg_from_app(sgx_enclave_id_t eid, int* retval, void* connection);
+extern "C" sgx_status_t ecall_decent_dht_proc_session_msg(sgx_enclave_id_t eid, int* retval, void* connection);
+extern "C" sgx_status_t ecall_decent_dht_close_session(sgx_enclave_id_t eid, void* connection);
 
+extern "C" sgx_status_t ecall_decent_dht_set_forward_batching(sgx_enclave_id_t eid, size_t flush_size, uint64_t window_ms);
 extern "C" sgx_status_t ecall_decent_dht_forward_queue_worker(sgx_enclave_id_t eid, int* retval);
 extern "C" sgx_status_t ecall_decent_dht_reply_queue_worker(sgx_enclave_id_t eid, int* retval);
+extern "C" sgx_status_t ecall_decent_dht_pending_query_timer(sgx_enclave_id_t eid, int* retval);
+extern "C" sgx_status_t ecall_decent_dht_task_worker(sgx_enclave_id_t eid, int* retval);
 extern "C" sgx_status_t ecall_decent_dht_terminate_workers(sgx_enclave_id_t eid);
 
 using namespace Decent::Net;
 using namespace Decent::Dht;
 
+namespace
+{
+	/** \brief	Time, in milliseconds, an app session may wait for its next request before it's closed. */
+	static constexpr uint64_t gsk_appSessionIdleTimeoutMs = 30 * 1000;
+
+	/**
+	 * \brief	Time, in milliseconds, a channel opened by a peer may wait for its next RPC before it's
+	 * 			closed. Peers close channels idle for DhtSecureConnectionMgr::sk_channelMaxIdleMs first.
+	 */
+	static constexpr uint64_t gsk_channelIdleTimeoutMs = 2 * 60 * 1000;
+}
+
 Decent::Dht::DecentDhtApp::~DecentDhtApp()
 {
 	TerminateWorkers();
 	ecall_decent_dht_deinit(GetEnclaveId());
 }
 
-bool DecentDhtApp::ProcessMsgFromDht(ConnectionBase & connection, ConnectionBase*& freeHeldCnt)
+int DecentDhtApp::ProcessMsgFromDht(ConnectionBase & connection)
 {
-	int retValue = false;
-
-	void*& prevHeldCntRef = reinterpret_cast<void*&>(freeHeldCnt);
+	int retValue = ProcResult::k_close;
 
-	sgx_status_t enclaveRet = ecall_decent_dht_proc_msg_from_dht(GetEnclaveId(), &retValue, &connection, &prevHeldCntRef);
+	sgx_status_t enclaveRet = ecall_decent_dht_proc_msg_from_dht(GetEnclaveId(), &retValue, &connection);
 	DECENT_CHECK_SGX_STATUS_ERROR(enclaveRet, ecall_decent_dht_proc_msg_from_dht);
 
 	return retValue;
@@ -51,9 +72,9 @@ bool DecentDhtApp::ProcessMsgFromStore(ConnectionBase & connection)
 	return retValue;
 }
 
-bool DecentDhtApp::ProcessMsgFromApp(ConnectionBase & connection)
+int DecentDhtApp::ProcessMsgFromApp(ConnectionBase & connection)
 {
-	int retValue = false;
+	int retValue = ProcResult::k_close;
 
 	sgx_status_t enclaveRet = ecall_decent_dht_proc_msg_from_app(GetEnclaveId(), &retValue, &connection);
 	DECENT_CHECK_SGX_STATUS_ERROR(enclaveRet, ecall_decent_dht_proc_msg_from_app);
@@ -61,6 +82,33 @@ bool DecentDhtApp::ProcessMsgFromApp(ConnectionBase & connection)
 	return retValue;
 }
 
+int DecentDhtApp::ProcessSessionMsg(ConnectionBase & connection)
+{
+	int retValue = ProcResult::k_close;
+
+	sgx_status_t enclaveRet = ecall_decent_dht_proc_session_msg(GetEnclaveId(), &retValue, &connection);
+	DECENT_CHECK_SGX_STATUS_ERROR(enclaveRet, ecall_decent_dht_proc_session_msg);
+
+	return retValue;
+}
+
+void DecentDhtApp::CloseSession(ConnectionBase & connection)
+{
+	sgx_status_t enclaveRet = ecall_decent_dht_close_session(GetEnclaveId(), &connection);
+	DECENT_CHECK_SGX_STATUS_ERROR(enclaveRet, ecall_decent_dht_close_session);
+}
+
+uint64_t DecentDhtApp::GetSessionIdleTimeoutMs(const std::string & category) const
+{
+	return category == RequestCategory::sk_fromApp ? gsk_appSessionIdleTimeoutMs : gsk_channelIdleTimeoutMs;
+}
+
+void DecentDhtApp::SetForwardBatching(size_t flushSize, uint64_t windowMs)
+{
+	sgx_status_t enclaveRet = ecall_decent_dht_set_forward_batching(GetEnclaveId(), flushSize, windowMs);
+	DECENT_CHECK_SGX_STATUS_ERROR(enclaveRet, ecall_decent_dht_set_forward_batching);
+}
+
 void DecentDhtApp::QueryForwardWorker()
 {
 	int retVal = false;
@@ -85,29 +133,94 @@ void DecentDhtApp::QueryReplyWorker()
 	}
 }
 
+void DecentDhtApp::PendingQueryTimer()
+{
+	int retVal = false;
+
+	sgx_status_t enclaveRet = ecall_decent_dht_pending_query_timer(GetEnclaveId(), &retVal);
+	DECENT_CHECK_SGX_STATUS_ERROR(enclaveRet, ecall_decent_dht_pending_query_timer);
+	if (!retVal)
+	{
+		throw RuntimeException("DecentDhtApp::PendingQueryTimer failed.");
+	}
+}
+
+void DecentDhtApp::TaskWorker()
+{
+	int retVal = false;
+
+	sgx_status_t enclaveRet = ecall_decent_dht_task_worker(GetEnclaveId(), &retVal);
+	DECENT_CHECK_SGX_STATUS_ERROR(enclaveRet, ecall_decent_dht_task_worker);
+	if (!retVal)
+	{
+		throw RuntimeException("DecentDhtApp::TaskWorker failed.");
+	}
+}
+
 void DecentDhtApp::TerminateWorkers()
 {
 	ecall_decent_dht_terminate_workers(GetEnclaveId());
+
+	//Held connections will not be released once the pending query timer is stopped.
+	GetHeldCntRegistry().Terminate();
 }
 
-bool DecentDhtApp::ProcessSmartMessage(const std::string & category, ConnectionBase & connection, ConnectionBase*& freeHeldCnt)
+int DecentDhtApp::ProcessRequest(const std::string & category, ConnectionBase & connection)
 {
 	if (category == RequestCategory::sk_fromDht)
 	{
-		return ProcessMsgFromDht(connection, freeHeldCnt);
+		return ProcessMsgFromDht(connection);
 	}
 	else if (category == RequestCategory::sk_fromStore)
 	{
-		return ProcessMsgFromStore(connection);
+		ProcessMsgFromStore(connection);
+		return ProcResult::k_done; //Store requests are never held.
 	}
 	else if (category == RequestCategory::sk_fromApp)
 	{
 		return ProcessMsgFromApp(connection);
 	}
 	else
+	{
+		return ProcResult::k_close;
+	}
+}
+
+bool DecentDhtApp::ProcessSmartMessage(const std::string & category, ConnectionBase & connection, ConnectionBase*& freeHeldCnt)
+{
+	if (category != RequestCategory::sk_fromDht &&
+		category != RequestCategory::sk_fromStore &&
+		category != RequestCategory::sk_fromApp)
 	{
 		return Decent::RaSgx::DecentApp::ProcessSmartMessage(category, connection, freeHeldCnt);
 	}
+
+	if (ServeBlocking(category, connection) == ProcResult::k_close)
+	{
+		connection.Terminate();
+	}
+	return false;
+}
+
+void DecentDhtApp::SetOneHopRouting(bool isEnabled)
+{
+	sgx_status_t enclaveRet = ecall_decent_dht_set_one_hop_routing(GetEnclaveId(), isEnabled);
+	DECENT_CHECK_SGX_STATUS_ERROR(enclaveRet, ecall_decent_dht_set_one_hop_routing);
+}
+
+void DecentDhtApp::SetStoreConfig(size_t pagedValueMaxSize, size_t valueCacheBudget, bool isIndexUntrusted)
+{
+	int retValue = false;
+
+	sgx_status_t enclaveRet = ecall_decent_dht_set_store_config(GetEnclaveId(), &retValue, pagedValueMaxSize, valueCacheBudget, isIndexUntrusted);
+	DECENT_CHECK_SGX_STATUS_ERROR(enclaveRet, ecall_decent_dht_set_store_config);
+	DECENT_ASSERT_ENCLAVE_APP_RESULT(retValue, "Configure DHT store.");
+}
+
+void DecentDhtApp::SetSessionBudget(size_t maxSessionNum)
+{
+	sgx_status_t enclaveRet = ecall_decent_dht_set_session_budget(GetEnclaveId(), maxSessionNum);
+	DECENT_CHECK_SGX_STATUS_ERROR(enclaveRet, ecall_decent_dht_set_session_budget);
 }
 
 void DecentDhtApp::InitDhtNode(uint64_t selfAddr, uint64_t exNodeAddr, size_t totalNode, size_t idx)
@@ -156,6 +269,42 @@ void DecentDhtApp::InitQueryWorkers(const size_t forwardWorkerNum, const size_t
 
 		m_queryWorkerPool->AddTaskSet(task);
 	}
+
+	std::unique_ptr<TaskSet> timerTask = std::make_unique<TaskSet>(
+		[this]() //Main task
+	{
+		this->PendingQueryTimer();
+	},
+		[this]() //Main task killer
+	{
+		this->TerminateWorkers();
+	}
+	);
+
+	m_queryWorkerPool->AddTaskSet(timerTask);
+}
+
+void DecentDhtApp::InitTaskWorkers(const size_t taskWorkerNum)
+{
+	using namespace Decent::Threading;
+
+	m_taskWorkerPool = std::make_unique<SingleTaskThreadPool>(nullptr);
+
+	for (size_t i = 0; i < taskWorkerNum; ++i)
+	{
+		std::unique_ptr<TaskSet> task = std::make_unique<TaskSet>(
+			[this]() //Main task
+		{
+			this->TaskWorker();
+		},
+			[this]() //Main task killer
+		{
+			this->TerminateWorkers();
+		}
+		);
+
+		m_taskWorkerPool->AddTaskSet(task);
+	}
 }
 
 #endif // ENCLAVE_PLATFORM_SGX
@@ -2,6 +2,8 @@
 
 #include <DecentApi/DecentAppApp/DecentApp.h>
 
+#include "../RequestHandler.h"
+
 namespace Decent
 {
 	namespace Threading
@@ -11,33 +13,116 @@ namespace Decent
 
 	namespace Dht
 	{
-		class DecentDhtApp : public Decent::RaSgx::DecentApp
+		class DecentDhtApp : public Decent::RaSgx::DecentApp, public RequestHandler
 		{
 		public:
 			using DecentApp::DecentApp;
 
 			virtual ~DecentDhtApp();
 
-			virtual bool ProcessMsgFromDht(Decent::Net::ConnectionBase& connection, Net::ConnectionBase*& freeHeldCnt);
+			/**
+			 * \brief	Processes a request from a DHT node.
+			 *
+			 * \param [in,out]	connection	The connection.
+			 *
+			 * \return	What to do with the connection next (see ProcResult).
+			 */
+			virtual int ProcessMsgFromDht(Decent::Net::ConnectionBase& connection);
 
 			virtual bool ProcessMsgFromStore(Decent::Net::ConnectionBase& connection);
 
-			virtual bool ProcessMsgFromApp(Decent::Net::ConnectionBase& connection);
+			/**
+			 * \brief	Processes the first request of an app session.
+			 *
+			 * \param [in,out]	connection	The connection.
+			 *
+			 * \return	What to do with the connection next (see ProcResult).
+			 */
+			virtual int ProcessMsgFromApp(Decent::Net::ConnectionBase& connection);
 
 			virtual void QueryForwardWorker();
 
 			virtual void QueryReplyWorker();
 
+			virtual void PendingQueryTimer();
+
+			virtual void TaskWorker();
+
 			virtual void TerminateWorkers();
 
+			virtual int ProcessRequest(const std::string& category, Net::ConnectionBase& connection) override;
+
+			virtual int ProcessSessionMsg(Net::ConnectionBase& connection) override;
+
+			virtual void CloseSession(Net::ConnectionBase& connection) override;
+
+			/** \brief	App sessions are closed sooner than channels opened by peers. */
+			virtual uint64_t GetSessionIdleTimeoutMs(const std::string& category) const override;
+
+			/**
+			 * \brief	Processes a request for SmartServer (see RequestHandler::ServeBlocking). SmartServer can
+			 * 			only take back one held connection at the end of each request, so neither a held
+			 * 			connection nor a session is handed to it; instead, this thread (but not the enclave)
+			 * 			waits for the next message of the session, or for the connection to be released.
+			 * 			Thus, freeHeldCnt is never set.
+			 */
 			virtual bool ProcessSmartMessage(const std::string& category, Net::ConnectionBase& connection, Net::ConnectionBase*& freeHeldCnt) override;
 
+			/**
+			 * \brief	Enables or disables one-hop routing, where the DHT node keeps the full list of nodes in
+			 * 			the network. It must be called before InitDhtNode.
+			 *
+			 * \param	isEnabled	True to enable.
+			 */
+			void SetOneHopRouting(bool isEnabled);
+
+			/**
+			 * \brief	Configures the store of the DHT node. It must be called before InitDhtNode.
+			 *
+			 * \param	pagedValueMaxSize	Values not larger than this size are packed into pages. Zero to
+			 * 								disable paging.
+			 * \param	valueCacheBudget 	The memory budget, in bytes, of the cache of values for hot
+			 * 								keys inside the enclave. Zero to disable the cache.
+			 * \param	isIndexUntrusted 	True to keep the index in the memory store, authenticated by
+			 * 								the enclave, so the number of keys is not limited by enclave
+			 * 								memory; paging is disabled in this mode.
+			 */
+			void SetStoreConfig(size_t pagedValueMaxSize, size_t valueCacheBudget, bool isIndexUntrusted);
+
+			/**
+			 * \brief	Sets the maximum number of sessions the enclave keeps alive, each of which takes a
+			 * 			TLS context in the enclave heap. It must be called before InitDhtNode.
+			 *
+			 * \param	maxSessionNum	The maximum number of sessions.
+			 */
+			void SetSessionBudget(size_t maxSessionNum);
+
 			void InitDhtNode(uint64_t selfAddr, uint64_t exNodeAddr, size_t totalNode, size_t idx);
 
 			void InitQueryWorkers(const size_t forwardWorkerNum, const size_t replyWorkerNum);
 
+			/**
+			 * \brief	Sets how forwarded queries to the same next hop are coalesced into one message.
+			 *
+			 * \param	flushSize	Maximum number of queries sent in one message.
+			 * \param	windowMs 	Time, in milliseconds, to wait for more queries when there are fewer
+			 * 						than flushSize. Zero to send immediately.
+			 */
+			void SetForwardBatching(size_t flushSize, uint64_t windowMs);
+
+			/**
+			 * \brief	Initializes the workers that run tasks for the enclave's task pool (e.g. the stages
+			 * 			of migration pipelines). It should be called before InitDhtNode, so that the data
+			 * 			migration during joining can be pipelined. Each worker takes a TCS of the enclave
+			 * 			until workers are terminated, so the number is limited by TCSNum of the enclave.
+			 *
+			 * \param	taskWorkerNum	Number of task workers. Zero to run tasks on the threads that start them.
+			 */
+			void InitTaskWorkers(const size_t taskWorkerNum);
+
 		private:
 			std::unique_ptr<Threading::SingleTaskThreadPool> m_queryWorkerPool;
+			std::unique_ptr<Threading::SingleTaskThreadPool> m_taskWorkerPool;
 		};
 	}
 }
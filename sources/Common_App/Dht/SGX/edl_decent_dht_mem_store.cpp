@@ -1,9 +1,68 @@
 #ifdef ENCLAVE_PLATFORM_SGX
 
+#include <cstring>
+
+#include <DecentApi/Common/make_unique.h>
+
 #include "../../../Common/Dht/MemKeyValueStore.h"
+#include "../../../Common/Dht/UntrustedBufferPool.h"
 
 using namespace Decent::Dht;
 
+namespace
+{
+	static UntrustedBufferPool& GetBufferPool()
+	{
+		static std::unique_ptr<UntrustedBufferPool> inst = []()
+		{
+			std::unique_ptr<UntrustedBufferPool> pool = Decent::Tools::make_unique<UntrustedBufferPool>();
+			pool->m_nextBuf = 0;
+			for (size_t i = 0; i < UntrustedBufferPool::sk_bufNum; ++i)
+			{
+				pool->m_bufs[i].m_inUse = 0;
+			}
+			return pool;
+		}();
+
+		return *inst;
+	}
+
+	/**
+	 * \brief	Gets a buffer to be handed over to the enclave, which is a pooled buffer if possible, so
+	 * 			that the enclave can release it without an OCall.
+	 */
+	static uint8_t* AcquireBuffer(size_t size)
+	{
+		uint8_t* res = GetBufferPool().Acquire(size);
+		return res != nullptr ? res : new uint8_t[size > 0 ? size : 1];
+	}
+
+	/**
+	 * \brief	Hands a value moved out of the store over to the enclave. The value is copied into a
+	 * 			pooled buffer if possible, so that the enclave can release it without an OCall;
+	 * 			otherwise, the value's own buffer is handed over.
+	 */
+	static uint8_t* ToEnclave(MemKeyValueStore::ValueType&& val)
+	{
+		uint8_t* pooledBuf = GetBufferPool().Acquire(val.first);
+		if (pooledBuf == nullptr)
+		{
+			return val.second.release();
+		}
+
+		if (val.first > 0)
+		{
+			std::memcpy(pooledBuf, val.second.get(), val.first);
+		}
+		return pooledBuf;
+	}
+}
+
+extern "C" void* ocall_decent_dht_mem_store_get_buf_pool()
+{
+	return &GetBufferPool();
+}
+
 extern "C" void* ocall_decent_dht_mem_store_init()
 {
 	return new MemKeyValueStore();
@@ -50,11 +109,20 @@ extern "C" uint8_t* ocall_decent_dht_mem_store_read(void* obj, const char* key,
 
 	try
 	{
-		MemKeyValueStore::ValueType val = objPtr->Read(key);
-
-		*val_size = val.first;
-		
-		return val.second.release();
+		uint8_t* res = nullptr;
+
+		objPtr->Read(key, [&res, val_size](const uint8_t* val, size_t size)
+		{
+			//Copy straight into a pooled buffer, without an intermediate allocation.
+			res = AcquireBuffer(size);
+			if (size > 0)
+			{
+				std::memcpy(res, val, size);
+			}
+			*val_size = size;
+		});
+
+		return res;
 	}
 	catch (const std::exception&)
 	{
@@ -93,10 +161,14 @@ extern "C" uint8_t* ocall_decent_dht_mem_store_migrate_one(void* obj, const char
 	try
 	{
 		MemKeyValueStore::ValueType val = objPtr->Delete(key);
+		if (val.second.get() == nullptr)
+		{
+			return nullptr;
+		}
 
 		*val_size = val.first;
 
-		return val.second.release();
+		return ToEnclave(std::move(val));
 	}
 	catch (const std::exception&)
 	{
@@ -104,4 +176,75 @@ extern "C" uint8_t* ocall_decent_dht_mem_store_migrate_one(void* obj, const char
 	}
 }
 
+extern "C" int ocall_decent_dht_mem_store_migrate_range(void* obj, const char* start_key, const char* end_key, size_t max_count, uint8_t** buf_ptr, size_t* buf_size, size_t* pair_count)
+{
+	if (!obj || !start_key || !end_key || !buf_ptr || !buf_size || !pair_count)
+	{
+		return false;
+	}
+	MemKeyValueStore* objPtr = static_cast<MemKeyValueStore*>(obj);
+
+	*buf_ptr = nullptr;
+	*buf_size = 0;
+	*pair_count = 0;
+
+	try
+	{
+		std::vector<MemKeyValueStore::KeyValPair> pairs = objPtr->Migrate(start_key, end_key, max_count);
+		if (pairs.size() == 0)
+		{
+			return true;
+		}
+
+		//Packed straight into the buffer handed over, instead of being packed and then copied.
+		const size_t packedSize = MemKeyValueStore::GetPackedPairsSize(pairs);
+		uint8_t* packedPtr = AcquireBuffer(packedSize);
+		MemKeyValueStore::PackPairs(pairs, packedPtr);
+
+		*pair_count = pairs.size();
+		*buf_size = packedSize;
+		*buf_ptr = packedPtr;
+	}
+	catch (const std::exception&)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+extern "C" int ocall_decent_dht_mem_store_batch(void* obj, const uint8_t* req_ptr, size_t req_size, uint8_t** res_ptr, size_t* res_size)
+{
+	if (!obj || !req_ptr || !res_ptr || !res_size)
+	{
+		return false;
+	}
+	MemKeyValueStore* objPtr = static_cast<MemKeyValueStore*>(obj);
+
+	*res_ptr = nullptr;
+	*res_size = 0;
+
+	try
+	{
+		//Results are copied once, from where they are generated to the buffer handed over.
+		std::vector<uint8_t> res;
+		objPtr->ProcessBatch(req_ptr, req_size, res);
+
+		uint8_t* resPtr = AcquireBuffer(res.size());
+		if (res.size() > 0)
+		{
+			std::memcpy(resPtr, res.data(), res.size());
+		}
+
+		*res_size = res.size();
+		*res_ptr = resPtr;
+	}
+	catch (const std::exception&)
+	{
+		return false;
+	}
+
+	return true;
+}
+
 #endif //ENCLAVE_PLATFORM_SGX
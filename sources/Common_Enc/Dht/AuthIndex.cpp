@@ -0,0 +1,367 @@
+#include "AuthIndex.h"
+
+#include <cstring>
+
+#include <mbedtls/md.h>
+
+#include <DecentApi/Common/RuntimeException.h>
+
+#include "../../Common/Dht/MemKeyValueStore.h"
+
+using namespace Decent;
+using namespace Decent::Dht;
+
+namespace
+{
+	static AuthIndex::HashType CalcHash(const std::vector<uint8_t>& blob)
+	{
+		AuthIndex::HashType res;
+		int mbedRet = mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), blob.data(), blob.size(), res.data());
+		if (mbedRet != 0)
+		{
+			throw RuntimeException("Failed to calculate the hash of index.");
+		}
+		return res;
+	}
+
+	static bool IsEmptyHash(const AuthIndex::HashType& hash)
+	{
+		return hash == AuthIndex::HashType();
+	}
+
+	static std::string GetBlobKeyStr(const char* prefix, size_t id)
+	{
+		static constexpr char sk_hexDigits[] = "0123456789abcdef";
+
+		std::string res(prefix);
+		for (int i = 3; i >= 0; --i)
+		{
+			res.push_back(sk_hexDigits[(id >> (i * 4)) & 0x0F]);
+		}
+		return res;
+	}
+
+	static int HexToInt(char ch)
+	{
+		if (ch >= '0' && ch <= '9')
+		{
+			return ch - '0';
+		}
+		if (ch >= 'a' && ch <= 'f')
+		{
+			return ch - 'a' + 10;
+		}
+		if (ch >= 'A' && ch <= 'F')
+		{
+			return ch - 'A' + 10;
+		}
+		throw RuntimeException("Invalid key string is given to the index.");
+	}
+}
+
+constexpr size_t AuthIndex::sk_keySize;
+constexpr size_t AuthIndex::sk_tagSize;
+constexpr size_t AuthIndex::sk_hashSize;
+constexpr size_t AuthIndex::sk_bucketBits;
+constexpr size_t AuthIndex::sk_bucketNum;
+constexpr size_t AuthIndex::sk_groupSize;
+constexpr size_t AuthIndex::sk_groupNum;
+constexpr char AuthIndex::sk_bucketKeyPrefix[];
+constexpr char AuthIndex::sk_groupKeyPrefix[];
+
+uint32_t AuthIndex::GetBucketId(const std::string & keyStr)
+{
+	static constexpr size_t sk_prefixLen = sk_bucketBits / 4;
+	static_assert(sk_bucketBits % 4 == 0, "Bucket bits must be a multiple of hex digit size.");
+
+	if (keyStr.size() < sk_prefixLen)
+	{
+		throw RuntimeException("Invalid key string is given to the index.");
+	}
+
+	uint32_t res = 0;
+	for (size_t i = 0; i < sk_prefixLen; ++i)
+	{
+		res = (res << 4) | static_cast<uint32_t>(HexToInt(keyStr[i]));
+	}
+	return res;
+}
+
+AuthIndex::AuthIndex(BatchFuncType batchFunc) :
+	m_batchFunc(batchFunc),
+	m_pinnedGroupHashes(sk_groupNum)
+{}
+
+AuthIndex::~AuthIndex()
+{}
+
+bool AuthIndex::Find(uint32_t bucket, const KeyBinType & key, TagType & tag)
+{
+	std::vector<HashType> groupHashes;
+	for (const EntryType& entry : Load(bucket, groupHashes))
+	{
+		if (entry.first == key)
+		{
+			tag = entry.second;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool AuthIndex::Put(uint32_t bucket, const KeyBinType & key, const TagType & tag, TagType & oldTag)
+{
+	std::vector<HashType> groupHashes;
+	BucketType entries = Load(bucket, groupHashes);
+
+	bool isFound = false;
+	for (EntryType& entry : entries)
+	{
+		if (entry.first == key)
+		{
+			oldTag = entry.second;
+			entry.second = tag;
+			isFound = true;
+			break;
+		}
+	}
+	if (!isFound)
+	{
+		entries.push_back(std::make_pair(key, tag));
+	}
+
+	std::vector<uint8_t> batch;
+	AppendBucketWrite(batch, bucket, entries, groupHashes);
+	CommitGroup(batch, 1, bucket / sk_groupSize, groupHashes);
+
+	return isFound;
+}
+
+bool AuthIndex::Erase(uint32_t bucket, const KeyBinType & key)
+{
+	std::vector<HashType> groupHashes;
+	BucketType entries = Load(bucket, groupHashes);
+
+	for (auto it = entries.begin(); it != entries.end(); ++it)
+	{
+		if (it->first == key)
+		{
+			entries.erase(it);
+
+			std::vector<uint8_t> batch;
+			AppendBucketWrite(batch, bucket, entries, groupHashes);
+			CommitGroup(batch, 1, bucket / sk_groupSize, groupHashes);
+			return true;
+		}
+	}
+	return false;
+}
+
+void AuthIndex::ExtractRange(uint32_t firstBucket, uint32_t lastBucket, const std::function<bool(const KeyBinType&)>& isInRange, std::vector<EntryType>& res)
+{
+	if (firstBucket > lastBucket || lastBucket >= sk_bucketNum)
+	{
+		throw RuntimeException("Invalid bucket range is given to the index.");
+	}
+
+	for (size_t group = firstBucket / sk_groupSize; group <= lastBucket / sk_groupSize; ++group)
+	{
+		if (IsEmptyHash(m_pinnedGroupHashes[group]))
+		{
+			continue;
+		}
+
+		std::vector<uint8_t> readBatch;
+		MemKeyValueStore::AppendBatchOp(readBatch, MemKeyValueStore::BatchOp::Read, GetBlobKeyStr(sk_groupKeyPrefix, group));
+		std::vector<HashType> groupHashes = ParseGroup(group, m_batchFunc(readBatch, 1)[0]);
+
+		//Read all non-empty buckets of this group in the range at once.
+		const uint32_t groupFirst = static_cast<uint32_t>(group * sk_groupSize);
+		const uint32_t begin = std::max(firstBucket, groupFirst);
+		const uint32_t end = std::min(lastBucket, static_cast<uint32_t>(groupFirst + sk_groupSize - 1));
+
+		std::vector<uint32_t> buckets;
+		readBatch.clear();
+		for (uint32_t bucket = begin; bucket <= end; ++bucket)
+		{
+			if (!IsEmptyHash(groupHashes[bucket - groupFirst]))
+			{
+				MemKeyValueStore::AppendBatchOp(readBatch, MemKeyValueStore::BatchOp::Read, GetBlobKeyStr(sk_bucketKeyPrefix, bucket));
+				buckets.push_back(bucket);
+			}
+		}
+		if (buckets.size() == 0)
+		{
+			continue;
+		}
+
+		BatchResultsType blobs = m_batchFunc(readBatch, buckets.size());
+
+		std::vector<uint8_t> writeBatch;
+		size_t writeCount = 0;
+		for (size_t i = 0; i < buckets.size(); ++i)
+		{
+			BucketType entries = ParseBucket(buckets[i], groupHashes, blobs[i]);
+
+			BucketType kept;
+			for (EntryType& entry : entries)
+			{
+				if (isInRange(entry.first))
+				{
+					res.push_back(std::move(entry));
+				}
+				else
+				{
+					kept.push_back(std::move(entry));
+				}
+			}
+
+			if (kept.size() != entries.size())
+			{
+				AppendBucketWrite(writeBatch, buckets[i], kept, groupHashes);
+				++writeCount;
+			}
+		}
+
+		if (writeCount > 0)
+		{
+			CommitGroup(writeBatch, writeCount, group, groupHashes);
+		}
+	}
+}
+
+AuthIndex::BucketType AuthIndex::Load(uint32_t bucket, std::vector<HashType>& groupHashes)
+{
+	if (bucket >= sk_bucketNum)
+	{
+		throw RuntimeException("Invalid bucket is given to the index.");
+	}
+
+	const size_t group = bucket / sk_groupSize;
+	if (IsEmptyHash(m_pinnedGroupHashes[group]))
+	{
+		groupHashes.assign(sk_groupSize, HashType());
+		return BucketType();
+	}
+
+	std::vector<uint8_t> batch;
+	MemKeyValueStore::AppendBatchOp(batch, MemKeyValueStore::BatchOp::Read, GetBlobKeyStr(sk_groupKeyPrefix, group));
+	MemKeyValueStore::AppendBatchOp(batch, MemKeyValueStore::BatchOp::Read, GetBlobKeyStr(sk_bucketKeyPrefix, bucket));
+	BatchResultsType blobs = m_batchFunc(batch, 2);
+
+	groupHashes = ParseGroup(group, blobs[0]);
+	return ParseBucket(bucket, groupHashes, blobs[1]);
+}
+
+std::vector<AuthIndex::HashType> AuthIndex::ParseGroup(size_t group, const BlobType & blob) const
+{
+	if (IsEmptyHash(m_pinnedGroupHashes[group]))
+	{
+		return std::vector<HashType>(sk_groupSize);
+	}
+
+	if (!blob.first || blob.second.size() != sk_groupSize * sk_hashSize ||
+		CalcHash(blob.second) != m_pinnedGroupHashes[group])
+	{
+		throw RuntimeException("The index in untrusted memory has been tampered with.");
+	}
+
+	std::vector<HashType> res(sk_groupSize);
+	for (size_t i = 0; i < sk_groupSize; ++i)
+	{
+		std::memcpy(res[i].data(), blob.second.data() + (i * sk_hashSize), sk_hashSize);
+	}
+	return res;
+}
+
+AuthIndex::BucketType AuthIndex::ParseBucket(uint32_t bucket, const std::vector<HashType>& groupHashes, const BlobType & blob) const
+{
+	const HashType& expected = groupHashes[bucket % sk_groupSize];
+	if (IsEmptyHash(expected))
+	{
+		return BucketType();
+	}
+
+	static constexpr size_t sk_entrySize = sk_keySize + sk_tagSize;
+
+	uint32_t entryCount = 0;
+	if (!blob.first || blob.second.size() < sizeof(entryCount) || CalcHash(blob.second) != expected)
+	{
+		throw RuntimeException("The index in untrusted memory has been tampered with.");
+	}
+	std::memcpy(&entryCount, blob.second.data(), sizeof(entryCount));
+	if (blob.second.size() != sizeof(entryCount) + (static_cast<size_t>(entryCount) * sk_entrySize))
+	{
+		throw RuntimeException("The index in untrusted memory is malformed.");
+	}
+
+	BucketType res(entryCount);
+	const uint8_t* pos = blob.second.data() + sizeof(entryCount);
+	for (EntryType& entry : res)
+	{
+		std::memcpy(entry.first.data(), pos, sk_keySize);
+		std::memcpy(entry.second.data(), pos + sk_keySize, sk_tagSize);
+		pos += sk_entrySize;
+	}
+	return res;
+}
+
+void AuthIndex::AppendBucketWrite(std::vector<uint8_t>& batch, uint32_t bucket, const BucketType & entries, std::vector<HashType>& groupHashes) const
+{
+	const std::string keyStr = GetBlobKeyStr(sk_bucketKeyPrefix, bucket);
+	HashType& hash = groupHashes[bucket % sk_groupSize];
+
+	if (entries.size() == 0)
+	{
+		MemKeyValueStore::AppendBatchOp(batch, MemKeyValueStore::BatchOp::Delete, keyStr);
+		hash = HashType();
+		return;
+	}
+
+	const uint32_t entryCount = static_cast<uint32_t>(entries.size());
+	std::vector<uint8_t> blob(sizeof(entryCount));
+	blob.reserve(sizeof(entryCount) + (entries.size() * (sk_keySize + sk_tagSize)));
+	std::memcpy(blob.data(), &entryCount, sizeof(entryCount));
+	for (const EntryType& entry : entries)
+	{
+		blob.insert(blob.end(), entry.first.begin(), entry.first.end());
+		blob.insert(blob.end(), entry.second.begin(), entry.second.end());
+	}
+
+	MemKeyValueStore::AppendBatchOp(batch, MemKeyValueStore::BatchOp::Store, keyStr, blob.data(), blob.size());
+	hash = CalcHash(blob);
+}
+
+void AuthIndex::CommitGroup(std::vector<uint8_t>& batch, size_t opCount, size_t group, const std::vector<HashType>& groupHashes)
+{
+	const std::string keyStr = GetBlobKeyStr(sk_groupKeyPrefix, group);
+
+	bool isEmpty = true;
+	for (const HashType& hash : groupHashes)
+	{
+		isEmpty = isEmpty && IsEmptyHash(hash);
+	}
+
+	HashType groupHash;
+	if (isEmpty)
+	{
+		MemKeyValueStore::AppendBatchOp(batch, MemKeyValueStore::BatchOp::Delete, keyStr);
+	}
+	else
+	{
+		std::vector<uint8_t> blob;
+		blob.reserve(sk_groupSize * sk_hashSize);
+		for (const HashType& hash : groupHashes)
+		{
+			blob.insert(blob.end(), hash.begin(), hash.end());
+		}
+
+		MemKeyValueStore::AppendBatchOp(batch, MemKeyValueStore::BatchOp::Store, keyStr, blob.data(), blob.size());
+		groupHash = CalcHash(blob);
+	}
+
+	//Stores in the memory store always succeed, and deleting an absent blob is harmless.
+	m_batchFunc(batch, opCount + 1);
+
+	m_pinnedGroupHashes[group] = isEmpty ? HashType() : groupHash;
+}
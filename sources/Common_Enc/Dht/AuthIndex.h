@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+
+#include <array>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Decent
+{
+	namespace Dht
+	{
+		/**
+		 * \brief	An index of (key, tag) pairs kept in the untrusted memory store, protected by a
+		 * 			three-level hash tree, so that the index doesn't have to fit in enclave memory.
+		 *
+		 * 			Keys are partitioned into buckets by the prefix of key, and each bucket is stored as
+		 * 			one blob. Hashes of buckets are grouped into group blobs, which are also stored in
+		 * 			the memory store. Only hashes of groups are pinned in the enclave. Every lookup
+		 * 			verifies the group blob against the pinned hash, and the bucket blob against the
+		 * 			group blob; every update rewrites the bucket blob, the group blob, and the pinned
+		 * 			hash. An all-zero hash stands for an empty bucket or group, which is not stored.
+		 *
+		 * 			Bucket layout: entry count (4 bytes) | (key | tag) of each entry.
+		 * 			Group layout: hash of each bucket in the group.
+		 *
+		 * 			This class is not thread-safe; callers must serialize accesses.
+		 */
+		class AuthIndex
+		{
+		public:
+			static constexpr size_t sk_keySize = 32;
+			static constexpr size_t sk_tagSize = 16;
+			static constexpr size_t sk_hashSize = 32;
+
+			/** \brief	Number of bits of key prefix used to choose the bucket. */
+			static constexpr size_t sk_bucketBits = 16;
+			static constexpr size_t sk_bucketNum = 1 << sk_bucketBits;
+			static constexpr size_t sk_groupSize = 256;
+			static constexpr size_t sk_groupNum = sk_bucketNum / sk_groupSize;
+
+			/** \brief	Prefix of blob key strings in the memory store; ordered after hex digits. */
+			static constexpr char sk_bucketKeyPrefix[] = "~idx:b:";
+			static constexpr char sk_groupKeyPrefix[] = "~idx:g:";
+
+			typedef std::array<uint8_t, sk_keySize> KeyBinType;
+			typedef std::array<uint8_t, sk_tagSize> TagType;
+			typedef std::array<uint8_t, sk_hashSize> HashType;
+			typedef std::pair<KeyBinType, TagType> EntryType;
+
+			/** \brief	Result of a batch of memory store operations; see MemKeyValueStore::ProcessBatch. */
+			typedef std::vector<std::pair<bool, std::vector<uint8_t> > > BatchResultsType;
+
+			/** \brief	Passes a batch, generated by MemKeyValueStore::AppendBatchOp, to the memory store. */
+			typedef std::function<BatchResultsType(const std::vector<uint8_t>&, size_t)> BatchFuncType;
+
+			/**
+			 * \brief	Gets the bucket of a key.
+			 *
+			 * \param	keyStr	The key string in big-endian hex, as given by EnclaveStore::GetKeyStr.
+			 */
+			static uint32_t GetBucketId(const std::string& keyStr);
+
+		public:
+			/**
+			 * \brief	Constructor
+			 *
+			 * \param	batchFunc	The function to access the memory store.
+			 */
+			AuthIndex(BatchFuncType batchFunc);
+
+			virtual ~AuthIndex();
+
+			/**
+			 * \brief	Finds the tag of a key.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the index fails the verification.
+			 *
+			 * \param 	   	bucket	The bucket of the key.
+			 * \param 	   	key   	The key.
+			 * \param [out]	tag   	The tag.
+			 *
+			 * \return	True if it's found, otherwise, false.
+			 */
+			bool Find(uint32_t bucket, const KeyBinType& key, TagType& tag);
+
+			/**
+			 * \brief	Adds a key, or replace the tag if the key exists.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the index fails the verification, or
+			 * 												fails to be stored.
+			 *
+			 * \param 	   	bucket	The bucket of the key.
+			 * \param 	   	key   	The key.
+			 * \param 	   	tag   	The tag.
+			 * \param [out]	oldTag	The tag replaced, if the key exists.
+			 *
+			 * \return	True if the key exists, thus, its tag is replaced.
+			 */
+			bool Put(uint32_t bucket, const KeyBinType& key, const TagType& tag, TagType& oldTag);
+
+			/**
+			 * \brief	Erases a key.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the index fails the verification, or
+			 * 												fails to be stored.
+			 *
+			 * \return	False if the key is not found.
+			 */
+			bool Erase(uint32_t bucket, const KeyBinType& key);
+
+			/**
+			 * \brief	Erases keys within a range of buckets that match the given predicate, and returns
+			 * 			them.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the index fails the verification, or
+			 * 												fails to be stored.
+			 *
+			 * \param 	   	firstBucket	The first bucket (INclusive).
+			 * \param 	   	lastBucket 	The last bucket (INclusive).
+			 * \param 	   	isInRange  	Query if a key in those buckets should be extracted.
+			 * \param [out]	res		   	The entries extracted.
+			 */
+			void ExtractRange(uint32_t firstBucket, uint32_t lastBucket, const std::function<bool(const KeyBinType&)>& isInRange, std::vector<EntryType>& res);
+
+		private:
+			typedef std::vector<EntryType> BucketType;
+
+			typedef std::pair<bool, std::vector<uint8_t> > BlobType;
+
+			/** \brief	Reads and verifies a bucket, together with its group, in one batch. */
+			BucketType Load(uint32_t bucket, std::vector<HashType>& groupHashes);
+
+			/** \brief	Verifies a group blob against the pinned hash, and parses it. */
+			std::vector<HashType> ParseGroup(size_t group, const BlobType& blob) const;
+
+			/** \brief	Verifies a bucket blob against the group, and parses it. */
+			BucketType ParseBucket(uint32_t bucket, const std::vector<HashType>& groupHashes, const BlobType& blob) const;
+
+			/**
+			 * \brief	Appends the operation to store (or delete, if empty) a bucket to the batch, and
+			 * 			updates the hash of the bucket in the group.
+			 */
+			void AppendBucketWrite(std::vector<uint8_t>& batch, uint32_t bucket, const BucketType& entries, std::vector<HashType>& groupHashes) const;
+
+			/**
+			 * \brief	Appends the operation to store (or delete, if empty) the group to the batch,
+			 * 			processes the batch, and then updates the pinned hash of the group.
+			 */
+			void CommitGroup(std::vector<uint8_t>& batch, size_t opCount, size_t group, const std::vector<HashType>& groupHashes);
+
+			BatchFuncType m_batchFunc;
+			std::vector<HashType> m_pinnedGroupHashes;
+		};
+	}
+}
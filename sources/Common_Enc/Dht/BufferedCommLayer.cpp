@@ -0,0 +1,82 @@
+#include "BufferedCommLayer.h"
+
+#include <DecentApi/Common/RuntimeException.h>
+
+using namespace Decent;
+using namespace Decent::Net;
+using namespace Decent::Dht;
+
+constexpr size_t BufferedCommLayer::sk_defaultFlushThreshold;
+
+BufferedCommLayer::BufferedCommLayer(SecureCommLayer & base, size_t flushThreshold) :
+	m_base(base),
+	m_flushThreshold(flushThreshold > 0 ? flushThreshold : 1),
+	m_buffer()
+{
+}
+
+BufferedCommLayer::~BufferedCommLayer()
+{
+}
+
+BufferedCommLayer::operator bool() const
+{
+	return static_cast<bool>(m_base);
+}
+
+size_t BufferedCommLayer::SendRaw(const void * buf, const size_t size)
+{
+	if (m_buffer.size() + size > m_flushThreshold)
+	{
+		Flush();
+	}
+
+	if (size >= m_flushThreshold)
+	{
+		SendToBase(buf, size);
+		return size;
+	}
+
+	const uint8_t* bytePtr = static_cast<const uint8_t*>(buf);
+	m_buffer.insert(m_buffer.end(), bytePtr, bytePtr + size);
+
+	return size;
+}
+
+size_t BufferedCommLayer::ReceiveRaw(void * buf, const size_t size)
+{
+	Flush();
+
+	return m_base.ReceiveRaw(buf, size);
+}
+
+void BufferedCommLayer::SetConnectionPtr(ConnectionBase & cnt)
+{
+	m_base.SetConnectionPtr(cnt);
+}
+
+void BufferedCommLayer::Flush()
+{
+	if (m_buffer.size() == 0)
+	{
+		return;
+	}
+
+	SendToBase(m_buffer.data(), m_buffer.size());
+	m_buffer.clear();
+}
+
+void BufferedCommLayer::SendToBase(const void * buf, const size_t size)
+{
+	const uint8_t* bytePtr = static_cast<const uint8_t*>(buf);
+	size_t sentSize = 0;
+	while (sentSize < size)
+	{
+		const size_t res = m_base.SendRaw(bytePtr + sentSize, size - sentSize);
+		if (res == 0)
+		{
+			throw RuntimeException("Failed to flush the buffered data to the secure comm layer.");
+		}
+		sentSize += res;
+	}
+}
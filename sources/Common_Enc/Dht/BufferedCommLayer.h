@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+
+#include <vector>
+
+#include <DecentApi/Common/Net/SecureCommLayer.h>
+
+namespace Decent
+{
+	namespace Dht
+	{
+		/**
+		 * \brief	A secure comm layer that collects small sends into one buffer, so that a message built
+		 * 			by many SendStruct()/SendRaw() calls goes out as one TLS record, instead of one record
+		 * 			(and usually one TCP segment) per call.
+		 *
+		 * 			The buffer is flushed to the underlying layer when Flush() is called, before anything
+		 * 			is received, and whenever it reaches the flush threshold. Sends that are no smaller
+		 * 			than the threshold bypass the buffer. The buffer is NOT flushed on destruction, since
+		 * 			that may throw; the owner must call Flush() once it's done sending.
+		 */
+		class BufferedCommLayer : public Net::SecureCommLayer
+		{
+		public: //static members:
+
+			/** \brief	Default flush threshold, which is the maximum size of the plain text in one TLS record. */
+			static constexpr size_t sk_defaultFlushThreshold = 16 * 1024;
+
+		public:
+			BufferedCommLayer() = delete;
+
+			/**
+			 * \brief	Constructor
+			 *
+			 * \param [in,out]	base		  	The underlying comm layer, which must outlive this object.
+			 * \param 		  	flushThreshold	The buffer is flushed once it reaches this size.
+			 */
+			BufferedCommLayer(Net::SecureCommLayer& base, size_t flushThreshold = sk_defaultFlushThreshold);
+
+			/** \brief	Destructor. Anything left in the buffer is discarded. */
+			virtual ~BufferedCommLayer();
+
+			virtual operator bool() const override;
+
+			/**
+			 * \brief	Buffers the data; it's always taken in full.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the buffer is flushed and the flush fails.
+			 */
+			virtual size_t SendRaw(const void* buf, const size_t size) override;
+
+			/** \brief	Flushes the buffer, and then receives from the underlying layer. */
+			virtual size_t ReceiveRaw(void* buf, const size_t size) override;
+
+			virtual void SetConnectionPtr(Net::ConnectionBase& cnt) override;
+
+			/**
+			 * \brief	Sends everything in the buffer to the underlying layer.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the underlying layer fails to send.
+			 */
+			void Flush();
+
+		private:
+			/** \brief	Sends the data to the underlying layer in full. */
+			void SendToBase(const void* buf, const size_t size);
+
+			Net::SecureCommLayer& m_base;
+			size_t m_flushThreshold;
+			std::vector<uint8_t> m_buffer;
+		};
+	}
+}
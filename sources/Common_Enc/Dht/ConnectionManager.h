@@ -18,6 +18,15 @@ namespace Decent
 		{
 			std::unique_ptr<Decent::Net::ConnectionBase> GetConnection2DecentNode(uint64_t address);
 			std::unique_ptr<Decent::Net::ConnectionBase> GetConnection2DecentStore(uint64_t address);
+
+			/**
+			 * \brief	Releases a connection held by the enclave back to the untrusted side. The enclave
+			 * 			must not use the connection anymore afterwards.
+			 *
+			 * \param	cntPtr	The pointer to the untrusted connection.
+			 * \param	result	What the untrusted side should do with the connection next (see ProcResult).
+			 */
+			void ReleaseHeldConnection(void* cntPtr, int result);
 		}
 	}
 }
@@ -1,6 +1,7 @@
 #include "DhtSecureConnectionMgr.h"
 
 #include <DecentApi/Common/make_unique.h>
+#include <DecentApi/Common/RuntimeException.h>
 #include <DecentApi/Common/Ra/States.h>
 #include <DecentApi/Common/Net/ConnectionBase.h>
 #include <DecentApi/Common/Net/TlsCommLayer.h>
@@ -10,6 +11,8 @@
 #include <DecentApi/CommonEnclave/Ra/TlsConfigSameEnclave.h>
 
 #include "ConnectionManager.h"
+#include "BufferedCommLayer.h"
+#include "TimeSource.h"
 
 using namespace Decent;
 using namespace Decent::Net;
@@ -24,8 +27,18 @@ namespace
 	}
 }
 
-DhtSecureConnectionMgr::DhtSecureConnectionMgr(size_t maxOutCnt) :
-	m_sessionCache(maxOutCnt)
+constexpr size_t DhtSecureConnectionMgr::sk_defaultChannelsPerPeer;
+constexpr size_t DhtSecureConnectionMgr::sk_maxIdleChannelNum;
+constexpr uint64_t DhtSecureConnectionMgr::sk_channelPingIdleMs;
+constexpr uint64_t DhtSecureConnectionMgr::sk_channelMaxIdleMs;
+
+DhtSecureConnectionMgr::DhtSecureConnectionMgr(size_t maxOutCnt, size_t channelsPerPeer) :
+	m_sessionCache(maxOutCnt),
+	m_channelsPerPeer(channelsPerPeer),
+	m_reqCount(0),
+	m_channelsMutex(),
+	m_idleChannels(),
+	m_idleChannelNum(0)
 {}
 
 DhtSecureConnectionMgr::~DhtSecureConnectionMgr()
@@ -48,3 +61,149 @@ CntPair DhtSecureConnectionMgr::GetNew(const uint64_t& addr, Ra::States& state)
 	std::unique_ptr<SecureCommLayer> comm = std::move(tls);
 	return CntPair(connection, comm);
 }
+
+void DhtSecureConnectionMgr::Call(const uint64_t & addr, Ra::States & state, EncFunc::Dht::NumType funcNum, const RpcFuncType & rpcFunc)
+{
+	bool isReused = false;
+	std::unique_ptr<Channel> channel = AcquireChannel(addr, state, isReused);
+
+	if (isReused && TimeSource::GetSteadyTimeMs() - channel->m_lastUsed > sk_channelPingIdleMs)
+	{
+		//The peer may have closed the channel in the meantime; if so, retry once on a new channel.
+		bool isKept = false;
+		try
+		{
+			isKept = CallOnChannel(*channel, EncFunc::Dht::k_ping, [](SecureCommLayer&) {});
+		}
+		catch (const std::exception&)
+		{}
+
+		if (!isKept)
+		{
+			channel = OpenChannel(addr, state);
+		}
+	}
+
+	if (CallOnChannel(*channel, funcNum, rpcFunc))
+	{
+		ReleaseChannel(addr, std::move(channel));
+	}
+	//Otherwise, the peer has too many channels open, so the channel is closed.
+}
+
+void DhtSecureConnectionMgr::CloseIdleChannels()
+{
+	std::vector<std::unique_ptr<Channel> > expired;
+	{
+		std::unique_lock<std::mutex> channelsLock(m_channelsMutex);
+		TakeExpiredChannels(TimeSource::GetSteadyTimeMs(), expired);
+	}
+	//Expired channels are closed here, without holding the lock.
+}
+
+std::unique_ptr<DhtSecureConnectionMgr::Channel> DhtSecureConnectionMgr::AcquireChannel(const uint64_t & addr, Ra::States & state, bool & isReused)
+{
+	const uint64_t now = TimeSource::GetSteadyTimeMs();
+
+	std::unique_ptr<Channel> res;
+	std::vector<std::unique_ptr<Channel> > expired;
+	{
+		std::unique_lock<std::mutex> channelsLock(m_channelsMutex);
+		TakeExpiredChannels(now, expired);
+
+		auto it = m_idleChannels.find(addr);
+		if (it != m_idleChannels.end())
+		{
+			res = std::move(it->second.back());
+			it->second.pop_back();
+			--m_idleChannelNum;
+
+			if (it->second.size() == 0)
+			{
+				m_idleChannels.erase(it);
+			}
+		}
+	}
+	//Expired channels are closed here, without holding the lock.
+	expired.clear();
+
+	isReused = static_cast<bool>(res);
+	if (isReused)
+	{
+		return res;
+	}
+
+	return OpenChannel(addr, state);
+}
+
+std::unique_ptr<DhtSecureConnectionMgr::Channel> DhtSecureConnectionMgr::OpenChannel(const uint64_t & addr, Ra::States & state)
+{
+	CntPair cntPair = GetNew(addr, state);
+	cntPair.GetCommLayer().SendStruct(EncFunc::Dht::k_openChannel); //1. Send function type - Done!
+
+	return Tools::make_unique<Channel>(std::move(cntPair), TimeSource::GetSteadyTimeMs());
+}
+
+void DhtSecureConnectionMgr::ReleaseChannel(const uint64_t & addr, std::unique_ptr<Channel> channel)
+{
+	channel->m_lastUsed = TimeSource::GetSteadyTimeMs();
+
+	std::unique_lock<std::mutex> channelsLock(m_channelsMutex);
+	if (m_idleChannelNum < sk_maxIdleChannelNum)
+	{
+		std::vector<std::unique_ptr<Channel> >& channels = m_idleChannels[addr];
+		if (channels.size() < m_channelsPerPeer)
+		{
+			channels.push_back(std::move(channel));
+			++m_idleChannelNum;
+			return;
+		}
+	}
+	channelsLock.unlock();
+
+	//The pool is full, so the channel is closed.
+	channel.reset();
+}
+
+bool DhtSecureConnectionMgr::CallOnChannel(Channel & channel, EncFunc::Dht::NumType funcNum, const RpcFuncType & rpcFunc)
+{
+	//The frame header and the request are sent as one record, once the response is awaited.
+	BufferedCommLayer comm(channel.m_cntPair.GetCommLayer());
+
+	ChannelFrame frame;
+	frame.m_reqId = m_reqCount++;
+	frame.m_funcNum = funcNum;
+
+	comm.SendStruct(frame); //1. Send frame header.
+
+	rpcFunc(comm);          //2. Send request & receive response.
+
+	ChannelTrailer trailer;
+	comm.ReceiveStruct(trailer); //3. Receive trailer - Done!
+
+	if (trailer.m_reqId != frame.m_reqId)
+	{
+		throw RuntimeException("The channel to the DHT peer is out of sync.");
+	}
+
+	return trailer.m_isKept != 0;
+}
+
+void DhtSecureConnectionMgr::TakeExpiredChannels(uint64_t now, std::vector<std::unique_ptr<Channel> >& expired)
+{
+	for (auto it = m_idleChannels.begin(); it != m_idleChannels.end(); )
+	{
+		//Channels are appended as they are released, so the oldest ones are at the front.
+		std::vector<std::unique_ptr<Channel> >& channels = it->second;
+		auto expiredEnd = channels.begin();
+		while (expiredEnd != channels.end() && now - (*expiredEnd)->m_lastUsed > sk_channelMaxIdleMs)
+		{
+			expired.push_back(std::move(*expiredEnd));
+			++expiredEnd;
+			--m_idleChannelNum;
+		}
+		channels.erase(channels.begin(), expiredEnd);
+
+		it = channels.size() == 0 ? m_idleChannels.erase(it) : std::next(it);
+	}
+}
@@ -1,8 +1,19 @@
 #pragma once
 
+#include <cstdint>
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <functional>
+
 #include <DecentApi/Common/Net/SecureConnectionPoolBase.h>
 #include <DecentApi/Common/Tools/SharedCachingQueue.h>
 
+#include "../../Common/Dht/FuncNums.h"
+
 namespace Decent
 {
 	namespace MbedTlsObj
@@ -18,15 +29,135 @@ namespace Decent
 	{
 		class DhtSecureConnectionMgr
 		{
+		public: //static members:
+
+			/**
+			 * \brief	Header sent before each RPC on a channel. The request ID is echoed in the trailer,
+			 * 			so that both sides can tell the channel is still in sync.
+			 */
+			struct ChannelFrame
+			{
+				uint64_t m_reqId;
+				EncFunc::Dht::NumType m_funcNum;
+			};
+
+			/** \brief	Trailer sent by the server after each RPC on a channel has been processed. */
+			struct ChannelTrailer
+			{
+				uint64_t m_reqId;
+
+				/**
+				 * \brief	Non-zero if the server keeps the channel for more RPCs; otherwise, the channel
+				 * 			must be closed, e.g. since the server has too many channels open.
+				 */
+				uint8_t m_isKept;
+			};
+
+			/** \brief	Default maximum number of idle channels kept for each peer. */
+			static constexpr size_t sk_defaultChannelsPerPeer = 4;
+
+			/** \brief	Maximum number of idle channels kept for all peers. */
+			static constexpr size_t sk_maxIdleChannelNum = 64;
+
+			/** \brief	Idle channels are checked with a ping before being reused after this time. */
+			static constexpr uint64_t sk_channelPingIdleMs = 5 * 1000;
+
+			/**
+			 * \brief	Idle channels are closed after this time, to release the sessions kept by peers for
+			 * 			them. Peers close channels idle for longer than this on their own.
+			 */
+			static constexpr uint64_t sk_channelMaxIdleMs = 60 * 1000;
+
+			/** \brief	Type of the function that sends the request and receives the response of an RPC. */
+			typedef std::function<void(Net::SecureCommLayer&)> RpcFuncType;
+
 		public:
-			DhtSecureConnectionMgr(size_t maxOutCnt);
+			DhtSecureConnectionMgr(size_t maxOutCnt, size_t channelsPerPeer);
 
 			virtual ~DhtSecureConnectionMgr();
 
+			/**
+			 * \brief	Opens a new connection to a peer, which is closed after use.
+			 *
+			 * \param 		  	addr 	The address of the peer.
+			 * \param [in,out]	state	The Decent states.
+			 *
+			 * \return	The connection pair.
+			 */
 			virtual Net::CntPair GetNew(const uint64_t& addr, Ra::States& state);
 
+			/**
+			 * \brief	Runs an RPC on a long-lived channel to a peer, so that the TCP connection and the
+			 * 			TLS session are reused by many RPCs. An idle channel is taken from the pool if
+			 * 			there is any; otherwise, a new channel is opened. The channel is put back into the
+			 * 			pool once the RPC succeeds, or closed if it fails.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the RPC fails.
+			 *
+			 * \param 		  	addr   	The address of the peer.
+			 * \param [in,out]	state  	The Decent states.
+			 * \param 		  	funcNum	The function number of the RPC.
+			 * \param 		  	rpcFunc	The function that sends the request (not including the function
+			 * 							number) and receives the response.
+			 */
+			virtual void Call(const uint64_t& addr, Ra::States& state, EncFunc::Dht::NumType funcNum, const RpcFuncType& rpcFunc);
+
+			/**
+			 * \brief	Closes the channels that have been idle for longer than sk_channelMaxIdleMs. It should
+			 * 			be called periodically, so that channels to peers that are no longer called are
+			 * 			closed, too.
+			 */
+			virtual void CloseIdleChannels();
+
 		private:
+			struct Channel
+			{
+				Net::CntPair m_cntPair;
+				uint64_t m_lastUsed;
+
+				Channel(Net::CntPair&& cntPair, uint64_t lastUsed) :
+					m_cntPair(std::forward<Net::CntPair>(cntPair)),
+					m_lastUsed(lastUsed)
+				{}
+			};
+
+			/**
+			 * \brief	Takes an idle channel to the peer from the pool, or opens a new one.
+			 *
+			 * \param [out]	isReused	True if the channel is taken from the pool.
+			 */
+			std::unique_ptr<Channel> AcquireChannel(const uint64_t& addr, Ra::States& state, bool& isReused);
+
+			/** \brief	Opens a new channel to the peer. */
+			std::unique_ptr<Channel> OpenChannel(const uint64_t& addr, Ra::States& state);
+
+			/**
+			 * \brief	Puts a channel back into the pool, or closes it if the pool of the peer, or the
+			 * 			pool of all peers, is full.
+			 */
+			void ReleaseChannel(const uint64_t& addr, std::unique_ptr<Channel> channel);
+
+			/**
+			 * \brief	Runs an RPC on a channel, and checks the trailer.
+			 *
+			 * \return	True if the peer keeps the channel for more RPCs.
+			 */
+			bool CallOnChannel(Channel& channel, EncFunc::Dht::NumType funcNum, const RpcFuncType& rpcFunc);
+
+			/**
+			 * \brief	Takes the idle channels that have expired out of the pool. It's called under the lock
+			 * 			of channels; the caller closes them afterwards, without holding the lock.
+			 */
+			void TakeExpiredChannels(uint64_t now, std::vector<std::unique_ptr<Channel> >& expired);
+
 			Tools::SharedCachingQueue<uint64_t, MbedTlsObj::Session> m_sessionCache;
+
+			size_t m_channelsPerPeer;
+			std::atomic<uint64_t> m_reqCount;
+
+			std::mutex m_channelsMutex;
+			std::map<uint64_t, std::vector<std::unique_ptr<Channel> > > m_idleChannels;
+			size_t m_idleChannelNum;
 		};
 	}
 }
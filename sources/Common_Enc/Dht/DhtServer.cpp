@@ -1,11 +1,15 @@
 #include "DhtServer.h"
 
-#include <queue>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <algorithm>
 
 #include <cppcodec/base64_default_rfc4648.hpp>
 
 #include <DecentApi/Common/Common.h>
 #include <DecentApi/Common/make_unique.h>
+#include <DecentApi/Common/RuntimeException.h>
 #include <DecentApi/Common/GeneralKeyTypes.h>
 #include <DecentApi/Common/Net/TlsCommLayer.h>
 #include <DecentApi/Common/Net/ConnectionBase.h>
@@ -19,12 +23,21 @@
 #include "../../Common/Dht/LocalNode.h"
 #include "../../Common/Dht/FuncNums.h"
 #include "../../Common/Dht/NodeBase.h"
+#include "../../Common/Dht/TaskPool.h"
+#include "../../Common/Dht/DestinationQueues.h"
+#include "../../Common/Dht/PendingTable.h"
+#include "../../Common/Dht/IterativeLookup.h"
+#include "../../Common/Dht/OwnershipCache.h"
+#include "../../Common/Dht/ProcResult.h"
 
 #include "EnclaveStore.h"
 #include "NodeConnector.h"
 #include "ConnectionManager.h"
 #include "DhtSecureConnectionMgr.h"
+#include "BufferedCommLayer.h"
 #include "DhtStatesSingleton.h"
+#include "ServerSession.h"
+#include "TimeSource.h"
 
 using namespace Decent;
 using namespace Decent::Net;
@@ -37,14 +50,177 @@ namespace
 
 	static char gsk_ack[] = "ACK";
 
+	/** \brief	Default of gs_maxSessionNum, which fits in the heap of the enclave with the default store. */
+	static constexpr size_t gsk_defaultMaxSessionNum = 128;
+
+	/**
+	 * \brief	Maximum number of sessions alive (see ServerSession::GetSessionNum()), set by
+	 * 			SetSessionBudget() from the enclave heap. Each of them takes a TLS context in enclave
+	 * 			memory, so an app session beyond the budget is closed after its request, rather than
+	 * 			kept for the next one.
+	 */
+	static std::atomic<size_t> gs_maxSessionNum(gsk_defaultMaxSessionNum);
+
+	/**
+	 * \brief	Channels opened by peers may take up to 1/gsk_channelBudgetShare of the session budget. A
+	 * 			channel beyond the limit serves only the RPC it's opened with, and the peer is told to
+	 * 			close it afterwards.
+	 */
+	static constexpr size_t gsk_channelBudgetShare = 4;
+
+	static size_t GetMaxChannelNum()
+	{
+		const size_t maxChannelNum = gs_maxSessionNum.load() / gsk_channelBudgetShare;
+		return maxChannelNum > 0 ? maxChannelNum : 1;
+	}
+
+	static std::mutex gs_keptSessionsMutex;
+	static std::map<void*, std::unique_ptr<ServerSession> > gs_keptSessions;
+
+	/**
+	 * \brief	Closes idle channels kept for peers, while the number of sessions alive is over the
+	 * 			budget, so that their TLS contexts give room to new sessions. A peer opens a new
+	 * 			channel once it finds the channel closed (see DhtSecureConnectionMgr::Call).
+	 */
+	static void EvictIdleChannels()
+	{
+		size_t sessionNum = ServerSession::GetSessionNum();
+		if (sessionNum <= gs_maxSessionNum.load())
+		{
+			return;
+		}
+
+		std::vector<std::unique_ptr<ServerSession> > evicted;
+		{
+			std::unique_lock<std::mutex> sessionsLock(gs_keptSessionsMutex);
+			for (auto it = gs_keptSessions.begin(); it != gs_keptSessions.end() && sessionNum > gs_maxSessionNum.load();)
+			{
+				if (it->second->IsChannel())
+				{
+					evicted.push_back(std::move(it->second));
+					it = gs_keptSessions.erase(it);
+					--sessionNum;
+				}
+				else
+				{
+					++it;
+				}
+			}
+		}
+
+		if (evicted.size() > 0)
+		{
+			LOGW("Too many sessions are alive; %llu idle channels are closed.", static_cast<unsigned long long>(evicted.size()));
+		}
+		//TLS contexts of evicted channels are freed here, without holding the lock.
+	}
+
+	/**
+	 * \brief	Checks if an app session, which is alive already, can be kept or held beyond its
+	 * 			current call, after idle channels are evicted if necessary.
+	 *
+	 * \return	False if the session budget is used up; otherwise, true.
+	 */
+	static bool IsInSessionBudget()
+	{
+		EvictIdleChannels();
+		return ServerSession::GetSessionNum() <= gs_maxSessionNum.load();
+	}
+
+	/**
+	 * \brief	Keeps the session for its next message, which is processed by ProcessSessionMsg().
+	 * 			Channels are always kept, since they are limited when they are opened.
+	 *
+	 * \param [in,out]	session	The session, which is taken if it's kept.
+	 *
+	 * \return	ProcResult::k_session if it's kept, or ProcResult::k_close if the session budget is
+	 * 			used up.
+	 */
+	static ProcResult::NumType KeepSession(std::unique_ptr<ServerSession>& session)
+	{
+		void* cntPtr = session->m_cnt.GetPointer();
+
+		if (!session->IsChannel() && !IsInSessionBudget())
+		{
+			LOGW("Too many sessions are alive; the app session is closed.");
+			return ProcResult::k_close;
+		}
+
+		std::unique_lock<std::mutex> sessionsLock(gs_keptSessionsMutex);
+		gs_keptSessions[cntPtr] = std::move(session);
+		return ProcResult::k_session;
+	}
+
+	/** \brief	Takes the session kept for the connection out of the table; null if there is none. */
+	static std::unique_ptr<ServerSession> TakeSession(void* cntPtr)
+	{
+		std::unique_ptr<ServerSession> session;
+
+		std::unique_lock<std::mutex> sessionsLock(gs_keptSessionsMutex);
+		auto it = gs_keptSessions.find(cntPtr);
+		if (it != gs_keptSessions.end())
+		{
+			session = std::move(it->second);
+			gs_keptSessions.erase(it);
+		}
+		return session;
+	}
+
 	struct PendingQueryItem
 	{
-		std::unique_ptr<EnclaveCntTranslator> m_cnt;
-		std::unique_ptr<TlsCommLayer> m_tls;
+		std::unique_ptr<ServerSession> m_session;
+		uint8_t m_keyId[DhtStates::sk_keySizeByte];
+		uint64_t m_nextAddr;
+		size_t m_retryCount;
+	};
+
+	/**
+	 * \brief	Number of shards of the pending tables. Slots are sized from the session budget (see
+	 * 			GetPendingSlotsPerShard()), since every entry holds an app session.
+	 */
+	static constexpr size_t gsk_pendingQueryShardNum = 16;
+
+	static size_t GetPendingSlotsPerShard()
+	{
+		const size_t maxSessionNum = gs_maxSessionNum.load();
+		return (maxSessionNum + gsk_pendingQueryShardNum - 1) / gsk_pendingQueryShardNum;
+	}
+
+	/** \brief	Time, in milliseconds, a forwarded query waits for its reply before it's expired. */
+	static constexpr uint64_t gsk_pendingQueryTimeoutMs = 5 * 1000;
+
+	/** \brief	Number of times an expired query is retried on an alternate route; zero to disable. */
+	static constexpr size_t gsk_pendingQueryMaxRetry = 1;
+
+	struct PendingDataOpItem
+	{
+		std::unique_ptr<ServerSession> m_session;
+		EncFunc::App::NumType m_op;
 	};
 
-	static std::mutex gs_clientPendingQueriesMutex;
-	static std::map<uint64_t, std::unique_ptr<PendingQueryItem> > gs_clientPendingQueries;
+	/**
+	 * \brief	Routed data operations waiting for their results. They share the limits of pending
+	 * 			queries, but are never retried, since they are not idempotent in general.
+	 *
+	 * 			The table is allocated on first use, i.e., after SetSessionBudget() is called.
+	 */
+	static PendingTable<PendingDataOpItem>& GetClientPendingDataOps()
+	{
+		static PendingTable<PendingDataOpItem> inst(gsk_pendingQueryShardNum, GetPendingSlotsPerShard());
+		return inst;
+	}
+
+	/** \brief	Interval, in milliseconds, between two sweeps of the pending query table. */
+	static constexpr uint64_t gsk_pendingQuerySweepIntervalMs = 1000;
+
+	/** \brief	Queries forwarded for app sessions; allocated on first use, as GetClientPendingDataOps(). */
+	static PendingTable<PendingQueryItem>& GetClientPendingQueries()
+	{
+		static PendingTable<PendingQueryItem> inst(gsk_pendingQueryShardNum, GetPendingSlotsPerShard());
+		return inst;
+	}
+
+	static std::atomic<bool> gs_isPendingQueryTimerTerminated(false);
 
 	static bool TryGetQueriedAddrLocally(DhtStates::DhtLocalNodeType& localNode, const BigNumber& queriedId, uint64_t& resAddr)
 	{
@@ -70,8 +246,6 @@ namespace
 		return false;
 	}
 
-	static std::atomic<bool> gs_isForwardingTerminated = false;
-
 	struct ForwardQueueItem
 	{
 		uint64_t m_reqId;
@@ -79,17 +253,57 @@ namespace
 		uint64_t m_reAddr;
 	};
 
-	static std::mutex gs_forwardQueueMutex;
-	static std::queue<std::pair<uint64_t, std::unique_ptr<ForwardQueueItem> > > gs_forwardQueue;
-	static std::condition_variable gs_forwardQueueSignal;
+	/** \brief	Number of shards of the per-destination forward and reply queues. */
+	static constexpr size_t gsk_queueShardNum = 16;
+
+	/** \brief	Capacity of the lock-free ingress ring of the forward and reply queues. */
+	static constexpr size_t gsk_queueIngressCapacity = 4096;
+
+	static DestinationQueues<uint64_t, ForwardQueueItem> gs_forwardQueues(gsk_queueShardNum, gsk_queueIngressCapacity);
+	static std::atomic<size_t> gs_forwardWorkerCount(0);
+
+	/** \brief	Maximum number of forwarded queries to the same peer sent in one message. */
+	static std::atomic<size_t> gs_forwardBatchSize(64);
+
+	/**
+	 * \brief	Time, in milliseconds, the forward worker waits for more queries when there are fewer
+	 * 			than a batch. Zero to send what is in the queue immediately.
+	 */
+	static std::atomic<uint64_t> gs_forwardBatchWindowMs(0);
+
+	/** \brief	Whether the local node created by Init() uses one-hop routing. */
+	static std::atomic<bool> gs_isOneHopRouting(false);
+
+	/** \brief	Upper bound of the size of query (or reply) batches accepted from peers. */
+	static constexpr uint64_t gsk_maxQueryBatchSize = 4096;
 
 	static void ForwardQuery(const uint64_t& nextAddr, const ForwardQueueItem& item)
 	{
 		//PRINT_I("Forward query with ID %s.", item.m_uuid.c_str());
-		CntPair peerCntPair = gs_state.GetConnectionMgr().GetNew(nextAddr, gs_state);
+		gs_state.GetConnectionMgr().Call(nextAddr, gs_state, EncFunc::Dht::k_queryNonBlock,
+			[&item](SecureCommLayer& comm)
+		{
+			comm.SendStruct(item);
+		});
+	}
+
+	static void ForwardQueries(const uint64_t& nextAddr, const std::vector<ForwardQueueItem>& items, size_t begin, size_t end)
+	{
+		if (end - begin == 1)
+		{
+			return ForwardQuery(nextAddr, items[begin]);
+		}
 
-		peerCntPair.GetCommLayer().SendStruct(EncFunc::Dht::k_queryNonBlock);
-		peerCntPair.GetCommLayer().SendStruct(item);
+		gs_state.GetConnectionMgr().Call(nextAddr, gs_state, EncFunc::Dht::k_queryNonBlockBatch,
+			[&items, begin, end](SecureCommLayer& comm)
+		{
+			const uint64_t count = end - begin;
+			comm.SendStruct(count); //1. Send number of items.
+			for (size_t i = begin; i < end; ++i)
+			{
+				comm.SendStruct(items[i]); //2. Send items. - Done!
+			}
+		});
 	}
 
 	struct ReplyQueueItem
@@ -98,21 +312,204 @@ namespace
 		uint64_t m_resAddr;
 	};
 
-	static std::mutex gs_replyQueueMutex;
-	static std::queue<std::pair< uint64_t, std::unique_ptr<ReplyQueueItem> > > gs_replyQueue;
-	static std::condition_variable gs_replyQueueSignal;
+	static DestinationQueues<uint64_t, ReplyQueueItem> gs_replyQueues(gsk_queueShardNum, gsk_queueIngressCapacity);
+	static std::atomic<size_t> gs_replyWorkerCount(0);
 
 	static void ReplyQuery(const uint64_t& nextAddr, const ReplyQueueItem& item)
 	{
 		//PRINT_I("Reply query with ID %s.", item.m_uuid.c_str());
-		CntPair peerCntPair = gs_state.GetConnectionMgr().GetNew(nextAddr, gs_state);
+		gs_state.GetConnectionMgr().Call(nextAddr, gs_state, EncFunc::Dht::k_queryReply,
+			[&item](SecureCommLayer& comm)
+		{
+			comm.SendStruct(item);
+		});
+	}
+
+	static void ReplyQueries(const uint64_t& nextAddr, const std::vector<ReplyQueueItem>& items, size_t begin, size_t end)
+	{
+		if (end - begin == 1)
+		{
+			return ReplyQuery(nextAddr, items[begin]);
+		}
+
+		gs_state.GetConnectionMgr().Call(nextAddr, gs_state, EncFunc::Dht::k_queryReplyBatch,
+			[&items, begin, end](SecureCommLayer& comm)
+		{
+			const uint64_t count = end - begin;
+			comm.SendStruct(count); //1. Send number of items.
+			for (size_t i = begin; i < end; ++i)
+			{
+				comm.SendStruct(items[i]); //2. Send items. - Done!
+			}
+		});
+	}
+
+	/**
+	 * \brief	Destroys a pending item, and releases the held connection of the app to the untrusted
+	 * 			side right away, through an OCall, so that the connections completed together (e.g. by
+	 * 			a reply batch) don't wait for later ECalls. If the request is done, the session is kept
+	 * 			for the next request, which the app may have sent already.
+	 *
+	 * \param [in,out]	pendingItem	The pending item, which is reset.
+	 * \param 		  	result	   	ProcResult::k_done if the result has been sent to the app;
+	 * 								otherwise, ProcResult::k_close.
+	 */
+	template<typename ItemType>
+	static void ReleasePendingItem(std::unique_ptr<ItemType>& pendingItem, ProcResult::NumType result)
+	{
+		void* cntPtr = pendingItem->m_session->m_cnt.GetPointer();
+		if (result == ProcResult::k_done)
+		{
+			result = KeepSession(pendingItem->m_session);
+		}
+		pendingItem.reset(); //Unless it's kept, the TLS session is done with the connection before it's released.
+
+		try
+		{
+			ConnectionManager::ReleaseHeldConnection(cntPtr, result);
+		}
+		catch (const std::exception& e)
+		{
+			PRINT_W("Failed to release the app connection. Error msg: %s", e.what());
+		}
+	}
+
+	/** \brief	Sends the result of a query to the app that is waiting for it, and releases the connection. */
+	static void CompleteQuery(const ReplyQueueItem& replyItem)
+	{
+		std::unique_ptr<PendingQueryItem> pendingItem = GetClientPendingQueries().Take(replyItem.m_reqId);
+		if (!pendingItem)
+		{
+			LOGW("Pending request ID is not found, or it has expired!");
+			return;
+		}
+
+		ProcResult::NumType result = ProcResult::k_done;
+		try
+		{
+			pendingItem->m_session->m_tls->SendStruct(replyItem.m_resAddr);
+		}
+		catch (const std::exception& e)
+		{
+			PRINT_W("Failed to send query result to App. Error msg: %s", e.what());
+			result = ProcResult::k_close;
+		}
+
+		ReleasePendingItem(pendingItem, result);
+	}
+
+	static void ProcessForwardItem(const ForwardQueueItem& forwardItem)
+	{
+		ConstBigNumber queriedId(forwardItem.m_keyId, sk_struct);
+
+		DhtStates::DhtLocalNodePtrType localNode = gs_state.GetDhtNode();
+
+		uint64_t resAddr = 0;
+		if (TryGetQueriedAddrLocally(*localNode, queriedId, resAddr))
+		{
+			//Query can be answered immediately.
+
+			ReplyQueueItem reItem;
+			reItem.m_reqId = forwardItem.m_reqId;
+			reItem.m_resAddr = resAddr;
+
+			gs_replyQueues.Push(forwardItem.m_reAddr, std::move(reItem));
+
+			return;
+		}
+		else
+		{
+			//Query has to be forwarded to other peer.
+		
+			DhtStates::DhtLocalNodeType::NodeBasePtr nextHop = localNode->GetNextHop(queriedId);
+
+			ForwardQueueItem nextItem = forwardItem;
+			gs_forwardQueues.Push(nextHop->GetAddress(), std::move(nextItem));
+
+			return;
+		}
+	}
+
+	/**
+	 * \brief	Inserts a pending query into the table, and forwards it to the given next hop.
+	 *
+	 * \return	False if the table is full, in which case the item is left untouched.
+	 */
+	static bool ForwardPendingQuery(std::unique_ptr<PendingQueryItem>& pendingItem, uint64_t nextAddr, uint64_t selfAddr)
+	{
+		ForwardQueueItem queueItem;
+		std::memcpy(queueItem.m_keyId, pendingItem->m_keyId, sizeof(queueItem.m_keyId));
+		queueItem.m_reAddr = selfAddr;
+
+		pendingItem->m_nextAddr = nextAddr;
+
+		const uint64_t deadline = TimeSource::GetSteadyTimeMs() + gsk_pendingQueryTimeoutMs;
+		if (!GetClientPendingQueries().Insert(std::move(pendingItem), deadline, queueItem.m_reqId))
+		{
+			return false;
+		}
+
+		gs_forwardQueues.Push(nextAddr, std::move(queueItem));
+
+		return true;
+	}
+
+	/**
+	 * \brief	Expires pending queries that have waited too long. Each of them is retried on an
+	 * 			alternate route, if it has retries left; otherwise, the held connection of the app is
+	 * 			closed without a result.
+	 */
+	static void ExpirePendingQueries()
+	{
+		std::vector<PendingTable<PendingQueryItem>::EntryType> expired;
+		GetClientPendingQueries().TakeExpired(TimeSource::GetSteadyTimeMs(), expired);
+		if (expired.size() == 0)
+		{
+			return;
+		}
+
+		DhtStates::DhtLocalNodePtrType localNode = gs_state.GetDhtNode();
+
+		for (auto& entry : expired)
+		{
+			std::unique_ptr<PendingQueryItem>& pendingItem = entry.second;
+
+			if (localNode && pendingItem->m_retryCount < gsk_pendingQueryMaxRetry)
+			{
+				//The immediate successor is always a valid, though slower, route around a dead finger.
+				uint64_t nextAddr = localNode->GetImmediateSuccessor()->GetAddress();
+				if (nextAddr == pendingItem->m_nextAddr)
+				{
+					nextAddr = localNode->GetNextHop(ConstBigNumber(pendingItem->m_keyId, sk_struct))->GetAddress();
+				}
+
+				++(pendingItem->m_retryCount);
+				if (ForwardPendingQuery(pendingItem, nextAddr, localNode->GetAddress()))
+				{
+					continue;
+				}
+			}
+
+			LOGW("Pending query has expired; closing the app connection.");
+			ReleasePendingItem(pendingItem, ProcResult::k_close);
+		}
+	}
+
+	/** \brief	Expires routed data operations that have waited too long for their results. */
+	static void ExpirePendingDataOps()
+	{
+		std::vector<PendingTable<PendingDataOpItem>::EntryType> expired;
+		GetClientPendingDataOps().TakeExpired(TimeSource::GetSteadyTimeMs(), expired);
 
-		peerCntPair.GetCommLayer().SendStruct(EncFunc::Dht::k_queryReply);
-		peerCntPair.GetCommLayer().SendStruct(item);
+		for (auto& entry : expired)
+		{
+			LOGW("Pending data operation has expired; closing the app connection.");
+			ReleasePendingItem(entry.second, ProcResult::k_close);
+		}
 	}
 }
 
-void Dht::DeUpdateFingerTable(Decent::Net::TlsCommLayer &tls)
+void Dht::DeUpdateFingerTable(Decent::Net::SecureCommLayer &tls)
 {
 	//LOGI("DHT Server: De-Updating FingerTable...");
 	std::array<uint8_t, DhtStates::sk_keySizeByte> oldIdBin{};
@@ -132,168 +529,158 @@ void Dht::DeUpdateFingerTable(Decent::Net::TlsCommLayer &tls)
 	//LOGI("");
 }
 
-void Dht::QueryNonBlock(Decent::Net::TlsCommLayer & tls)
+void Dht::QueryNonBlock(Decent::Net::SecureCommLayer & tls)
 {
-	std::unique_ptr<ForwardQueueItem> forwardItem = Tools::make_unique<ForwardQueueItem>();
-
-	tls.ReceiveStruct(*forwardItem);
+	ForwardQueueItem forwardItem;
 
-	ConstBigNumber queriedId(forwardItem->m_keyId, sk_struct);
+	tls.ReceiveStruct(forwardItem);
 
-	DhtStates::DhtLocalNodePtrType localNode = gs_state.GetDhtNode();
+	ProcessForwardItem(forwardItem);
+}
 
-	uint64_t resAddr = 0;
-	if (TryGetQueriedAddrLocally(*localNode, queriedId, resAddr))
+void Dht::QueryNonBlockBatch(Decent::Net::SecureCommLayer & tls)
+{
+	uint64_t count = 0;
+	tls.ReceiveStruct(count); //1. Receive number of items.
+	if (count > gsk_maxQueryBatchSize)
 	{
-		//Query can be answered immediately.
-
-		std::unique_ptr<ReplyQueueItem> reItem = Tools::make_unique<ReplyQueueItem>();
-		reItem->m_reqId = forwardItem->m_reqId;
-		reItem->m_resAddr = resAddr;
-
-		{
-			std::unique_lock<std::mutex> replyQueueLock(gs_replyQueueMutex);
-			gs_replyQueue.push(std::make_pair(forwardItem->m_reAddr, std::move(reItem)));
-			replyQueueLock.unlock();
-			gs_replyQueueSignal.notify_one();
-		}
-
-		return;
+		throw RuntimeException("The batch of forwarded queries is too large.");
 	}
-	else
+
+	for (uint64_t i = 0; i < count; ++i)
 	{
-		//Query has to be forwarded to other peer.
-		
-		DhtStates::DhtLocalNodeType::NodeBasePtr nextHop = localNode->GetNextHop(queriedId);
+		ForwardQueueItem forwardItem;
 
-		{
-			std::unique_lock<std::mutex> forwardQueueLock(gs_forwardQueueMutex);
-			gs_forwardQueue.push(std::make_pair(nextHop->GetAddress(), std::move(forwardItem)));
-			forwardQueueLock.unlock();
-			gs_forwardQueueSignal.notify_one();
-		}
+		tls.ReceiveStruct(forwardItem); //2. Receive items. - Done!
 
-		return;
+		ProcessForwardItem(forwardItem);
 	}
 }
 
+void Dht::SetForwardBatching(size_t flushSize, uint64_t windowMs)
+{
+	//Larger batches would be rejected by peers (see QueryNonBlockBatch).
+	gs_forwardBatchSize = std::min<size_t>(std::max<size_t>(flushSize, 1), static_cast<size_t>(gsk_maxQueryBatchSize));
+	gs_forwardBatchWindowMs = windowMs;
+}
+
 void Dht::QueryForwardWorker()
 {
-	std::queue<std::pair<uint64_t, std::unique_ptr<ForwardQueueItem> > > tmpQueue;
-	//bool hasJob = false;
-	//uint64_t addr = 0;
-	//std::unique_ptr<ForwardQueueItem> item;
+	const size_t workerIdx = gs_forwardWorkerCount++;
 
-	while (!gs_isForwardingTerminated)
+	uint64_t addr = 0;
+	std::vector<ForwardQueueItem> items;
+
+	while (gs_forwardQueues.Pop(workerIdx, gs_forwardBatchSize, addr, items))
 	{
+		const size_t batchSize = gs_forwardBatchSize;
+		const uint64_t windowMs = gs_forwardBatchWindowMs;
+		if (windowMs > 0 && items.size() < batchSize)
 		{
-			std::unique_lock<std::mutex> forwardQueueLock(gs_forwardQueueMutex);
-			if (gs_forwardQueue.size() == 0)
-			{
-				gs_forwardQueueSignal.wait(forwardQueueLock, []() {
-					return gs_isForwardingTerminated || gs_forwardQueue.size() > 0;
-				});
-			}
+			//Wait once for more queries to fill the batch.
+			TimeSource::SleepMs(windowMs);
 
-			if (!gs_isForwardingTerminated && gs_forwardQueue.size() > 0)
-			{
-				tmpQueue.swap(gs_forwardQueue);
-				//hasJob = true;
-				//addr = gs_forwardQueue.front().first;
-				//item = std::move(gs_forwardQueue.front().second);
-				//gs_forwardQueue.pop();
-			}
+			gs_forwardQueues.PopMore(addr, batchSize - items.size(), items);
 		}
 
-		//if (hasJob)
-		while (tmpQueue.size() > 0)
+		//Queries to the same next hop are sent together. Only this worker is blocked if the next hop
+		//is slow; other workers keep serving other next hops.
+		try
 		{
-			ForwardQuery(tmpQueue.front().first, *tmpQueue.front().second);
-			tmpQueue.pop();
-			//ForwardQuery(addr, *item);
-			//hasJob = false;
+			ForwardQueries(addr, items, 0, items.size());
 		}
+		catch (const std::exception& e)
+		{
+			PRINT_W("Failed to forward %llu queries to peer. Error msg: %s", static_cast<unsigned long long>(items.size()), e.what());
+		}
+
+		items.clear();
+		gs_forwardQueues.Done(addr);
 	}
 }
 
 void Dht::QueryReplyWorker()
 {
-	std::queue<std::pair< uint64_t, std::unique_ptr<ReplyQueueItem> > > tmpQueue;
-	//bool hasJob = false;
-	//uint64_t addr = 0;
-	//std::unique_ptr<ReplyQueueItem> item;
+	const size_t workerIdx = gs_replyWorkerCount++;
+
+	uint64_t addr = 0;
+	std::vector<ReplyQueueItem> items;
 
-	while (!gs_isForwardingTerminated)
+	while (gs_replyQueues.Pop(workerIdx, gsk_maxQueryBatchSize, addr, items))
 	{
+		//Replies to the same origin node are sent together.
+		try
 		{
-			std::unique_lock<std::mutex> replyQueueLock(gs_replyQueueMutex);
-			if (gs_replyQueue.size() == 0)
-			{
-				gs_replyQueueSignal.wait(replyQueueLock, []() {
-					return gs_isForwardingTerminated || gs_replyQueue.size() > 0;
-				});
-			}
-
-			if (!gs_isForwardingTerminated && gs_replyQueue.size() > 0)
-			{
-				tmpQueue.swap(gs_replyQueue);
-				//hasJob = true;
-				//addr = gs_replyQueue.front().first;
-				//item = std::move(gs_replyQueue.front().second);
-				//gs_replyQueue.pop();
-			}
+			ReplyQueries(addr, items, 0, items.size());
 		}
-
-		//if (hasJob)
-		while (tmpQueue.size() > 0)
+		catch (const std::exception& e)
 		{
-			ReplyQuery(tmpQueue.front().first, *tmpQueue.front().second);
-			tmpQueue.pop();
-			//ReplyQuery(addr, *item);
-			//hasJob = false;
+			PRINT_W("Failed to reply %llu queries to peer. Error msg: %s", static_cast<unsigned long long>(items.size()), e.what());
 		}
+
+		items.clear();
+		gs_replyQueues.Done(addr);
+	}
+}
+
+void Dht::PendingQueryTimer()
+{
+	while (!gs_isPendingQueryTimerTerminated)
+	{
+		TimeSource::SleepMs(gsk_pendingQuerySweepIntervalMs);
+
+		ExpirePendingQueries();
+		ExpirePendingDataOps();
+
+		gs_state.GetConnectionMgr().CloseIdleChannels();
 	}
 }
 
 void Dht::TerminateWorkers()
 {
-	gs_isForwardingTerminated = true;
+	gs_isPendingQueryTimerTerminated = true;
+
+	gs_forwardQueues.Close();
+	gs_replyQueues.Close();
 
-	gs_forwardQueueSignal.notify_all();
-	gs_replyQueueSignal.notify_all();
+	gs_state.GetTaskPool().Terminate();
 }
 
-void Dht::QueryReply(Decent::Net::TlsCommLayer & tls, void*& heldCntPtr)
+void Dht::TaskWorker()
+{
+	gs_state.GetTaskPool().Work();
+}
+
+void Dht::QueryReply(Decent::Net::SecureCommLayer & tls)
 {
 	ReplyQueueItem replyItem;
 
 	tls.ReceiveStruct(replyItem);
 
 	//PRINT_I("Received forwarded query reply with ID %s.", requestId.c_str());
-	
-	std::unique_ptr<PendingQueryItem> pendingItem;
 
-	{
-		std::unique_lock<std::mutex> clientPendingQueriesLock(gs_clientPendingQueriesMutex);
-		auto it = gs_clientPendingQueries.find(replyItem.m_reqId);
-		if (it != gs_clientPendingQueries.end())
-		{
-			pendingItem = std::move(it->second);
+	CompleteQuery(replyItem);
+}
 
-			gs_clientPendingQueries.erase(it);
-		}
-		else
-		{
-			LOGW("Pending request UUID is not found!");
-			return;
-		}
+void Dht::QueryReplyBatch(Decent::Net::SecureCommLayer & tls)
+{
+	uint64_t count = 0;
+	tls.ReceiveStruct(count); //1. Receive number of items.
+	if (count > gsk_maxQueryBatchSize)
+	{
+		throw RuntimeException("The batch of query replies is too large.");
 	}
 
-	pendingItem->m_tls->SendStruct(replyItem.m_resAddr);
-	heldCntPtr = pendingItem->m_cnt->GetPointer();
+	for (uint64_t i = 0; i < count; ++i)
+	{
+		ReplyQueueItem replyItem;
+		tls.ReceiveStruct(replyItem); //2. Receive items. - Done!
+
+		CompleteQuery(replyItem);
+	}
 }
 
-void Dht::UpdateFingerTable(Decent::Net::TlsCommLayer &tls)
+void Dht::UpdateFingerTable(Decent::Net::SecureCommLayer &tls)
 {
 	//LOGI("DHT Server: Updating FingerTable...");
 	DhtStates::DhtLocalNodeType::NodeBasePtr s = NodeConnector::ReceiveNode(tls); //2. Receive node.
@@ -310,7 +697,7 @@ void Dht::UpdateFingerTable(Decent::Net::TlsCommLayer &tls)
 	//LOGI("");
 }
 
-void Dht::GetImmediatePredecessor(Decent::Net::TlsCommLayer &tls)
+void Dht::GetImmediatePredecessor(Decent::Net::SecureCommLayer &tls)
 {
 	//LOGI("DHT Server: Getting Immediate Predecessor...");
 
@@ -320,7 +707,7 @@ void Dht::GetImmediatePredecessor(Decent::Net::TlsCommLayer &tls)
 	//LOGI("");
 }
 
-void Dht::SetImmediatePredecessor(Decent::Net::TlsCommLayer &tls)
+void Dht::SetImmediatePredecessor(Decent::Net::SecureCommLayer &tls)
 {
 	//LOGI("DHT Server: Setting Immediate Predecessor...");
 
@@ -332,7 +719,21 @@ void Dht::SetImmediatePredecessor(Decent::Net::TlsCommLayer &tls)
 	//LOGI("");
 }
 
-void Dht::GetImmediateSucessor(Decent::Net::TlsCommLayer &tls)
+void Dht::GetMembers(Decent::Net::SecureCommLayer &tls)
+{
+	DhtStates::DhtLocalNodePtrType localNode = gs_state.GetDhtNode();
+
+	std::vector<DhtStates::DhtLocalNodeType::NodeBasePtr> members = localNode->GetMembers();
+
+	const uint64_t memberNum = members.size();
+	tls.SendStruct(memberNum); //2. Send number of nodes.
+	for (DhtStates::DhtLocalNodeType::NodeBasePtr& member : members)
+	{
+		NodeConnector::SendNode(tls, member); //3. Send nodes. - Done!
+	}
+}
+
+void Dht::GetImmediateSucessor(Decent::Net::SecureCommLayer &tls)
 {
     //LOGI("DHT Server: Finding Immediate Successor...");
 
@@ -342,7 +743,7 @@ void Dht::GetImmediateSucessor(Decent::Net::TlsCommLayer &tls)
 	//LOGI("");
 }
 
-void Dht::GetNodeId(Decent::Net::TlsCommLayer &tls)
+void Dht::GetNodeId(Decent::Net::SecureCommLayer &tls)
 {
     //LOGI("DHT Server: Getting the NodeId...");
 	DhtStates::DhtLocalNodePtrType localNode = gs_state.GetDhtNode();
@@ -355,7 +756,7 @@ void Dht::GetNodeId(Decent::Net::TlsCommLayer &tls)
 	//LOGI("");
 }
 
-void Dht::FindPredecessor(Decent::Net::TlsCommLayer &tls)
+void Dht::FindPredecessor(Decent::Net::SecureCommLayer &tls)
 {
     //LOGI("DHT Server: Finding Predecessor...");
     std::array<uint8_t, DhtStates::sk_keySizeByte> keyBin{};
@@ -370,7 +771,7 @@ void Dht::FindPredecessor(Decent::Net::TlsCommLayer &tls)
 	//LOGI("");
 }
 
-void Dht::FindSuccessor(Decent::Net::TlsCommLayer &tls)
+void Dht::FindSuccessor(Decent::Net::SecureCommLayer &tls)
 {
 	//LOGI("DHT Server: Finding Successor...");
 	std::array<uint8_t, DhtStates::sk_keySizeByte> keyBin{};
@@ -385,14 +786,64 @@ void Dht::FindSuccessor(Decent::Net::TlsCommLayer &tls)
 	//LOGI("");
 }
 
-void Dht::ProcessDhtQuery(Decent::Net::TlsCommLayer & tls, void*& heldCntPtr)
+ProcResult::NumType Dht::ProcessSessionMsg(void * cntPtr)
+{
+	std::unique_ptr<ServerSession> session = TakeSession(cntPtr);
+	if (!session)
+	{
+		LOGW("The session of the connection is not found!");
+		return ProcResult::k_close;
+	}
+
+	if (session->IsChannel())
+	{
+		return ServeChannelFrame(session);
+	}
+
+	EncFunc::App::NumType funcNum;
+	try
+	{
+		session->m_tls->ReceiveStruct(funcNum); //1. Received function type.
+	}
+	catch (const std::exception&)
+	{
+		return ProcResult::k_close; //The session is closed by the app.
+	}
+
+	return ProcessAppFunc(funcNum, session);
+}
+
+void Dht::CloseSession(void * cntPtr)
+{
+	TakeSession(cntPtr);
+}
+
+ProcResult::NumType Dht::ProcessDhtQuery(std::unique_ptr<ServerSession>& session)
 {
 	using namespace EncFunc::Dht;
 
 	//LOGI("DHT Server: Processing DHT queries...");
 
 	NumType funcNum;
-	tls.ReceiveStruct(funcNum); //1. Received function type.
+	session->m_tls->ReceiveStruct(funcNum); //1. Received function type.
+
+	if (funcNum == k_openChannel)
+	{
+		//The first RPC is sent right after the channel is opened. If there are too many channels, it's
+		//the only one served, and the peer is told to close the channel by the trailer; otherwise,
+		//later RPCs on the channel are served one per ECall, as they arrive.
+		session->TryMakeChannel(GetMaxChannelNum());
+		return ServeChannelFrame(session);
+	}
+
+	ProcessDhtFunc(funcNum, *session->m_tls);
+
+	return ProcResult::k_done;
+}
+
+void Dht::ProcessDhtFunc(EncFunc::Dht::NumType funcNum, Decent::Net::SecureCommLayer & tls)
+{
+	using namespace EncFunc::Dht;
 
 	switch (funcNum)
 	{
@@ -421,6 +872,10 @@ void Dht::ProcessDhtQuery(Decent::Net::TlsCommLayer & tls, void*& heldCntPtr)
 		GetImmediatePredecessor(tls);
 		break;
 
+	case k_getMembers:
+		GetMembers(tls);
+		break;
+
 	case k_updFingerTable:
 		UpdateFingerTable(tls);
 		break;
@@ -433,16 +888,71 @@ void Dht::ProcessDhtQuery(Decent::Net::TlsCommLayer & tls, void*& heldCntPtr)
 		QueryNonBlock(tls);
 		break;
 
+	case k_queryNonBlockBatch:
+		QueryNonBlockBatch(tls);
+		break;
+
 	case k_queryReply:
-		QueryReply(tls, heldCntPtr);
+		QueryReply(tls);
 		break;
 
-	default:
+	case k_queryReplyBatch:
+		QueryReplyBatch(tls);
 		break;
-	}
-}
 
-void Dht::ProcessStoreRequest(Decent::Net::TlsCommLayer & tls)
+	case k_routedData:
+		RoutedData(tls);
+		break;
+
+	case k_routedDataReply:
+		RoutedDataReply(tls);
+		break;
+
+	default:
+		break;
+	}
+}
+
+ProcResult::NumType Dht::ServeChannelFrame(std::unique_ptr<ServerSession>& session)
+{
+	using namespace EncFunc::Dht;
+
+	//The response and the trailer of each RPC are sent as one record.
+	BufferedCommLayer tls(*session->m_tls);
+
+	DhtSecureConnectionMgr::ChannelFrame frame;
+	try
+	{
+		tls.ReceiveStruct(frame); //1. Received frame header.
+	}
+	catch (const std::exception&)
+	{
+		return ProcResult::k_close; //The channel is closed by the peer.
+	}
+
+	switch (frame.m_funcNum)
+	{
+	case k_ping:
+		break;
+
+	case k_openChannel:
+		throw RuntimeException("Function is not allowed on DHT channels.");
+
+	default:
+		ProcessDhtFunc(frame.m_funcNum, tls); //2. Process the function.
+		break;
+	}
+
+	DhtSecureConnectionMgr::ChannelTrailer trailer;
+	trailer.m_reqId = frame.m_reqId;
+	trailer.m_isKept = session->IsChannel() ? 1 : 0;
+	tls.SendStruct(trailer); //3. Send trailer.
+	tls.Flush(); //Done!
+
+	return session->IsChannel() ? KeepSession(session) : ProcResult::k_done;
+}
+
+void Dht::ProcessStoreRequest(Decent::Net::TlsCommLayer & tls)
 {
 	using namespace EncFunc::Store;
 
@@ -474,18 +984,23 @@ void Dht::GetMigrateData(Decent::Net::TlsCommLayer & tls)
 	tls.ReceiveRaw(endKeyBin.data(), endKeyBin.size());
 	ConstBigNumber end(endKeyBin);
 
+	//Fields of the migrating data are sent in records of up to the flush threshold.
+	BufferedCommLayer comm(tls);
+
 	gs_state.GetDhtStore().SendMigratingData(
-		[&tls](const void* buffer, const size_t size) -> void
+		[&comm](const void* buffer, const size_t size) -> void
 	{
-		tls.SendRaw(buffer, size);
+		comm.SendRaw(buffer, size);
 	},
-		[&tls](const BigNumber& key) -> void
+		[&comm](const BigNumber& key) -> void
 	{
 		std::array<uint8_t, DhtStates::sk_keySizeByte> keyBuf{};
 		key.ToBinary(keyBuf);
-		tls.SendRaw(keyBuf.data(), keyBuf.size());
+		comm.SendRaw(keyBuf.data(), keyBuf.size());
 	},
-		start, end);
+		start, end, gs_state.GetTaskPool());
+
+	comm.Flush();
 }
 
 void Dht::SetMigrateData(Decent::Net::TlsCommLayer & tls)
@@ -500,7 +1015,8 @@ void Dht::SetMigrateData(Decent::Net::TlsCommLayer & tls)
 		std::array<uint8_t, DhtStates::sk_keySizeByte> keyBuf{};
 		tls.ReceiveRaw(keyBuf.data(), keyBuf.size());
 		return BigNumber(keyBuf);
-	});
+	},
+		gs_state.GetTaskPool());
 }
 
 void Dht::SetData(Decent::Net::TlsCommLayer & tls)
@@ -543,6 +1059,349 @@ void Dht::DelData(Decent::Net::TlsCommLayer & tls)
 	tls.SendStruct(gsk_ack);
 }
 
+namespace
+{
+	typedef OwnershipReply<DhtStates::sk_keySizeByte> DhtOwnershipReply;
+
+	//Replies are sent as raw bytes, so they must not have implicit padding, which may carry stale
+	//enclave memory.
+	static_assert(sizeof(DhtOwnershipReply) == 8 + (2 * DhtStates::sk_keySizeByte) + 8 + 8, "OwnershipReply has implicit padding.");
+	static_assert(sizeof(NextHopReply<DhtStates::sk_keySizeByte>) == 8 + DhtStates::sk_keySizeByte + 8, "NextHopReply has implicit padding.");
+
+	/**
+	 * \brief	Fills the ownership reply header for the key.
+	 *
+	 * \return	True if this node owns the key; otherwise, false, and the redirect address is set.
+	 */
+	static bool FillOwnershipReply(const BigNumber& key, DhtOwnershipReply& reply)
+	{
+		DhtStates::DhtLocalNodePtrType localNode = gs_state.GetDhtNode();
+
+		localNode->GetImmediatePredecessor()->GetNodeId().ToBinary(reply.m_predId);
+		localNode->GetNodeId().ToBinary(reply.m_nodeId);
+		reply.m_nodeAddr = localNode->GetAddress();
+
+		if (localNode->IsResponsibleFor(key))
+		{
+			reply.m_isServed = 1;
+			reply.m_redirectAddr = reply.m_nodeAddr;
+			return true;
+		}
+
+		reply.m_isServed = 0;
+		reply.m_redirectAddr = localNode->IsImmediatePredecessorOf(key) ?
+			localNode->GetImmediateSuccessor()->GetAddress() :
+			localNode->GetNextHop(key)->GetAddress();
+		return false;
+	}
+}
+
+void Dht::GetDataOwned(Decent::Net::TlsCommLayer & tls)
+{
+	std::array<uint8_t, DhtStates::sk_keySizeByte> keyBin{};
+	tls.ReceiveRaw(keyBin.data(), keyBin.size()); //2. Received key
+	ConstBigNumber key(keyBin);
+
+	DhtOwnershipReply reply{};
+	if (!FillOwnershipReply(key, reply))
+	{
+		tls.SendStruct(reply); //3. Send redirect. - Done!
+		return;
+	}
+
+	std::vector<uint8_t> buffer = gs_state.GetDhtStore().GetValue(key);
+
+	tls.SendStruct(reply); //3. Send header.
+	tls.SendMsg(buffer); //4. Send value. - Done!
+}
+
+void Dht::SetDataOwned(Decent::Net::TlsCommLayer & tls)
+{
+	std::array<uint8_t, DhtStates::sk_keySizeByte> keyBin{};
+	tls.ReceiveRaw(keyBin.data(), keyBin.size()); //2. Received key
+	ConstBigNumber key(keyBin);
+
+	std::vector<uint8_t> buffer;
+	tls.ReceiveMsg(buffer); //3. Received value; it's received even if redirected, to keep the session in sync.
+
+	DhtOwnershipReply reply{};
+	if (FillOwnershipReply(key, reply))
+	{
+		gs_state.GetDhtStore().SetValue(key, std::move(buffer));
+	}
+
+	tls.SendStruct(reply); //4. Send reply. - Done!
+}
+
+void Dht::DelDataOwned(Decent::Net::TlsCommLayer & tls)
+{
+	std::array<uint8_t, DhtStates::sk_keySizeByte> keyBin{};
+	tls.ReceiveRaw(keyBin.data(), keyBin.size()); //2. Received key
+	ConstBigNumber key(keyBin);
+
+	DhtOwnershipReply reply{};
+	if (FillOwnershipReply(key, reply))
+	{
+		gs_state.GetDhtStore().DelValue(key);
+	}
+
+	tls.SendStruct(reply); //3. Send reply. - Done!
+}
+
+namespace
+{
+	/**
+	 * \brief	Maximum number of hops a routed data operation may take; it's dropped afterwards, so
+	 * 			an operation caught in a routing loop, e.g. while the ring is changing, does not circle
+	 * 			forever.
+	 */
+	static constexpr uint8_t gsk_maxRoutedDataHops = 32;
+
+	/**
+	 * \brief	Maximum number of routed data operations waiting for a task worker. An operation
+	 * 			beyond it is dropped, and the app session held for it is closed when it expires.
+	 */
+	static constexpr size_t gsk_maxQueuedRoutedDataNum = 64;
+
+	struct RoutedDataHeader
+	{
+		uint64_t m_reqId;
+		uint8_t m_keyId[DhtStates::sk_keySizeByte];
+		uint64_t m_reAddr;
+		EncFunc::App::NumType m_op;
+		uint8_t m_hopCount;
+		uint8_t m_pad[6];
+	};
+
+	struct RoutedDataResult
+	{
+		uint64_t m_reqId;
+		uint8_t m_isSucceeded;
+		uint8_t m_pad[7];
+	};
+
+	static_assert(sizeof(RoutedDataHeader) == 8 + DhtStates::sk_keySizeByte + 8 + 8, "RoutedDataHeader has implicit padding.");
+	static_assert(sizeof(RoutedDataResult) == 8 + 8, "RoutedDataResult has implicit padding.");
+
+	static void SendValue(SecureCommLayer& comm, const std::vector<uint8_t>& value)
+	{
+		const uint64_t size = value.size();
+		comm.SendStruct(size); //1. Send size of the value.
+		if (size > 0)
+		{
+			comm.SendRaw(value.data(), value.size()); //2. Send the value. - Done!
+		}
+	}
+
+	static std::vector<uint8_t> ReceiveValue(SecureCommLayer& comm)
+	{
+		uint64_t size = 0;
+		comm.ReceiveStruct(size); //1. Receive size of the value.
+		if (size > EnclaveStore::sk_maxValueSize)
+		{
+			throw RuntimeException("The value of the routed data operation is too large.");
+		}
+
+		std::vector<uint8_t> value(static_cast<size_t>(size));
+		if (size > 0)
+		{
+			comm.ReceiveRaw(value.data(), value.size()); //2. Receive the value. - Done!
+		}
+		return value;
+	}
+
+	/**
+	 * \brief	Does a data operation on the local store.
+	 *
+	 * \param 		  	op   	The operation, i.e. k_getData, k_setData, or k_delData.
+	 * \param 		  	key  	The key.
+	 * \param [in,out]	value	The value to set; or the value got. Cleared for other operations.
+	 *
+	 * \return	True if it succeeds; false if it fails, e.g. the key is not found.
+	 */
+	static bool DoDataOpLocally(EncFunc::App::NumType op, const BigNumber& key, std::vector<uint8_t>& value)
+	{
+		using namespace EncFunc::App;
+
+		try
+		{
+			switch (op)
+			{
+			case k_getData:
+				value = gs_state.GetDhtStore().GetValue(key);
+				return true;
+
+			case k_setData:
+				gs_state.GetDhtStore().SetValue(key, std::move(value));
+				value.clear();
+				return true;
+
+			case k_delData:
+				gs_state.GetDhtStore().DelValue(key);
+				value.clear();
+				return true;
+
+			default:
+				value.clear();
+				return false;
+			}
+		}
+		catch (const std::exception& e)
+		{
+			PRINT_W("Failed to do the data operation. Error msg: %s", e.what());
+			value.clear();
+			return false;
+		}
+	}
+
+	/** \brief	Sends the result of a data operation to the app. */
+	static void SendDataOpResult(TlsCommLayer& tls, EncFunc::App::NumType op, bool isSucceeded, const std::vector<uint8_t>& value)
+	{
+		const uint8_t isSucceededByte = isSucceeded ? 1 : 0;
+		tls.SendStruct(isSucceededByte); //1. Send the result.
+		if (isSucceeded && op == EncFunc::App::k_getData)
+		{
+			tls.SendMsg(value); //2. Send the value. - Done!
+		}
+	}
+
+	/** \brief	Checks if the operation is one of the data operations that can be routed. */
+	static bool IsRoutedDataOp(EncFunc::App::NumType op)
+	{
+		return op == EncFunc::App::k_getData || op == EncFunc::App::k_setData || op == EncFunc::App::k_delData;
+	}
+
+	/**
+	 * \brief	Queues a task on the task pool, so the ECall that receives a routed data operation is
+	 * 			not held by the next peer. The task is dropped if the queue is full.
+	 *
+	 * \return	True if the task is queued; otherwise, false.
+	 */
+	static bool RunOnTaskPool(const std::function<void()>& task)
+	{
+		if (!gs_state.GetTaskPool().TryQueue(task, gsk_maxQueuedRoutedDataNum))
+		{
+			LOGW("Too many routed data operations are waiting; the operation is dropped.");
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	 * \brief	Does a routed data operation if this node owns the key, and sends the result to the
+	 * 			origin node; otherwise, forwards the operation to the next hop.
+	 *
+	 * \return	False if the operation is dropped, i.e. it has taken too many hops, or the task pool is
+	 * 			busy; otherwise, true.
+	 */
+	static bool ProcessRoutedDataOp(const RoutedDataHeader& header, std::vector<uint8_t>&& value)
+	{
+		ConstBigNumber key(header.m_keyId, sk_struct);
+
+		DhtStates::DhtLocalNodePtrType localNode = gs_state.GetDhtNode();
+
+		std::shared_ptr<std::vector<uint8_t> > valuePtr = std::make_shared<std::vector<uint8_t> >(std::move(value));
+
+		if (localNode->IsResponsibleFor(key))
+		{
+			RoutedDataResult result{};
+			result.m_reqId = header.m_reqId;
+			result.m_isSucceeded = DoDataOpLocally(header.m_op, key, *valuePtr) ? 1 : 0;
+
+			const uint64_t reAddr = header.m_reAddr;
+			return RunOnTaskPool([reAddr, result, valuePtr]()
+			{
+				try
+				{
+					gs_state.GetConnectionMgr().Call(reAddr, gs_state, EncFunc::Dht::k_routedDataReply,
+						[&result, &valuePtr](SecureCommLayer& comm)
+					{
+						comm.SendStruct(result); //1. Send result.
+						SendValue(comm, *valuePtr); //2. Send value. - Done!
+					});
+				}
+				catch (const std::exception& e)
+				{
+					PRINT_W("Failed to send the result of the data operation to peer. Error msg: %s", e.what());
+				}
+			});
+		}
+
+		if (header.m_hopCount >= gsk_maxRoutedDataHops)
+		{
+			LOGW("The routed data operation has taken too many hops; it's dropped.");
+			return false;
+		}
+
+		RoutedDataHeader nextHeader = header;
+		++nextHeader.m_hopCount;
+
+		const uint64_t nextAddr = localNode->IsImmediatePredecessorOf(key) ?
+			localNode->GetImmediateSuccessor()->GetAddress() :
+			localNode->GetNextHop(key)->GetAddress();
+		return RunOnTaskPool([nextAddr, nextHeader, valuePtr]()
+		{
+			try
+			{
+				gs_state.GetConnectionMgr().Call(nextAddr, gs_state, EncFunc::Dht::k_routedData,
+					[&nextHeader, &valuePtr](SecureCommLayer& comm)
+				{
+					comm.SendStruct(nextHeader); //1. Send header.
+					SendValue(comm, *valuePtr); //2. Send value. - Done!
+				});
+			}
+			catch (const std::exception& e)
+			{
+				PRINT_W("Failed to forward the data operation to peer. Error msg: %s", e.what());
+			}
+		});
+	}
+}
+
+void Dht::RoutedData(Decent::Net::SecureCommLayer & tls)
+{
+	RoutedDataHeader header;
+	tls.ReceiveStruct(header); //1. Receive header.
+
+	std::vector<uint8_t> value = ReceiveValue(tls); //2. Receive value. - Done!
+
+	if (!IsRoutedDataOp(header.m_op))
+	{
+		LOGW("Unknown routed data operation from peer; it's dropped.");
+		return;
+	}
+
+	ProcessRoutedDataOp(header, std::move(value));
+}
+
+void Dht::RoutedDataReply(Decent::Net::SecureCommLayer & tls)
+{
+	RoutedDataResult result;
+	tls.ReceiveStruct(result); //1. Receive result.
+
+	std::vector<uint8_t> value = ReceiveValue(tls); //2. Receive value. - Done!
+
+	std::unique_ptr<PendingDataOpItem> pendingItem = GetClientPendingDataOps().Take(result.m_reqId);
+	if (!pendingItem)
+	{
+		LOGW("Pending data operation is not found, or it has expired!");
+		return;
+	}
+
+	ProcResult::NumType procResult = ProcResult::k_done;
+	try
+	{
+		SendDataOpResult(*pendingItem->m_session->m_tls, pendingItem->m_op, result.m_isSucceeded != 0, value);
+	}
+	catch (const std::exception& e)
+	{
+		PRINT_W("Failed to send the result of the data operation to App. Error msg: %s", e.what());
+		procResult = ProcResult::k_close;
+	}
+
+	ReleasePendingItem(pendingItem, procResult);
+}
+
 namespace
 {
 	static std::shared_ptr<Ra::TlsConfigSameEnclave> GetClientTlsConfigDhtNode()
@@ -557,7 +1416,8 @@ namespace
 		using namespace EncFunc::Store;
 
 		std::unique_ptr<ConnectionBase> connection = ConnectionManager::GetConnection2DecentStore(addr);
-		Decent::Net::TlsCommLayer tls(*connection, GetClientTlsConfigDhtNode(), true, nullptr);
+		Decent::Net::TlsCommLayer secComm(*connection, GetClientTlsConfigDhtNode(), true, nullptr);
+		BufferedCommLayer tls(secComm); //The request is flushed once the data is being received.
 
 		tls.SendStruct(k_getMigrateData);         //1. Send function type
 
@@ -579,7 +1439,8 @@ namespace
 			std::array<uint8_t, DhtStates::sk_keySizeByte> keyBuf{};
 			tls.ReceiveRaw(keyBuf.data(), keyBuf.size());
 			return BigNumber(keyBuf);
-		}); //4. Receive data.
+		},
+			gs_state.GetTaskPool()); //4. Receive data.
 	}
 
 	static void MigrateAllDataToPeer(EnclaveStore& dhtStore, const uint64_t & addr)
@@ -588,7 +1449,8 @@ namespace
 		using namespace EncFunc::Store;
 
 		std::unique_ptr<ConnectionBase> connection = ConnectionManager::GetConnection2DecentStore(addr);
-		Decent::Net::TlsCommLayer tls(*connection, GetClientTlsConfigDhtNode(), true, nullptr);
+		Decent::Net::TlsCommLayer secComm(*connection, GetClientTlsConfigDhtNode(), true, nullptr);
+		BufferedCommLayer tls(secComm);
 
 		tls.SendStruct(k_setMigrateData); //1. Send function type
 
@@ -602,8 +1464,36 @@ namespace
 			std::array<uint8_t, DhtStates::sk_keySizeByte> keyBuf{};
 			key.ToBinary(keyBuf);
 			tls.SendRaw(keyBuf.data(), keyBuf.size());
-		}); //2. Send data.
+		},
+			gs_state.GetTaskPool()); //2. Send data.
+
+		tls.Flush(); //Done!
+	}
+}
+
+void Dht::SetOneHopRouting(bool isEnabled)
+{
+	gs_isOneHopRouting = isEnabled;
+}
+
+void Dht::SetSessionBudget(size_t maxSessionNum)
+{
+	gs_maxSessionNum = maxSessionNum > 0 ? maxSessionNum : 1;
+}
+
+void Dht::ReclaimSessionBudget()
+{
+	EvictIdleChannels();
+}
+
+void Dht::SetStoreConfig(size_t pagedValueMaxSize, size_t valueCacheBudget, bool isIndexUntrusted)
+{
+	if (gs_state.GetDhtNode())
+	{
+		throw RuntimeException("The store must be configured before the DHT node is initialized.");
 	}
+
+	gs_state.GetDhtStore().Configure(pagedValueMaxSize, valueCacheBudget, isIndexUntrusted);
 }
 
 void Dht::Init(uint64_t selfAddr, int isFirstNode, uint64_t exAddr, size_t totalNode, size_t idx)
@@ -623,14 +1513,14 @@ void Dht::Init(uint64_t selfAddr, int isFirstNode, uint64_t exAddr, size_t total
 	BigNumber selfId = step * idx;
 
 	PRINT_I("Self Node ID: %s.", selfId.ToBigEndianHexStr().c_str());
-	DhtStates::DhtLocalNodePtrType dhtNode = std::make_shared<DhtStates::DhtLocalNodeType>(selfId, selfAddr, 0, largest, pow2iArray);
+	DhtStates::DhtLocalNodePtrType dhtNode = std::make_shared<DhtStates::DhtLocalNodeType>(selfId, selfAddr, 0, largest, pow2iArray, gs_isOneHopRouting.load());
 
 	gs_state.GetDhtNode() = dhtNode;
 
 	if (!isFirstNode)
 	{
 		NodeConnector nodeCnt(exAddr);
-		dhtNode->Join(nodeCnt);
+		dhtNode->Join(nodeCnt, gs_state.GetTaskPool());
 
 		uint64_t succAddr = dhtNode->GetImmediateSuccessor()->GetAddress();
 		const BigNumber& predId = dhtNode->GetImmediatePredecessor()->GetNodeId();
@@ -642,46 +1532,92 @@ void Dht::DeInit()
 {
 	DhtStates::DhtLocalNodePtrType dhtNode = gs_state.GetDhtNode();
 	uint64_t succAddr = dhtNode->GetImmediateSuccessor()->GetAddress();
-	dhtNode->Leave();
+	dhtNode->Leave(gs_state.GetTaskPool());
 	if (dhtNode->GetAddress() != succAddr)
 	{
 		MigrateAllDataToPeer(gs_state.GetDhtStore(), succAddr);
 	}
 }
 
-bool Dht::ProcessAppRequest(Decent::Net::TlsCommLayer & tls, Net::EnclaveCntTranslator& cnt)
+ProcResult::NumType Dht::ProcessAppRequest(std::unique_ptr<ServerSession>& session)
 {
-	using namespace EncFunc::App;
+	EncFunc::App::NumType funcNum;
+	session->m_tls->ReceiveStruct(funcNum); //1. Received function type.
 
-	NumType funcNum;
-	tls.ReceiveStruct(funcNum); //1. Received function type.
+	return ProcessAppFunc(funcNum, session);
+}
+
+ProcResult::NumType Dht::ProcessAppFunc(EncFunc::App::NumType funcNum, std::unique_ptr<ServerSession>& session)
+{
+	using namespace EncFunc::App;
 
+	//A session carries requests until the app closes it; responses are sent in the order of requests,
+	//so the app may pipeline requests.
+	TlsCommLayer& tls = *session->m_tls;
 	switch (funcNum)
 	{
-	case k_findSuccessor: return AppFindSuccessor(tls, cnt);
+	case k_findSuccessor:
+		if (AppFindSuccessor(session))
+		{
+			//The session is held until the query is replied by peers.
+			return ProcResult::k_held;
+		}
+		break;
+
+	case k_findNextHop:
+		AppFindNextHop(tls);
+		break;
 
 	case k_getData:
 		GetData(tls);
-		return false;
+		break;
 
 	case k_setData:
 		SetData(tls);
-		return false;
+		break;
 
 	case k_delData:
 		DelData(tls);
-		return false;
+		break;
 
-	default: return false;
+	case k_getDataOwned:
+		GetDataOwned(tls);
+		break;
+
+	case k_setDataOwned:
+		SetDataOwned(tls);
+		break;
+
+	case k_delDataOwned:
+		DelDataOwned(tls);
+		break;
+
+	case k_routedData:
+		if (AppRoutedData(session))
+		{
+			//The session is held until the result is sent back by the owner.
+			return ProcResult::k_held;
+		}
+		break;
+
+	case k_close:
+		return ProcResult::k_done;
+
+	default:
+		return ProcResult::k_close;
 	}
+
+	return KeepSession(session);
 }
 
-bool Dht::AppFindSuccessor(Decent::Net::TlsCommLayer & tls, Net::EnclaveCntTranslator& cnt)
+bool Dht::AppFindSuccessor(std::unique_ptr<ServerSession>& session)
 {
-	std::unique_ptr<ForwardQueueItem> queueItem = Tools::make_unique<ForwardQueueItem>();
+	TlsCommLayer& tls = *session->m_tls;
+
+	ForwardQueueItem queueItem;
 
-	tls.ReceiveStruct(queueItem->m_keyId); //2. Received queried ID
-	ConstBigNumber queriedId(queueItem->m_keyId, sk_struct);
+	tls.ReceiveStruct(queueItem.m_keyId); //2. Received queried ID
+	ConstBigNumber queriedId(queueItem.m_keyId, sk_struct);
 
 	//LOGI("Recv app queried ID: %s.", static_cast<const BigNumber&>(queriedId).ToBigEndianHexStr().c_str());
 
@@ -699,36 +1635,131 @@ bool Dht::AppFindSuccessor(Decent::Net::TlsCommLayer & tls, Net::EnclaveCntTrans
 	else
 	{
 		//Query should be forwarded to peer(s) and reply later.
-		
-		std::unique_ptr<PendingQueryItem> pendingItem = Tools::make_unique<PendingQueryItem>();
 
-		pendingItem->m_cnt = Tools::make_unique<EnclaveCntTranslator>(std::move(cnt));
-		pendingItem->m_tls = Tools::make_unique<TlsCommLayer>(std::move(tls));
+		if (!IsInSessionBudget())
+		{
+			throw RuntimeException("Too many sessions are alive; the app request is dropped.");
+		}
 
-		pendingItem->m_tls->SetConnectionPtr(*pendingItem->m_cnt);
+		std::unique_ptr<PendingQueryItem> pendingItem = Tools::make_unique<PendingQueryItem>();
 
-		queueItem->m_reAddr = localNode->GetAddress();
-		queueItem->m_reqId = reinterpret_cast<uint64_t>(pendingItem.get());
+		pendingItem->m_session = std::move(session);
+
+		std::memcpy(pendingItem->m_keyId, queueItem.m_keyId, sizeof(pendingItem->m_keyId));
+		pendingItem->m_retryCount = 0;
 
 		//PRINT_I("Forward query with ID %s to peer.", requestId.c_str());
-		
-		{
-			std::unique_lock<std::mutex> clientPendingQueriesLock(gs_clientPendingQueriesMutex);
-			gs_clientPendingQueries.insert(
-				std::make_pair(queueItem->m_reqId, std::move(pendingItem)));
-		}
 
 		DhtStates::DhtLocalNodeType::NodeBasePtr nextHop = localNode->GetNextHop(queriedId);
 
+		if (!ForwardPendingQuery(pendingItem, nextHop->GetAddress(), localNode->GetAddress()))
 		{
-			std::unique_lock<std::mutex> forwardQueueLock(gs_forwardQueueMutex);
-			gs_forwardQueue.push(std::make_pair(nextHop->GetAddress(), std::move(queueItem)));
-			forwardQueueLock.unlock();
-			gs_forwardQueueSignal.notify_one();
-
-			//NOTE! Don't use 'ConstBigNumber queriedId' after here!
+			throw RuntimeException("Too many pending queries; the app request is dropped.");
 		}
 
 		return true;
 	}
 }
+
+void Dht::AppFindNextHop(Decent::Net::TlsCommLayer & tls)
+{
+	uint8_t keyId[DhtStates::sk_keySizeByte];
+	tls.ReceiveStruct(keyId); //2. Received queried ID
+	ConstBigNumber queriedId(keyId, sk_struct);
+
+	DhtStates::DhtLocalNodePtrType localNode = gs_state.GetDhtNode();
+
+	NextHopReply<DhtStates::sk_keySizeByte> reply{};
+	std::memset(&reply, 0, sizeof(reply));
+	DhtStates::DhtLocalNodeType::NodeBasePtr node;
+	if (localNode->IsResponsibleFor(queriedId))
+	{
+		reply.m_isFinal = 1;
+		node = localNode;
+	}
+	else if (localNode->IsImmediatePredecessorOf(queriedId))
+	{
+		reply.m_isFinal = 1;
+		node = localNode->GetImmediateSuccessor();
+	}
+	else
+	{
+		reply.m_isFinal = 0;
+		node = localNode->GetNextHop(queriedId);
+	}
+
+	node->GetNodeId().ToBinary(reply.m_nodeId);
+	reply.m_addr = node->GetAddress();
+
+	tls.SendStruct(reply); //3. Send reply. - Done!
+}
+
+bool Dht::AppRoutedData(std::unique_ptr<ServerSession>& session)
+{
+	TlsCommLayer& tls = *session->m_tls;
+
+	RoutedDataHeader header{};
+	tls.ReceiveStruct(header.m_op); //2. Received operation.
+	if (!IsRoutedDataOp(header.m_op))
+	{
+		throw RuntimeException("Unknown data operation; the app request is dropped.");
+	}
+
+	tls.ReceiveStruct(header.m_keyId); //3. Received key.
+
+	std::vector<uint8_t> value;
+	if (header.m_op == EncFunc::App::k_setData)
+	{
+		tls.ReceiveMsg(value); //4. Received value.
+		if (value.size() > EnclaveStore::sk_maxValueSize)
+		{
+			throw RuntimeException("The value of the data operation is too large; the app request is dropped.");
+		}
+	}
+
+	ConstBigNumber key(header.m_keyId, sk_struct);
+
+	DhtStates::DhtLocalNodePtrType localNode = gs_state.GetDhtNode();
+
+	if (localNode->IsResponsibleFor(key))
+	{
+		//Operation can be done immediately.
+
+		const bool isSucceeded = DoDataOpLocally(header.m_op, key, value);
+		SendDataOpResult(tls, header.m_op, isSucceeded, value);
+
+		return false;
+	}
+
+	//Operation should be routed to the owner, which sends the result back later.
+
+	if (!IsInSessionBudget())
+	{
+		throw RuntimeException("Too many sessions are alive; the app request is dropped.");
+	}
+
+	std::unique_ptr<PendingDataOpItem> pendingItem = Tools::make_unique<PendingDataOpItem>();
+
+	pendingItem->m_session = std::move(session);
+	pendingItem->m_op = header.m_op;
+
+	header.m_reAddr = localNode->GetAddress();
+
+	const uint64_t deadline = TimeSource::GetSteadyTimeMs() + gsk_pendingQueryTimeoutMs;
+	if (!GetClientPendingDataOps().Insert(std::move(pendingItem), deadline, header.m_reqId))
+	{
+		throw RuntimeException("Too many pending data operations; the app request is dropped.");
+	}
+
+	if (!ProcessRoutedDataOp(header, std::move(value)))
+	{
+		pendingItem = GetClientPendingDataOps().Take(header.m_reqId);
+		if (pendingItem)
+		{
+			session = std::move(pendingItem->m_session);
+		}
+		throw RuntimeException("The data operation can't be routed now; the app request is dropped.");
+	}
+
+	return true;
+}
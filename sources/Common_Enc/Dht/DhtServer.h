@@ -1,45 +1,131 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
+#include <memory>
+
+#include "../../Common/Dht/FuncNums.h"
+#include "../../Common/Dht/ProcResult.h"
+
 namespace Decent
 {
 	namespace Net
 	{
 		class TlsCommLayer;
-		class EnclaveCntTranslator;
+		class SecureCommLayer;
 	}
 
     namespace Dht
     {
+		class ServerSession;
+
+		//Sessions kept between messages:
+
+		/**
+		 * \brief	Processes the next message of a session kept by the enclave, i.e., the next request
+		 * 			of an app, or the next RPC on a channel opened by a peer.
+		 *
+		 * \param [in,out]	cntPtr	Pointer to the untrusted connection of the session.
+		 *
+		 * \return	What the untrusted side should do with the connection next (see ProcResult).
+		 */
+		ProcResult::NumType ProcessSessionMsg(void* cntPtr);
+
+		/**
+		 * \brief	Closes the session kept for the connection, if there is any.
+		 *
+		 * \param [in,out]	cntPtr	Pointer to the untrusted connection of the session.
+		 */
+		void CloseSession(void* cntPtr);
+
 		//DHT node functions:
-		
-		void ProcessDhtQuery(Decent::Net::TlsCommLayer& tls, void*& heldCntPtr);
 
-		void GetNodeId(Decent::Net::TlsCommLayer &tls);
+		/**
+		 * \brief	Processes a request from a peer. If the peer opens a channel, the session is kept for
+		 * 			the RPCs on the channel; otherwise, it's done after the request.
+		 *
+		 * \return	What the untrusted side should do with the connection next (see ProcResult).
+		 */
+		ProcResult::NumType ProcessDhtQuery(std::unique_ptr<ServerSession>& session);
+
+		/** \brief	Processes a DHT function, whose function number has already been received. */
+		void ProcessDhtFunc(EncFunc::Dht::NumType funcNum, Decent::Net::SecureCommLayer& tls);
+
+		/**
+		 * \brief	Serves one RPC on a channel opened by a peer (see DhtSecureConnectionMgr::Call). Each
+		 * 			RPC on the channel is framed by a header and a trailer.
+		 *
+		 * \return	What the untrusted side should do with the connection next (see ProcResult).
+		 */
+		ProcResult::NumType ServeChannelFrame(std::unique_ptr<ServerSession>& session);
+
+		void GetNodeId(Decent::Net::SecureCommLayer &tls);
+
+		void FindSuccessor(Decent::Net::SecureCommLayer &tls);
+
+		void FindPredecessor(Decent::Net::SecureCommLayer &tls);
+
+		void GetImmediateSucessor(Decent::Net::SecureCommLayer &tls);
 
-		void FindSuccessor(Decent::Net::TlsCommLayer &tls);
+		void GetImmediatePredecessor(Decent::Net::SecureCommLayer &tls);
 
-		void FindPredecessor(Decent::Net::TlsCommLayer &tls);
+		void SetImmediatePredecessor(Decent::Net::SecureCommLayer &tls);
 
-		void GetImmediateSucessor(Decent::Net::TlsCommLayer &tls);
+		/** \brief	Sends the membership list of this node, used by a joining node in one-hop routing mode. */
+		void GetMembers(Decent::Net::SecureCommLayer &tls);
 
-		void GetImmediatePredecessor(Decent::Net::TlsCommLayer &tls);
+		void UpdateFingerTable(Decent::Net::SecureCommLayer &tls);
 
-		void SetImmediatePredecessor(Decent::Net::TlsCommLayer &tls);
+		void DeUpdateFingerTable(Decent::Net::SecureCommLayer &tls);
 
-		void UpdateFingerTable(Decent::Net::TlsCommLayer &tls);
+		void QueryNonBlock(Decent::Net::SecureCommLayer &tls);
 
-		void DeUpdateFingerTable(Decent::Net::TlsCommLayer &tls);
+		/** \brief	Receives a batch of forwarded queries, and processes each of them as QueryNonBlock does. */
+		void QueryNonBlockBatch(Decent::Net::SecureCommLayer &tls);
 
-		void QueryNonBlock(Decent::Net::TlsCommLayer &tls);
+		void QueryReply(Decent::Net::SecureCommLayer &tls);
 
-		void QueryReply(Decent::Net::TlsCommLayer &tls, void*& heldCntPtr);
+		/**
+		 * \brief	Receives a batch of query replies, and sends each result to the app waiting for it.
+		 * 			Each held app connection is released to the untrusted side as soon as its result is
+		 * 			sent.
+		 */
+		void QueryReplyBatch(Decent::Net::SecureCommLayer &tls);
+
+		/**
+		 * \brief	Receives a routed data operation. It's done if this node owns the key, and the result is
+		 * 			sent straight back to the origin node; otherwise, it's forwarded to the next hop.
+		 */
+		void RoutedData(Decent::Net::SecureCommLayer &tls);
+
+		/** \brief	Receives the result of a routed data operation, and sends it to the app waiting for it. */
+		void RoutedDataReply(Decent::Net::SecureCommLayer &tls);
+
+		/**
+		 * \brief	Sets how the forward worker coalesces queries going to the same next hop.
+		 *
+		 * \param	flushSize	Maximum number of queries sent in one message. It's clamped to the
+		 * 						range between 1 and the largest batch accepted by peers (4096).
+		 * \param	windowMs 	Time, in milliseconds, to wait for more queries when there are fewer
+		 * 						than flushSize. Zero to send immediately.
+		 */
+		void SetForwardBatching(size_t flushSize, uint64_t windowMs);
 
 		void QueryForwardWorker();
 
 		void QueryReplyWorker();
 
+		/**
+		 * \brief	Periodically expires forwarded app queries that have waited too long for replies,
+		 * 			until workers are terminated. Expired queries are retried on an alternate route once;
+		 * 			otherwise, their held app connections are closed. Channels to peers that have been
+		 * 			idle for too long are closed, too.
+		 */
+		void PendingQueryTimer();
+
+		void TaskWorker();
+
 		void TerminateWorkers();
 
 		//DHT Store functions:
@@ -56,16 +142,94 @@ namespace Decent
 
 		void DelData(Decent::Net::TlsCommLayer & tls);
 
+		/**
+		 * \brief	Owner-checked versions of GetData(), SetData(), and DelData(). The reply starts with an
+		 * 			OwnershipReply header carrying the ownership interval of this node, so the app can
+		 * 			cache it. If this node doesn't own the key, the operation is not done, and the app is
+		 * 			redirected to a node closer to the owner, instead of the session being closed.
+		 */
+		void GetDataOwned(Decent::Net::TlsCommLayer & tls);
+
+		void SetDataOwned(Decent::Net::TlsCommLayer & tls);
+
+		void DelDataOwned(Decent::Net::TlsCommLayer & tls);
+
 		//(De-)Initialization functions:
 		
+		/**
+		 * \brief	Enables or disables one-hop routing for the local node created by Init(), thus, it must be
+		 * 			called before Init(). In one-hop routing mode, the node keeps the full list of nodes in
+		 * 			the network, and lookups are forwarded to the owner of the key directly.
+		 *
+		 * \param	isEnabled	True to enable.
+		 */
+		void SetOneHopRouting(bool isEnabled);
+
+		/**
+		 * \brief	Configures paging, the value cache, and the index of the store (see
+		 * 			EnclaveStore::Configure). It must be called before Init().
+		 *
+		 * \exception	Decent::RuntimeException	Thrown when the node has been initialized.
+		 */
+		void SetStoreConfig(size_t pagedValueMaxSize, size_t valueCacheBudget, bool isIndexUntrusted);
+
+		/**
+		 * \brief	Sets the maximum number of sessions alive at a time, i.e., app sessions being served,
+		 * 			kept between requests, or held for replies, and channels opened by peers. Each of
+		 * 			them takes a TLS context in enclave memory, so the budget must fit in the enclave
+		 * 			heap. It must be called before Init().
+		 *
+		 * \param	maxSessionNum	The maximum number of sessions.
+		 */
+		void SetSessionBudget(size_t maxSessionNum);
+
+		/**
+		 * \brief	Makes room for a new session before its TLS context is set up. If the session budget
+		 * 			is used up, idle channels kept for peers are closed, rather than letting the new TLS
+		 * 			context fail to be allocated.
+		 */
+		void ReclaimSessionBudget();
+
 		void Init(uint64_t selfAddr, int isFirstNode, uint64_t exAddr, size_t totalNode, size_t idx);
 
 		void DeInit();
 
 		//Requests from Apps:
 		
-		bool ProcessAppRequest(Decent::Net::TlsCommLayer & tls, Net::EnclaveCntTranslator& cnt);
-
-		bool AppFindSuccessor(Decent::Net::TlsCommLayer &tls, Net::EnclaveCntTranslator& cnt);
+		/**
+		 * \brief	Processes the first request of an app session. The session is kept for the next
+		 * 			request afterwards, unless the app closes it with k_close. If the request has to be
+		 * 			replied later, the session is held until then, and kept once the reply is sent, so
+		 * 			requests the app has sent in the meantime are served afterwards.
+		 *
+		 * \return	What the untrusted side should do with the connection next (see ProcResult).
+		 */
+		ProcResult::NumType ProcessAppRequest(std::unique_ptr<ServerSession>& session);
+
+		/** \brief	Processes an app function, whose function number has already been received. */
+		ProcResult::NumType ProcessAppFunc(EncFunc::App::NumType funcNum, std::unique_ptr<ServerSession>& session);
+
+		/**
+		 * \brief	Finds the successor of the queried key for the app.
+		 *
+		 * \return	True if the query is forwarded, and the session is taken to reply later.
+		 */
+		bool AppFindSuccessor(std::unique_ptr<ServerSession>& session);
+
+		/**
+		 * \brief	One step of an iterative lookup, which is driven by the app. Replies right away with
+		 * 			either the successor of the queried key, or the next hop the app should ask, so no
+		 * 			state is kept for the query.
+		 */
+		void AppFindNextHop(Decent::Net::TlsCommLayer &tls);
+
+		/**
+		 * \brief	A data operation (k_getData, k_setData, or k_delData) on any key, which is done right
+		 * 			away if this node owns the key; otherwise, it's routed to the owner along the finger
+		 * 			path, just like a forwarded query, and the result is sent back later.
+		 *
+		 * \return	True if the operation is routed, and the session is taken to reply later.
+		 */
+		bool AppRoutedData(std::unique_ptr<ServerSession>& session);
     }
 }
@@ -12,6 +12,7 @@ namespace Decent
 
 		class EnclaveStore;
 		class DhtSecureConnectionMgr;
+		class TaskPool;
 
 		class DhtStates : public Ra::AppStates
 		{
@@ -22,11 +23,12 @@ namespace Decent
 			typedef std::shared_ptr<DhtLocalNodeType> DhtLocalNodePtrType;
 
 		public:
-			DhtStates(Ra::AppCertContainer & certCntnr, Ra::KeyContainer & keyCntnr, Ra::WhiteList::DecentServer & serverWl, GetLoadedWlFunc getLoadedFunc, EnclaveStore& dhtStore, DhtSecureConnectionMgr& cntPool) :
+			DhtStates(Ra::AppCertContainer & certCntnr, Ra::KeyContainer & keyCntnr, Ra::WhiteList::DecentServer & serverWl, GetLoadedWlFunc getLoadedFunc, EnclaveStore& dhtStore, DhtSecureConnectionMgr& cntPool, TaskPool& taskPool) :
 				AppStates(certCntnr, keyCntnr, serverWl, getLoadedFunc),
 				m_dhtNode(),
 				m_dhtStore(dhtStore),
-				m_cntPool(cntPool)
+				m_cntPool(cntPool),
+				m_taskPool(taskPool)
 			{}
 			
 			virtual ~DhtStates()
@@ -62,10 +64,16 @@ namespace Decent
 				return m_cntPool;
 			}
 
+			TaskPool& GetTaskPool()
+			{
+				return m_taskPool;
+			}
+
 		private:
 			DhtLocalNodePtrType m_dhtNode;
 			EnclaveStore& m_dhtStore;
 			DhtSecureConnectionMgr& m_cntPool;
+			TaskPool& m_taskPool;
 		};
 	}
 }
@@ -0,0 +1,476 @@
+#include "EnclaveStore.h"
+
+#include <type_traits>
+
+#include <DecentApi/Common/make_unique.h>
+#include <DecentApi/Common/RuntimeException.h>
+
+#include "../../Common/Dht/MemKeyValueStore.h"
+
+#include "MemStoreRingClient.h"
+#include "PagedValueStore.h"
+#include "AuthIndex.h"
+
+using namespace Decent;
+using namespace Decent::Dht;
+
+namespace
+{
+	static_assert(std::is_same<EnclaveStore::KeyBinType, AuthIndex::KeyBinType>::value, "The key size of the index doesn't match the key size of DHT.");
+	static_assert(std::is_same<EnclaveStore::KeyBinType, PagedValueStore::KeyBinType>::value, "The key size of pages doesn't match the key size of DHT.");
+	static_assert(std::is_same<EnclaveStore::TagType, AuthIndex::TagType>::value, "The tag size of the index doesn't match the tag size of the store.");
+}
+
+constexpr size_t EnclaveStore::sk_defaultPagedValueMaxSize;
+constexpr size_t EnclaveStore::sk_defaultValueCacheBudget;
+constexpr size_t EnclaveStore::sk_maxValueSize;
+
+std::string EnclaveStore::GetKeyStr(const MbedTlsObj::BigNumber & key)
+{
+	static constexpr size_t sk_keyStrLen = DhtStates::sk_keySizeByte * 2;
+
+	std::string keyStr = key.ToBigEndianHexStr();
+	if (keyStr.size() < sk_keyStrLen)
+	{
+		keyStr.insert(0, sk_keyStrLen - keyStr.size(), '0');
+	}
+
+	return keyStr;
+}
+
+EnclaveStore::KeyBinType EnclaveStore::GetKeyBin(const MbedTlsObj::BigNumber & key)
+{
+	KeyBinType keyBin{};
+	key.ToBinary(keyBin);
+	return keyBin;
+}
+
+EnclaveStore::MigrateIndexCursor::MigrateIndexCursor(const IndexingType & indexing, PagedValueStore* pagedStore, const MigrateCallbackType& callback) :
+	m_it(indexing.cbegin()),
+	m_end(indexing.cend()),
+	m_keyStr(m_it != m_end ? GetKeyStr(m_it->first) : std::string()),
+	m_pagedStore(pagedStore),
+	m_callback(callback)
+{}
+
+const EnclaveStore::IndexingType::value_type * EnclaveStore::MigrateIndexCursor::Find(const std::string & keyStr)
+{
+	while (m_it != m_end && m_keyStr < keyStr)
+	{
+		MigratePaged();
+		Next();
+	}
+
+	if (m_it == m_end || m_keyStr != keyStr)
+	{
+		return nullptr;
+	}
+
+	if (IsPaged())
+	{
+		//The value in the memory store is stale, since the key has been moved to a page.
+		MigratePaged();
+		Next();
+		return nullptr;
+	}
+
+	return &(*m_it);
+}
+
+void EnclaveStore::MigrateIndexCursor::Finish()
+{
+	for (; m_it != m_end; Next())
+	{
+		MigratePaged();
+	}
+}
+
+bool EnclaveStore::MigrateIndexCursor::IsPaged() const
+{
+	return m_pagedStore && m_it->second == TagType();
+}
+
+void EnclaveStore::MigrateIndexCursor::MigratePaged()
+{
+	if (!IsPaged())
+	{
+		return;
+	}
+
+	std::vector<uint8_t> data;
+	try
+	{
+		data = m_pagedStore->Migrate(GetKeyBin(m_it->first));
+	}
+	catch (const std::exception&)
+	{
+		return;
+	}
+
+	m_callback(m_it->first, data);
+}
+
+void EnclaveStore::MigrateIndexCursor::Next()
+{
+	++m_it;
+	m_keyStr = m_it != m_end ? GetKeyStr(m_it->first) : std::string();
+}
+
+EnclaveStore::EnclaveStore(const MbedTlsObj::BigNumber & ringStart, const MbedTlsObj::BigNumber & ringEnd, size_t pagedValueMaxSize, size_t valueCacheBudget, bool isIndexUntrusted) :
+	EnclaveStore(ringStart, ringEnd)
+{
+	Configure(pagedValueMaxSize, valueCacheBudget, isIndexUntrusted);
+}
+
+void EnclaveStore::Configure(size_t pagedValueMaxSize, size_t valueCacheBudget, bool isIndexUntrusted)
+{
+	GetValueCache().SetBudget(valueCacheBudget);
+
+	m_pagedValueMaxSize = isIndexUntrusted ? 0 : pagedValueMaxSize;
+
+	m_pagedStore.reset();
+	if (m_pagedValueMaxSize > 0)
+	{
+		m_pagedStore = Tools::make_unique<PagedValueStore>(m_sealer, [this](const std::vector<uint8_t>& batch, size_t opCount)
+		{
+			return ProcessMemStoreBatch(batch, opCount);
+		});
+	}
+
+	m_authIndex.reset();
+	if (isIndexUntrusted)
+	{
+		m_authIndex = Tools::make_unique<AuthIndex>([this](const std::vector<uint8_t>& batch, size_t opCount)
+		{
+			return ProcessMemStoreBatch(batch, opCount);
+		});
+	}
+}
+
+std::vector<std::pair<bool, EnclaveStore::TagType> > EnclaveStore::SaveDataFiles(const std::vector<std::pair<MbedTlsObj::BigNumber, std::vector<uint8_t> > >& items)
+{
+	std::vector<std::pair<bool, TagType> > res(items.size(), std::make_pair(false, TagType()));
+
+	std::vector<uint8_t> batch;
+	std::vector<size_t> batchIdx;
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+		try
+		{
+			if (TrySavePagedValue(GetKeyBin(items[i].first), items[i].second))
+			{
+				res[i].first = true;
+				continue;
+			}
+		}
+		catch (const std::exception&)
+		{
+			continue;
+		}
+
+		//Sealed straight into the batch, instead of being sealed and then copied.
+		const std::string keyStr = GetKeyStr(items[i].first);
+		const size_t sealedSize = ValueSealer::GetSealedSize(items[i].second.size());
+		uint8_t* sealedPtr = MemKeyValueStore::AppendBatchStoreOp(batch, keyStr, sealedSize);
+		SealValue(keyStr, items[i].second, sealedPtr, sealedSize, res[i].second);
+
+		batchIdx.push_back(i);
+	}
+
+	std::vector<std::pair<bool, std::vector<uint8_t> > > results;
+	try
+	{
+		results = ProcessMemStoreBatch(batch, batchIdx.size());
+	}
+	catch (const std::exception&)
+	{
+		return res; //None of the values in the batch is stored, but paged values are.
+	}
+
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		res[batchIdx[i]].first = results[i].first;
+	}
+
+	return res;
+}
+
+void EnclaveStore::DeleteDataFiles(const std::vector<MbedTlsObj::BigNumber>& keys)
+{
+	std::vector<uint8_t> batch;
+	size_t opCount = 0;
+	for (const auto& key : keys)
+	{
+		if (!m_pagedStore || !m_pagedStore->Remove(GetKeyBin(key)))
+		{
+			MemKeyValueStore::AppendBatchOp(batch, MemKeyValueStore::BatchOp::Delete, GetKeyStr(key));
+			++opCount;
+		}
+	}
+
+	for (const auto& result : ProcessMemStoreBatch(batch, opCount))
+	{
+		if (!result.first)
+		{
+			throw RuntimeException("Failed to delete data from the memory store.");
+		}
+	}
+}
+
+std::vector<std::vector<uint8_t> > EnclaveStore::ReadDataFiles(const std::vector<std::pair<MbedTlsObj::BigNumber, TagType> >& keyTags)
+{
+	std::vector<std::vector<uint8_t> > res(keyTags.size());
+
+	std::vector<uint8_t> batch;
+	std::vector<size_t> batchIdx;
+	for (size_t i = 0; i < keyTags.size(); ++i)
+	{
+		if (IsPagedTag(keyTags[i].second))
+		{
+			res[i] = m_pagedStore->Get(GetKeyBin(keyTags[i].first));
+			continue;
+		}
+
+		MemKeyValueStore::AppendBatchOp(batch, MemKeyValueStore::BatchOp::Read, GetKeyStr(keyTags[i].first));
+		batchIdx.push_back(i);
+	}
+
+	std::vector<std::pair<bool, std::vector<uint8_t> > > results = ProcessMemStoreBatch(batch, batchIdx.size());
+
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		if (!results[i].first)
+		{
+			throw RuntimeException("Failed to read data from the memory store.");
+		}
+
+		const auto& keyTag = keyTags[batchIdx[i]];
+		res[batchIdx[i]] = UnsealValue(GetKeyStr(keyTag.first), results[i].second.data(), results[i].second.size(), keyTag.second);
+	}
+
+	return res;
+}
+
+std::vector<std::pair<MbedTlsObj::BigNumber, std::vector<uint8_t> > > EnclaveStore::MigrateDataFiles(const IndexingType & indexing)
+{
+	std::vector<std::pair<MbedTlsObj::BigNumber, std::vector<uint8_t> > > res;
+	res.reserve(indexing.size());
+
+	std::vector<uint8_t> batch;
+	std::vector<IndexingType::const_iterator> batchItems;
+	for (auto it = indexing.cbegin(); it != indexing.cend(); ++it)
+	{
+		if (IsPagedTag(it->second))
+		{
+			try
+			{
+				res.push_back(std::make_pair(it->first, m_pagedStore->Migrate(GetKeyBin(it->first))));
+			}
+			catch (const std::exception&)
+			{}
+			continue;
+		}
+
+		MemKeyValueStore::AppendBatchOp(batch, MemKeyValueStore::BatchOp::Migrate, GetKeyStr(it->first));
+		batchItems.push_back(it);
+	}
+
+	std::vector<std::pair<bool, std::vector<uint8_t> > > results = ProcessMemStoreBatch(batch, batchItems.size());
+
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		if (!results[i].first)
+		{
+			continue;
+		}
+
+		std::vector<uint8_t> data;
+		try
+		{
+			data = UnsealValue(GetKeyStr(batchItems[i]->first), results[i].second.data(), results[i].second.size(), batchItems[i]->second);
+		}
+		catch (const std::exception&)
+		{
+			continue;
+		}
+
+		res.push_back(std::make_pair(batchItems[i]->first, std::move(data)));
+	}
+
+	return res;
+}
+
+void EnclaveStore::DeleteIndexingNormalOrder(IndexingType & res, const MbedTlsObj::BigNumber & start, const MbedTlsObj::BigNumber & end)
+{
+	if (!m_authIndex)
+	{
+		return StoreBase::DeleteIndexingNormalOrder(res, start, end);
+	}
+
+	std::vector<AuthIndex::EntryType> entries;
+	m_authIndex->ExtractRange(AuthIndex::GetBucketId(GetKeyStr(start)), AuthIndex::GetBucketId(GetKeyStr(end)),
+		[&start, &end](const AuthIndex::KeyBinType& keyBin) -> bool
+	{
+		MbedTlsObj::ConstBigNumber key(keyBin);
+		return start <= key.Get() && key.Get() <= end;
+	},
+		entries);
+
+	for (const auto& entry : entries)
+	{
+		res.insert(std::make_pair(MbedTlsObj::BigNumber(MbedTlsObj::ConstBigNumber(entry.first).Get()), entry.second));
+	}
+
+	GetValueCache().InvalidateRange(start, end);
+}
+
+bool EnclaveStore::FindIndex(const MbedTlsObj::BigNumber & key, TagType & tag)
+{
+	if (!m_authIndex)
+	{
+		return StoreBase::FindIndex(key, tag);
+	}
+
+	return m_authIndex->Find(AuthIndex::GetBucketId(GetKeyStr(key)), GetKeyBin(key), tag);
+}
+
+void EnclaveStore::PutIndex(const MbedTlsObj::BigNumber & key, const TagType & tag)
+{
+	TagType oldTag;
+	bool hasOldTag = false;
+	if (!m_authIndex)
+	{
+		hasOldTag = StoreBase::FindIndex(key, oldTag);
+		StoreBase::PutIndex(key, tag);
+	}
+	else
+	{
+		hasOldTag = m_authIndex->Put(AuthIndex::GetBucketId(GetKeyStr(key)), GetKeyBin(key), tag, oldTag);
+	}
+
+	if (hasOldTag)
+	{
+		RemoveReplacedDataFile(key, tag, oldTag);
+	}
+}
+
+void EnclaveStore::EraseIndex(const MbedTlsObj::BigNumber & key)
+{
+	if (!m_authIndex)
+	{
+		return StoreBase::EraseIndex(key);
+	}
+
+	m_authIndex->Erase(AuthIndex::GetBucketId(GetKeyStr(key)), GetKeyBin(key));
+}
+
+void EnclaveStore::ExtractAllIndex(IndexingType & res)
+{
+	if (!m_authIndex)
+	{
+		return StoreBase::ExtractAllIndex(res);
+	}
+
+	std::vector<AuthIndex::EntryType> entries;
+	m_authIndex->ExtractRange(0, AuthIndex::sk_bucketNum - 1,
+		[](const AuthIndex::KeyBinType&) -> bool
+	{
+		return true;
+	},
+		entries);
+
+	for (const auto& entry : entries)
+	{
+		res.insert(std::make_pair(MbedTlsObj::BigNumber(MbedTlsObj::ConstBigNumber(entry.first).Get()), entry.second));
+	}
+}
+
+bool EnclaveStore::TrySavePagedValue(const KeyBinType & keyBin, const std::vector<uint8_t>& data)
+{
+	if (!m_pagedStore)
+	{
+		return false;
+	}
+
+	if (data.size() > m_pagedValueMaxSize)
+	{
+		return false;
+	}
+
+	m_pagedStore->Put(keyBin, data);
+	return true;
+}
+
+void EnclaveStore::RemoveReplacedDataFile(const MbedTlsObj::BigNumber & key, const TagType & tag, const TagType & oldTag)
+{
+	if (!m_pagedStore || IsPagedTag(tag) == IsPagedTag(oldTag))
+	{
+		return;
+	}
+
+	if (IsPagedTag(oldTag))
+	{
+		m_pagedStore->Remove(GetKeyBin(key));
+		return;
+	}
+
+	//The value has been moved into a page, so the sealed value left in the memory store is stale.
+	std::vector<uint8_t> batch;
+	MemKeyValueStore::AppendBatchOp(batch, MemKeyValueStore::BatchOp::Delete, GetKeyStr(key));
+	try
+	{
+		ProcessMemStoreBatch(batch, 1);
+	}
+	catch (const std::exception&)
+	{}
+}
+
+bool EnclaveStore::IsPagedTag(const TagType& tag) const
+{
+	return m_pagedStore && tag == TagType();
+}
+
+std::vector<uint8_t> EnclaveStore::SealValue(const std::string & keyStr, const std::vector<uint8_t>& data, TagType& tag)
+{
+	std::vector<uint8_t> sealed(ValueSealer::GetSealedSize(data.size()));
+	SealValue(keyStr, data, sealed.data(), sealed.size(), tag);
+
+	return sealed;
+}
+
+void EnclaveStore::SealValue(const std::string & keyStr, const std::vector<uint8_t>& data, uint8_t * sealed, size_t sealedSize, TagType & tag)
+{
+	m_sealer.Seal(keyStr.data(), keyStr.size(), data.data(), data.size(), sealed, sealedSize, tag.data(), tag.size());
+}
+
+std::vector<uint8_t> EnclaveStore::UnsealValue(const std::string & keyStr, const uint8_t * sealed, size_t sealedSize, const TagType& tag)
+{
+	std::vector<uint8_t> data(ValueSealer::GetUnsealedSize(sealedSize));
+
+	m_sealer.Unseal(keyStr.data(), keyStr.size(), sealed, sealedSize, tag.data(), tag.size(), data.data(), data.size());
+
+	return data;
+}
+
+bool EnclaveStore::TryProcessMemStoreBatchExitless(const std::vector<uint8_t>& batch, size_t opCount, std::vector<std::pair<bool, std::vector<uint8_t> > >& results)
+{
+	std::vector<uint8_t> packedResults;
+	if (!GetRingClient().TryProcess(batch, packedResults))
+	{
+		return false;
+	}
+
+	results = MemKeyValueStore::UnpackBatchResults(packedResults.data(), packedResults.size(), opCount);
+
+	return true;
+}
+
+MemStoreRingClient & EnclaveStore::GetRingClient()
+{
+	std::call_once(m_ringInitFlag, [this]()
+	{
+		InitMemStoreRing();
+	});
+
+	return *m_ringClient;
+}
@@ -2,34 +2,282 @@
 
 #include "../../Common/Dht/StoreBase.h"
 
+#include <array>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+
 #include <DecentApi/Common/MbedTls/BigNumber.h>
 
 #include "DhtStates.h"
+#include "ValueSealer.h"
 
 namespace Decent
 {
 	namespace Dht
 	{
-		class EnclaveStore : public StoreBase<MbedTlsObj::BigNumber, uint64_t>
+		class MemStoreRingClient;
+		class PagedValueStore;
+		class AuthIndex;
+
+		class EnclaveStore : public StoreBase<MbedTlsObj::BigNumber, uint64_t, ValueSealer::sk_tagSize>
 		{
+		public:
+			/**
+			 * \brief	Maximum number of key-value pairs fetched from the memory store in one bulk
+			 * 			migration call.
+			 */
+			static constexpr size_t sk_migrateBatchSize = 512;
+
+			/** \brief	Default maximum size of values that are packed into pages, when paging is enabled. */
+			static constexpr size_t sk_defaultPagedValueMaxSize = 128;
+
+			/** \brief	Default memory budget, in bytes, of the cache of values for hot keys. */
+			static constexpr size_t sk_defaultValueCacheBudget = 1024 * 1024;
+
+			/**
+			 * \brief	Maximum size of values routed to this store from apps and peers (see
+			 * 			Dht::AppRoutedData). Every routed value is buffered in enclave memory until the
+			 * 			operation is done, so it must be far smaller than the enclave heap.
+			 */
+			static constexpr size_t sk_maxValueSize = 256 * 1024;
+
+			/**
+			 * \brief	Gets the key string used to store the value in the memory store. The string has a
+			 * 			fixed length, so that the order of key strings is the same as the order of keys.
+			 *
+			 * \param	key	The key.
+			 *
+			 * \return	The key string.
+			 */
+			static std::string GetKeyStr(const MbedTlsObj::BigNumber& key);
+
+			typedef std::array<uint8_t, DhtStates::sk_keySizeByte> KeyBinType;
+
+			/** \brief	Gets the key in fixed-size binary form, which is used to index paged values. */
+			static KeyBinType GetKeyBin(const MbedTlsObj::BigNumber& key);
+
 		public:
 			EnclaveStore(const MbedTlsObj::BigNumber& ringStart, const MbedTlsObj::BigNumber& ringEnd);
 
+			/**
+			 * \brief	Constructor, with small values packed into pages (see PagedValueStore), which saves
+			 * 			space and crypto operations for workloads of tiny values, and with decrypted values
+			 * 			of hot keys cached inside the enclave.
+			 *
+			 * \param	ringStart		 	The ring start.
+			 * \param	ringEnd			 	The ring end.
+			 * \param	pagedValueMaxSize	Values not larger than this size are packed into pages. Zero to
+			 * 								disable paging.
+			 * \param	valueCacheBudget 	See Configure().
+			 * \param	isIndexUntrusted 	See Configure().
+			 */
+			EnclaveStore(const MbedTlsObj::BigNumber& ringStart, const MbedTlsObj::BigNumber& ringEnd, size_t pagedValueMaxSize, size_t valueCacheBudget, bool isIndexUntrusted);
+
 			virtual ~EnclaveStore();
 
 			virtual bool IsResponsibleFor(const MbedTlsObj::BigNumber& key) const;
 
+			/**
+			 * \brief	Configures paging, the value cache, and the index. It must be called before any
+			 * 			value is stored.
+			 *
+			 * \param	pagedValueMaxSize	Values not larger than this size are packed into pages. Zero to
+			 * 								disable paging.
+			 * \param	valueCacheBudget 	The memory budget, in bytes, of the value cache. Zero to
+			 * 								disable the cache.
+			 * \param	isIndexUntrusted 	True to keep the index in the memory store, authenticated by
+			 * 								hashes kept inside the enclave (see AuthIndex), so that the
+			 * 								number of keys is not limited by enclave memory. Every index
+			 * 								access then costs a round trip to the memory store. Paging
+			 * 								is disabled in this mode, since PagedValueStore keeps an
+			 * 								entry per paged key inside the enclave.
+			 */
+			void Configure(size_t pagedValueMaxSize, size_t valueCacheBudget, bool isIndexUntrusted);
+
 		protected:
-			virtual std::vector<uint8_t> SaveDataFile(const MbedTlsObj::BigNumber& key, const std::vector<uint8_t>& data) override;
+			/**
+			 * \brief	Matches the key-value pairs migrated out of the memory store to the indexing. Both
+			 * 			of them must be visited in ascending order of key. Paged values in the indexing are
+			 * 			migrated out of pages and passed to the callback as the cursor moves past them, so
+			 * 			that the callback is still called in ascending order of key.
+			 */
+			class MigrateIndexCursor
+			{
+			public:
+				/**
+				 * \brief	Constructor
+				 *
+				 * \param	indexing  	The indexing.
+				 * \param	pagedStore	The paged value store; null if paging is disabled.
+				 * \param	callback  	The migrate callback for paged values.
+				 */
+				MigrateIndexCursor(const IndexingType& indexing, PagedValueStore* pagedStore, const MigrateCallbackType& callback);
+
+				/**
+				 * \brief	Finds the indexing entry for a migrated key string. Entries before the given key
+				 * 			string are skipped, and will not be found afterwards.
+				 *
+				 * \param	keyStr	The key string.
+				 *
+				 * \return	Null if the key is not found in the indexing, else the pointer to the entry.
+				 */
+				const IndexingType::value_type* Find(const std::string& keyStr);
+
+				/** \brief	Migrates the rest of paged values, once the memory store has no more data. */
+				void Finish();
+
+			private:
+				bool IsPaged() const;
+
+				void MigratePaged();
+
+				void Next();
+
+				IndexingType::const_iterator m_it;
+				IndexingType::const_iterator m_end;
+				std::string m_keyStr;
+				PagedValueStore* m_pagedStore;
+				const MigrateCallbackType& m_callback;
+			};
+
+			virtual TagType SaveDataFile(const MbedTlsObj::BigNumber& key, const std::vector<uint8_t>& data) override;
 
 			virtual void DeleteDataFile(const MbedTlsObj::BigNumber& key) override;
 
-			virtual std::vector<uint8_t> ReadDataFile(const MbedTlsObj::BigNumber& key, const std::vector<uint8_t>& tag) override;
+			virtual std::vector<uint8_t> ReadDataFile(const MbedTlsObj::BigNumber& key, const TagType& tag) override;
+
+			virtual std::vector<uint8_t> MigrateOneDataFile(const MbedTlsObj::BigNumber& key, const TagType& tag) override;
 
-			virtual std::vector<uint8_t> MigrateOneDataFile(const MbedTlsObj::BigNumber& key, const std::vector<uint8_t>& tag) override;
+			virtual void MigrateRangeDataFile(const MbedTlsObj::BigNumber& start, const MbedTlsObj::BigNumber& end, const IndexingType& indexing, const MigrateCallbackType& callback) override;
+
+			virtual std::vector<std::pair<bool, TagType> > SaveDataFiles(const std::vector<std::pair<MbedTlsObj::BigNumber, std::vector<uint8_t> > >& items) override;
+
+			virtual void DeleteDataFiles(const std::vector<MbedTlsObj::BigNumber>& keys) override;
+
+			virtual std::vector<std::vector<uint8_t> > ReadDataFiles(const std::vector<std::pair<MbedTlsObj::BigNumber, TagType> >& keyTags) override;
+
+			virtual std::vector<std::pair<MbedTlsObj::BigNumber, std::vector<uint8_t> > > MigrateDataFiles(const IndexingType& indexing) override;
+
+			virtual void DeleteIndexingNormalOrder(IndexingType& res, const MbedTlsObj::BigNumber& start, const MbedTlsObj::BigNumber& end) override;
+
+			virtual bool FindIndex(const MbedTlsObj::BigNumber& key, TagType& tag) override;
+
+			virtual void PutIndex(const MbedTlsObj::BigNumber& key, const TagType& tag) override;
+
+			virtual void EraseIndex(const MbedTlsObj::BigNumber& key) override;
+
+			virtual void ExtractAllIndex(IndexingType& res) override;
 
 		private:
+			/**
+			 * \brief	Puts the value into a page if it's small enough. Otherwise, the caller stores the
+			 * 			value in the memory store. Either way, the old value of the key is kept until the
+			 * 			new tag is put into the index (see RemoveReplacedDataFile), so the old value is still
+			 * 			readable if the new one fails to be stored.
+			 *
+			 * \return	True if the value is paged, in which case the tag of the value is all zero.
+			 */
+			bool TrySavePagedValue(const KeyBinType& keyBin, const std::vector<uint8_t>& data);
+
+			/**
+			 * \brief	Removes the old value of a key, once the index is updated with the new tag, if the
+			 * 			value is moved between a page and the memory store; otherwise, the old value has been
+			 * 			overwritten in place. Failures are ignored, since the old value is no longer reachable
+			 * 			from the index. Assume m_indexingMutex has been locked.
+			 *
+			 * \param	key   	The key.
+			 * \param	tag   	The new tag.
+			 * \param	oldTag	The tag replaced.
+			 */
+			void RemoveReplacedDataFile(const MbedTlsObj::BigNumber& key, const TagType& tag, const TagType& oldTag);
+
+			/**
+			 * \brief	Query if the tag belongs to a paged value. An all-zero tag marks a paged value;
+			 * 			a sealing tag is all zero with negligible probability.
+			 */
+			bool IsPagedTag(const TagType& tag) const;
+
+			/**
+			 * \brief	Seals a value before it's passed to the memory store. The key string is
+			 * 			authenticated together with the value.
+			 *
+			 * \param 	   	keyStr	The key string.
+			 * \param 	   	data  	The value.
+			 * \param [out]	tag   	The tag to be kept in the index.
+			 *
+			 * \return	The sealed value.
+			 */
+			std::vector<uint8_t> SealValue(const std::string& keyStr, const std::vector<uint8_t>& data, TagType& tag);
+
+			/**
+			 * \brief	Seals a value into a buffer given by the caller, e.g. the space of the value in a
+			 * 			batch (see MemKeyValueStore::AppendBatchStoreOp). The buffer must be inside the
+			 * 			enclave, since the sealer reads the cipher text back to calculate the tag.
+			 *
+			 * \param 	   	keyStr	  	The key string.
+			 * \param 	   	data	  	The value.
+			 * \param [out]	sealed	  	The output buffer.
+			 * \param 	   	sealedSize	Size of the output buffer; must be ValueSealer::GetSealedSize(data.size()).
+			 * \param [out]	tag		  	The tag to be kept in the index.
+			 */
+			void SealValue(const std::string& keyStr, const std::vector<uint8_t>& data, uint8_t* sealed, size_t sealedSize, TagType& tag);
+
+			/**
+			 * \brief	Unseals a value returned by the memory store.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the value fails the authentication.
+			 *
+			 * \param	keyStr	  	The key string.
+			 * \param	sealed	  	The sealed value.
+			 * \param	sealedSize	Size of the sealed value.
+			 * \param	tag		  	The tag kept in the index.
+			 *
+			 * \return	The value.
+			 */
+			std::vector<uint8_t> UnsealValue(const std::string& keyStr, const uint8_t* sealed, size_t sealedSize, const TagType& tag);
+
+			/**
+			 * \brief	Passes a batch of operations, generated by MemKeyValueStore::AppendBatchOp, to the
+			 * 			memory store in one call.
+			 *
+			 * \param	batch  	The batch.
+			 * \param	opCount	Number of operations in the batch.
+			 *
+			 * \return	The results, in the same order as operations in the batch.
+			 */
+			std::vector<std::pair<bool, std::vector<uint8_t> > > ProcessMemStoreBatch(const std::vector<uint8_t>& batch, size_t opCount);
+
+			/**
+			 * \brief	Try to pass a batch of operations to the memory store through the exitless ring.
+			 *
+			 * \param 	   	batch  	The batch.
+			 * \param 	   	opCount	Number of operations in the batch.
+			 * \param [out]	results	The results, in the same order as operations in the batch.
+			 *
+			 * \return	False if the ring is not available at the moment, so OCall should be used instead.
+			 */
+			bool TryProcessMemStoreBatchExitless(const std::vector<uint8_t>& batch, size_t opCount, std::vector<std::pair<bool, std::vector<uint8_t> > >& results);
+
+			/**
+			 * \brief	Gets the client of the exitless ring. The ring is set up on first use, rather than
+			 * 			in the constructor, since the store may be constructed before the untrusted side
+			 * 			is configured.
+			 */
+			MemStoreRingClient& GetRingClient();
+
+			/** \brief	Asks the untrusted side for the exitless ring. */
+			void InitMemStoreRing();
+
 			void* m_memStore;
+			ValueSealer m_sealer;
+			size_t m_pagedValueMaxSize;
+			std::unique_ptr<PagedValueStore> m_pagedStore;
+			std::unique_ptr<AuthIndex> m_authIndex;
+			std::once_flag m_ringInitFlag;
+			void* m_ringServer;
+			std::unique_ptr<MemStoreRingClient> m_ringClient;
 		};
 	}
 }
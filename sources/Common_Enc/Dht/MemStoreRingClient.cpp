@@ -0,0 +1,169 @@
+#include "MemStoreRingClient.h"
+
+#include <cstring>
+
+#include <DecentApi/Common/RuntimeException.h>
+
+#ifdef ENCLAVE_PLATFORM_SGX
+#include <sgx_trts.h>
+#include <DecentApi/Common/SGX/ErrorCode.h>
+#include "Sgx/edl_decent_dht_mem_store.h"
+#else
+extern "C" void ocall_decent_dht_mem_store_ring_wait(void* slot_ptr);
+#endif // ENCLAVE_PLATFORM_SGX
+
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "../../Common/Dht/MemStoreRing.h"
+
+using namespace Decent;
+using namespace Decent::Dht;
+
+namespace
+{
+	static bool IsOutsideEnclave(const void* ptr, size_t size)
+	{
+#ifdef ENCLAVE_PLATFORM_SGX
+		return sgx_is_outside_enclave(ptr, size) == 1;
+#else
+		return true;
+#endif // ENCLAVE_PLATFORM_SGX
+	}
+
+	/**
+	 * \brief	Hints the CPU that the thread is spinning, so that it yields resources to the sibling
+	 * 			hyper-thread (which may be the worker serving the request), and doesn't flood the memory
+	 * 			bus. The thread can't yield to the OS, since it's inside the enclave.
+	 */
+	static inline void SpinPause()
+	{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+		_mm_pause();
+#endif
+	}
+
+	/** \brief	Leaves the enclave to wait until the slot is no longer being served. */
+	static void WaitOutside(MemStoreRing::Slot& slot)
+	{
+#ifdef ENCLAVE_PLATFORM_SGX
+		sgx_status_t sgxRet = ocall_decent_dht_mem_store_ring_wait(&slot);
+		if (sgxRet != SGX_SUCCESS)
+		{
+			throw RuntimeException(Sgx::ConstructSimpleErrorMsg(sgxRet, "ocall_decent_dht_mem_store_ring_wait"));
+		}
+#else
+		ocall_decent_dht_mem_store_ring_wait(&slot);
+#endif // ENCLAVE_PLATFORM_SGX
+	}
+}
+
+constexpr size_t MemStoreRingClient::sk_pickUpSpinLimit;
+constexpr size_t MemStoreRingClient::sk_serveSpinLimit;
+
+MemStoreRingClient::MemStoreRingClient(MemStoreRing * ring) :
+	m_ring(ring)
+{
+	if (m_ring && !IsOutsideEnclave(m_ring, sizeof(MemStoreRing)))
+	{
+		throw RuntimeException("The memory store ring must be located outside of the enclave.");
+	}
+}
+
+MemStoreRingClient::~MemStoreRingClient()
+{
+}
+
+bool MemStoreRingClient::TryProcess(const std::vector<uint8_t>& req, std::vector<uint8_t>& res)
+{
+	if (!m_ring || req.size() > MemStoreRing::sk_slotDataSize)
+	{
+		return false;
+	}
+
+	//1. Claim a free slot.
+	MemStoreRing::Slot* slot = nullptr;
+	const uint32_t startIdx = m_ring->m_nextSlot.fetch_add(1, std::memory_order_relaxed);
+	for (size_t i = 0; i < MemStoreRing::sk_slotNum && !slot; ++i)
+	{
+		MemStoreRing::Slot& candidate = m_ring->m_slots[(startIdx + i) % MemStoreRing::sk_slotNum];
+		uint32_t expected = MemStoreRing::sk_slotFree;
+		if (candidate.m_state.compare_exchange_strong(expected, MemStoreRing::sk_slotFilling, std::memory_order_acq_rel))
+		{
+			slot = &candidate;
+		}
+	}
+	if (!slot)
+	{
+		return false;
+	}
+
+	//2. Post the request.
+	if (req.size() > 0)
+	{
+		std::memcpy(slot->m_data, req.data(), req.size());
+	}
+	slot->m_reqSize = req.size();
+	slot->m_state.store(MemStoreRing::sk_slotPosted, std::memory_order_release);
+
+	//3. Wait for a worker to pick it up; withdraw the request if it takes too long.
+	for (size_t spin = 0; slot->m_state.load(std::memory_order_acquire) == MemStoreRing::sk_slotPosted; ++spin)
+	{
+		if (spin >= sk_pickUpSpinLimit)
+		{
+			uint32_t expected = MemStoreRing::sk_slotPosted;
+			if (slot->m_state.compare_exchange_strong(expected, MemStoreRing::sk_slotFree, std::memory_order_acq_rel))
+			{
+				return false;
+			}
+		}
+		SpinPause();
+	}
+
+	//4. Wait for the response; outside of the enclave if it takes too long. The state is checked
+	//   again after the OCall returns, since the untrusted side may return early.
+	uint32_t state = MemStoreRing::sk_slotServing;
+	for (size_t spin = 0; (state = slot->m_state.load(std::memory_order_acquire)) == MemStoreRing::sk_slotServing; ++spin)
+	{
+		if (spin >= sk_serveSpinLimit)
+		{
+			WaitOutside(*slot);
+			spin = 0;
+			continue;
+		}
+		SpinPause();
+	}
+
+	//5. Copy the response into the enclave. Values are read only once, since they are untrusted.
+	bool isSucceeded = (state == MemStoreRing::sk_slotDone) && (slot->m_resRet != 0);
+	if (isSucceeded)
+	{
+		const uint64_t resSize = slot->m_resSize;
+		const uint8_t* resOverflow = slot->m_resOverflow;
+		const uint8_t* resPtr = resOverflow ? resOverflow : slot->m_data;
+
+		if ((!resOverflow && resSize > MemStoreRing::sk_slotDataSize) ||
+			(resOverflow && !IsOutsideEnclave(resOverflow, static_cast<size_t>(resSize))))
+		{
+			isSucceeded = false;
+		}
+		else
+		{
+			res.resize(static_cast<size_t>(resSize));
+			if (res.size() > 0)
+			{
+				std::memcpy(res.data(), resPtr, res.size());
+			}
+		}
+	}
+
+	slot->m_state.store(MemStoreRing::sk_slotFree, std::memory_order_release);
+
+	if (!isSucceeded)
+	{
+		throw RuntimeException("Memory store ring request failed.");
+	}
+
+	return true;
+}
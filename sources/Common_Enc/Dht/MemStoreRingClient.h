@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+namespace Decent
+{
+	namespace Dht
+	{
+		struct MemStoreRing;
+
+		/** \brief	The enclave side of the MemStoreRing, which posts requests without leaving the enclave. */
+		class MemStoreRingClient
+		{
+		public:
+			/**
+			 * \brief	Number of polls on a posted request that no worker has picked up, before the
+			 * 			request is withdrawn.
+			 */
+			static constexpr size_t sk_pickUpSpinLimit = 1 << 16;
+
+			/**
+			 * \brief	Number of polls on a request being served, before the thread leaves the enclave to
+			 * 			wait for the response (see ocall_decent_dht_mem_store_ring_wait), so that a slow or
+			 * 			stalled worker doesn't keep it spinning inside the enclave. The request can't be
+			 * 			withdrawn at this point, since the worker may still apply it.
+			 */
+			static constexpr size_t sk_serveSpinLimit = 1 << 20;
+
+		public:
+			/**
+			 * \brief	Constructor
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the ring is not located outside of
+			 * 												the enclave.
+			 *
+			 * \param [in,out]	ring	The ring in untrusted memory. Null to disable the client.
+			 */
+			MemStoreRingClient(MemStoreRing* ring);
+
+			virtual ~MemStoreRingClient();
+
+			bool IsEnabled() const
+			{
+				return m_ring != nullptr;
+			}
+
+			/**
+			 * \brief	Try to process a request through the ring.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the request is picked up by a worker, but
+			 * 												fails, or the response is invalid.
+			 *
+			 * \param 	   	req	The request.
+			 * \param [out]	res	The response.
+			 *
+			 * \return	False if the request is not processed, because the ring is disabled, the request
+			 * 			is too large, no slot is free, or no worker picks up the request in time; in
+			 * 			which case the caller should fall back to the OCall. True if the request is
+			 * 			processed successfully.
+			 */
+			bool TryProcess(const std::vector<uint8_t>& req, std::vector<uint8_t>& res);
+
+		private:
+			MemStoreRing* m_ring;
+		};
+	}
+}
@@ -2,6 +2,7 @@
 
 #include <DecentApi/Common/Common.h>
 #include <DecentApi/Common/make_unique.h>
+#include <DecentApi/Common/RuntimeException.h>
 #include <DecentApi/Common/Net/SecureCommLayer.h>
 
 #include "../../Common/Dht/FuncNums.h"
@@ -19,6 +20,9 @@ namespace
 	DhtStates& gs_state = GetDhtStatesSingleton();
 
 	static char gsk_ack[] = "ACK";
+
+	/** \brief	Upper bound of the number of nodes accepted in a membership list from a peer. */
+	static constexpr uint64_t gsk_maxMemberNum = 1 << 16;
 }
 
 void NodeConnector::SendNode(SecureCommLayer & comm, NodeBasePtr node)
@@ -93,16 +97,18 @@ NodeConnector::~NodeConnector()
 
 NodeConnector::NodeBasePtr NodeConnector::LookupTypeFunc(const MbedTlsObj::BigNumber & key, EncFunc::Dht::NumType type)
 {
-	CntPair cntPair = gs_state.GetConnectionMgr().GetNew(m_address, gs_state);
-
-	cntPair.GetCommLayer().SendStruct(type); //1. Send function type
-
 	std::array<uint8_t, DhtStates::sk_keySizeByte> keyBin{};
 	key.ToBinary(keyBin);
-	cntPair.GetCommLayer().SendRaw(keyBin.data(), keyBin.size()); //2. Send queried ID
-	//LOGI("Sent queried ID: %s.", key.ToBigEndianHexStr().c_str());
 
-	NodeConnector::NodeBasePtr res = ReceiveNode(cntPair.GetCommLayer()); //3. Receive node. - Done!
+	NodeConnector::NodeBasePtr res;
+	gs_state.GetConnectionMgr().Call(m_address, gs_state, type, //1. Send function type
+		[&keyBin, &res](SecureCommLayer& comm)
+	{
+		comm.SendRaw(keyBin.data(), keyBin.size()); //2. Send queried ID
+		//LOGI("Sent queried ID: %s.", key.ToBigEndianHexStr().c_str());
+
+		res = ReceiveNode(comm); //3. Receive node. - Done!
+	});
 
 	return res;
 }
@@ -126,11 +132,12 @@ NodeConnector::NodeBasePtr NodeConnector::GetImmediateSuccessor()
 	//LOGI("Node Connector: Getting Immediate Successor of Node %s...", GetNodeId().ToBigEndianHexStr().c_str());
 	using namespace EncFunc::Dht;
 
-	CntPair cntPair = gs_state.GetConnectionMgr().GetNew(m_address, gs_state);
-
-	cntPair.GetCommLayer().SendStruct(k_getImmediateSuc); //1. Send function type
-
-	NodeConnector::NodeBasePtr res = ReceiveNode(cntPair.GetCommLayer()); //2. Receive node. - Done!
+	NodeConnector::NodeBasePtr res;
+	gs_state.GetConnectionMgr().Call(m_address, gs_state, k_getImmediateSuc, //1. Send function type
+		[&res](SecureCommLayer& comm)
+	{
+		res = ReceiveNode(comm); //2. Receive node. - Done!
+	});
 
 	return res;
 }
@@ -140,11 +147,12 @@ NodeConnector::NodeBasePtr NodeConnector::GetImmediatePredecessor()
 	//LOGI("Node Connector: Getting Immediate Predecessor of Node %s...", GetNodeId().ToBigEndianHexStr().c_str());
 	using namespace EncFunc::Dht;
 
-	CntPair cntPair = gs_state.GetConnectionMgr().GetNew(m_address, gs_state);
-
-	cntPair.GetCommLayer().SendStruct(k_getImmediatePre); //1. Send function type
-
-	NodeConnector::NodeBasePtr res = ReceiveNode(cntPair.GetCommLayer()); //2. Receive node. - Done!
+	NodeConnector::NodeBasePtr res;
+	gs_state.GetConnectionMgr().Call(m_address, gs_state, k_getImmediatePre, //1. Send function type
+		[&res](SecureCommLayer& comm)
+	{
+		res = ReceiveNode(comm); //2. Receive node. - Done!
+	});
 
 	return res;
 
@@ -155,13 +163,38 @@ void NodeConnector::SetImmediatePredecessor(NodeBasePtr pred)
 	//LOGI("Node Connector: Setting Immediate Predecessor of Node %s...", GetNodeId().ToBigEndianHexStr().c_str());
 	using namespace EncFunc::Dht;
 
-	CntPair cntPair = gs_state.GetConnectionMgr().GetNew(m_address, gs_state);
+	gs_state.GetConnectionMgr().Call(m_address, gs_state, k_setImmediatePre, //1. Send function type
+		[&pred](SecureCommLayer& comm)
+	{
+		SendNode(comm, pred); //2. Send Node. - Done!
 
-	cntPair.GetCommLayer().SendStruct(k_setImmediatePre); //1. Send function type
+		comm.ReceiveStruct(gsk_ack);
+	});
+}
 
-	SendNode(cntPair.GetCommLayer(), pred); //2. Send Node. - Done!
+std::vector<NodeConnector::NodeBasePtr> NodeConnector::GetMembers()
+{
+	using namespace EncFunc::Dht;
+
+	std::vector<NodeBasePtr> res;
+	gs_state.GetConnectionMgr().Call(m_address, gs_state, k_getMembers, //1. Send function type
+		[&res](SecureCommLayer& comm)
+	{
+		uint64_t memberNum = 0;
+		comm.ReceiveStruct(memberNum); //2. Receive number of nodes.
+		if (memberNum > gsk_maxMemberNum)
+		{
+			throw RuntimeException("The membership list received is too large.");
+		}
+
+		res.reserve(static_cast<size_t>(memberNum));
+		for (uint64_t i = 0; i < memberNum; ++i)
+		{
+			res.push_back(ReceiveNode(comm)); //3. Receive nodes. - Done!
+		}
+	});
 
-	cntPair.GetCommLayer().ReceiveStruct(gsk_ack);
+	return res;
 }
 
 void NodeConnector::UpdateFingerTable(NodeBasePtr & s, uint64_t i)
@@ -169,13 +202,14 @@ void NodeConnector::UpdateFingerTable(NodeBasePtr & s, uint64_t i)
 	//LOGI("Node Connector: Updating Finger Table of Node %s...", GetNodeId().ToBigEndianHexStr().c_str());
 	using namespace EncFunc::Dht;
 
-	CntPair cntPair = gs_state.GetConnectionMgr().GetNew(m_address, gs_state);
-
-	cntPair.GetCommLayer().SendStruct(k_updFingerTable); //1. Send function type
-	SendNode(cntPair.GetCommLayer(), s); //2. Send Node.
-	cntPair.GetCommLayer().SendStruct(i); //3. Send i. - Done!
+	gs_state.GetConnectionMgr().Call(m_address, gs_state, k_updFingerTable, //1. Send function type
+		[&s, i](SecureCommLayer& comm)
+	{
+		SendNode(comm, s); //2. Send Node.
+		comm.SendStruct(i); //3. Send i. - Done!
 
-	cntPair.GetCommLayer().ReceiveStruct(gsk_ack);
+		comm.ReceiveStruct(gsk_ack);
+	});
 }
 
 void NodeConnector::DeUpdateFingerTable(const MbedTlsObj::BigNumber & oldId, NodeBasePtr & succ, uint64_t i)
@@ -183,18 +217,19 @@ void NodeConnector::DeUpdateFingerTable(const MbedTlsObj::BigNumber & oldId, Nod
 	//LOGI("Node Connector: De-Updating Finger Table of Node %s...", GetNodeId().ToBigEndianHexStr().c_str());
 	using namespace EncFunc::Dht;
 
-	CntPair cntPair = gs_state.GetConnectionMgr().GetNew(m_address, gs_state);
-
-	cntPair.GetCommLayer().SendStruct(k_dUpdFingerTable); //1. Send function type
-
 	std::array<uint8_t, DhtStates::sk_keySizeByte> keyBin{};
 	oldId.ToBinary(keyBin);
-	cntPair.GetCommLayer().SendRaw(keyBin.data(), keyBin.size()); //2. Send oldId.
 
-	SendNode(cntPair.GetCommLayer(), succ); //3. Send Node.
-	cntPair.GetCommLayer().SendStruct(i); //4. Send i. - Done!
+	gs_state.GetConnectionMgr().Call(m_address, gs_state, k_dUpdFingerTable, //1. Send function type
+		[&keyBin, &succ, i](SecureCommLayer& comm)
+	{
+		comm.SendRaw(keyBin.data(), keyBin.size()); //2. Send oldId.
+
+		SendNode(comm, succ); //3. Send Node.
+		comm.SendStruct(i); //4. Send i. - Done!
 
-	cntPair.GetCommLayer().ReceiveStruct(gsk_ack);
+		comm.ReceiveStruct(gsk_ack);
+	});
 }
 
 const BigNumber & NodeConnector::GetNodeId()
@@ -208,12 +243,12 @@ const BigNumber & NodeConnector::GetNodeId()
 	//LOGI("Node Connector: Getting Node ID...");
 	using namespace EncFunc::Dht;
 
-	CntPair cntPair = gs_state.GetConnectionMgr().GetNew(m_address, gs_state);
-
-	cntPair.GetCommLayer().SendStruct(k_getNodeId); //1. Send function type
-
 	std::array<uint8_t, DhtStates::sk_keySizeByte> keyBin{};
-	cntPair.GetCommLayer().ReceiveRaw(keyBin.data(), keyBin.size()); //2. Received resultant ID - Done!
+	gs_state.GetConnectionMgr().Call(m_address, gs_state, k_getNodeId, //1. Send function type
+		[&keyBin](SecureCommLayer& comm)
+	{
+		comm.ReceiveRaw(keyBin.data(), keyBin.size()); //2. Received resultant ID - Done!
+	});
 
 	m_Id = Tools::make_unique<BigNumber>(keyBin);
 	//LOGI("Recv result ID: %s.", m_Id->ToBigEndianHexStr().c_str());
@@ -4,6 +4,7 @@
 #include "../../Common/Dht/FuncNums.h"
 
 #include <memory>
+#include <vector>
 
 namespace Decent
 {
@@ -58,6 +59,8 @@ namespace Decent
 
 			virtual void SetImmediatePredecessor(NodeBasePtr pred) override;
 
+			virtual std::vector<NodeBasePtr> GetMembers() override;
+
 			virtual void UpdateFingerTable(NodeBasePtr& s, uint64_t i) override;
 
 			virtual void DeUpdateFingerTable(const MbedTlsObj::BigNumber& oldId, NodeBasePtr& succ, uint64_t i) override;
@@ -8,6 +8,7 @@
 
 extern "C" void* ocall_decent_dht_cnt_mgr_get_dht(uint64_t address);
 extern "C" void* ocall_decent_dht_cnt_mgr_get_store(uint64_t address);
+extern "C" void ocall_decent_dht_release_held_cnt(void* connection, int result);
 
 using namespace Decent::Dht;
 using namespace Decent::Net;
@@ -32,4 +33,9 @@ std::unique_ptr<ConnectionBase> Decent::Dht::ConnectionManager::GetConnection2De
 	return std::unique_ptr<ConnectionBase>(ptr);
 }
 
+void ConnectionManager::ReleaseHeldConnection(void* cntPtr, int result)
+{
+	ocall_decent_dht_release_held_cnt(cntPtr, result);
+}
+
 #endif //ENCLAVE_PLATFORM_NON_ENCLAVE
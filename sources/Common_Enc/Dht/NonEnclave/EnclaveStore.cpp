@@ -3,11 +3,18 @@
 #include "../EnclaveStore.h"
 
 #include <DecentApi/Common/Common.h>
+#include <DecentApi/Common/make_unique.h>
 
 #include "../../../Common/Dht/MemKeyValueStore.h"
 #include "../../../Common/Dht/LocalNode.h"
 
 #include "../DhtStatesSingleton.h"
+#include "../MemStoreRingClient.h"
+#include "../PagedValueStore.h"
+#include "../AuthIndex.h"
+
+extern "C" void* ocall_decent_dht_mem_store_ring_init(void* obj, void** ring_ptr);
+extern "C" void  ocall_decent_dht_mem_store_ring_deinit(void* ring_server);
 
 using namespace Decent;
 using namespace Decent::Dht;
@@ -15,43 +22,83 @@ using namespace Decent::Tools;
 
 namespace
 {
+	constexpr char gsk_sealKeyLabel[] = "Decent_DHT_Data";
+
 	DhtStates& gs_state = GetDhtStatesSingleton();
 
 }
 
 EnclaveStore::EnclaveStore(const MbedTlsObj::BigNumber & ringStart, const MbedTlsObj::BigNumber & ringEnd) :
 	StoreBase(ringStart, ringEnd),
-	m_memStore(new MemKeyValueStore())
+	m_memStore(new MemKeyValueStore()),
+	m_sealer(gsk_sealKeyLabel),
+	m_pagedValueMaxSize(0),
+	m_pagedStore(),
+	m_authIndex(),
+	m_ringInitFlag(),
+	m_ringServer(nullptr),
+	m_ringClient()
 {}
 
 EnclaveStore::~EnclaveStore()
 {
+	m_ringClient.reset();
+	if (m_ringServer)
+	{
+		ocall_decent_dht_mem_store_ring_deinit(m_ringServer);
+	}
+
 	MemKeyValueStore* m_memStorePtr = static_cast<MemKeyValueStore*>(m_memStore);
 	delete m_memStorePtr;
 }
 
+void EnclaveStore::InitMemStoreRing()
+{
+	//Same ring as the SGX build, so that the exitless path can be measured without SGX hardware.
+	void* ringPtr = nullptr;
+	m_ringServer = ocall_decent_dht_mem_store_ring_init(m_memStore, &ringPtr);
+	m_ringClient = Tools::make_unique<MemStoreRingClient>(m_ringServer ? static_cast<MemStoreRing*>(ringPtr) : nullptr);
+}
+
 bool EnclaveStore::IsResponsibleFor(const MbedTlsObj::BigNumber & key) const
 {
 	DhtStates::DhtLocalNodePtrType localNode = gs_state.GetDhtNode();
 	return localNode ? localNode->IsResponsibleFor(key) : false;
 }
 
-std::vector<uint8_t> EnclaveStore::SaveDataFile(const MbedTlsObj::BigNumber& key, const std::vector<uint8_t>& data)
+EnclaveStore::TagType EnclaveStore::SaveDataFile(const MbedTlsObj::BigNumber& key, const std::vector<uint8_t>& data)
 {
 	using namespace Decent::Tools;
 
-	const std::string keyStr = key.ToBigEndianHexStr();
+	if (GetRingClient().IsEnabled())
+	{
+		std::pair<bool, TagType> res = SaveDataFiles({ std::make_pair(key, data) }).front();
+		if (!res.first)
+		{
+			throw RuntimeException("Failed to save data to the memory store.");
+		}
+		return res.second;
+	}
+
+	const std::string keyStr = GetKeyStr(key);
 	LOGI("DHT store: adding key to the index. %s", keyStr.c_str());
 	//LOGI("DHT store: writing value: %s", std::string(reinterpret_cast<const char*>(data.data()), data.size()).c_str());
 
-	std::vector<uint8_t> mac;
+	if (TrySavePagedValue(GetKeyBin(key), data))
+	{
+		return TagType(); //Paged values are located by the page index, instead of tags.
+	}
+
+	//Values are sealed in the same way as the SGX build, so that the cost of sealing is included.
+	//Without an enclave boundary to cross, they are sealed straight into the buffer kept by the store.
+	TagType mac;
 	{
 		MemKeyValueStore* m_memStorePtr = static_cast<MemKeyValueStore*>(m_memStore);
 
 		MemKeyValueStore::ValueType val;
-		val.first = data.size();
+		val.first = ValueSealer::GetSealedSize(data.size());
 		val.second = std::make_unique<uint8_t[]>(val.first);
-		std::copy(data.data(), data.data() + val.first, val.second.get());
+		SealValue(keyStr, data, val.second.get(), val.first, mac);
 
 		m_memStorePtr->Store(keyStr, std::move(val));
 	}
@@ -61,7 +108,17 @@ std::vector<uint8_t> EnclaveStore::SaveDataFile(const MbedTlsObj::BigNumber& key
 
 void EnclaveStore::DeleteDataFile(const MbedTlsObj::BigNumber& key)
 {
-	const std::string keyStr = key.ToBigEndianHexStr();
+	if (GetRingClient().IsEnabled())
+	{
+		return DeleteDataFiles({ key });
+	}
+
+	const std::string keyStr = GetKeyStr(key);
+
+	if (m_pagedStore && m_pagedStore->Remove(GetKeyBin(key)))
+	{
+		return;
+	}
 
 	{
 		MemKeyValueStore* m_memStorePtr = static_cast<MemKeyValueStore*>(m_memStore);
@@ -75,34 +132,113 @@ void EnclaveStore::DeleteDataFile(const MbedTlsObj::BigNumber& key)
 	}
 }
 
-std::vector<uint8_t> EnclaveStore::ReadDataFile(const MbedTlsObj::BigNumber& key, const std::vector<uint8_t>& tag)
+std::vector<uint8_t> EnclaveStore::ReadDataFile(const MbedTlsObj::BigNumber& key, const TagType& tag)
 {
 	using namespace Decent::Tools;
 
-	const std::string keyStr = key.ToBigEndianHexStr();
+	if (GetRingClient().IsEnabled())
+	{
+		return ReadDataFiles({ std::make_pair(key, tag) }).front();
+	}
+
+	if (IsPagedTag(tag))
+	{
+		return m_pagedStore->Get(GetKeyBin(key));
+	}
+
+	const std::string keyStr = GetKeyStr(key);
 
 	{
 		MemKeyValueStore* m_memStorePtr = static_cast<MemKeyValueStore*>(m_memStore);
 
 		MemKeyValueStore::ValueType val = m_memStorePtr->Read(keyStr);
+		if (val.second.get() == nullptr)
+		{
+			throw RuntimeException("Failed to read key-value pair, " + keyStr + ". Pair not found.");
+		}
 
-		return std::vector<uint8_t>(val.second.get(), val.second.get() + val.first);
+		return UnsealValue(keyStr, val.second.get(), val.first, tag);
 	}
 }
 
-std::vector<uint8_t> EnclaveStore::MigrateOneDataFile(const MbedTlsObj::BigNumber& key, const std::vector<uint8_t>& tag)
+std::vector<uint8_t> EnclaveStore::MigrateOneDataFile(const MbedTlsObj::BigNumber& key, const TagType& tag)
 {
 	using namespace Decent::Tools;
 
-	const std::string keyStr = key.ToBigEndianHexStr();
+	if (IsPagedTag(tag))
+	{
+		return m_pagedStore->Migrate(GetKeyBin(key));
+	}
+
+	const std::string keyStr = GetKeyStr(key);
 
 	{
 		MemKeyValueStore* m_memStorePtr = static_cast<MemKeyValueStore*>(m_memStore);
 
 		MemKeyValueStore::ValueType val = m_memStorePtr->Delete(keyStr);
+		if (val.second.get() == nullptr)
+		{
+			throw RuntimeException("Failed to migrate key-value pair, " + keyStr + ". Pair not found.");
+		}
 
-		return std::vector<uint8_t>(val.second.get(), val.second.get() + val.first);
+		return UnsealValue(keyStr, val.second.get(), val.first, tag);
 	}
 }
 
+void EnclaveStore::MigrateRangeDataFile(const MbedTlsObj::BigNumber & start, const MbedTlsObj::BigNumber & end, const IndexingType & indexing, const MigrateCallbackType & callback)
+{
+	const std::string startStr = GetKeyStr(start);
+	const std::string endStr = GetKeyStr(end);
+
+	MemKeyValueStore* m_memStorePtr = static_cast<MemKeyValueStore*>(m_memStore);
+	MigrateIndexCursor cursor(indexing, m_pagedStore.get(), callback);
+
+	size_t pairCount = 0;
+	do
+	{
+		std::vector<MemKeyValueStore::KeyValPair> pairs = m_memStorePtr->Migrate(startStr, endStr, sk_migrateBatchSize);
+		pairCount = pairs.size();
+
+		for (const MemKeyValueStore::KeyValPair& pair : pairs)
+		{
+			const IndexingType::value_type* indexItem = cursor.Find(pair.first);
+			if (!indexItem)
+			{
+				continue;
+			}
+
+			std::vector<uint8_t> data;
+			try
+			{
+				data = UnsealValue(pair.first, pair.second.second.get(), pair.second.first, indexItem->second);
+			}
+			catch (const std::exception&)
+			{
+				continue;
+			}
+
+			callback(indexItem->first, data);
+		}
+	} while (pairCount >= sk_migrateBatchSize);
+
+	cursor.Finish();
+}
+
+std::vector<std::pair<bool, std::vector<uint8_t> > > EnclaveStore::ProcessMemStoreBatch(const std::vector<uint8_t>& batch, size_t opCount)
+{
+	std::vector<std::pair<bool, std::vector<uint8_t> > > results;
+	if (opCount == 0 || TryProcessMemStoreBatchExitless(batch, opCount, results))
+	{
+		return results;
+	}
+
+	//Same packing as the SGX build, but the memory store is called directly instead of through an OCall.
+	MemKeyValueStore* m_memStorePtr = static_cast<MemKeyValueStore*>(m_memStore);
+
+	std::vector<uint8_t> packedResults;
+	m_memStorePtr->ProcessBatch(batch.data(), batch.size(), packedResults);
+
+	return MemKeyValueStore::UnpackBatchResults(packedResults.data(), packedResults.size(), opCount);
+}
+
 #endif //ENCLAVE_PLATFORM_NON_ENCLAVE
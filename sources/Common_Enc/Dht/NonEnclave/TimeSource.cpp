@@ -0,0 +1,27 @@
+#ifdef ENCLAVE_PLATFORM_NON_ENCLAVE
+
+#include "../TimeSource.h"
+
+#include <chrono>
+#include <thread>
+
+using namespace Decent::Dht;
+
+uint64_t TimeSource::GetSteadyTimeMs()
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+uint64_t TimeSource::GetSteadyTimeUs()
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void TimeSource::SleepMs(uint64_t ms)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+#endif //ENCLAVE_PLATFORM_NON_ENCLAVE
@@ -0,0 +1,21 @@
+#ifdef ENCLAVE_PLATFORM_NON_ENCLAVE
+
+#include "../ValueSealer.h"
+
+#include <random>
+
+using namespace Decent;
+using namespace Decent::Dht;
+
+void ValueSealer::GetRootKey(KeyType & rootKey)
+{
+	//There is no hardware key here; a random key unique to this run is used instead.
+	std::random_device randDev;
+	std::uniform_int_distribution<int> dist(0, UINT8_MAX);
+	for (uint8_t& byte : rootKey)
+	{
+		byte = static_cast<uint8_t>(dist(randDev));
+	}
+}
+
+#endif //ENCLAVE_PLATFORM_NON_ENCLAVE
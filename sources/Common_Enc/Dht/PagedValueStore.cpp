@@ -0,0 +1,330 @@
+#include "PagedValueStore.h"
+
+#include <cstring>
+
+#include <DecentApi/Common/RuntimeException.h>
+
+#include "../../Common/Dht/MemKeyValueStore.h"
+
+#include "ValueSealer.h"
+
+using namespace Decent;
+using namespace Decent::Dht;
+
+namespace
+{
+	static std::vector<uint8_t> GetSlotFromPage(const std::vector<uint8_t>& page, uint32_t slot)
+	{
+		uint32_t slotCount = 0;
+		if (page.size() < sizeof(slotCount))
+		{
+			throw RuntimeException("The page is malformed.");
+		}
+		std::memcpy(&slotCount, page.data(), sizeof(slotCount));
+
+		const size_t headerSize = sizeof(slotCount) + (static_cast<size_t>(slotCount) * sizeof(uint32_t));
+		if (slot >= slotCount || page.size() < headerSize)
+		{
+			throw RuntimeException("The page is malformed.");
+		}
+
+		uint32_t begin = 0;
+		uint32_t end = 0;
+		const uint8_t* offsets = page.data() + sizeof(slotCount);
+		if (slot > 0)
+		{
+			std::memcpy(&begin, offsets + ((slot - 1) * sizeof(uint32_t)), sizeof(begin));
+		}
+		std::memcpy(&end, offsets + (slot * sizeof(uint32_t)), sizeof(end));
+
+		if (begin > end || headerSize + end > page.size())
+		{
+			throw RuntimeException("The page is malformed.");
+		}
+
+		return std::vector<uint8_t>(page.begin() + headerSize + begin, page.begin() + headerSize + end);
+	}
+}
+
+constexpr size_t PagedValueStore::sk_keySize;
+constexpr size_t PagedValueStore::sk_pageSize;
+constexpr size_t PagedValueStore::sk_pageTagSize;
+
+static_assert(PagedValueStore::sk_pageTagSize == ValueSealer::sk_tagSize, "The size of page tag doesn't match the size of sealing tag.");
+constexpr char PagedValueStore::sk_pageKeyPrefix[];
+
+std::string PagedValueStore::GetPageKeyStr(uint64_t pageId)
+{
+	static constexpr char sk_hexDigits[] = "0123456789abcdef";
+
+	std::string res(sk_pageKeyPrefix);
+	for (int i = (sizeof(pageId) * 2) - 1; i >= 0; --i)
+	{
+		res.push_back(sk_hexDigits[(pageId >> (i * 4)) & 0x0F]);
+	}
+
+	return res;
+}
+
+PagedValueStore::PagedValueStore(ValueSealer & sealer, BatchFuncType batchFunc) :
+	m_sealer(sealer),
+	m_batchFunc(batchFunc),
+	m_mutex(),
+	m_entries(),
+	m_pages(),
+	m_openPageId(0),
+	m_openSlots(),
+	m_openSize(0),
+	m_openLiveCount(0)
+{
+}
+
+PagedValueStore::~PagedValueStore()
+{
+}
+
+bool PagedValueStore::Has(const KeyBinType & key) const
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	return m_entries.find(key) != m_entries.end();
+}
+
+void PagedValueStore::Put(const KeyBinType & key, const std::vector<uint8_t>& data)
+{
+	//Each slot also takes an offset in the page header.
+	const size_t slotSize = sizeof(uint32_t) + data.size();
+	if (slotSize > sk_pageSize)
+	{
+		throw RuntimeException("The value is too large to be stored in a page.");
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	//The open page is flushed before the old entry is removed, so that the old value is kept if
+	//flushing fails.
+	if (m_openSlots.size() > 0 && m_openSize + slotSize > sk_pageSize)
+	{
+		FlushOpenPage();
+	}
+
+	EntryRef ref;
+	ref.m_pageId = m_openPageId;
+	ref.m_slot = static_cast<uint32_t>(m_openSlots.size());
+
+	m_openSlots.push_back(data);
+	m_openSize += slotSize;
+	++m_openLiveCount;
+
+	auto it = m_entries.find(key);
+	if (it != m_entries.end())
+	{
+		RemoveEntry(it->second);
+		it->second = ref;
+	}
+	else
+	{
+		m_entries.insert(std::make_pair(key, ref));
+	}
+}
+
+std::vector<uint8_t> PagedValueStore::Get(const KeyBinType & key)
+{
+	return Read(key, false);
+}
+
+bool PagedValueStore::Remove(const KeyBinType & key)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	auto it = m_entries.find(key);
+	if (it == m_entries.end())
+	{
+		return false;
+	}
+
+	RemoveEntry(it->second);
+	m_entries.erase(it);
+
+	return true;
+}
+
+std::vector<uint8_t> PagedValueStore::Migrate(const KeyBinType & key)
+{
+	return Read(key, true);
+}
+
+std::vector<uint8_t> PagedValueStore::Read(const KeyBinType & key, bool isRemoved)
+{
+	EntryRef ref;
+	std::array<uint8_t, sk_pageTagSize> tag;
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		auto it = m_entries.find(key);
+		if (it == m_entries.end())
+		{
+			throw RuntimeException("Queried key is not found in pages.");
+		}
+		ref = it->second;
+
+		if (ref.m_pageId == m_openPageId)
+		{
+			std::vector<uint8_t> res = m_openSlots[ref.m_slot];
+			if (isRemoved)
+			{
+				RemoveEntry(ref);
+				m_entries.erase(it);
+			}
+			return res;
+		}
+
+		auto pageIt = m_pages.find(ref.m_pageId);
+		if (pageIt == m_pages.end())
+		{
+			throw RuntimeException("Queried page is not found.");
+		}
+		tag = pageIt->second.m_tag;
+
+		//Sealed pages are immutable, so the page is read without holding the lock; it's pinned, so
+		//that it's not deleted from the memory store in the meantime.
+		++(pageIt->second.m_pinCount);
+	}
+
+	std::vector<uint8_t> res;
+	try
+	{
+		res = GetSlotFromPage(ReadPage(ref.m_pageId, tag), ref.m_slot);
+	}
+	catch (const std::exception&)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		UnpinPage(ref.m_pageId);
+		throw;
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (isRemoved)
+	{
+		auto it = m_entries.find(key);
+		if (it != m_entries.end() && it->second.m_pageId == ref.m_pageId && it->second.m_slot == ref.m_slot)
+		{
+			RemoveEntry(ref);
+			m_entries.erase(it);
+		}
+	}
+	UnpinPage(ref.m_pageId);
+
+	return res;
+}
+
+std::vector<uint8_t> PagedValueStore::ReadPage(uint64_t pageId, const std::array<uint8_t, sk_pageTagSize>& tag)
+{
+	const std::string pageKeyStr = GetPageKeyStr(pageId);
+
+	std::vector<uint8_t> batch;
+	MemKeyValueStore::AppendBatchOp(batch, MemKeyValueStore::BatchOp::Read, pageKeyStr);
+
+	BatchResultsType results = m_batchFunc(batch, 1);
+	if (!results[0].first)
+	{
+		throw RuntimeException("Failed to read the page from the memory store.");
+	}
+
+	const std::vector<uint8_t>& sealed = results[0].second;
+	std::vector<uint8_t> page(ValueSealer::GetUnsealedSize(sealed.size()));
+	m_sealer.Unseal(pageKeyStr.data(), pageKeyStr.size(), sealed.data(), sealed.size(), tag.data(), tag.size(), page.data(), page.size());
+
+	return page;
+}
+
+void PagedValueStore::FlushOpenPage()
+{
+	if (m_openLiveCount > 0)
+	{
+		//The open page is only reset after it's stored, so that no entry is lost if storing fails.
+		const uint32_t slotCount = static_cast<uint32_t>(m_openSlots.size());
+		const size_t headerSize = sizeof(slotCount) + (m_openSlots.size() * sizeof(uint32_t));
+
+		std::vector<uint8_t> page(headerSize);
+		page.reserve(sizeof(slotCount) + m_openSize);
+		std::memcpy(page.data(), &slotCount, sizeof(slotCount));
+
+		uint32_t offset = 0;
+		for (size_t i = 0; i < m_openSlots.size(); ++i)
+		{
+			page.insert(page.end(), m_openSlots[i].begin(), m_openSlots[i].end());
+			offset += static_cast<uint32_t>(m_openSlots[i].size());
+			std::memcpy(page.data() + sizeof(slotCount) + (i * sizeof(uint32_t)), &offset, sizeof(offset));
+		}
+
+		const std::string pageKeyStr = GetPageKeyStr(m_openPageId);
+
+		PageInfo info;
+		info.m_liveCount = m_openLiveCount;
+		info.m_pinCount = 0;
+
+		//Sealed straight into the batch, instead of being sealed and then copied.
+		const size_t sealedSize = ValueSealer::GetSealedSize(page.size());
+		std::vector<uint8_t> batch;
+		uint8_t* sealedPtr = MemKeyValueStore::AppendBatchStoreOp(batch, pageKeyStr, sealedSize);
+		m_sealer.Seal(pageKeyStr.data(), pageKeyStr.size(), page.data(), page.size(), sealedPtr, sealedSize, info.m_tag.data(), info.m_tag.size());
+
+		if (!m_batchFunc(batch, 1)[0].first)
+		{
+			throw RuntimeException("Failed to store the page to the memory store.");
+		}
+
+		m_pages[m_openPageId] = std::move(info);
+	}
+
+	++m_openPageId;
+	m_openSlots.clear();
+	m_openSize = 0;
+	m_openLiveCount = 0;
+}
+
+void PagedValueStore::RemoveEntry(const EntryRef & ref)
+{
+	if (ref.m_pageId == m_openPageId)
+	{
+		m_openSize -= m_openSlots[ref.m_slot].size();
+		std::vector<uint8_t>().swap(m_openSlots[ref.m_slot]);
+		--m_openLiveCount;
+		return;
+	}
+
+	auto pageIt = m_pages.find(ref.m_pageId);
+	if (pageIt == m_pages.end() || --(pageIt->second.m_liveCount) > 0 || pageIt->second.m_pinCount > 0)
+	{
+		return;
+	}
+
+	DeletePage(pageIt);
+}
+
+void PagedValueStore::UnpinPage(uint64_t pageId)
+{
+	auto pageIt = m_pages.find(pageId);
+	if (pageIt == m_pages.end() || --(pageIt->second.m_pinCount) > 0 || pageIt->second.m_liveCount > 0)
+	{
+		return;
+	}
+
+	//The last entry was removed while the page was being read.
+	DeletePage(pageIt);
+}
+
+void PagedValueStore::DeletePage(PageMapType::iterator pageIt)
+{
+	const uint64_t pageId = pageIt->first;
+	m_pages.erase(pageIt);
+
+	std::vector<uint8_t> batch;
+	MemKeyValueStore::AppendBatchOp(batch, MemKeyValueStore::BatchOp::Delete, GetPageKeyStr(pageId));
+	try
+	{
+		m_batchFunc(batch, 1);
+	}
+	catch (const std::exception&)
+	{}
+}
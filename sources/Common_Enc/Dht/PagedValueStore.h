@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstdint>
+
+#include <array>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Decent
+{
+	namespace Dht
+	{
+		class ValueSealer;
+
+		/**
+		 * \brief	Packs small values into fixed-size pages, so that each page, instead of each value, is
+		 * 			sealed and stored in the memory store. Values are appended to the open page kept inside
+		 * 			the enclave; once the open page is full, it's sealed as one unit and passed to the
+		 * 			memory store. The index maps each key, in its fixed-size binary form, to a (page, slot)
+		 * 			pair.
+		 *
+		 * 			Sealed pages are never rewritten; a page is deleted from the memory store once all of
+		 * 			its entries are deleted or overwritten, and no reader is reading it.
+		 *
+		 * 			Page layout: slot count (4 bytes) | end offset of each slot (4 bytes each) | values.
+		 */
+		class PagedValueStore
+		{
+		public:
+			/** \brief	Size of a key in binary; the same as DhtStates::sk_keySizeByte. */
+			static constexpr size_t sk_keySize = 32;
+
+			/** \brief	Size of a page, including slot offsets, beyond which the open page is sealed. */
+			static constexpr size_t sk_pageSize = 4096;
+
+			/** \brief	Size of the tag of a sealed page; the same as ValueSealer::sk_tagSize. */
+			static constexpr size_t sk_pageTagSize = 16;
+
+			/**
+			 * \brief	Prefix of the page key string in the memory store. It's ordered after hex digits, so
+			 * 			pages are never included in range migration of values.
+			 */
+			static constexpr char sk_pageKeyPrefix[] = "~page:";
+
+			typedef std::array<uint8_t, sk_keySize> KeyBinType;
+
+			/** \brief	Result of a batch of memory store operations; see MemKeyValueStore::ProcessBatch. */
+			typedef std::vector<std::pair<bool, std::vector<uint8_t> > > BatchResultsType;
+
+			/** \brief	Passes a batch, generated by MemKeyValueStore::AppendBatchOp, to the memory store. */
+			typedef std::function<BatchResultsType(const std::vector<uint8_t>&, size_t)> BatchFuncType;
+
+			static std::string GetPageKeyStr(uint64_t pageId);
+
+		public:
+			/**
+			 * \brief	Constructor
+			 *
+			 * \param [in,out]	sealer   	The sealer used to seal pages.
+			 * \param 		  	batchFunc	The function to access the memory store.
+			 */
+			PagedValueStore(ValueSealer& sealer, BatchFuncType batchFunc);
+
+			virtual ~PagedValueStore();
+
+			bool Has(const KeyBinType& key) const;
+
+			/**
+			 * \brief	Puts a value into the open page. If the key is already in a page, the old entry is
+			 * 			removed.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the full page fails to be stored, in
+			 * 												which case the old entry is kept.
+			 *
+			 * \param	key 	The key in binary.
+			 * \param	data	The value; must fit in an empty page.
+			 */
+			void Put(const KeyBinType& key, const std::vector<uint8_t>& data);
+
+			/**
+			 * \brief	Gets a value.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the key is not found, or the page fails
+			 * 												to be read or unsealed.
+			 *
+			 * \param	key	The key in binary.
+			 *
+			 * \return	The value.
+			 */
+			std::vector<uint8_t> Get(const KeyBinType& key);
+
+			/**
+			 * \brief	Removes a value.
+			 *
+			 * \param	key	The key in binary.
+			 *
+			 * \return	False if the key is not in any page.
+			 */
+			bool Remove(const KeyBinType& key);
+
+			/**
+			 * \brief	Gets and removes a value. The entry is not removed if it's replaced while the page
+			 * 			is read.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the key is not found, or the page fails
+			 * 												to be read or unsealed.
+			 */
+			std::vector<uint8_t> Migrate(const KeyBinType& key);
+
+		private:
+			struct EntryRef
+			{
+				uint64_t m_pageId;
+				uint32_t m_slot;
+			};
+
+			struct PageInfo
+			{
+				std::array<uint8_t, sk_pageTagSize> m_tag;
+				size_t m_liveCount;
+				/** \brief	Number of readers reading the page without holding the lock. */
+				size_t m_pinCount;
+			};
+
+			typedef std::map<uint64_t, PageInfo> PageMapType;
+
+			/** \brief	Implements Get() and Migrate(). */
+			std::vector<uint8_t> Read(const KeyBinType& key, bool isRemoved);
+
+			/** \brief	Reads a sealed page from the memory store and unseals it; m_mutex is not needed. */
+			std::vector<uint8_t> ReadPage(uint64_t pageId, const std::array<uint8_t, sk_pageTagSize>& tag);
+
+			/** \brief	Seals the open page and stores it; assume m_mutex has been locked. */
+			void FlushOpenPage();
+
+			/** \brief	Marks an entry as dead; assume m_mutex has been locked. */
+			void RemoveEntry(const EntryRef& ref);
+
+			/** \brief	Releases a page pinned by a reader; assume m_mutex has been locked. */
+			void UnpinPage(uint64_t pageId);
+
+			/**
+			 * \brief	Deletes a page, which has neither entries nor readers, from the memory store;
+			 * 			assume m_mutex has been locked.
+			 */
+			void DeletePage(PageMapType::iterator pageIt);
+
+			ValueSealer& m_sealer;
+			BatchFuncType m_batchFunc;
+
+			mutable std::mutex m_mutex;
+			std::map<KeyBinType, EntryRef> m_entries;
+			PageMapType m_pages;
+
+			uint64_t m_openPageId;
+			std::vector<std::vector<uint8_t> > m_openSlots;
+			size_t m_openSize;
+			size_t m_openLiveCount;
+		};
+	}
+}
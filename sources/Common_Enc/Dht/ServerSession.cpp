@@ -0,0 +1,56 @@
+#include "ServerSession.h"
+
+#include <atomic>
+
+using namespace Decent::Dht;
+
+namespace
+{
+	/** \brief	Number of sessions alive. */
+	static std::atomic<size_t> gs_sessionNum(0);
+
+	/** \brief	Number of channels alive, whether they are waiting for RPCs or being served. */
+	static std::atomic<size_t> gs_channelNum(0);
+}
+
+ServerSession::ServerSession(void* cntPtr) :
+	m_cnt(cntPtr),
+	m_tls(),
+	m_isChannel(false)
+{
+	++gs_sessionNum;
+}
+
+ServerSession::~ServerSession()
+{
+	if (m_isChannel)
+	{
+		--gs_channelNum;
+	}
+	--gs_sessionNum;
+}
+
+size_t ServerSession::GetSessionNum()
+{
+	return gs_sessionNum.load();
+}
+
+bool ServerSession::TryMakeChannel(size_t maxChannelNum)
+{
+	if (m_isChannel)
+	{
+		return true;
+	}
+
+	size_t channelNum = gs_channelNum.load();
+	do
+	{
+		if (channelNum >= maxChannelNum)
+		{
+			return false;
+		}
+	} while (!gs_channelNum.compare_exchange_weak(channelNum, channelNum + 1));
+
+	m_isChannel = true;
+	return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+
+#include <memory>
+
+#include <DecentApi/Common/Net/TlsCommLayer.h>
+#include <DecentApi/CommonEnclave/Net/EnclaveCntTranslator.h>
+
+namespace Decent
+{
+	namespace Dht
+	{
+		/**
+		 * \brief	The server side of a TLS session on an untrusted connection. It's kept in the enclave
+		 * 			between messages (see ProcResult::k_session), so that each message is served by its
+		 * 			own ECall, instead of one ECall waiting in the enclave for the whole session.
+		 */
+		class ServerSession
+		{
+		public:
+			ServerSession() = delete;
+
+			/**
+			 * \brief	Constructor. The TLS session is set up by the caller afterwards.
+			 *
+			 * \param [in,out]	cntPtr	Pointer to the untrusted connection.
+			 */
+			ServerSession(void* cntPtr);
+
+			ServerSession(const ServerSession&) = delete;
+
+			ServerSession(ServerSession&&) = delete;
+
+			/** \brief	Destructor. A channel gives its place back to new channels. */
+			~ServerSession();
+
+			/**
+			 * \brief	Gets the number of sessions alive, whether they are being served, kept between
+			 * 			messages, or held for replies. Each of them may take a TLS context in enclave memory.
+			 */
+			static size_t GetSessionNum();
+
+			/**
+			 * \brief	Turns the session into a channel opened by a peer, unless the number of channels
+			 * 			has reached the limit, since each of them keeps a TLS context in enclave memory.
+			 *
+			 * \param	maxChannelNum	The maximum number of channels.
+			 *
+			 * \return	True if it's a channel.
+			 */
+			bool TryMakeChannel(size_t maxChannelNum);
+
+			/** \brief	True if it's a channel opened by a peer; otherwise, it's a session of an app. */
+			bool IsChannel() const
+			{
+				return m_isChannel;
+			}
+
+			Net::EnclaveCntTranslator m_cnt;
+
+			/** \brief	The TLS session over m_cnt; it's declared after m_cnt, so it's destroyed first. */
+			std::unique_ptr<Net::TlsCommLayer> m_tls;
+
+		private:
+			bool m_isChannel;
+		};
+	}
+}
@@ -3,13 +3,17 @@
 #include "../ConnectionManager.h"
 
 #include <DecentApi/Common/make_unique.h>
+#include <DecentApi/Common/SGX/ErrorCode.h>
+#include <DecentApi/Common/RuntimeException.h>
 #include <DecentApi/CommonEnclave/Net/EnclaveConnectionOwner.h>
 
 #include <sgx_edger8r.h>
 
 extern "C" sgx_status_t ocall_decent_dht_cnt_mgr_get_dht(void** out_cnt_ptr, uint64_t address);
 extern "C" sgx_status_t ocall_decent_dht_cnt_mgr_get_store(void** out_cnt_ptr, uint64_t address);
+extern "C" sgx_status_t ocall_decent_dht_release_held_cnt(void* connection, int result);
 
+using namespace Decent;
 using namespace Decent::Dht;
 using namespace Decent::Net;
 
@@ -23,4 +27,13 @@ std::unique_ptr<ConnectionBase> Decent::Dht::ConnectionManager::GetConnection2De
 	return Tools::make_unique<EnclaveConnectionOwner>(EnclaveConnectionOwner::CntBuilder(SGX_SUCCESS, &ocall_decent_dht_cnt_mgr_get_store, address));
 }
 
+void ConnectionManager::ReleaseHeldConnection(void* cntPtr, int result)
+{
+	sgx_status_t sgxRet = ocall_decent_dht_release_held_cnt(cntPtr, result);
+	if (sgxRet != SGX_SUCCESS)
+	{
+		throw RuntimeException(Sgx::ConstructSimpleErrorMsg(sgxRet, "ocall_decent_dht_release_held_cnt"));
+	}
+}
+
 #endif //ENCLAVE_PLATFORM_SGX
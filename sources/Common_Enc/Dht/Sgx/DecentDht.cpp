@@ -3,6 +3,7 @@
 #include "../DhtServer.h"
 
 #include <DecentApi/Common/Common.h>
+#include <DecentApi/Common/make_unique.h>
 #include <DecentApi/Common/Net/TlsCommLayer.h>
 #include <DecentApi/Common/Ra/TlsConfigAnyWhiteListed.h>
 #include <DecentApi/Common/MbedTls/SessionTicketMgr.h>
@@ -10,9 +11,14 @@
 #include <DecentApi/CommonEnclave/Net/EnclaveCntTranslator.h>
 #include <DecentApi/CommonEnclave/Ra/TlsConfigSameEnclave.h>
 
+#include <DecentApi/DecentAppEnclave/AppCertContainer.h>
+
 #include "../../../Common/Dht/FuncNums.h"
+#include "../../../Common/Dht/ProcResult.h"
 
 #include "../DhtStatesSingleton.h"
+#include "../ServerSession.h"
+#include "../TlsConfigCache.h"
 
 using namespace Decent;
 using namespace Decent::Dht;
@@ -34,6 +40,52 @@ namespace
 		static const std::shared_ptr<SessionTicketMgr> inst = std::make_shared<SessionTicketMgr>();
 		return inst;
 	}
+
+	TlsConfigCache<Ra::TlsConfigSameEnclave>& GetDhtTlsCfgCache()
+	{
+		static TlsConfigCache<Ra::TlsConfigSameEnclave> inst([]()
+		{
+			return std::make_shared<Ra::TlsConfigSameEnclave>(gs_state, Ra::TlsConfig::Mode::ServerVerifyPeer, GetDhtSessionTicketMgr());
+		});
+		return inst;
+	}
+
+	TlsConfigCache<Ra::TlsConfigAnyWhiteListed>& GetAppTlsCfgCache()
+	{
+		static TlsConfigCache<Ra::TlsConfigAnyWhiteListed> inst([]()
+		{
+			return std::make_shared<Ra::TlsConfigAnyWhiteListed>(gs_state, Ra::TlsConfig::Mode::ServerVerifyPeer, GetAppSessionTicketMgr());
+		});
+		return inst;
+	}
+
+	TlsSetupStats gs_dhtTlsSetupStats("DHT");
+	TlsSetupStats gs_storeTlsSetupStats("store");
+	TlsSetupStats gs_appTlsSetupStats("app");
+}
+
+extern "C" void ecall_decent_dht_set_one_hop_routing(int is_enabled)
+{
+	SetOneHopRouting(is_enabled != 0);
+}
+
+extern "C" int ecall_decent_dht_set_store_config(size_t paged_value_max_size, size_t value_cache_budget, int is_index_untrusted)
+{
+	try
+	{
+		SetStoreConfig(paged_value_max_size, value_cache_budget, is_index_untrusted != 0);
+		return true;
+	}
+	catch (const std::exception& e)
+	{
+		PRINT_I("Failed to configure the DHT store. Error msg: %s", e.what());
+		return false;
+	}
+}
+
+extern "C" void ecall_decent_dht_set_session_budget(size_t max_session_num)
+{
+	SetSessionBudget(max_session_num);
 }
 
 extern "C" int ecall_decent_dht_init(uint64_t self_addr, int is_first_node, uint64_t ex_addr, size_t totalNode, size_t idx)
@@ -62,32 +114,33 @@ extern "C" void ecall_decent_dht_deinit()
 	}
 }
 
-extern "C" int ecall_decent_dht_proc_msg_from_dht(void* connection, void** prev_held_cnt)
+extern "C" int ecall_decent_dht_proc_msg_from_dht(void* connection)
 {
 	if (!gs_state.GetDhtNode())
 	{
 		LOGW("Local DHT Node had not been initialized yet!");
-		return false;
+		return ProcResult::k_close;
 	}
 
-	*prev_held_cnt = nullptr;
-	EnclaveCntTranslator cnt(connection);
-
 	//LOGI("Processing message from DHT node...");
 
 	try
 	{
-		std::shared_ptr<Ra::TlsConfigSameEnclave> tlsCfg = std::make_shared<Ra::TlsConfigSameEnclave>(gs_state, Ra::TlsConfig::Mode::ServerVerifyPeer, GetDhtSessionTicketMgr());
-		Decent::Net::TlsCommLayer tls(cnt, tlsCfg, true, nullptr);
+		std::unique_ptr<ServerSession> session = Tools::make_unique<ServerSession>(connection);
+		ReclaimSessionBudget();
+
+		TlsSetupStats::Timer setupTimer(gs_dhtTlsSetupStats);
+		std::shared_ptr<Ra::TlsConfigSameEnclave> tlsCfg = GetDhtTlsCfgCache().Get(gs_state.GetAppCertContainer().GetCert());
+		session->m_tls = Tools::make_unique<Decent::Net::TlsCommLayer>(session->m_cnt, tlsCfg, true, nullptr);
+		setupTimer.Stop();
 
-		ProcessDhtQuery(tls, *prev_held_cnt);
+		return ProcessDhtQuery(session);
 	}
 	catch (const std::exception& e)
 	{
 		PRINT_W("Failed to process message from DHT node. Error msg: %s", e.what());
+		return ProcResult::k_close;
 	}
-
-	return false;
 }
 
 extern "C" int ecall_decent_dht_proc_msg_from_store(void* connection)
@@ -106,8 +159,10 @@ extern "C" int ecall_decent_dht_proc_msg_from_store(void* connection)
 
 	try
 	{
-		std::shared_ptr<Ra::TlsConfigSameEnclave> tlsCfg = std::make_shared<Ra::TlsConfigSameEnclave>(gs_state, Ra::TlsConfig::Mode::ServerVerifyPeer, GetDhtSessionTicketMgr());
+		TlsSetupStats::Timer setupTimer(gs_storeTlsSetupStats);
+		std::shared_ptr<Ra::TlsConfigSameEnclave> tlsCfg = GetDhtTlsCfgCache().Get(gs_state.GetAppCertContainer().GetCert());
 		Decent::Net::TlsCommLayer tls(cnt, tlsCfg, true, nullptr);
+		setupTimer.Stop();
 
 		ProcessStoreRequest(tls);
 	}
@@ -124,27 +179,56 @@ extern "C" int ecall_decent_dht_proc_msg_from_app(void* connection)
 	if (!gs_state.GetDhtNode())
 	{
 		LOGW("Local DHT Node had not been initialized yet!");
-		return false;
+		return ProcResult::k_close;
 	}
 
-	EnclaveCntTranslator cnt(connection);
-
-	using namespace EncFunc::App;
-
 	LOGI("Processing message from App...");
 
 	try
 	{
-		std::shared_ptr<Ra::TlsConfigAnyWhiteListed> tlsCfg = std::make_shared<Ra::TlsConfigAnyWhiteListed>(gs_state, Ra::TlsConfig::Mode::ServerVerifyPeer, GetAppSessionTicketMgr());
-		Decent::Net::TlsCommLayer tls(cnt, tlsCfg, true, nullptr);
+		std::unique_ptr<ServerSession> session = Tools::make_unique<ServerSession>(connection);
+		ReclaimSessionBudget();
+
+		TlsSetupStats::Timer setupTimer(gs_appTlsSetupStats);
+		std::shared_ptr<Ra::TlsConfigAnyWhiteListed> tlsCfg = GetAppTlsCfgCache().Get(gs_state.GetAppCertContainer().GetCert());
+		session->m_tls = Tools::make_unique<Decent::Net::TlsCommLayer>(session->m_cnt, tlsCfg, true, nullptr);
+		setupTimer.Stop();
 
-		return ProcessAppRequest(tls, cnt);
+		return ProcessAppRequest(session);
 	}
 	catch (const std::exception& e)
 	{
 		PRINT_W("Failed to process message from App. Error msg: %s", e.what());
-		return false;
+		return ProcResult::k_close;
+	}
+}
+
+extern "C" int ecall_decent_dht_proc_session_msg(void* connection)
+{
+	try
+	{
+		return ProcessSessionMsg(connection);
+	}
+	catch (const std::exception& e)
+	{
+		PRINT_W("Failed to process message of the session. Error msg: %s", e.what());
+		return ProcResult::k_close;
+	}
+}
+
+extern "C" void ecall_decent_dht_close_session(void* connection)
+{
+	try
+	{
+		CloseSession(connection);
 	}
+	catch (const std::exception&)
+	{}
+}
+
+extern "C" void ecall_decent_dht_set_forward_batching(size_t flush_size, uint64_t window_ms)
+{
+	SetForwardBatching(flush_size, window_ms);
 }
 
 extern "C" int ecall_decent_dht_forward_queue_worker()
@@ -179,6 +263,38 @@ extern "C" int ecall_decent_dht_reply_queue_worker()
 	}
 }
 
+extern "C" int ecall_decent_dht_pending_query_timer()
+{
+	while (true)
+	{
+		try
+		{
+			PendingQueryTimer();
+			return true;
+		}
+		catch (const std::exception& e)
+		{
+			PRINT_I("Pending query timer failed. Error Msg: %s", e.what());
+		}
+	}
+}
+
+extern "C" int ecall_decent_dht_task_worker()
+{
+	while (true)
+	{
+		try
+		{
+			TaskWorker();
+			return true;
+		}
+		catch (const std::exception& e)
+		{
+			PRINT_I("Task worker failed. Error Msg: %s", e.what());
+		}
+	}
+}
+
 extern "C" void ecall_decent_dht_terminate_workers()
 {
 	try
@@ -2,14 +2,23 @@
 
 #include "../EnclaveStore.h"
 
+#include <cstring>
+
+#include <sgx_trts.h>
+
 #include <DecentApi/Common/Common.h>
+#include <DecentApi/Common/make_unique.h>
 #include <DecentApi/Common/SGX/ErrorCode.h>
 #include <DecentApi/CommonEnclave/Tools/UntrustedBuffer.h>
-#include <DecentApi/CommonEnclave/Tools/DataSealer.h>
 
 #include "../../../Common/Dht/LocalNode.h"
+#include "../../../Common/Dht/MemKeyValueStore.h"
+#include "../../../Common/Dht/UntrustedBufferPool.h"
 
 #include "../DhtStatesSingleton.h"
+#include "../MemStoreRingClient.h"
+#include "../PagedValueStore.h"
+#include "../AuthIndex.h"
 
 #include "edl_decent_dht_mem_store.h"
 
@@ -23,12 +32,6 @@ namespace
 
 	DhtStates& gs_state = GetDhtStatesSingleton();
 
-	const std::vector<uint8_t>& GetSealKeyMetaData()
-	{
-		static std::vector<uint8_t> inst = DataSealer::GenSealKeyRecoverMeta();
-		return inst;
-	}
-
 	void* InitializeMemStore()
 	{
 		void* res = nullptr;
@@ -45,35 +48,130 @@ namespace
 
 		return res;
 	}
+
+	UntrustedBufferPool* GetUntrustedBufferPool()
+	{
+		static UntrustedBufferPool* inst = []() -> UntrustedBufferPool*
+		{
+			void* res = nullptr;
+			sgx_status_t sgxRet = ocall_decent_dht_mem_store_get_buf_pool(&res);
+			if (sgxRet != SGX_SUCCESS || res == nullptr || sgx_is_outside_enclave(res, sizeof(UntrustedBufferPool)) != 1)
+			{
+				return nullptr; //Fall back to separately allocated buffers.
+			}
+			return static_cast<UntrustedBufferPool*>(res);
+		}();
+
+		return inst;
+	}
+
+	/**
+	 * \brief	Copies a buffer returned by the memory store into the enclave, and then releases the
+	 * 			buffer. Pooled buffers are released without an OCall.
+	 *
+	 * \param 	   	ptr 	The pointer to the untrusted buffer.
+	 * \param 	   	size	The size of the buffer.
+	 * \param [out]	dest	The destination.
+	 */
+	void ReadFromUntrusted(uint8_t* ptr, size_t size, std::vector<uint8_t>& dest)
+	{
+		UntrustedBufferPool* pool = GetUntrustedBufferPool();
+		UntrustedBufferPool::Buffer* pooledBuf = pool ? pool->Find(ptr) : nullptr;
+		if (pooledBuf == nullptr)
+		{
+			UntrustedBuffer uBuf(ptr, size);
+			dest = uBuf.Read();
+			return;
+		}
+
+		if (size > UntrustedBufferPool::sk_bufSize)
+		{
+			UntrustedBufferPool::Release(*pooledBuf);
+			throw RuntimeException("The size of pooled untrusted buffer is invalid.");
+		}
+
+		dest.resize(size);
+		if (size > 0)
+		{
+			std::memcpy(dest.data(), pooledBuf->m_data, size);
+		}
+		UntrustedBufferPool::Release(*pooledBuf);
+	}
+
+	void* InitializeMemStoreRing(void* memStore, void*& ringPtr)
+	{
+		void* res = nullptr;
+		sgx_status_t sgxRet = ocall_decent_dht_mem_store_ring_init(&res, memStore, &ringPtr);
+
+		if (sgxRet != SGX_SUCCESS)
+		{
+			throw RuntimeException(Sgx::ConstructSimpleErrorMsg(sgxRet, "ocall_decent_dht_mem_store_ring_init"));
+		}
+
+		return res; //Null if the ring is disabled by the untrusted side.
+	}
 }
 
 EnclaveStore::EnclaveStore(const MbedTlsObj::BigNumber & ringStart, const MbedTlsObj::BigNumber & ringEnd) :
 	StoreBase(ringStart, ringEnd),
-	m_memStore(InitializeMemStore())
+	m_memStore(InitializeMemStore()),
+	m_sealer(gsk_sealKeyLabel),
+	m_pagedValueMaxSize(0),
+	m_pagedStore(),
+	m_authIndex(),
+	m_ringInitFlag(),
+	m_ringServer(nullptr),
+	m_ringClient()
 {}
 
 EnclaveStore::~EnclaveStore()
 {
+	m_ringClient.reset();
+	if (m_ringServer)
+	{
+		ocall_decent_dht_mem_store_ring_deinit(m_ringServer);
+	}
 	ocall_decent_dht_mem_store_deinit(m_memStore);
 }
 
+void EnclaveStore::InitMemStoreRing()
+{
+	void* ringPtr = nullptr;
+	m_ringServer = InitializeMemStoreRing(m_memStore, ringPtr);
+	m_ringClient = Tools::make_unique<MemStoreRingClient>(m_ringServer ? static_cast<MemStoreRing*>(ringPtr) : nullptr);
+}
+
 bool EnclaveStore::IsResponsibleFor(const MbedTlsObj::BigNumber & key) const
 {
 	DhtStates::DhtLocalNodePtrType localNode = gs_state.GetDhtNode();
 	return localNode ? localNode->IsResponsibleFor(key) : false;
 }
 
-std::vector<uint8_t> EnclaveStore::SaveDataFile(const MbedTlsObj::BigNumber& key, const std::vector<uint8_t>& data)
+EnclaveStore::TagType EnclaveStore::SaveDataFile(const MbedTlsObj::BigNumber& key, const std::vector<uint8_t>& data)
 {
 	using namespace Decent::Tools;
 
-	const std::string keyStr = key.ToBigEndianHexStr();
+	if (GetRingClient().IsEnabled())
+	{
+		std::pair<bool, TagType> res = SaveDataFiles({ std::make_pair(key, data) }).front();
+		if (!res.first)
+		{
+			throw RuntimeException("Failed to save data to the memory store.");
+		}
+		return res.second;
+	}
+
+	const std::string keyStr = GetKeyStr(key);
 	LOGI("DHT store: adding key to the index. %s", keyStr.c_str());
 	//LOGI("DHT store: writing value: %s", std::string(reinterpret_cast<const char*>(data.data()), data.size()).c_str());
+
+	if (TrySavePagedValue(GetKeyBin(key), data))
+	{
+		return TagType(); //Paged values are located by the page index, instead of tags.
+	}
 	
-	std::vector<uint8_t> meta;
-	std::vector<uint8_t> mac;
-	std::vector<uint8_t> sealedData = DataSealer::SealData(DataSealer::KeyPolicy::ByMrEnclave, gs_state, gsk_sealKeyLabel, mac, meta, data);
+	TagType mac;
+	std::vector<uint8_t> sealedData = SealValue(keyStr, data, mac);
 	
 	{
 		int memStoreRet = true;
@@ -93,7 +191,17 @@ std::vector<uint8_t> EnclaveStore::SaveDataFile(const MbedTlsObj::BigNumber& key
 
 void EnclaveStore::DeleteDataFile(const MbedTlsObj::BigNumber& key)
 {
-	const std::string keyStr = key.ToBigEndianHexStr();
+	if (GetRingClient().IsEnabled())
+	{
+		return DeleteDataFiles({ key });
+	}
+
+	const std::string keyStr = GetKeyStr(key);
+
+	if (m_pagedStore && m_pagedStore->Remove(GetKeyBin(key)))
+	{
+		return;
+	}
 
 	{
 		int memStoreRet = true;
@@ -109,13 +217,23 @@ void EnclaveStore::DeleteDataFile(const MbedTlsObj::BigNumber& key)
 	}
 }
 
-std::vector<uint8_t> EnclaveStore::ReadDataFile(const MbedTlsObj::BigNumber& key, const std::vector<uint8_t>& tag)
+std::vector<uint8_t> EnclaveStore::ReadDataFile(const MbedTlsObj::BigNumber& key, const TagType& tag)
 {
 	using namespace Decent::Tools;
+
+	if (GetRingClient().IsEnabled())
+	{
+		return ReadDataFiles({ std::make_pair(key, tag) }).front();
+	}
 	
 	std::vector<uint8_t> sealedData;
 
-	const std::string keyStr = key.ToBigEndianHexStr();
+	if (IsPagedTag(tag))
+	{
+		return m_pagedStore->Get(GetKeyBin(key));
+	}
+
+	const std::string keyStr = GetKeyStr(key);
 
 	{
 		uint8_t* valPtr = nullptr;
@@ -130,25 +248,24 @@ std::vector<uint8_t> EnclaveStore::ReadDataFile(const MbedTlsObj::BigNumber& key
 			throw RuntimeException("OCall ocall_decent_dht_mem_store_read failed.");
 		}
 
-		UntrustedBuffer uBuf(valPtr, valSize);
-
-		sealedData = uBuf.Read();
+		ReadFromUntrusted(valPtr, valSize, sealedData);
 	}
 
-	std::vector<uint8_t> meta;
-	std::vector<uint8_t> data;
-	DataSealer::UnsealData(DataSealer::KeyPolicy::ByMrEnclave, gs_state, gsk_sealKeyLabel, sealedData, tag, meta, data);
-
-	return data;
+	return UnsealValue(keyStr, sealedData.data(), sealedData.size(), tag);
 }
 
-std::vector<uint8_t> EnclaveStore::MigrateOneDataFile(const MbedTlsObj::BigNumber& key, const std::vector<uint8_t>& tag)
+std::vector<uint8_t> EnclaveStore::MigrateOneDataFile(const MbedTlsObj::BigNumber& key, const TagType& tag)
 {
 	using namespace Decent::Tools;
 
 	std::vector<uint8_t> sealedData;
 
-	const std::string keyStr = key.ToBigEndianHexStr();
+	if (IsPagedTag(tag))
+	{
+		return m_pagedStore->Migrate(GetKeyBin(key));
+	}
+
+	const std::string keyStr = GetKeyStr(key);
 
 	{
 		uint8_t* valPtr = nullptr;
@@ -163,16 +280,102 @@ std::vector<uint8_t> EnclaveStore::MigrateOneDataFile(const MbedTlsObj::BigNumbe
 			throw RuntimeException("OCall ocall_decent_dht_mem_store_migrate_one failed.");
 		}
 
-		UntrustedBuffer uBuf(valPtr, valSize);
+		ReadFromUntrusted(valPtr, valSize, sealedData);
+	}
+
+	return UnsealValue(keyStr, sealedData.data(), sealedData.size(), tag);
+}
+
+void EnclaveStore::MigrateRangeDataFile(const MbedTlsObj::BigNumber & start, const MbedTlsObj::BigNumber & end, const IndexingType & indexing, const MigrateCallbackType & callback)
+{
+	using namespace Decent::Tools;
+
+	const std::string startStr = GetKeyStr(start);
+	const std::string endStr = GetKeyStr(end);
+
+	MigrateIndexCursor cursor(indexing, m_pagedStore.get(), callback);
+
+	size_t pairCount = 0;
+	do
+	{
+		std::vector<uint8_t> packedPairs;
+		{
+			int memStoreRet = false;
+			uint8_t* bufPtr = nullptr;
+			size_t bufSize = 0;
+			sgx_status_t sgxRet = ocall_decent_dht_mem_store_migrate_range(&memStoreRet, m_memStore, startStr.c_str(), endStr.c_str(), sk_migrateBatchSize, &bufPtr, &bufSize, &pairCount);
+			if (sgxRet != SGX_SUCCESS)
+			{
+				throw RuntimeException(Sgx::ConstructSimpleErrorMsg(sgxRet, "ocall_decent_dht_mem_store_migrate_range"));
+			}
+			if (!memStoreRet)
+			{
+				throw RuntimeException("OCall ocall_decent_dht_mem_store_migrate_range failed.");
+			}
+			if (bufPtr == nullptr)
+			{
+				break; //No more data in the range.
+			}
+
+			ReadFromUntrusted(bufPtr, bufSize, packedPairs);
+		}
+
+		//Values are unsealed straight from the packed buffer, instead of being unpacked first.
+		MemKeyValueStore::VisitPairs(packedPairs.data(), packedPairs.size(),
+			[this, &cursor, &callback](const std::string& keyStr, const uint8_t* val, size_t valSize)
+		{
+			const IndexingType::value_type* indexItem = cursor.Find(keyStr);
+			if (!indexItem)
+			{
+				return;
+			}
+
+			std::vector<uint8_t> data;
+			try
+			{
+				data = UnsealValue(keyStr, val, valSize, indexItem->second);
+			}
+			catch (const std::exception&)
+			{
+				return;
+			}
+
+			callback(indexItem->first, data);
+		});
+	} while (pairCount >= sk_migrateBatchSize);
+
+	cursor.Finish();
+}
+
+std::vector<std::pair<bool, std::vector<uint8_t> > > EnclaveStore::ProcessMemStoreBatch(const std::vector<uint8_t>& batch, size_t opCount)
+{
+	using namespace Decent::Tools;
 
-		sealedData = uBuf.Read();
+	std::vector<std::pair<bool, std::vector<uint8_t> > > results;
+	if (opCount == 0 || TryProcessMemStoreBatchExitless(batch, opCount, results))
+	{
+		return results;
 	}
 
-	std::vector<uint8_t> meta;
-	std::vector<uint8_t> data;
-	DataSealer::UnsealData(DataSealer::KeyPolicy::ByMrEnclave, gs_state, gsk_sealKeyLabel, sealedData, tag, meta, data);
+	std::vector<uint8_t> packedResults;
+	{
+		int memStoreRet = false;
+		uint8_t* resPtr = nullptr;
+		size_t resSize = 0;
+		sgx_status_t sgxRet = ocall_decent_dht_mem_store_batch(&memStoreRet, m_memStore, batch.data(), batch.size(), &resPtr, &resSize);
+		if (sgxRet != SGX_SUCCESS)
+		{
+			throw RuntimeException(Sgx::ConstructSimpleErrorMsg(sgxRet, "ocall_decent_dht_mem_store_batch"));
+		}
+		if (!memStoreRet || resPtr == nullptr)
+		{
+			throw RuntimeException("OCall ocall_decent_dht_mem_store_batch failed.");
+		}
+
+		ReadFromUntrusted(resPtr, resSize, packedResults);
+	}
 
-	return data;
+	return MemKeyValueStore::UnpackBatchResults(packedResults.data(), packedResults.size(), opCount);
 }
 
 #endif //ENCLAVE_PLATFORM_SGX
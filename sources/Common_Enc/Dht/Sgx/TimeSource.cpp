@@ -0,0 +1,50 @@
+#ifdef ENCLAVE_PLATFORM_SGX
+
+#include "../TimeSource.h"
+
+#include <DecentApi/Common/SGX/ErrorCode.h>
+#include <DecentApi/Common/RuntimeException.h>
+
+#include <sgx_edger8r.h>
+
+extern "C" sgx_status_t ocall_decent_dht_get_steady_time_ms(uint64_t* retval);
+extern "C" sgx_status_t ocall_decent_dht_get_steady_time_us(uint64_t* retval);
+extern "C" sgx_status_t ocall_decent_dht_sleep_ms(uint64_t ms);
+
+using namespace Decent;
+using namespace Decent::Dht;
+
+uint64_t TimeSource::GetSteadyTimeMs()
+{
+	uint64_t res = 0;
+	sgx_status_t sgxRet = ocall_decent_dht_get_steady_time_ms(&res);
+	if (sgxRet != SGX_SUCCESS)
+	{
+		throw RuntimeException(Sgx::ConstructSimpleErrorMsg(sgxRet, "ocall_decent_dht_get_steady_time_ms"));
+	}
+
+	return res;
+}
+
+uint64_t TimeSource::GetSteadyTimeUs()
+{
+	uint64_t res = 0;
+	sgx_status_t sgxRet = ocall_decent_dht_get_steady_time_us(&res);
+	if (sgxRet != SGX_SUCCESS)
+	{
+		throw RuntimeException(Sgx::ConstructSimpleErrorMsg(sgxRet, "ocall_decent_dht_get_steady_time_us"));
+	}
+
+	return res;
+}
+
+void TimeSource::SleepMs(uint64_t ms)
+{
+	sgx_status_t sgxRet = ocall_decent_dht_sleep_ms(ms);
+	if (sgxRet != SGX_SUCCESS)
+	{
+		throw RuntimeException(Sgx::ConstructSimpleErrorMsg(sgxRet, "ocall_decent_dht_sleep_ms"));
+	}
+}
+
+#endif //ENCLAVE_PLATFORM_SGX
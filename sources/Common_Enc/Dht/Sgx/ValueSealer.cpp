@@ -0,0 +1,55 @@
+#ifdef ENCLAVE_PLATFORM_SGX
+
+#include "../ValueSealer.h"
+
+#include <cstring>
+
+#include <sgx_trts.h>
+#include <sgx_utils.h>
+
+#include <DecentApi/Common/RuntimeException.h>
+
+using namespace Decent;
+using namespace Decent::Dht;
+
+namespace
+{
+	//Same masks used by the SGX SDK for sealing.
+	constexpr uint64_t gsk_sealFlagsMask = 0xFF0000000000000BULL;
+	constexpr uint32_t gsk_sealMiscMask = 0xF0000000;
+}
+
+void ValueSealer::GetRootKey(KeyType & rootKey)
+{
+	const sgx_report_t* selfReport = sgx_self_report();
+
+	sgx_key_request_t keyReq;
+	std::memset(&keyReq, 0, sizeof(keyReq));
+	keyReq.key_name = SGX_KEYSELECT_SEAL;
+	keyReq.key_policy = SGX_KEYPOLICY_MRENCLAVE;
+	keyReq.isv_svn = selfReport->body.isv_svn;
+	std::memcpy(&keyReq.cpu_svn, &selfReport->body.cpu_svn, sizeof(keyReq.cpu_svn));
+	keyReq.attribute_mask.flags = gsk_sealFlagsMask;
+	keyReq.attribute_mask.xfrm = 0;
+	keyReq.misc_mask = gsk_sealMiscMask;
+
+	//Values are only kept in memory, so a random key ID makes the root key unique to this run.
+	sgx_status_t sgxRet = sgx_read_rand(keyReq.key_id.id, sizeof(keyReq.key_id.id));
+	if (sgxRet != SGX_SUCCESS)
+	{
+		throw RuntimeException("Failed to generate the key ID for the sealing key.");
+	}
+
+	sgx_key_128bit_t key;
+	sgxRet = sgx_get_key(&keyReq, &key);
+	if (sgxRet != SGX_SUCCESS)
+	{
+		throw RuntimeException("Failed to get the sealing key.");
+	}
+
+	static_assert(sizeof(key) == std::tuple_size<KeyType>::value, "The size of SGX key doesn't match the size of root key.");
+	std::memcpy(rootKey.data(), key, rootKey.size());
+	std::memset(key, 0, sizeof(key));
+}
+
+#endif //ENCLAVE_PLATFORM_SGX
@@ -12,10 +12,16 @@ extern "C" {
 
 	sgx_status_t SGX_CDECL ocall_decent_dht_mem_store_init(void** retval);
 	sgx_status_t SGX_CDECL ocall_decent_dht_mem_store_deinit(void* ptr);
+	sgx_status_t SGX_CDECL ocall_decent_dht_mem_store_get_buf_pool(void** retval);
 	sgx_status_t SGX_CDECL ocall_decent_dht_mem_store_save(int* retval, void* obj, const char* key, const uint8_t* val_ptr, size_t val_size);
 	sgx_status_t SGX_CDECL ocall_decent_dht_mem_store_read(uint8_t** retval, void* obj, const char* key, size_t* val_size);
 	sgx_status_t SGX_CDECL ocall_decent_dht_mem_store_dele(int* retval, void* obj, const char* key);
 	sgx_status_t SGX_CDECL ocall_decent_dht_mem_store_migrate_one(uint8_t** retval, void* obj, const char* key, size_t* val_size);
+	sgx_status_t SGX_CDECL ocall_decent_dht_mem_store_migrate_range(int* retval, void* obj, const char* start_key, const char* end_key, size_t max_count, uint8_t** buf_ptr, size_t* buf_size, size_t* pair_count);
+	sgx_status_t SGX_CDECL ocall_decent_dht_mem_store_batch(int* retval, void* obj, const uint8_t* req_ptr, size_t req_size, uint8_t** res_ptr, size_t* res_size);
+	sgx_status_t SGX_CDECL ocall_decent_dht_mem_store_ring_init(void** retval, void* obj, void** ring_ptr);
+	sgx_status_t SGX_CDECL ocall_decent_dht_mem_store_ring_deinit(void* ring_server);
+	sgx_status_t SGX_CDECL ocall_decent_dht_mem_store_ring_wait(void* slot_ptr);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Decent
+{
+	namespace Dht
+	{
+		namespace TimeSource
+		{
+			/**
+			 * \brief	Gets the time of a monotonic clock, in milliseconds. The starting point is
+			 * 			unspecified, so it's only meaningful for measuring intervals.
+			 */
+			uint64_t GetSteadyTimeMs();
+
+			/** \brief	Same as GetSteadyTimeMs(), but in microseconds. */
+			uint64_t GetSteadyTimeUs();
+
+			/** \brief	Blocks the calling thread for the given time, in milliseconds. */
+			void SleepMs(uint64_t ms);
+		}
+	}
+}
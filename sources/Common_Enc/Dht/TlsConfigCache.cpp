@@ -0,0 +1,30 @@
+#include "TlsConfigCache.h"
+
+#include <DecentApi/Common/Common.h>
+
+using namespace Decent::Dht;
+
+constexpr uint64_t TlsSetupStats::sk_printInterval;
+
+TlsSetupStats::TlsSetupStats(const char * name) :
+	m_name(name),
+	m_count(0),
+	m_totalTimeUs(0)
+{
+}
+
+TlsSetupStats::~TlsSetupStats()
+{
+}
+
+void TlsSetupStats::Record(uint64_t timeUs)
+{
+	const uint64_t totalTimeUs = (m_totalTimeUs += timeUs);
+	const uint64_t count = ++m_count;
+
+	if (count % sk_printInterval == 0)
+	{
+		PRINT_I("TLS setup of %s connections: %llu connections, %llu us on average.", m_name,
+			static_cast<unsigned long long>(count), static_cast<unsigned long long>(totalTimeUs / count));
+	}
+}
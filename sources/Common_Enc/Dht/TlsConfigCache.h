@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+
+#include "TimeSource.h"
+
+namespace Decent
+{
+	namespace Dht
+	{
+		/**
+		 * \brief	Keeps a server-side TLS configuration, so that it's built once and shared by incoming
+		 * 			connections, instead of being rebuilt (i.e., the certificate and key parsed and the
+		 * 			mbedTLS configuration set up) for every one of them.
+		 *
+		 * 			The configuration takes the certificate of this enclave when it's built, thus, it's
+		 * 			rebuilt once the certificate is replaced. White lists are not a concern, since they
+		 * 			are looked up from the states at the time a peer is verified.
+		 *
+		 * 			If DECENT_DHT_NO_TLS_CFG_CACHE is defined, a new configuration is built for every call,
+		 * 			which is only meant for measuring the cost of doing so.
+		 *
+		 * \tparam	CfgType	Type of the TLS configuration.
+		 */
+		template<typename CfgType>
+		class TlsConfigCache
+		{
+		public:
+			typedef std::function<std::shared_ptr<CfgType>()> BuildFuncType;
+
+		public:
+			TlsConfigCache() = delete;
+
+			/**
+			 * \brief	Constructor
+			 *
+			 * \param	buildFunc	The function that builds a new configuration.
+			 */
+			TlsConfigCache(BuildFuncType buildFunc) :
+				m_buildFunc(buildFunc),
+				m_mutex(),
+				m_cfg(),
+				m_cert()
+			{}
+
+			/** \brief	Destructor */
+			virtual ~TlsConfigCache()
+			{}
+
+			/**
+			 * \brief	Gets the configuration, which is built if there is none, or if it's built with a
+			 * 			different certificate.
+			 *
+			 * \param	cert	The current certificate of this enclave.
+			 *
+			 * \return	The configuration.
+			 */
+			std::shared_ptr<CfgType> Get(std::shared_ptr<const void> cert)
+			{
+#ifdef DECENT_DHT_NO_TLS_CFG_CACHE
+				return m_buildFunc();
+#else
+				std::unique_lock<std::mutex> cacheLock(m_mutex);
+				if (!m_cfg || m_cert != cert)
+				{
+					m_cfg = m_buildFunc();
+					m_cert = cert;
+				}
+				return m_cfg;
+#endif //DECENT_DHT_NO_TLS_CFG_CACHE
+			}
+
+		private:
+			BuildFuncType m_buildFunc;
+
+			std::mutex m_mutex;
+			std::shared_ptr<CfgType> m_cfg;
+			std::shared_ptr<const void> m_cert;
+		};
+
+		/**
+		 * \brief	Statistics of the time spent on setting up TLS for incoming connections, i.e., getting
+		 * 			the configuration and the handshake. The average is printed every sk_printInterval
+		 * 			connections. Nothing is measured unless DECENT_DHT_TLS_SETUP_STATS is defined.
+		 */
+		class TlsSetupStats
+		{
+		public: //static members:
+			static constexpr uint64_t sk_printInterval = 1000;
+
+			/** \brief	Measures the time from its construction to the call to Stop(). */
+			class Timer
+			{
+			public:
+				Timer() = delete;
+
+#ifdef DECENT_DHT_TLS_SETUP_STATS
+				Timer(TlsSetupStats& stats) :
+					m_stats(stats),
+					m_startTime(TimeSource::GetSteadyTimeUs())
+				{}
+
+				void Stop()
+				{
+					m_stats.Record(TimeSource::GetSteadyTimeUs() - m_startTime);
+				}
+
+			private:
+				TlsSetupStats& m_stats;
+				uint64_t m_startTime;
+#else
+				Timer(TlsSetupStats&)
+				{}
+
+				void Stop()
+				{}
+#endif //DECENT_DHT_TLS_SETUP_STATS
+			};
+
+		public:
+			TlsSetupStats() = delete;
+
+			/**
+			 * \brief	Constructor
+			 *
+			 * \param	name	The name of the kind of connections, used in the printed message.
+			 */
+			TlsSetupStats(const char* name);
+
+			/** \brief	Destructor */
+			virtual ~TlsSetupStats();
+
+			/**
+			 * \brief	Records the time spent on setting up one connection.
+			 *
+			 * \param	timeUs	The time, in microseconds.
+			 */
+			void Record(uint64_t timeUs);
+
+		private:
+			const char* m_name;
+			std::atomic<uint64_t> m_count;
+			std::atomic<uint64_t> m_totalTimeUs;
+		};
+	}
+}
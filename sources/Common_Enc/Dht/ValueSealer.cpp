@@ -0,0 +1,205 @@
+#include "ValueSealer.h"
+
+#include <cstring>
+#include <iterator>
+
+#include <mbedtls/gcm.h>
+#include <mbedtls/md.h>
+
+#include <DecentApi/Common/make_unique.h>
+#include <DecentApi/Common/RuntimeException.h>
+
+using namespace Decent;
+using namespace Decent::Dht;
+
+struct ValueSealer::Context
+{
+	mbedtls_gcm_context m_gcm;
+	uint32_t m_epoch;
+	bool m_hasKey;
+
+	Context() :
+		m_epoch(0),
+		m_hasKey(false)
+	{
+		mbedtls_gcm_init(&m_gcm);
+	}
+
+	~Context()
+	{
+		mbedtls_gcm_free(&m_gcm);
+	}
+};
+
+constexpr size_t ValueSealer::sk_tagSize;
+constexpr size_t ValueSealer::sk_ivSize;
+constexpr size_t ValueSealer::sk_headerSize;
+constexpr uint64_t ValueSealer::sk_sealPerEpoch;
+
+size_t ValueSealer::GetUnsealedSize(size_t sealedSize)
+{
+	if (sealedSize < sk_headerSize)
+	{
+		throw RuntimeException("The sealed value is too small.");
+	}
+	return sealedSize - sk_headerSize;
+}
+
+ValueSealer::ValueSealer(const std::string & label) :
+	m_label(label),
+	m_rootKey(),
+	m_sealCount(0),
+	m_epochKeysMutex(),
+	m_epochKeys(),
+	m_ctxPoolMutex(),
+	m_ctxPool()
+{
+	GetRootKey(m_rootKey);
+}
+
+ValueSealer::~ValueSealer()
+{
+	std::memset(m_rootKey.data(), 0, m_rootKey.size());
+}
+
+void ValueSealer::Seal(const void * aad, size_t aadSize, const uint8_t * data, size_t dataSize, uint8_t * sealed, size_t sealedSize, uint8_t * tag, size_t tagSize)
+{
+	if (sealedSize != GetSealedSize(dataSize) || tagSize != sk_tagSize)
+	{
+		throw RuntimeException("Invalid buffer size is given to seal the value.");
+	}
+
+	//Each value gets a distinct counter, so that IVs are never reused under the same key.
+	const uint64_t count = m_sealCount++;
+	const uint32_t epoch = static_cast<uint32_t>(count / sk_sealPerEpoch);
+
+	uint8_t* iv = sealed + sizeof(epoch);
+	std::memcpy(sealed, &epoch, sizeof(epoch));
+	std::memcpy(iv, &count, sizeof(count));
+	std::memset(iv + sizeof(count), 0, sk_ivSize - sizeof(count));
+
+	ContextHolder ctx(*this, epoch);
+	int mbedRet = mbedtls_gcm_crypt_and_tag(&ctx.Get().m_gcm, MBEDTLS_GCM_ENCRYPT, dataSize,
+		iv, sk_ivSize, static_cast<const uint8_t*>(aad), aadSize,
+		data, sealed + sk_headerSize, tagSize, tag);
+	if (mbedRet != 0)
+	{
+		throw RuntimeException("Failed to seal the value.");
+	}
+}
+
+void ValueSealer::Unseal(const void * aad, size_t aadSize, const uint8_t * sealed, size_t sealedSize, const uint8_t * tag, size_t tagSize, uint8_t * data, size_t dataSize)
+{
+	if (dataSize != GetUnsealedSize(sealedSize) || tagSize != sk_tagSize)
+	{
+		throw RuntimeException("Invalid buffer size is given to unseal the value.");
+	}
+
+	uint32_t epoch = 0;
+	std::memcpy(&epoch, sealed, sizeof(epoch));
+	//Epochs that haven't been reached are rejected, so that untrusted values can't make us derive keys.
+	if (epoch > m_sealCount.load() / sk_sealPerEpoch)
+	{
+		throw RuntimeException("The sealed value has an invalid key epoch.");
+	}
+
+	ContextHolder ctx(*this, epoch);
+	int mbedRet = mbedtls_gcm_auth_decrypt(&ctx.Get().m_gcm, dataSize,
+		sealed + sizeof(epoch), sk_ivSize, static_cast<const uint8_t*>(aad), aadSize,
+		tag, tagSize, sealed + sk_headerSize, data);
+	if (mbedRet != 0)
+	{
+		throw RuntimeException("Failed to unseal the value.");
+	}
+}
+
+const ValueSealer::KeyType & ValueSealer::GetEpochKey(uint32_t epoch)
+{
+	std::unique_lock<std::mutex> epochKeysLock(m_epochKeysMutex);
+	if (epoch >= m_epochKeys.size())
+	{
+		m_epochKeys.resize(static_cast<size_t>(epoch) + 1);
+	}
+
+	std::unique_ptr<KeyType>& key = m_epochKeys[epoch];
+	if (!key)
+	{
+		//Epoch key = HMAC-SHA256(root key, label | epoch), truncated to the key size.
+		std::vector<uint8_t> info(m_label.begin(), m_label.end());
+		const uint8_t* epochPtr = reinterpret_cast<const uint8_t*>(&epoch);
+		info.insert(info.end(), epochPtr, epochPtr + sizeof(epoch));
+
+		std::array<uint8_t, 32> hmac;
+		int mbedRet = mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
+			m_rootKey.data(), m_rootKey.size(), info.data(), info.size(), hmac.data());
+		if (mbedRet != 0)
+		{
+			throw RuntimeException("Failed to derive the sealing key.");
+		}
+
+		key = Tools::make_unique<KeyType>();
+		std::memcpy(key->data(), hmac.data(), key->size());
+		std::memset(hmac.data(), 0, hmac.size());
+	}
+
+	return *key;
+}
+
+std::unique_ptr<ValueSealer::Context> ValueSealer::AcquireContext(uint32_t epoch)
+{
+	std::unique_ptr<Context> ctx;
+	{
+		std::unique_lock<std::mutex> ctxPoolLock(m_ctxPoolMutex);
+		//Prefer a context that already has the key of this epoch.
+		for (auto it = m_ctxPool.rbegin(); it != m_ctxPool.rend(); ++it)
+		{
+			if ((*it)->m_hasKey && (*it)->m_epoch == epoch)
+			{
+				ctx = std::move(*it);
+				m_ctxPool.erase(std::next(it).base());
+				break;
+			}
+		}
+		if (!ctx && m_ctxPool.size() > 0)
+		{
+			ctx = std::move(m_ctxPool.back());
+			m_ctxPool.pop_back();
+		}
+	}
+
+	if (!ctx)
+	{
+		ctx = Tools::make_unique<Context>();
+	}
+
+	if (!ctx->m_hasKey || ctx->m_epoch != epoch)
+	{
+		const KeyType& key = GetEpochKey(epoch);
+		ctx->m_hasKey = false;
+		if (mbedtls_gcm_setkey(&ctx->m_gcm, MBEDTLS_CIPHER_ID_AES, key.data(), static_cast<unsigned int>(key.size() * 8)) != 0)
+		{
+			throw RuntimeException("Failed to set the sealing key.");
+		}
+		ctx->m_epoch = epoch;
+		ctx->m_hasKey = true;
+	}
+
+	return ctx;
+}
+
+void ValueSealer::ReleaseContext(std::unique_ptr<Context> ctx)
+{
+	std::unique_lock<std::mutex> ctxPoolLock(m_ctxPoolMutex);
+	m_ctxPool.push_back(std::move(ctx));
+}
+
+ValueSealer::ContextHolder::ContextHolder(ValueSealer & sealer, uint32_t epoch) :
+	m_sealer(sealer),
+	m_ctx(sealer.AcquireContext(epoch))
+{
+}
+
+ValueSealer::ContextHolder::~ContextHolder()
+{
+	m_sealer.ReleaseContext(std::move(m_ctx));
+}
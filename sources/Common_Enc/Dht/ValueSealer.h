@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Decent
+{
+	namespace Dht
+	{
+		/**
+		 * \brief	Seals values stored outside of the enclave with AES-GCM. The sealing key is derived once
+		 * 			per key epoch from a root key, instead of once per value, and the initialized AEAD
+		 * 			contexts are kept in a pool and reused by later calls. Results are written into
+		 * 			buffers provided by the caller.
+		 *
+		 * 			Sealed value layout: epoch (4 bytes) | IV (12 bytes) | cipher text. The tag is
+		 * 			returned separately, so that it can be kept in the index inside the enclave.
+		 */
+		class ValueSealer
+		{
+		public:
+			typedef std::array<uint8_t, 16> KeyType;
+
+			static constexpr size_t sk_tagSize = 16;
+			static constexpr size_t sk_ivSize = 12;
+			static constexpr size_t sk_headerSize = sizeof(uint32_t) + sk_ivSize;
+
+			/** \brief	Number of values sealed with the key of one epoch, before moving to the next epoch. */
+			static constexpr uint64_t sk_sealPerEpoch = 1ULL << 32;
+
+			static size_t GetSealedSize(size_t dataSize)
+			{
+				return sk_headerSize + dataSize;
+			}
+
+			/**
+			 * \brief	Gets the size of the data sealed in a sealed value.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when the sealed value is smaller than the header.
+			 */
+			static size_t GetUnsealedSize(size_t sealedSize);
+
+		public:
+			/**
+			 * \brief	Constructor
+			 *
+			 * \param	label	The label used to derive epoch keys, so that keys for different purposes are
+			 * 					different.
+			 */
+			ValueSealer(const std::string& label);
+
+			virtual ~ValueSealer();
+
+			/**
+			 * \brief	Seals a value.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when buffer sizes are invalid or sealing fails.
+			 *
+			 * \param 	   	aad		  	The additional authenticated data, e.g. the key of the value.
+			 * \param 	   	aadSize   	Size of the additional authenticated data.
+			 * \param 	   	data	  	The data to seal.
+			 * \param 	   	dataSize  	Size of the data.
+			 * \param [out]	sealed	  	The output buffer; must be GetSealedSize(dataSize) bytes.
+			 * \param 	   	sealedSize	Size of the output buffer.
+			 * \param [out]	tag		  	The output buffer for the tag; must be sk_tagSize bytes.
+			 * \param 	   	tagSize   	Size of the tag buffer.
+			 */
+			void Seal(const void* aad, size_t aadSize, const uint8_t* data, size_t dataSize,
+				uint8_t* sealed, size_t sealedSize, uint8_t* tag, size_t tagSize);
+
+			/**
+			 * \brief	Unseals a value.
+			 *
+			 * \exception	Decent::RuntimeException	Thrown when buffer sizes are invalid, or the value
+			 * 												fails the authentication.
+			 *
+			 * \param 	   	aad		  	The additional authenticated data given when the value is sealed.
+			 * \param 	   	aadSize   	Size of the additional authenticated data.
+			 * \param 	   	sealed	  	The sealed value.
+			 * \param 	   	sealedSize	Size of the sealed value.
+			 * \param 	   	tag		  	The tag.
+			 * \param 	   	tagSize   	Size of the tag.
+			 * \param [out]	data	  	The output buffer; must be GetUnsealedSize(sealedSize) bytes.
+			 * \param 	   	dataSize  	Size of the output buffer.
+			 */
+			void Unseal(const void* aad, size_t aadSize, const uint8_t* sealed, size_t sealedSize,
+				const uint8_t* tag, size_t tagSize, uint8_t* data, size_t dataSize);
+
+		private:
+			struct Context;
+
+			/** \brief	Returns a context to the pool when it goes out of scope. */
+			class ContextHolder
+			{
+			public:
+				ContextHolder(ValueSealer& sealer, uint32_t epoch);
+
+				~ContextHolder();
+
+				Context& Get()
+				{
+					return *m_ctx;
+				}
+
+			private:
+				ValueSealer& m_sealer;
+				std::unique_ptr<Context> m_ctx;
+			};
+
+			/**
+			 * \brief	Gets the root key, which is unique to this run of the enclave. Implemented per
+			 * 			platform.
+			 */
+			static void GetRootKey(KeyType& rootKey);
+
+			/** \brief	Gets the key of the given epoch; derived on the first use of the epoch. */
+			const KeyType& GetEpochKey(uint32_t epoch);
+
+			std::unique_ptr<Context> AcquireContext(uint32_t epoch);
+
+			void ReleaseContext(std::unique_ptr<Context> ctx);
+
+			const std::string m_label;
+			KeyType m_rootKey;
+			std::atomic<uint64_t> m_sealCount;
+
+			std::mutex m_epochKeysMutex;
+			std::vector<std::unique_ptr<KeyType> > m_epochKeys;
+
+			std::mutex m_ctxPoolMutex;
+			std::vector<std::unique_ptr<Context> > m_ctxPool;
+		};
+	}
+}
@@ -1,6 +1,8 @@
 #include <string>
+#include <thread>
 #include <memory>
 #include <iostream>
+#include <algorithm>
 
 #include <tclap/CmdLine.h>
 #include <boost/filesystem.hpp>
@@ -26,6 +28,9 @@
 
 #include "../Common_App/Dht/NonEnclave/DecentDhtApp.h"
 #include "../Common_App/Dht/DhtConnectionPool.h"
+#include "../Common_App/Dht/MemStoreRingServer.h"
+#include "../Common_App/Dht/HeldCntRegistry.h"
+#include "../Common_App/Dht/NonEnclave/EpollServer.h"
 
 using namespace Decent;
 using namespace Decent::Tools;
@@ -69,6 +74,11 @@ extern "C" void* ocall_decent_dht_cnt_mgr_get_store(uint64_t address)
 	}
 }
 
+extern "C" void ocall_decent_dht_release_held_cnt(void* connection, int result)
+{
+	GetHeldCntRegistry().Release(static_cast<ConnectionBase*>(connection), result);
+}
+
 /**
  * \brief	Main entry-point for this application
  *
@@ -97,6 +107,18 @@ int main(int argc, char ** argv)
 	TCLAP::SwitchArg isSendWlArg("n", "not-send-wl", "Do not send whitelist to Decent Server.", true);
 	TCLAP::ValueArg<int> totalNode("t", "total-node", "Total number of nodes in the network.", true, 0, "[0-MAX_INT]");
 	TCLAP::ValueArg<int> nodeIdx("i", "node-idx", "The index of the current adding node.", true, 0, "[0-MAX_INT]");
+	TCLAP::ValueArg<int> exitlessWorkerNum("e", "exitless-workers", "Number of worker threads serving the exitless memory store ring (0 to disable).", false, 0, "[0-MAX_INT]");
+	TCLAP::ValueArg<int> forwardBatchSize("b", "forward-batch", "Maximum number of forwarded queries to the same node sent in one message.", false, 64, "[1-4096]");
+	TCLAP::ValueArg<int> forwardBatchWindow("f", "forward-window", "Time in milliseconds to wait for more forwarded queries to fill a batch (0 to send immediately).", false, 0, "[0-MAX_INT]");
+	TCLAP::ValueArg<int> forwardWorkerNum("q", "forward-workers", "Number of worker threads forwarding queries (0 for the number of hardware threads).", false, 0, "[0-MAX_INT]");
+	TCLAP::ValueArg<int> replyWorkerNum("r", "reply-workers", "Number of worker threads replying forwarded queries (0 for the number of hardware threads).", false, 0, "[0-MAX_INT]");
+	TCLAP::ValueArg<int> taskWorkerNum("k", "task-workers", "Number of worker threads running tasks of the enclave, e.g. stages of data migration and routed data operations (0 to run them on the requesting threads, except routed data operations, which are then refused).", false, 2, "[0-MAX_INT]");
+	TCLAP::ValueArg<int> epollWorkerNum("a", "async-workers", "Number of workers of the epoll front end (Linux only), which replaces the thread-per-connection server (0 to disable).", false, 0, "[0-MAX_INT]");
+	TCLAP::ValueArg<int> epollMaxCntNum("m", "max-connections", "Maximum number of connections accepted by the epoll front end.", false, 65536, "[1-MAX_INT]");
+	TCLAP::SwitchArg isOneHopArg("o", "one-hop", "Keep the full list of nodes, and route lookups to their owners in one hop (for networks of up to a few hundred nodes).", false);
+	TCLAP::ValueArg<int> pagedValueMaxSize("g", "paged-value-max", "Values not larger than this size, in bytes, are packed into pages (0 to disable paging).", false, 128, "[0-MAX_INT]");
+	TCLAP::ValueArg<int> valueCacheBudget("z", "value-cache", "Memory budget, in bytes, of the cache of values for hot keys (0 to disable).", false, 1024 * 1024, "[0-MAX_INT]");
+	TCLAP::SwitchArg isIndexUntrustedArg("u", "untrusted-index", "Keep the index in the untrusted memory store, authenticated by the enclave, so the number of keys is not limited by enclave memory (disables paging).", false);
 	cmd.add(configPathArg);
 	cmd.add(wlKeyArg);
 	cmd.add(selfNodePortNum);
@@ -104,9 +126,46 @@ int main(int argc, char ** argv)
 	cmd.add(isSendWlArg);
 	cmd.add(totalNode);
 	cmd.add(nodeIdx);
+	cmd.add(exitlessWorkerNum);
+	cmd.add(forwardBatchSize);
+	cmd.add(forwardBatchWindow);
+	cmd.add(forwardWorkerNum);
+	cmd.add(replyWorkerNum);
+	cmd.add(taskWorkerNum);
+	cmd.add(epollWorkerNum);
+	cmd.add(epollMaxCntNum);
+	cmd.add(isOneHopArg);
+	cmd.add(pagedValueMaxSize);
+	cmd.add(valueCacheBudget);
+	cmd.add(isIndexUntrustedArg);
 
 	cmd.parse(argc, argv);
 
+	if (forwardBatchSize.getValue() < 1 || forwardBatchSize.getValue() > 4096 || forwardBatchWindow.getValue() < 0)
+	{
+		PRINT_W("Invalid forward batching arguments; the batch size must be within [1, 4096], and the window must not be negative.");
+		return -1;
+	}
+
+	if (pagedValueMaxSize.getValue() < 0 || valueCacheBudget.getValue() < 0)
+	{
+		PRINT_W("Invalid store arguments; the maximum size of paged values and the value cache budget must not be negative.");
+		return -1;
+	}
+
+	if (forwardWorkerNum.getValue() < 0 || replyWorkerNum.getValue() < 0 || taskWorkerNum.getValue() < 0 ||
+		exitlessWorkerNum.getValue() < 0)
+	{
+		PRINT_W("Invalid worker numbers; they must not be negative.");
+		return -1;
+	}
+
+	if (epollMaxCntNum.getValue() < 1)
+	{
+		PRINT_W("Invalid maximum number of connections; it must be positive.");
+		return -1;
+	}
+
 	//------- Read configuration file:
 	std::unique_ptr<ConfigManager> configMgr;
 	try
@@ -146,10 +205,14 @@ int main(int argc, char ** argv)
 	}
 
 	//------- Setup TCP server:
+	const bool isEpollUsed = epollWorkerNum.getValue() > 0;
 	std::unique_ptr<Server> server;
 	try
 	{
-		server = std::make_unique<Net::TCPServer>(selfIp, selfPort);
+		if (!isEpollUsed)
+		{
+			server = std::make_unique<Net::TCPServer>(selfIp, selfPort);
+		}
 	}
 	catch (const std::exception& e)
 	{
@@ -159,15 +222,39 @@ int main(int argc, char ** argv)
 
 	//------- Setup Enclave:
 	std::shared_ptr<DecentDhtApp> enclave;
+	std::unique_ptr<EpollServer> epollServer;
 	try
 	{
+		MemStoreRingServer::SetWorkerNum(static_cast<size_t>(exitlessWorkerNum.getValue()));
+
 		enclave = std::make_shared<DecentDhtApp>();
 
-		smartServer.AddServer(server, enclave, GetTcpConnectionPool(), 1, 1002);
+		if (isEpollUsed)
+		{
+			epollServer = std::make_unique<EpollServer>(enclave, selfIp, selfPort,
+				static_cast<size_t>(epollWorkerNum.getValue()), static_cast<size_t>(epollMaxCntNum.getValue()));
+		}
+		else
+		{
+			smartServer.AddServer(server, enclave, GetTcpConnectionPool(), 1, 1002);
+		}
+
+		enclave->InitTaskWorkers(static_cast<size_t>(taskWorkerNum.getValue()));
+
+		enclave->SetOneHopRouting(isOneHopArg.getValue());
+
+		enclave->SetSessionBudget(static_cast<size_t>(epollMaxCntNum.getValue()));
+
+		enclave->SetStoreConfig(static_cast<size_t>(pagedValueMaxSize.getValue()), static_cast<size_t>(valueCacheBudget.getValue()), isIndexUntrustedArg.getValue());
 
 		enclave->InitDhtNode(selfFullAddr, exNodeFullAddr, totalNode.getValue(), nodeIdx.getValue());
 
-		enclave->InitQueryWorkers(1, 1);
+		enclave->SetForwardBatching(static_cast<size_t>(forwardBatchSize.getValue()), static_cast<uint64_t>(forwardBatchWindow.getValue()));
+
+		const size_t hardwareThreadNum = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+		enclave->InitQueryWorkers(
+			forwardWorkerNum.getValue() > 0 ? static_cast<size_t>(forwardWorkerNum.getValue()) : hardwareThreadNum,
+			replyWorkerNum.getValue() > 0 ? static_cast<size_t>(replyWorkerNum.getValue()) : hardwareThreadNum);
 	}
 	catch (const std::exception& e)
 	{
@@ -179,7 +266,12 @@ int main(int argc, char ** argv)
 	mainThreadWorker->UpdateUntilInterrupt();
 
 	//------- Exit...
+	if (epollServer)
+	{
+		epollServer->Terminate();
+	}
 	enclave.reset();
+	epollServer.reset();
 	smartServer.Terminate();
 
 	PRINT_I("Exit.");
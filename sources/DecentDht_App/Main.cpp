@@ -1,5 +1,9 @@
+#include <cstdint>
+
 #include <string>
 #include <memory>
+#include <chrono>
+#include <thread>
 #include <iostream>
 
 #include <tclap/CmdLine.h>
@@ -26,6 +30,8 @@
 
 #include "../Common_App/Dht/SGX/DecentDhtApp.h"
 #include "../Common_App/Dht/DhtConnectionPool.h"
+#include "../Common_App/Dht/MemStoreRingServer.h"
+#include "../Common_App/Dht/HeldCntRegistry.h"
 
 using namespace Decent;
 using namespace Decent::Tools;
@@ -33,6 +39,21 @@ using namespace Decent::Dht;
 using namespace Decent::Net;
 using namespace Decent::Threading;
 
+/** \brief	Number of TCSs of the enclave, which must match TCSNum in Enclave.config.xml. */
+static constexpr int64_t gsk_enclaveTcsNum = 10;
+
+/** \brief	Number of TCSs left for ECalls that serve requests, once all workers have entered the enclave. */
+static constexpr int64_t gsk_minRequestTcsNum = 3;
+
+/** \brief	Size of the enclave heap, which must match HeapMaxSize in Enclave.config.xml. */
+static constexpr int64_t gsk_enclaveHeapSize = 0x8000000;
+
+/** \brief	Enclave heap reserved for the store, pending tables, and buffers, besides sessions and the value cache. */
+static constexpr int64_t gsk_enclaveHeapReserved = 32 * 1024 * 1024;
+
+/** \brief	Estimated enclave heap taken by a session, which is mostly its TLS context. */
+static constexpr int64_t gsk_sessionHeapSize = 40 * 1024;
+
 static std::shared_ptr<DhtConnectionPool> GetTcpConnectionPool()
 {
 	static std::shared_ptr<DhtConnectionPool> tcpConnectionPool = std::make_shared<DhtConnectionPool>(1000, 1000);
@@ -69,6 +90,28 @@ extern "C" void* ocall_decent_dht_cnt_mgr_get_store(uint64_t address)
 	}
 }
 
+extern "C" void ocall_decent_dht_release_held_cnt(void* connection, int result)
+{
+	GetHeldCntRegistry().Release(static_cast<ConnectionBase*>(connection), result);
+}
+
+extern "C" uint64_t ocall_decent_dht_get_steady_time_ms()
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+extern "C" uint64_t ocall_decent_dht_get_steady_time_us()
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+extern "C" void ocall_decent_dht_sleep_ms(uint64_t ms)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
 /**
  * \brief	Main entry-point for this application
  *
@@ -97,6 +140,17 @@ int main(int argc, char ** argv)
 	TCLAP::SwitchArg isSendWlArg("n", "not-send-wl", "Do not send whitelist to Decent Server.", true);
 	TCLAP::ValueArg<int> totalNode("t", "total-node", "Total number of nodes in the network.", true, 0, "[0-MAX_INT]");
 	TCLAP::ValueArg<int> nodeIdx("i", "node-idx", "The index of the current adding node.", true, 0, "[0-MAX_INT]");
+	TCLAP::ValueArg<int> exitlessWorkerNum("e", "exitless-workers", "Number of worker threads serving the exitless memory store ring (0 to disable).", false, 0, "[0-MAX_INT]");
+	TCLAP::ValueArg<int> forwardBatchSize("b", "forward-batch", "Maximum number of forwarded queries to the same node sent in one message.", false, 64, "[1-4096]");
+	TCLAP::ValueArg<int> forwardBatchWindow("f", "forward-window", "Time in milliseconds to wait for more forwarded queries to fill a batch (0 to send immediately).", false, 0, "[0-MAX_INT]");
+	TCLAP::ValueArg<int> forwardWorkerNum("q", "forward-workers", "Number of worker threads forwarding queries (limited by TCSNum of the enclave).", false, 2, "[1-MAX_INT]");
+	TCLAP::ValueArg<int> replyWorkerNum("r", "reply-workers", "Number of worker threads replying forwarded queries (limited by TCSNum of the enclave).", false, 2, "[1-MAX_INT]");
+	TCLAP::ValueArg<int> taskWorkerNum("k", "task-workers", "Number of worker threads running tasks of the enclave, e.g. stages of data migration and routed data operations (0 to run them on the requesting threads, except routed data operations, which are then refused; limited by TCSNum of the enclave).", false, 2, "[0-MAX_INT]");
+	TCLAP::SwitchArg isOneHopArg("o", "one-hop", "Keep the full list of nodes, and route lookups to their owners in one hop (for networks of up to a few hundred nodes).", false);
+	TCLAP::ValueArg<int> pagedValueMaxSize("g", "paged-value-max", "Values not larger than this size, in bytes, are packed into pages (0 to disable paging).", false, 128, "[0-MAX_INT]");
+	TCLAP::ValueArg<int> valueCacheBudget("z", "value-cache", "Memory budget, in bytes, of the cache of values for hot keys inside the enclave (0 to disable; it takes from the enclave heap).", false, 1024 * 1024, "[0-MAX_INT]");
+	TCLAP::ValueArg<int> maxSessionNum("m", "max-sessions", "Maximum number of sessions the enclave keeps alive, i.e., app sessions and channels opened by peers, each of which takes a TLS context in the enclave heap (0 for as many as the heap allows).", false, 0, "[0-MAX_INT]");
+	TCLAP::SwitchArg isIndexUntrustedArg("u", "untrusted-index", "Keep the index in the untrusted memory store, authenticated by the enclave, so the number of keys is not limited by enclave memory (disables paging).", false);
 	cmd.add(configPathArg);
 	cmd.add(wlKeyArg);
 	cmd.add(selfNodePortNum);
@@ -104,9 +158,52 @@ int main(int argc, char ** argv)
 	cmd.add(isSendWlArg);
 	cmd.add(totalNode);
 	cmd.add(nodeIdx);
+	cmd.add(exitlessWorkerNum);
+	cmd.add(forwardBatchSize);
+	cmd.add(forwardBatchWindow);
+	cmd.add(forwardWorkerNum);
+	cmd.add(replyWorkerNum);
+	cmd.add(taskWorkerNum);
+	cmd.add(isOneHopArg);
+	cmd.add(pagedValueMaxSize);
+	cmd.add(valueCacheBudget);
+	cmd.add(isIndexUntrustedArg);
+	cmd.add(maxSessionNum);
 
 	cmd.parse(argc, argv);
 
+	if (forwardBatchSize.getValue() < 1 || forwardBatchSize.getValue() > 4096 || forwardBatchWindow.getValue() < 0)
+	{
+		PRINT_W("Invalid forward batching arguments; the batch size must be within [1, 4096], and the window must not be negative.");
+		return -1;
+	}
+
+	if (pagedValueMaxSize.getValue() < 0 || valueCacheBudget.getValue() < 0)
+	{
+		PRINT_W("Invalid store arguments; the maximum size of paged values and the value cache budget must not be negative.");
+		return -1;
+	}
+
+	//Sessions share the enclave heap with the value cache.
+	const int64_t heapSessionNum = (gsk_enclaveHeapSize - gsk_enclaveHeapReserved - valueCacheBudget.getValue()) / gsk_sessionHeapSize;
+	if (maxSessionNum.getValue() < 0 || heapSessionNum < 1 || maxSessionNum.getValue() > heapSessionNum)
+	{
+		PRINT_W("Invalid session budget; with the value cache, the enclave heap allows up to %lld sessions.",
+			static_cast<long long>(heapSessionNum > 0 ? heapSessionNum : 0));
+		return -1;
+	}
+	const size_t sessionBudget = static_cast<size_t>(maxSessionNum.getValue() > 0 ? maxSessionNum.getValue() : heapSessionNum);
+
+	//Workers stay in the enclave until exit, so they must leave enough TCSs for ECalls that serve requests.
+	const int64_t workerTcsNum = static_cast<int64_t>(forwardWorkerNum.getValue()) + replyWorkerNum.getValue() + taskWorkerNum.getValue() + 1; //Plus the pending query timer.
+	if (forwardWorkerNum.getValue() < 1 || replyWorkerNum.getValue() < 1 || taskWorkerNum.getValue() < 0 ||
+		exitlessWorkerNum.getValue() < 0 || workerTcsNum + gsk_minRequestTcsNum > gsk_enclaveTcsNum)
+	{
+		PRINT_W("Invalid worker numbers; there must be at least one forward worker and one reply worker, exitless workers must not be negative, and the enclave workers (plus the pending query timer) must leave %lld of the %lld TCSs of the enclave for requests.",
+			static_cast<long long>(gsk_minRequestTcsNum), static_cast<long long>(gsk_enclaveTcsNum));
+		return -1;
+	}
+
 	//------- Read configuration file:
 	std::unique_ptr<ConfigManager> configMgr;
 	try
@@ -197,6 +294,8 @@ int main(int argc, char ** argv)
 	std::shared_ptr<DecentDhtApp> enclave;
 	try
 	{
+		MemStoreRingServer::SetWorkerNum(static_cast<size_t>(exitlessWorkerNum.getValue()));
+
 		serverCon = std::make_unique<TCPConnection>(serverIp, serverPort);
 
 		boost::filesystem::path tokenPath = GetKnownFolderPath(KnownFolderType::LocalAppDataEnclave).append(TOKEN_FILENAME);
@@ -206,9 +305,19 @@ int main(int argc, char ** argv)
 
 		smartServer.AddServer(server, enclave, GetTcpConnectionPool(), 1, 1002);
 
+		enclave->InitTaskWorkers(static_cast<size_t>(taskWorkerNum.getValue()));
+
+		enclave->SetOneHopRouting(isOneHopArg.getValue());
+
+		enclave->SetSessionBudget(sessionBudget);
+
+		enclave->SetStoreConfig(static_cast<size_t>(pagedValueMaxSize.getValue()), static_cast<size_t>(valueCacheBudget.getValue()), isIndexUntrustedArg.getValue());
+
 		enclave->InitDhtNode(selfFullAddr, exNodeFullAddr, totalNode.getValue(), nodeIdx.getValue());
 
-		enclave->InitQueryWorkers(1, 1);
+		enclave->SetForwardBatching(static_cast<size_t>(forwardBatchSize.getValue()), static_cast<uint64_t>(forwardBatchWindow.getValue()));
+
+		enclave->InitQueryWorkers(static_cast<size_t>(forwardWorkerNum.getValue()), static_cast<size_t>(replyWorkerNum.getValue()));
 	}
 	catch (const std::exception& e)
 	{
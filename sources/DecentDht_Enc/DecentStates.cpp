@@ -11,6 +11,7 @@
 #include "../Common_Enc/Dht/EnclaveStore.h"
 #include "../Common_Enc/Dht/DhtSecureConnectionMgr.h"
 #include "../Common_Enc/Dht/DhtStatesSingleton.h"
+#include "../Common/Dht/TaskPool.h"
 
 using namespace Decent;
 using namespace Decent::Ra;
@@ -51,21 +52,28 @@ namespace
 
 	static EnclaveStore& GetDhtStore()
 	{
-		static EnclaveStore inst(0, MbedTlsObj::ConstBigNumber(GetFilledArray()));
+		//Paging, the value cache, and the index are configured by the untrusted side before the node is initialized (see SetStoreConfig).
+		static EnclaveStore inst(0, MbedTlsObj::ConstBigNumber(GetFilledArray()), EnclaveStore::sk_defaultPagedValueMaxSize, EnclaveStore::sk_defaultValueCacheBudget, false);
 
 		return inst;
 	}
 
 	static DhtSecureConnectionMgr& GetConnectionPool()
 	{
-		static DhtSecureConnectionMgr inst(10);
+		static DhtSecureConnectionMgr inst(10, DhtSecureConnectionMgr::sk_defaultChannelsPerPeer);
+		return inst;
+	}
+
+	static TaskPool& GetTaskPool()
+	{
+		static TaskPool inst;
 		return inst;
 	}
 }
 
 DhtStates& Decent::Dht::GetDhtStatesSingleton()
 {
-	static DhtStates state(GetCertContainer(), GetKeyContainer(), GetServerWhiteList(), &GetLoadedWhiteListImpl, GetDhtStore(), GetConnectionPool());
+	static DhtStates state(GetCertContainer(), GetKeyContainer(), GetServerWhiteList(), &GetLoadedWhiteListImpl, GetDhtStore(), GetConnectionPool(), GetTaskPool());
 
 	return state;
 }